@@ -0,0 +1,26 @@
+#ifndef ALLOCATION_COUNTER_H
+#define ALLOCATION_COUNTER_H
+
+#include <stdint.h>
+
+/*
+ * Counts the heap allocations of the whole process, the node's own and
+ * those of roscpp and the bindings. With glibc the executable takes the
+ * place of malloc, calloc and realloc, which operator new uses as well, and
+ * forwards to the C library. Counting is off until start(), so the
+ * allocations of the startup are not reported.
+ */
+class AllocationCounter
+{
+public:
+  //! Count the allocations from now on, false if the C library can't be hooked
+  static bool start();
+
+  //! Returns true if the allocations are counted
+  static bool isRunning();
+
+  //! Allocations since start
+  static uint64_t getCount();
+};
+
+#endif
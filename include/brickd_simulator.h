@@ -0,0 +1,202 @@
+#ifndef BRICKD_SIMULATOR_H
+#define BRICKD_SIMULATOR_H
+
+#include <string>
+#include <vector>
+#include <map>
+#include <queue>
+#include <list>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+#include <atomic>
+#include <random>
+#include <chrono>
+#include <stdint.h>
+
+//! Size of the Tinkerforge packet header
+#define BRICKD_SIM_HEADER_SIZE 8
+//! Maximum size of a Tinkerforge packet
+#define BRICKD_SIM_PACKET_SIZE 80
+//! Number of bricklets a simulated master brick carries
+#define BRICKD_SIM_BRICKLETS_PER_MASTER 4
+
+//! Settings of a simulated brickd
+struct BrickdSimulatorConfig
+{
+  //! TCP port, 0 picks a free port
+  uint16_t port;
+  //! Mean delay of responses and callbacks in sec
+  double latency;
+  //! Standard deviation of the delay in sec
+  double jitter;
+  //! Probability that a response or callback is dropped (0..1)
+  double loss;
+  //! Seed of the random generator, results are reproducible per seed
+  unsigned int seed;
+  //! Number of simulated devices per device identifier
+  std::map<uint16_t, int> devices;
+
+  BrickdSimulatorConfig()
+  {
+    port = 4223;
+    latency = 0.0;
+    jitter = 0.0;
+    loss = 0.0;
+    seed = 1;
+  }
+};
+
+//! Request and packet counters of a simulated brickd
+struct BrickdSimulatorStats
+{
+  uint64_t connections;
+  uint64_t requests;
+  uint64_t responses;
+  uint64_t callbacks;
+  uint64_t dropped;
+  uint64_t errors;
+
+  BrickdSimulatorStats()
+  {
+    connections = 0;
+    requests = 0;
+    responses = 0;
+    callbacks = 0;
+    dropped = 0;
+    errors = 0;
+  }
+};
+
+/*
+ * Local stand-in for brickd. Listens on a TCP port, speaks the
+ * Tinkerforge framing and simulates the devices of include/tinkerforge
+ * with synthetic signals. Answers enumerate requests, getters, setters
+ * and callback period setters, and sends the periodic callbacks. All
+ * packets leaving the simulator are delayed by latency and jitter and
+ * dropped with the configured loss probability.
+ */
+class BrickdSimulator
+{
+public:
+  //! Constructor
+  BrickdSimulator(const BrickdSimulatorConfig &config);
+  //! Destructor, stops the simulator
+  ~BrickdSimulator();
+
+  //! Start listening, returns false if the port can not be bound
+  bool start();
+
+  //! Close all connections and stop listening
+  void stop();
+
+  //! Port the simulator listens on
+  uint16_t getPort() const { return port; }
+
+  //! Number of simulated devices, master bricks included
+  size_t getDeviceCount() const { return devices.size(); }
+
+  //! Base58 UIDs of the simulated devices
+  std::vector<std::string> getUids() const;
+
+  //! Counters since start
+  BrickdSimulatorStats getStats();
+
+  //! Returns true if the device identifier can be simulated
+  static bool isSupported(uint16_t device_identifier);
+
+  //! Device identifier of a name like "imu_v2", 0 if unknown
+  static uint16_t parseDeviceName(const std::string &name);
+
+  //! Encode a UID to base58 as brickd does
+  static std::string encodeUid(uint32_t uid);
+
+private:
+  typedef std::chrono::steady_clock Clock;
+
+  struct Device
+  {
+    uint32_t uid;
+    std::string uid_str;
+    std::string connected_uid;
+    char position;
+    uint16_t identifier;
+    double phase;
+  };
+
+  struct Packet
+  {
+    Clock::time_point due;
+    uint64_t order;
+    uint8_t length;
+    uint8_t data[BRICKD_SIM_PACKET_SIZE];
+
+    bool operator<(const Packet &other) const
+    {
+      // earliest first in a priority queue
+      if (due != other.due)
+        return due > other.due;
+      return order > other.order;
+    }
+  };
+
+  struct CallbackTimer
+  {
+    size_t device;
+    uint8_t callback_id;
+    uint8_t getter_id;
+    uint32_t period;
+    Clock::time_point next;
+  };
+
+  struct Client
+  {
+    int fd;
+    std::thread reader;
+    std::thread writer;
+    std::mutex mutex;
+    std::condition_variable cond;
+    std::priority_queue<Packet> outbox;
+    // (device index << 8 | setter function id) -> timer
+    std::map<uint32_t, CallbackTimer> timers;
+    Clock::time_point last_due;
+    uint64_t order;
+    bool running;
+  };
+
+  //! accept connections until stopped
+  void acceptLoop();
+  //! join and free clients that disconnected
+  void reapClients(bool all);
+  //! read and answer requests of a client
+  void readLoop(Client *client);
+  //! send due packets and callbacks of a client
+  void writeLoop(Client *client);
+  //! answer a single request
+  void handleRequest(Client *client, const uint8_t *request);
+  //! answer an enumerate request
+  void enumerate(Client *client);
+  //! fill the payload of a getter, returns the payload size or -1
+  int fillGetter(const Device &device, uint8_t function_id, uint8_t *payload);
+  //! queue a packet with simulated latency, jitter and loss
+  void queuePacket(Client *client, const uint8_t *data, uint8_t length, bool callback);
+  //! look up a device by its UID
+  int findDevice(uint32_t uid) const;
+
+  BrickdSimulatorConfig config;
+  uint16_t port;
+  int listen_fd;
+  std::atomic<bool> running;
+  std::thread acceptor;
+  std::vector<Device> devices;
+  std::map<uint32_t, size_t> device_index;
+  std::list<Client*> clients;
+  std::mutex clients_mutex;
+  std::mutex random_mutex;
+  std::mt19937 random;
+  std::mutex stats_mutex;
+  BrickdSimulatorStats stats;
+  Clock::time_point start_time;
+};
+
+#endif
@@ -0,0 +1,48 @@
+#ifndef DEVICE_REGISTRY_H
+#define DEVICE_REGISTRY_H
+
+#include <string>
+#include <stdint.h>
+#include "ros/ros.h"
+#include "ip_connection.h"
+#include "sensor_config.h"
+
+class SensorDevice;
+class TinkerforgeSensors;
+
+/*
+ * Everything the node does with a device type, one entry per supported
+ * Tinkerforge device. The entries are built at compile time from the
+ * DeviceTraits specializations in device_registry.cpp, a new bricklet
+ * needs one traits specialization and one line in the table. Every
+ * SensorDevice keeps a pointer to its entry, so the publish loop calls
+ * the entry functions directly instead of switching on the identifier.
+ */
+struct DeviceEntry
+{
+  uint16_t identifier;
+  SensorClass sensor_class;
+  //! short name, e.g. "distance_us"
+  const char *name;
+  //! name for the log, e.g. "Distance US"
+  const char *label;
+  //! allocate and create the binding object, NULL if there is none to create
+  void *(*create)(const char *uid, IPConnection *ipcon);
+  //! release the binding object, NULL if the device does not own one
+  void (*destroy)(SensorDevice *sensor);
+  //! set up the device after the SensorDevice was created, NULL if nothing to do
+  void (*setup)(TinkerforgeSensors *tfs, SensorDevice *sensor);
+  //! create the publisher for the topic, NULL if the device publishes nothing
+  ros::Publisher (*advertise)(ros::NodeHandle &n, const std::string &topic);
+  //! read the device and publish the message, NULL if the device publishes nothing
+  void (*publish)(TinkerforgeSensors *tfs, SensorDevice *sensor);
+  //! read the device into the latest value without publishing, NULL if the device publishes nothing
+  bool (*read)(TinkerforgeSensors *tfs, SensorDevice *sensor);
+  //! identifier of a second sensor on the same binding object, 0 if none
+  uint16_t companion;
+};
+
+//! Entry of a device identifier, NULL if the device is not supported
+const DeviceEntry *findDeviceEntry(uint16_t identifier);
+
+#endif
@@ -0,0 +1,77 @@
+#ifndef LATEST_VALUE_H
+#define LATEST_VALUE_H
+
+#include <mutex>
+#include <condition_variable>
+#include "sensor_shm.h"
+
+/*
+ * Latest decoded sample of a sensor. update() is called by one thread at a
+ * time (the one holding the sensor mutex), get() is lock-free for any
+ * number of readers. beginRead() and endRead() collapse concurrent on-demand
+ * reads of the device into one.
+ */
+class LatestValue
+{
+public:
+  //! Constructor
+  LatestValue()
+  {
+    memset((void*)&slot, 0, sizeof(slot));
+    reading = false;
+    read_count = 0;
+  }
+
+  //! Store a new sample
+  void update(uint64_t stamp, const double *values, uint32_t count)
+  {
+    if (count > SENSOR_SHM_MAX_VALUES)
+      count = SENSOR_SHM_MAX_VALUES;
+    sensorShmWriteSlot(&slot, slot.sample.number + 1, stamp, values, count);
+  }
+
+  //! Copy the latest sample, returns false if there is none yet
+  bool get(SensorShmSample *sample) const
+  {
+    while (!sensorShmReadSlot(&slot, sample))
+      ;
+    return sample->number != 0;
+  }
+
+  /*
+   * Returns true if the caller has to read the device and then call
+   * endRead(). If another caller is already reading, waits for its read
+   * to finish and returns false.
+   */
+  bool beginRead()
+  {
+    std::unique_lock<std::mutex> lock(read_mutex);
+    if (!reading)
+    {
+      reading = true;
+      return true;
+    }
+    uint64_t count = read_count;
+    while (read_count == count)
+      read_done.wait(lock);
+    return false;
+  }
+
+  //! Finish the read started by beginRead() and wake up the waiting callers
+  void endRead()
+  {
+    std::lock_guard<std::mutex> lock(read_mutex);
+    reading = false;
+    read_count++;
+    read_done.notify_all();
+  }
+
+private:
+  SensorShmSlot slot;
+  std::mutex read_mutex;
+  std::condition_variable read_done;
+  bool reading;
+  uint64_t read_count;
+};
+
+#endif
@@ -0,0 +1,52 @@
+#ifndef MADGWICK_FILTER_H
+#define MADGWICK_FILTER_H
+
+/*
+ * Madgwick gradient descent orientation filter (MARG and IMU variants).
+ * The gyro is integrated and corrected towards the orientation that
+ * aligns gravity and, if a magnetic field is given, magnetic north with
+ * the measured vectors. beta is the correction gain in rad/s, higher
+ * converges faster but lets more accelerometer noise through. The
+ * orientation is the sensor frame in an earth frame with x to magnetic
+ * north and z up.
+ */
+class MadgwickFilter
+{
+public:
+  //! Constructor, the filter is off
+  MadgwickFilter();
+
+  //! Set the gain and start from the identity
+  void init(double beta);
+
+  //! Start from the identity, with a high gain for the first samples
+  void reset();
+
+  //! Returns true if init was called
+  bool isEnabled() const { return beta > 0.0; }
+
+  /*
+   * Add a sample, gyro in rad/s, acc and mag in any unit, dt in sec.
+   * A zero magnetic field runs the IMU variant without heading correction.
+   */
+  void update(const double *gyro, const double *acc, const double *mag, double dt);
+
+  //! Current orientation
+  void getQuaternion(double &w, double &x, double &y, double &z) const
+  {
+    w = q[0]; x = q[1]; y = q[2]; z = q[3];
+  }
+
+private:
+  //! gradient of the objective function, normalized, into step
+  void gradientImu(const double *a, double *step) const;
+  void gradientMarg(const double *a, const double *m, double *step) const;
+
+  double beta;
+  //! samples left with the start gain
+  int start_samples;
+  //! w x y z
+  double q[4];
+};
+
+#endif
@@ -0,0 +1,158 @@
+#ifndef PUBLISH_PIPELINE_H
+#define PUBLISH_PIPELINE_H
+
+#include <vector>
+#include <utility>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+#include <atomic>
+#include <stdint.h>
+#include <boost/shared_ptr.hpp>
+#include "ros/ros.h"
+
+/*
+ * Second stage of the publish loop. The loop reads the devices and builds
+ * the messages, the pipeline thread publishes them, so serialization and
+ * slow subscribers no longer delay the next hardware read.
+ *
+ * Every publisher has a ring of its own for up to capacity pending
+ * messages, created with its first message. When a ring is full its oldest
+ * message is dropped, the loop never waits, and a burst on one topic can't
+ * push out the messages of another. The thread takes the rings in turns.
+ *
+ * The slots of a ring hold messages of the publisher's type that are
+ * allocated with the ring, a push copies into the slot. The thread swaps
+ * the slot with the message it published last, so the messages are reused
+ * unless a subscriber in this process still holds one.
+ */
+class PublishPipeline
+{
+public:
+  //! Constructor, not running
+  PublishPipeline();
+
+  //! Destructor, stops the thread
+  ~PublishPipeline();
+
+  //! Run the thread with SCHED_FIFO at priority (0 = default) pinned to cpu (-1 = any), call before start
+  void setScheduling(int priority, int cpu) { sched_priority = priority; sched_cpu = cpu; }
+
+  //! Start the publisher thread with room for capacity pending messages per publisher
+  void start(size_t capacity);
+
+  //! Publish the pending messages and stop the thread
+  void stop();
+
+  //! Returns true if the thread is running
+  bool isRunning() const { return running; }
+
+  //! Messages dropped because the ring of their publisher was full
+  uint64_t getDropped();
+
+  //! Hand a message to the thread, publishes it directly if the thread is not running
+  template <typename M>
+  void publish(const ros::Publisher &pub, const M &msg)
+  {
+    if (!running)
+    {
+      pub.publish(msg);
+      return;
+    }
+
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      Channel *channel = findChannel(pub);
+      if (channel == NULL)
+      {
+        // the first message of the publisher
+        channel = new TypedChannel<M>(pub, capacity);
+        channels.push_back(channel);
+      }
+      // the subscribers in this process get the slot without serialization
+      *static_cast<TypedChannel<M>*>(channel)->ring[append(channel)] = msg;
+    }
+    cond.notify_one();
+  }
+
+private:
+  //! The pending messages of a publisher
+  class Channel
+  {
+  public:
+    explicit Channel(const ros::Publisher &pub) : pub(pub), head(0), count(0) {}
+    virtual ~Channel() {}
+
+    //! take the oldest slot out of the ring, NOTE: assumes the mutex is locked
+    virtual void take() = 0;
+
+    //! publish the message taken last
+    virtual void publishTaken() = 0;
+
+    ros::Publisher pub;
+    //! index of the oldest pending message
+    size_t head;
+    //! pending messages
+    size_t count;
+  };
+
+  //! The pending messages of a publisher of M
+  template <typename M>
+  class TypedChannel : public Channel
+  {
+  public:
+    TypedChannel(const ros::Publisher &pub, size_t capacity) : Channel(pub), ring(capacity), taken(new M())
+    {
+      for (size_t i = 0; i < capacity; i++)
+        ring[i].reset(new M());
+    }
+
+    virtual void take()
+    {
+      // the slot gets the message published last
+      std::swap(taken, ring[head]);
+    }
+
+    virtual void publishTaken()
+    {
+      pub.publish(taken);
+      // a subscriber in this process still holds it, the slot needs another one
+      if (!taken.unique())
+        taken.reset(new M());
+    }
+
+    std::vector<boost::shared_ptr<M> > ring;
+    //! owned by the thread
+    boost::shared_ptr<M> taken;
+  };
+
+  //! channel of pub, NULL if it has none yet. NOTE: assumes the mutex is locked
+  Channel *findChannel(const ros::Publisher &pub);
+
+  //! index of the slot for a new message of channel, drops its oldest if it
+  //! is full. NOTE: assumes the mutex is locked
+  size_t append(Channel *channel);
+
+  //! publisher thread
+  void run();
+
+  //! apply the scheduling to the thread, false if not permitted
+  bool applyScheduling();
+
+  std::atomic<bool> running;
+  bool stopping;
+  size_t capacity;
+  uint64_t dropped;
+  int sched_priority;
+  int sched_cpu;
+  std::vector<Channel*> channels;
+  //! channel the thread looks at first
+  size_t next;
+  //! pending messages of all channels
+  size_t count;
+  std::mutex mutex;
+  std::condition_variable cond;
+  std::thread worker;
+};
+
+#endif
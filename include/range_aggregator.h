@@ -0,0 +1,83 @@
+#ifndef RANGE_AGGREGATOR_H
+#define RANGE_AGGREGATOR_H
+
+#include <string>
+#include <vector>
+#include "ros/ros.h"
+#include <sensor_msgs/Range.h>
+#include <sensor_msgs/PointCloud2.h>
+#include <sensor_msgs/LaserScan.h>
+
+/*
+ * Collects the readings of many range sensors mounted around a base and
+ * packs the readings of one publish cycle into a single point cloud or
+ * laser scan in the base frame. Every member has a pose in the base frame
+ * with its x axis along the beam.
+ *
+ * The point cloud has one x y z float point per valid reading on the beam
+ * axis. The scan covers the full circle, every reading fills the bins its
+ * cone (field of view) covers with the distance of the arc from the base
+ * origin, the nearest reading wins. Bins without a reading are +Inf.
+ */
+class RangeAggregator
+{
+public:
+  //! Constructor, no members
+  RangeAggregator();
+
+  //! Set the base frame and the angular resolution of the scan in rad, removes the members
+  void init(const std::string &frame, double scan_resolution);
+
+  //! Add a member with its pose in the base frame
+  void addMember(const std::string &uid, double x, double y, double z,
+    double roll, double pitch, double yaw);
+
+  //! Number of members
+  size_t size() const { return members.size(); }
+
+  //! Store a reading of a member, returns false if uid is no member
+  bool update(const std::string &uid, const sensor_msgs::Range &range);
+
+  //! Returns true if a reading arrived since the last clear
+  bool hasFresh() const { return fresh_count > 0; }
+
+  //! Point cloud of the fresh readings
+  void fillCloud(sensor_msgs::PointCloud2 &cloud);
+
+  //! Laser scan of the fresh readings
+  void fillScan(sensor_msgs::LaserScan &scan);
+
+  //! Start the next cycle
+  void clearFresh();
+
+private:
+  struct Member
+  {
+    std::string uid;
+    //! position in the base frame
+    double position[3];
+    //! rotation sensor -> base frame, row major
+    double rotation[9];
+    bool fresh;
+    ros::Time stamp;
+    float range;
+    float min_range;
+    float max_range;
+    float field_of_view;
+  };
+
+  //! point at distance r and angle a off the beam axis, in the base frame
+  void beamPoint(const Member &member, double r, double a, double *p) const;
+
+  //! stamp of the newest fresh reading
+  ros::Time newestStamp() const;
+
+  std::string frame;
+  double scan_resolution;
+  uint32_t cloud_seq;
+  uint32_t scan_seq;
+  int fresh_count;
+  std::vector<Member> members;
+};
+
+#endif
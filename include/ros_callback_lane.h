@@ -0,0 +1,74 @@
+#ifndef ROS_CALLBACK_LANE_H
+#define ROS_CALLBACK_LANE_H
+
+#include <atomic>
+#include <mutex>
+#include <stdint.h>
+#include "ros/ros.h"
+#include "ros/callback_queue_interface.h"
+#include "ip_connection.h"
+
+/*
+ * Dispatches the device callbacks of an external ip_connection lane from a
+ * ros::CallbackQueue, so they run on the spinner threads of that queue and
+ * skip the hop through a callback thread of the bindings.
+ *
+ * The receive thread wakes the queue with one queued drain per burst of
+ * packets, the drain dispatches the lane in order. A drain that hits the
+ * batch size queues itself again, so a busy lane does not hold a spinner
+ * thread for longer than one batch.
+ */
+class RosCallbackLane
+{
+public:
+  //! Constructor, not running
+  RosCallbackLane();
+
+  //! Destructor, stops the lane
+  ~RosCallbackLane();
+
+  //! Dispatch lane of ipcon from queue, call before connecting
+  bool start(IPConnection *ipcon, uint8_t lane, ros::CallbackQueueInterface *queue);
+
+  //! Hand the lane back to the bindings and remove the queued drains, the
+  //! callbacks that are left run on lane 0
+  void stop();
+
+  //! Returns true if the lane is dispatched from the queue
+  bool isRunning() const { return queue != NULL; }
+
+  //! Lane of the bindings
+  uint8_t getLane() const { return lane; }
+
+private:
+  //! Queued into the ros::CallbackQueue, drains the lane
+  class Drain : public ros::CallbackInterface
+  {
+  public:
+    explicit Drain(RosCallbackLane *owner) : owner(owner) {}
+    virtual CallResult call();
+
+  private:
+    RosCallbackLane *owner;
+  };
+
+  //! called from the receive thread after a packet was queued
+  static void notify(void *user_data);
+
+  //! dispatch one batch of the lane
+  void drain();
+
+  //! queue a drain unless one is pending
+  void schedule();
+
+  IPConnection *ipcon;
+  uint8_t lane;
+  ros::CallbackQueueInterface *queue;
+  ros::CallbackInterfacePtr callback;
+  //! a drain is queued and did not start yet
+  std::atomic<bool> pending;
+  //! one drain at a time keeps the callbacks in order
+  std::mutex mutex;
+};
+
+#endif
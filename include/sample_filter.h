@@ -0,0 +1,75 @@
+#ifndef SAMPLE_FILTER_H
+#define SAMPLE_FILTER_H
+
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+enum class FilterType {NONE, MEAN, MEDIAN, HAMPEL, IIR};
+
+/*
+ * Smoothing stage for the values of a sensor, applied before a sample is
+ * published. The history is kept as one contiguous ring of window doubles
+ * per channel (structure of arrays), so the per-channel loops over the
+ * window run on plain arrays the compiler can vectorize. All buffers are
+ * allocated by init(), update() does not allocate.
+ *
+ *   MEAN    moving average over the last window samples
+ *   MEDIAN  moving median over the last window samples
+ *   HAMPEL  replaces a sample by the window median if it is more than
+ *           k scaled median absolute deviations away from it
+ *   IIR     first order low pass y += alpha * (x - y)
+ */
+class SampleFilter
+{
+public:
+  //! Constructor, the filter is off
+  SampleFilter();
+
+  //! Set up the filter for samples of channels values
+  void init(FilterType type, unsigned int window, unsigned int channels = 1,
+    double alpha = 0.2, double hampel_k = 3.0);
+
+  //! Forget the history, keep the configuration
+  void reset();
+
+  //! Returns true if init was called with a type other than NONE
+  bool isEnabled() const { return type != FilterType::NONE; }
+
+  //! Filter a sample of channels values in place
+  void update(double *values);
+
+  //! Filter a single value sample
+  double update(double value) { update(&value); return value; }
+
+  //! Number of values replaced by the Hampel filter since the last reset
+  uint64_t getRejected() const { return rejected; }
+
+  FilterType getType() const { return type; }
+
+  //! Parse a filter name from the sensor config (none, mean, median, hampel, iir)
+  static bool parseType(const std::string &name, FilterType &type);
+
+private:
+  //! median of the first count values of data, reorders data
+  static double median(double *data, unsigned int count);
+
+  FilterType type;
+  unsigned int window;
+  unsigned int channels;
+  double alpha;
+  double hampel_k;
+  //! window values per channel, channel after channel
+  std::vector<double> history;
+  //! IIR output per channel
+  std::vector<double> state;
+  //! work space for median and deviations
+  std::vector<double> scratch;
+  //! next write position in the ring
+  unsigned int head;
+  //! valid values in the ring
+  unsigned int count;
+  uint64_t rejected;
+};
+
+#endif
@@ -0,0 +1,110 @@
+#ifndef SENSOR_CONFIG_H
+#define SENSOR_CONFIG_H
+
+#include <string>
+#include <map>
+#include <stdint.h>
+#include "sample_filter.h"
+
+enum class SensorClass {TEMPERATURE, HUMIDITY, LIGHT, IMU, RANGE, GPS, MAGNETIC, MISC};
+enum class ParamType {NONE,INT,DOUBLE,STRING,BOOL};
+
+//! A value of the sensor config as read from the yaml file
+struct SensorParam
+{
+  ParamType type;
+  std::string value_str;
+  int value_int;
+  float value_double;
+
+  SensorParam()
+  {
+    type = ParamType::NONE;
+    value_str = "";
+    value_int = 0;
+    value_double = 0.0;
+  }
+
+  //! value of an int or double param, default_value for other types
+  double getNumber(double default_value) const
+  {
+    if (type == ParamType::INT)
+      return value_int;
+    if (type == ParamType::DOUBLE)
+      return value_double;
+    return default_value;
+  }
+
+  //! value of a bool or int param, default_value for other types
+  bool getBool(bool default_value) const
+  {
+    if (type == ParamType::BOOL || type == ParamType::INT)
+      return value_int != 0;
+    return default_value;
+  }
+};
+
+//! Pose of a sensor in the base frame, in m and rad
+struct PoseConfig
+{
+  double x, y, z;
+  double roll, pitch, yaw;
+};
+
+//! Value filter of scalar sensors
+struct FilterConfig
+{
+  FilterType type;
+  unsigned int window;
+  double alpha;
+  double k;
+};
+
+//! Range sensor limits
+struct RangeConfig
+{
+  float field_of_view;
+  float min_range;
+  float max_range;
+  //! part of the aggregated cloud and scan
+  bool aggregate;
+};
+
+//! Queueing of the device callbacks while they wait for the callback thread
+struct QueueConfig
+{
+  //! one of IPCON_QUEUE_POLICY_*
+  uint8_t policy;
+  //! packets per callback kept by drop_oldest
+  uint16_t depth;
+};
+
+/*
+ * Settings of a sensor, compiled once from its entry in conf.yaml when the
+ * device is enumerated. The publish path reads the typed fields directly,
+ * unset fields hold the defaults of the device type.
+ */
+struct SensorConfig
+{
+  //! empty for the default frame
+  std::string frame_id;
+  //! window of the covariance estimators, -1 for the node default
+  int covariance_window;
+  //! member of the virtual IMU
+  bool fuse;
+  //! publish rate in Hz, 0 for every cycle of the node
+  double rate;
+  PoseConfig pose;
+  FilterConfig filter;
+  RangeConfig range;
+  QueueConfig queue;
+
+  //! Defaults for a device type
+  explicit SensorConfig(uint16_t type = 0);
+
+  //! Compile the params of a sensor, unknown or mistyped params are logged and skipped
+  static SensorConfig compile(const std::map<std::string, SensorParam> &params, uint16_t type,
+    SensorClass sclass, const std::string &uid);
+};
+
+#endif
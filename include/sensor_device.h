@@ -15,25 +15,41 @@
 #include "brick_imu.h"
 #include "brick_imu_v2.h"
 #include "bricklet_temperature.h"
+#include "timestamp_filter.h"
+#include "latest_value.h"
+#include "sample_filter.h"
+#include "window_covariance.h"
+#include "madgwick_filter.h"
+#include "sensor_config.h"
+#include "device_registry.h"
 
 #define IMU_V2_MAGNETIC_DEVICE_IDENTIFIER 400
+//! Covariance estimators per sensor, the IMU needs one per vector
+#define SENSOR_COVARIANCE_COUNT 3
 
-enum class SensorClass {TEMPERATURE, HUMIDITY, LIGHT, IMU, RANGE, GPS, MAGNETIC, MISC};
-enum class ParamType {NONE,INT,DOUBLE,STRING,BOOL};
-
-struct SensorParam
+//! Latest streamed IMU sample with the orientation fused on the host
+struct ImuFusionState
 {
-  ParamType type;
-  std::string value_str;
-  int value_int;
-  float value_double;
+  MadgwickFilter filter;
+  //! nominal sample period in sec
+  double period;
+  //! arrival of the latest sample
+  ros::Time arrival;
+  //! the latest sample was not published yet
+  bool fresh;
+  //! w x y z
+  double orientation[4];
+  int16_t acc[3];
+  int16_t ang[3];
 
-  SensorParam()
+  ImuFusionState()
   {
-    type = ParamType::NONE;
-    value_str = "";
-    value_int = 0;
-    value_double = 0.0;
+    period = 0.0;
+    fresh = false;
+    orientation[0] = 1.0;
+    orientation[1] = orientation[2] = orientation[3] = 0.0;
+    acc[0] = acc[1] = acc[2] = 0;
+    ang[0] = ang[1] = ang[2] = 0;
   }
 };
 
@@ -41,15 +57,17 @@ class SensorDevice
 {
 public:
   //! Constructor
-  SensorDevice(void *dev, std::string uid, std::string topic, uint16_t type, SensorClass sclass, uint8_t rate)
+  SensorDevice(void *dev, std::string uid, std::string topic, uint16_t type, SensorClass sclass)
   {
     this->dev = dev;
     this->uid = uid;
     this->seq = 0;
     this->type = type;
     this->sclass = sclass;
-    this->rate = rate;
     this->frame = "base_link";
+    this->shm_index = -1;
+    this->entry = NULL;
+    this->config = SensorConfig(type);
 
     if (topic.size() == 0)
       buildTopic(this);
@@ -99,37 +117,78 @@ public:
     sensor->topic = topic;
     return topic;
   };
-  //! get a sensor parameter from parameter map
-  SensorParam getParam(std::string param)
-  {
-    std::map<std::string, SensorParam>::iterator it;
-    SensorParam sp;
-
-    it = this->params.find(param);
-    if (it != this->params.end())
-      return it->second;
-    return sp;
-  }
 public:
   void *getDev() { return dev; }
-  std::string getUID() { return uid; }
-  std::string getTopic() { return topic; }
-  std::string getFrame() { return frame; }
+  const std::string& getUID() { return uid; }
+  const std::string& getTopic() { return topic; }
+  const std::string& getFrame() { return frame; }
+  //! settings compiled from conf.yaml
+  const SensorConfig& getConfig() { return config; }
   uint32_t getSeq() { seq++; return seq; }
-  ros::Publisher getPub() { return pub; }
+  //! get the header stamp for a sample that arrived at the given time
+  ros::Time getStamp(const ros::Time &arrival) { return stamp_filter.update(arrival); }
+  TimestampFilter& getStampFilter() { return stamp_filter; }
+  //! value filter of scalar sensors
+  SampleFilter& getFilter() { return filter; }
+  //! covariance estimator, IMU: 0 orientation, 1 angular velocity, 2 linear acceleration
+  WindowCovariance& getCovariance(unsigned int index = 0) { return covariance[index]; }
+  //! host orientation fusion of streamed IMU samples, guarded by the sensor mutex
+  ImuFusionState& getFusion() { return fusion; }
+  const ros::Publisher& getPub() { return pub; }
   uint16_t getType() { return type; }
+  //! registry entry of the device type
+  const DeviceEntry* getEntry() { return entry; }
   SensorClass getSensorClass() { return sclass; }
-  std::map<std::string, SensorParam> params;
+  //! index in the shared memory export, -1 if not exported
+  int getShmIndex() { return shm_index; }
+  //! latest decoded sample
+  LatestValue& getLatest() { return latest; }
+  //! held while the sensor is read and published
+  std::mutex& getMutex() { return mutex; }
 
   void setTopic(std::string topic) { this->topic = topic; }
   void setPub(ros::Publisher pub) { this->pub = pub; }
-  void setParams(std::map<std::string, SensorParam> params)
-  { 
-    this->params = params;
-    // search and set frame_id
-    SensorParam frame_id = getParam("frame_id");
-    if (frame_id.type == ParamType::STRING)
-      this->frame = frame_id.value_str;
+  void setShmIndex(int index) { shm_index = index; }
+  void setEntry(const DeviceEntry *entry) { this->entry = entry; }
+  //! compile the params of conf.yaml into the config
+  void setParams(const std::map<std::string, SensorParam> &params)
+  {
+    config = SensorConfig::compile(params, type, sclass, uid);
+    if (!config.frame_id.empty())
+      this->frame = config.frame_id;
+    filter.init(config.filter.type, config.filter.window, 1, config.filter.alpha, config.filter.k);
+  }
+  //! set up the stamp filter for the node period (0 = off), a slower rate of the config overrides it
+  void initStampFilter(double period, double gain)
+  {
+    if (period > 0.0 && config.rate > 0.0 && 1.0 / config.rate > period)
+      period = 1.0 / config.rate;
+    stamp_filter.init(period, gain);
+  }
+  //! set up the covariance estimators, covariance_window of the config overrides window
+  void initCovariance(int window)
+  {
+    if (config.covariance_window >= 0)
+      window = config.covariance_window;
+    if (window < 2)
+      return;
+
+    switch (sclass)
+    {
+      case SensorClass::IMU:
+        // orientation as roll, pitch and yaw
+        covariance[0].init(window, 3, true);
+        covariance[1].init(window, 3);
+        covariance[2].init(window, 3);
+      break;
+      case SensorClass::MAGNETIC:
+      case SensorClass::GPS:
+        covariance[0].init(window, 3);
+      break;
+      default:
+        covariance[0].init(window, 1);
+      break;
+    }
   }
   static int dev_counter[10];
 
@@ -140,8 +199,16 @@ private:
   std::string frame;
   uint32_t seq;
   uint16_t type;
-  uint8_t rate;
   SensorClass sclass;
+  const DeviceEntry *entry;
   ros::Publisher pub;
+  TimestampFilter stamp_filter;
+  SampleFilter filter;
+  WindowCovariance covariance[SENSOR_COVARIANCE_COUNT];
+  ImuFusionState fusion;
+  SensorConfig config;
+  int shm_index;
+  LatestValue latest;
+  std::mutex mutex;
 };
 #endif
@@ -0,0 +1,128 @@
+#ifndef SENSOR_REGISTRY_H
+#define SENSOR_REGISTRY_H
+
+#include <vector>
+#include <string>
+#include <atomic>
+#include <mutex>
+#include <stddef.h>
+#include <stdint.h>
+#include "device_registry.h"
+
+class SensorDevice;
+
+/*
+ * The sensors of the node in two dense arrays. The slots hold what the
+ * publish cycle touches for every sensor, the entry of the device type
+ * and the publish deadline. The SensorDevice objects with their topic,
+ * uid, config and publisher are only reached for the sensors that are
+ * due. Slot i belongs to the sensor at index i.
+ *
+ * Enumeration adds sensors on the ip_connection thread while the ROS
+ * thread publishes. The arrays are an immutable snapshot, readers pin the
+ * current one with a Reader and never lock. A writer copies the snapshot,
+ * swaps the copy in and frees the old one once every Reader that could
+ * still see it is gone (two phase epoch, like userspace RCU). Sensors are
+ * never removed while the node runs, a SensorDevice outlives every
+ * snapshot that holds it.
+ */
+class SensorRegistry
+{
+public:
+  //! Per cycle data of a sensor
+  struct Slot
+  {
+    const DeviceEntry *entry;
+    SensorDevice *sensor;
+    //! publish period in sec, 0 for every cycle
+    double period;
+    //! next publish time in sec, only written by the publish loop
+    std::atomic<double> deadline;
+
+    Slot() : entry(NULL), sensor(NULL), period(0.0), deadline(0.0) {}
+    Slot(const Slot &other)
+      : entry(other.entry), sensor(other.sensor), period(other.period), deadline(other.deadline.load()) {}
+  };
+
+  typedef std::vector<SensorDevice*>::const_iterator iterator;
+
+  //! Sensors at one point in time
+  struct Snapshot
+  {
+    std::vector<Slot> slots;
+    std::vector<SensorDevice*> devices;
+  };
+
+  //! Pins the current snapshot for its lifetime, does not block writers from adding
+  class Reader
+  {
+  public:
+    explicit Reader(SensorRegistry &registry);
+    ~Reader();
+
+    size_t size() const { return snapshot->devices.size(); }
+    bool empty() const { return snapshot->devices.empty(); }
+    iterator begin() const { return snapshot->devices.begin(); }
+    iterator end() const { return snapshot->devices.end(); }
+    SensorDevice* operator[](size_t index) const { return snapshot->devices[index]; }
+    Slot& slot(size_t index) const { return snapshot->slots[index]; }
+
+  private:
+    Reader(const Reader&);
+    Reader& operator=(const Reader&);
+
+    SensorRegistry &registry;
+    unsigned int phase;
+    Snapshot *snapshot;
+  };
+
+  //! Constructor, no sensors
+  SensorRegistry();
+
+  //! Destructor, frees the snapshot but not the sensors
+  ~SensorRegistry();
+
+  //! Add a sensor after its config is set, the period is taken from the config rate
+  void add(SensorDevice *sensor);
+
+  //! Sensor of a device, NULL if it is not registered
+  SensorDevice* find(const std::string &uid, uint16_t type);
+
+  //! Remove all sensors, the caller deletes them
+  void clear();
+
+  //! Number of sensors right now
+  size_t size();
+
+  //! Returns true if the sensor of the slot is due at now, moves its deadline on
+  static bool isDue(Slot &slot, double now)
+  {
+    if (slot.period <= 0.0)
+      return true;
+    double deadline = slot.deadline.load(std::memory_order_relaxed);
+    if (now < deadline)
+      return false;
+    // skip missed cycles instead of catching up
+    deadline += slot.period;
+    if (deadline <= now)
+      deadline = now + slot.period;
+    slot.deadline.store(deadline, std::memory_order_relaxed);
+    return true;
+  }
+
+private:
+  SensorRegistry(const SensorRegistry&);
+  SensorRegistry& operator=(const SensorRegistry&);
+
+  //! swap in a new snapshot and free the old one after the readers left it
+  void publish(Snapshot *next);
+
+  std::atomic<Snapshot*> current;
+  //! odd or even phase, readers count themselves in the phase they entered
+  std::atomic<unsigned int> epoch;
+  std::atomic<int> readers[2];
+  //! serializes the writers
+  std::mutex write_mutex;
+};
+
+#endif
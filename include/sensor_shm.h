@@ -0,0 +1,253 @@
+#ifndef SENSOR_SHM_H
+#define SENSOR_SHM_H
+
+/*
+ * Layout of the shared memory segment the node exports the decoded samples
+ * to, and a reader for it. This header does not depend on ROS, a consumer
+ * only needs it and -lrt on older glibc.
+ *
+ * The segment starts with a SensorShmHeader, followed by one block of
+ * header.sensor_stride bytes per sensor: a SensorShmSensor and
+ * header.ring_size SensorShmSlots. Every slot is a seqlock, the writer
+ * makes its sequence odd while it writes and even when done, a reader
+ * copies the sample and retries if the sequence was odd or changed.
+ *
+ * Values of a sample by sensor class:
+ *   IMU          orientation x y z w, angular velocity x y z in rad/s,
+ *                linear acceleration x y z in m/s^2
+ *   MAGNETIC     magnetic field x y z in T
+ *   GPS          latitude, longitude in deg, altitude in m
+ *   HUMIDITY     relative humidity
+ *   TEMPERATURE  temperature in degC
+ *   LIGHT        illuminance in lx
+ *   RANGE        range in m
+ */
+
+#include <string>
+#include <cstring>
+#include <stdint.h>
+#include <atomic>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+//! "TFSH" as little endian uint32
+#define SENSOR_SHM_MAGIC 0x48534654
+#define SENSOR_SHM_VERSION 1
+//! Maximum number of values of a sample
+#define SENSOR_SHM_MAX_VALUES 10
+#define SENSOR_SHM_UID_SIZE 8
+#define SENSOR_SHM_TOPIC_SIZE 64
+
+//! A decoded sample
+struct SensorShmSample
+{
+  //! Running number of the sample per sensor, starting at 1
+  uint64_t number;
+  //! Header stamp in nsec since epoch
+  uint64_t stamp;
+  //! Number of valid values
+  uint32_t count;
+  uint32_t reserved;
+  double values[SENSOR_SHM_MAX_VALUES];
+};
+
+//! A sample guarded by a seqlock
+struct SensorShmSlot
+{
+  volatile uint32_t sequence;
+  uint32_t reserved;
+  SensorShmSample sample;
+};
+
+//! Description and latest value of a sensor, followed by its ring
+struct SensorShmSensor
+{
+  char uid[SENSOR_SHM_UID_SIZE];
+  char topic[SENSOR_SHM_TOPIC_SIZE];
+  uint16_t type;
+  uint8_t sensor_class;
+  uint8_t reserved[5];
+  //! Number of the latest sample, 0 if none was written yet
+  volatile uint64_t head;
+  SensorShmSlot latest;
+};
+
+//! Start of the segment
+struct SensorShmHeader
+{
+  uint32_t magic;
+  uint16_t version;
+  uint16_t reserved;
+  uint32_t sensor_count;
+  uint32_t ring_size;
+  uint32_t sensor_stride;
+  //! Changes each time the node creates the segment, readers reopen on a change
+  uint32_t generation;
+};
+
+//! Size of the segment for the given number of sensors and ring size
+inline size_t sensorShmSize(uint32_t sensor_count, uint32_t ring_size)
+{
+  return sizeof(SensorShmHeader) +
+    sensor_count * (sizeof(SensorShmSensor) + ring_size * sizeof(SensorShmSlot));
+}
+
+//! Copy a sample out of a slot, returns false if it was being written
+inline bool sensorShmReadSlot(const SensorShmSlot *slot, SensorShmSample *sample)
+{
+  uint32_t sequence = slot->sequence;
+  if (sequence & 1)
+    return false;
+  std::atomic_thread_fence(std::memory_order_acquire);
+  memcpy(sample, (const void*)&slot->sample, sizeof(SensorShmSample));
+  std::atomic_thread_fence(std::memory_order_acquire);
+  return slot->sequence == sequence;
+}
+
+//! Write a sample to a slot, writers of the same slot must not overlap
+inline void sensorShmWriteSlot(SensorShmSlot *slot, uint64_t number, uint64_t stamp,
+  const double *values, uint32_t count)
+{
+  slot->sequence++;
+  std::atomic_thread_fence(std::memory_order_release);
+
+  slot->sample.number = number;
+  slot->sample.stamp = stamp;
+  slot->sample.count = count;
+  memcpy(slot->sample.values, values, count * sizeof(double));
+
+  std::atomic_thread_fence(std::memory_order_release);
+  slot->sequence++;
+}
+
+/*
+ * Read-only view of an exported segment. Reads do not block the writer
+ * and do not allocate, a read that collides with a write is retried.
+ */
+class SensorShmReader
+{
+public:
+  SensorShmReader() : base(NULL), size(0) {}
+  ~SensorShmReader() { close(); }
+
+  //! Map the segment, name as given to the node (e.g. "/tfsensors")
+  bool open(const std::string &name)
+  {
+    close();
+    int fd = shm_open(name.c_str(), O_RDONLY, 0);
+    if (fd < 0)
+      return false;
+
+    struct stat st;
+    if (fstat(fd, &st) < 0 || (size_t)st.st_size < sizeof(SensorShmHeader))
+    {
+      ::close(fd);
+      return false;
+    }
+
+    void *addr = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (addr == MAP_FAILED)
+      return false;
+
+    base = (const uint8_t*)addr;
+    size = st.st_size;
+    if (header()->magic != SENSOR_SHM_MAGIC || header()->version != SENSOR_SHM_VERSION ||
+        sensorShmSize(header()->sensor_count, header()->ring_size) > size)
+    {
+      close();
+      return false;
+    }
+    return true;
+  }
+
+  //! Unmap the segment
+  void close()
+  {
+    if (base != NULL)
+      munmap((void*)base, size);
+    base = NULL;
+    size = 0;
+  }
+
+  bool isOpen() const { return base != NULL; }
+
+  const SensorShmHeader *header() const { return (const SensorShmHeader*)base; }
+
+  uint32_t getSensorCount() const { return header()->sensor_count; }
+
+  const SensorShmSensor *getSensor(uint32_t index) const
+  {
+    return (const SensorShmSensor*)(base + sizeof(SensorShmHeader) + index * header()->sensor_stride);
+  }
+
+  //! Index of the first sensor with the given UID and type (0 = any), -1 if not found
+  int findSensor(const std::string &uid, uint16_t type = 0) const
+  {
+    for (uint32_t i = 0; i < getSensorCount(); i++)
+    {
+      const SensorShmSensor *sensor = getSensor(i);
+      if (strncmp(sensor->uid, uid.c_str(), SENSOR_SHM_UID_SIZE) == 0 && (type == 0 || sensor->type == type))
+        return i;
+    }
+    return -1;
+  }
+
+  //! Latest sample of a sensor, returns false if there is none yet
+  bool readLatest(uint32_t index, SensorShmSample *sample) const
+  {
+    const SensorShmSensor *sensor = getSensor(index);
+    if (sensor->head == 0)
+      return false;
+    while (!sensorShmReadSlot(&sensor->latest, sample))
+      ;
+    return true;
+  }
+
+  /*
+   * Copy the samples after number next - 1 into samples, at most max_count,
+   * oldest first. Samples that were overwritten in the ring are skipped.
+   * Returns the number of copied samples and advances next past them.
+   */
+  size_t readRing(uint32_t index, uint64_t &next, SensorShmSample *samples, size_t max_count) const
+  {
+    const SensorShmSensor *sensor = getSensor(index);
+    const SensorShmSlot *ring = (const SensorShmSlot*)(sensor + 1);
+    uint32_t ring_size = header()->ring_size;
+    uint64_t head = sensor->head;
+    size_t count = 0;
+
+    std::atomic_thread_fence(std::memory_order_acquire);
+
+    if (next == 0)
+      next = 1;
+    if (head >= ring_size && next <= head - ring_size)
+      next = head - ring_size + 1;
+
+    while (next <= head && count < max_count)
+    {
+      const SensorShmSlot *slot = &ring[(next - 1) % ring_size];
+      if (!sensorShmReadSlot(slot, &samples[count]))
+        continue;
+      if (samples[count].number < next)
+        break; // not published yet
+      if (samples[count].number > next)
+      {
+        // overwritten while reading, restart at the oldest still in the ring
+        next = samples[count].number - ring_size + 1;
+        continue;
+      }
+      next++;
+      count++;
+    }
+    return count;
+  }
+
+private:
+  const uint8_t *base;
+  size_t size;
+};
+
+#endif
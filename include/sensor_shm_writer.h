@@ -0,0 +1,42 @@
+#ifndef SENSOR_SHM_WRITER_H
+#define SENSOR_SHM_WRITER_H
+
+#include <string>
+#include "sensor_shm.h"
+
+/*
+ * Owner of the shared memory segment described in sensor_shm.h. There is
+ * a single writer per segment, write() is wait-free and does not allocate.
+ */
+class SensorShmWriter
+{
+public:
+  //! Constructor
+  SensorShmWriter();
+  //! Destructor, removes the segment
+  ~SensorShmWriter();
+
+  //! Create the segment for sensor_count sensors, replaces an old one of the same name
+  bool create(const std::string &name, uint32_t sensor_count, uint32_t ring_size);
+
+  //! Unmap and remove the segment
+  void destroy();
+
+  //! Set the description of a sensor
+  void setSensor(uint32_t index, const std::string &uid, const std::string &topic,
+    uint16_t type, uint8_t sensor_class);
+
+  //! Publish a sample to the latest slot and the ring of a sensor
+  void write(uint32_t index, uint64_t stamp, const double *values, uint32_t count);
+
+  bool isOpen() const { return base != NULL; }
+
+private:
+  SensorShmSensor *getSensor(uint32_t index);
+
+  std::string name;
+  uint8_t *base;
+  size_t size;
+};
+
+#endif
@@ -0,0 +1,76 @@
+#ifndef TIMESTAMP_FILTER_H
+#define TIMESTAMP_FILTER_H
+
+#include <stdint.h>
+#include "ros/ros.h"
+
+//! Residual statistics of a timestamp filter (all times in sec)
+struct TimestampStats
+{
+  uint64_t samples;
+  uint64_t resyncs;
+  uint64_t slips;
+  double mean;
+  double stddev;
+  double max_abs;
+  double period;
+  double drift_ppm;
+
+  TimestampStats()
+  {
+    samples = 0;
+    resyncs = 0;
+    slips = 0;
+    mean = 0.0;
+    stddev = 0.0;
+    max_abs = 0.0;
+    period = 0.0;
+    drift_ppm = 0.0;
+  }
+};
+
+/*
+ * Software PLL for periodic sample streams. Arrival times carry network
+ * and scheduling jitter, the filter locks onto the nominal period, tracks
+ * the clock drift against it and returns smooth, strictly monotonic
+ * sample times. Missed samples slip the phase by whole periods, large
+ * gaps or time jumps resync the loop.
+ */
+class TimestampFilter
+{
+public:
+  //! Constructor
+  TimestampFilter();
+
+  //! Set the nominal period in sec and the loop gain (0 < gain < 1)
+  void init(double nominal_period, double gain = 0.05);
+
+  //! Forget the loop state, keep period and gain
+  void reset();
+
+  //! Returns true if init was called with a valid period
+  bool isEnabled() const { return nominal_period > 0.0; }
+
+  //! Feed an arrival time, returns the de-jittered sample time
+  ros::Time update(const ros::Time &arrival);
+
+  //! Residual statistics since the last reset
+  const TimestampStats& getStats() const { return stats; }
+
+private:
+  //! resync the loop on arrival
+  void resync(double arrival);
+
+  double nominal_period;
+  double alpha;
+  double beta;
+  bool locked;
+  int late_count;
+  double phase;
+  double period;
+  double last_stamp;
+  double residual_m2;
+  TimestampStats stats;
+};
+
+#endif
@@ -51,9 +51,129 @@ enum {
 	E_NOT_CONNECTED = -8,
 	E_INVALID_PARAMETER = -9, // error response from device
 	E_NOT_SUPPORTED = -10, // error response from device
-	E_UNKNOWN_ERROR_CODE = -11 // error response from device
+	E_UNKNOWN_ERROR_CODE = -11, // error response from device
+	E_NO_FILE = -12,
+	E_ALREADY_CAPTURING = -13,
+	E_INVALID_FILE = -14
 };
 
+/**
+ * \ingroup IPConnection
+ *
+ * Number of latency histogram buckets. Bucket 0 counts latencies below
+ * IPCON_STATS_BUCKET_BASE usec, bucket i below IPCON_STATS_BUCKET_BASE << i
+ * usec and the last bucket counts everything above.
+ */
+#define IPCON_STATS_NUM_BUCKETS 16
+
+/**
+ * \ingroup IPConnection
+ */
+#define IPCON_STATS_BUCKET_BASE 64
+
+/**
+ * \ingroup IPConnection
+ *
+ * Maximum number of function IDs tracked per device, further function IDs
+ * are accounted to one shared slot.
+ */
+#define IPCON_STATS_MAX_FUNCTIONS 16
+
+/**
+ * \ingroup IPConnection
+ *
+ * Number of callback dispatch lanes. Lane 0 is the callback thread that
+ * also dispatches the enumerate, connected and disconnected callbacks.
+ */
+#define IPCON_MAX_CALLBACK_LANES 4
+
+/**
+ * \ingroup IPConnection
+ *
+ * Queue every callback packet of the stream (default).
+ */
+#define IPCON_QUEUE_POLICY_KEEP_ALL 0
+
+/**
+ * \ingroup IPConnection
+ *
+ * Queue at most depth packets of the stream, a new packet drops the oldest.
+ */
+#define IPCON_QUEUE_POLICY_DROP_OLDEST 1
+
+/**
+ * \ingroup IPConnection
+ *
+ * Queue at most one packet of the stream, a new packet replaces the queued
+ * one in its place.
+ */
+#define IPCON_QUEUE_POLICY_CONFLATE 2
+
+/**
+ * \ingroup IPConnection
+ *
+ * Default number of packets the capture ring can hold.
+ */
+#define IPCON_CAPTURE_DEFAULT_RING_SIZE 4096
+
+/**
+ * \ingroup IPConnection
+ *
+ * Capture file format, all values little endian. The file starts with a
+ * header of IPCON_CAPTURE_HEADER_SIZE bytes:
+ *
+ *   char magic[4]             IPCON_CAPTURE_MAGIC
+ *   uint16_t version          IPCON_CAPTURE_VERSION
+ *   uint16_t reserved
+ *   uint64_t start_monotonic  monotonic clock at capture start in usec
+ *   uint64_t start_realtime   wall clock at capture start in usec
+ *
+ * followed by one record per packet:
+ *
+ *   uint64_t timestamp        monotonic clock in usec
+ *   uint8_t direction         IPCON_CAPTURE_DIRECTION_*
+ *   Packet packet             raw packet, header.length bytes
+ */
+#define IPCON_CAPTURE_MAGIC "TFPC"
+
+/**
+ * \ingroup IPConnection
+ */
+#define IPCON_CAPTURE_VERSION 1
+
+/**
+ * \ingroup IPConnection
+ */
+#define IPCON_CAPTURE_HEADER_SIZE 24
+
+/**
+ * \ingroup IPConnection
+ */
+#define IPCON_CAPTURE_DIRECTION_RECEIVE 0
+
+/**
+ * \ingroup IPConnection
+ */
+#define IPCON_CAPTURE_DIRECTION_SEND 1
+
+/**
+ * \ingroup IPConnection
+ *
+ * Request and callback statistics of one function ID of a device. Latencies
+ * are request round trips for getters and setters and receive-to-dispatch
+ * times for callbacks, all in usec.
+ */
+typedef struct {
+	uint8_t function_id;
+	uint32_t requests;
+	uint32_t timeouts;
+	uint32_t errors;
+	uint32_t callbacks;
+	uint64_t latency_sum;
+	uint32_t latency_max;
+	uint32_t latency_buckets[IPCON_STATS_NUM_BUCKETS];
+} FunctionStats;
+
 #ifdef IPCON_EXPOSE_INTERNALS
 
 typedef struct _Socket Socket;
@@ -116,15 +236,40 @@ typedef struct {
 
 typedef struct _QueueItem {
 	struct _QueueItem *next;
+	struct _QueueItem *prev;
 	int kind;
 	void *data;
+	uint64_t timestamp; // in usec, 0 if not recorded
+	// stream of a callback packet with a queue policy, NULL otherwise
+	struct _DevicePrivate *device; // holds a reference while queued
+	struct _DeviceQueueStream *stream;
+	struct _QueueItem *stream_next;
 } QueueItem;
 
+/**
+ * \internal
+ *
+ * Preallocated blocks for the queue items and callback packets, so the
+ * receive and callback threads don't call malloc. Without reserved blocks
+ * or when all are in use a block is allocated by malloc and counted as a
+ * miss.
+ */
+typedef struct {
+	Mutex mutex;
+	struct _PoolBlock *free_blocks; // protected by mutex
+	void *storage; // all reserved blocks in one allocation
+	uint32_t size; // number of reserved blocks
+	uint32_t available; // protected by mutex
+	uint32_t misses; // protected by mutex
+} PacketPool;
+
 typedef struct {
 	Mutex mutex;
 	Semaphore semaphore;
 	QueueItem *head;
 	QueueItem *tail;
+	int length; // protected by mutex
+	PacketPool *pool; // items and packets of the queue, NULL for malloc
 } Queue;
 
 #if defined _MSC_VER || defined __BORLANDC__
@@ -172,9 +317,14 @@ typedef struct _DevicePrivate DevicePrivate;
 #ifdef IPCON_EXPOSE_INTERNALS
 
 typedef struct _CallbackContext CallbackContext;
+typedef struct _DeviceStats DeviceStats;
+typedef struct _Capture Capture;
+typedef struct _Replay Replay;
 
 #endif
 
+typedef void (*CallbackLaneNotifyFunction)(void *user_data);
+
 typedef void (*EnumerateCallbackFunction)(const char *uid,
                                           const char *connected_uid,
                                           char position,
@@ -192,6 +342,24 @@ typedef void (*DisconnectedCallbackFunction)(uint8_t disconnect_reason,
 
 typedef void (*CallbackWrapperFunction)(DevicePrivate *device_p, Packet *packet);
 
+/**
+ * \internal
+ *
+ * Callback wrapper of a device type, every binding has one static table.
+ */
+typedef struct {
+	uint8_t function_id;
+	CallbackWrapperFunction wrapper;
+} DeviceCallbackWrapper;
+
+/**
+ * \internal
+ */
+typedef struct {
+	void *function;
+	void *user_data;
+} DeviceCallback;
+
 #endif
 
 /**
@@ -205,6 +373,31 @@ struct _Device {
 
 #define DEVICE_NUM_FUNCTION_IDS 256
 
+/**
+ * \internal
+ *
+ * Callback streams per device with their own queue policy.
+ */
+#define DEVICE_NUM_QUEUE_STREAMS 8
+
+/**
+ * \internal
+ *
+ * Queue policy and queued packets of one callback function ID of a device.
+ * Protected by the queue_mutex of the device.
+ */
+typedef struct _DeviceQueueStream {
+	bool used;
+	bool inherited; // created from the default, follows its changes
+	uint8_t function_id; // 0 for the default of all function IDs
+	uint8_t policy;
+	uint16_t depth;
+	int queued;
+	QueueItem *head; // oldest queued packet
+	QueueItem *tail;
+	uint32_t dropped;
+} DeviceQueueStream;
+
 /**
  * \internal
  */
@@ -224,11 +417,20 @@ struct _DevicePrivate {
 	Mutex response_mutex;
 	Packet response_packet; // protected by response_mutex
 	Event response_event;
-	int response_expected[DEVICE_NUM_FUNCTION_IDS];
+	uint8_t response_expected[DEVICE_NUM_FUNCTION_IDS];
+
+	// static wrapper table of the device type, registered_callbacks[i]
+	// belongs to callback_wrappers[i]
+	const DeviceCallbackWrapper *callback_wrappers;
+	DeviceCallback *registered_callbacks;
+	int callback_count;
+
+	DeviceStats *stats; // allocated on first use if stats are enabled
+
+	uint8_t callback_lane; // callbacks are dispatched by this lane
 
-	void *registered_callbacks[DEVICE_NUM_FUNCTION_IDS];
-	void *registered_callback_user_data[DEVICE_NUM_FUNCTION_IDS];
-	CallbackWrapperFunction callback_wrappers[DEVICE_NUM_FUNCTION_IDS];
+	Mutex queue_mutex;
+	DeviceQueueStream queue_streams[DEVICE_NUM_QUEUE_STREAMS]; // protected by queue_mutex
 };
 
 /**
@@ -277,6 +479,25 @@ int device_set_response_expected_all(DevicePrivate *device_p, bool response_expe
 void device_register_callback(DevicePrivate *device_p, uint8_t id, void *callback,
                               void *user_data);
 
+/**
+ * \internal
+ */
+void device_set_callback_wrappers(DevicePrivate *device_p,
+                                  const DeviceCallbackWrapper *wrappers,
+                                  int count);
+
+/**
+ * \internal
+ */
+CallbackWrapperFunction device_get_callback_wrapper(DevicePrivate *device_p,
+                                                    uint8_t id);
+
+/**
+ * \internal
+ */
+void *device_get_registered_callback(DevicePrivate *device_p, uint8_t id,
+                                     void **ret_user_data);
+
 /**
  * \internal
  */
@@ -360,6 +581,25 @@ struct _IPConnection {
  */
 typedef Device BrickDaemon;
 
+/**
+ * \internal
+ *
+ * Thread of a callback lane, applied when the callback threads are created.
+ */
+typedef struct {
+	bool enabled; // lane 0 is always enabled
+	int sched_priority; // SCHED_FIFO priority, 0 for the default scheduling
+	int cpu; // -1 for any CPU
+	bool scheduled; // sched_priority and cpu are in effect
+
+	// dispatched by ipcon_dispatch_callback_lane instead of a lane thread,
+	// the queue outlives the connections
+	bool external; // protected by lane_mutex
+	CallbackLaneNotifyFunction notify; // protected by lane_mutex
+	void *notify_user_data; // protected by lane_mutex
+	Queue *external_queue;
+} CallbackLaneConfig;
+
 /**
  * \internal
  */
@@ -404,6 +644,24 @@ struct _IPConnectionPrivate {
 
 	Semaphore wait;
 
+	bool stats_enabled;
+
+	CallbackLaneConfig callback_lanes[IPCON_MAX_CALLBACK_LANES]; // protected by socket_mutex
+
+	// the receive thread routes callback packets into the external lanes
+	// under it, it can't use the socket_mutex for that
+	Mutex lane_mutex;
+
+	int receive_sched_priority; // SCHED_FIFO priority, 0 for the default scheduling
+	int receive_cpu; // -1 for any CPU
+	bool receive_scheduled; // protected by socket_mutex
+
+	PacketPool packet_pool;
+
+	Capture *capture;
+
+	Replay *replay; // protected by socket_mutex
+
 	BrickDaemon brickd;
 };
 
@@ -552,6 +810,229 @@ void ipcon_unwait(IPConnection *ipcon);
 void ipcon_register_callback(IPConnection *ipcon, uint8_t id,
                              void *callback, void *user_data);
 
+/**
+ * \ingroup IPConnection
+ *
+ * Enables or disables request and callback statistics. If enabled, each
+ * device counts requests, timeouts, errors and callbacks per function ID
+ * and records their latencies in a histogram. The counters are updated
+ * lock-free and can be read with device_get_stats.
+ *
+ * Default value is *false*.
+ */
+void ipcon_set_stats_enabled(IPConnection *ipcon, bool stats_enabled);
+
+/**
+ * \ingroup IPConnection
+ *
+ * Returns the number of packets and events waiting in the callback queue,
+ * the queues of the lanes included.
+ */
+int ipcon_get_callback_queue_length(IPConnection *ipcon);
+
+/**
+ * \ingroup IPConnection
+ *
+ * Enables a callback dispatch lane with its own queue and thread. The
+ * callbacks of a device are dispatched in order by the lane that is set
+ * with device_set_callback_lane, so a burst of callbacks of one device
+ * does not delay the callbacks of the devices in other lanes.
+ *
+ * A sched_priority above 0 runs the lane thread with SCHED_FIFO at that
+ * priority, a cpu of 0 or above pins it to that CPU. This applies to lane
+ * 0 as well. The settings take effect when the callback threads are
+ * created by the next ipcon_connect or ipcon_replay.
+ *
+ * Returns E_INVALID_PARAMETER if lane is not below IPCON_MAX_CALLBACK_LANES.
+ */
+int ipcon_set_callback_lane(IPConnection *ipcon, uint8_t lane,
+                            int sched_priority, int cpu);
+
+/**
+ * \ingroup IPConnection
+ *
+ * Returns true if the lane thread runs with the scheduling and CPU set by
+ * ipcon_set_callback_lane. Setting SCHED_FIFO needs the privilege for it,
+ * without it the lane still runs with the default scheduling.
+ */
+bool ipcon_is_callback_lane_scheduled(IPConnection *ipcon, uint8_t lane);
+
+/**
+ * \ingroup IPConnection
+ *
+ * Makes a callback lane above 0 external: it gets no thread of its own,
+ * the callbacks of its devices are dispatched by the caller of
+ * ipcon_dispatch_callback_lane instead, e.g. from the threads of an event
+ * loop. The notify function is called from the receive thread after each
+ * callback packet of the lane was queued. It must not block, it only has
+ * to wake up the thread that dispatches the lane.
+ *
+ * Call it before ipcon_connect or ipcon_replay. A NULL notify function
+ * makes the lane a regular lane again, it can be set while connected: the
+ * notify function is not called anymore once it returns and the callbacks
+ * that were not dispatched yet are handed to lane 0, or dropped without a
+ * connection.
+ *
+ * Returns E_INVALID_PARAMETER for lane 0 or a lane that is not below
+ * IPCON_MAX_CALLBACK_LANES.
+ */
+int ipcon_set_callback_lane_external(IPConnection *ipcon, uint8_t lane,
+                                     CallbackLaneNotifyFunction notify,
+                                     void *user_data);
+
+/**
+ * \ingroup IPConnection
+ *
+ * Dispatches up to max_count queued callbacks of an external lane in the
+ * calling thread without waiting for more, see
+ * ipcon_set_callback_lane_external. The callbacks of a lane have to be
+ * dispatched by one thread at a time to keep them in order.
+ *
+ * Returns the number of dispatched callbacks.
+ */
+int ipcon_dispatch_callback_lane(IPConnection *ipcon, uint8_t lane, int max_count);
+
+/**
+ * \ingroup IPConnection
+ *
+ * Runs the receive thread with SCHED_FIFO at sched_priority if it is above
+ * 0 and pins it to cpu if it is 0 or above. The settings take effect when
+ * the receive thread is created by the next ipcon_connect or ipcon_replay,
+ * see ipcon_is_receive_scheduled.
+ */
+void ipcon_set_receive_scheduling(IPConnection *ipcon, int sched_priority, int cpu);
+
+/**
+ * \ingroup IPConnection
+ *
+ * Returns true if the receive thread runs with the scheduling and CPU set
+ * by ipcon_set_receive_scheduling.
+ */
+bool ipcon_is_receive_scheduled(IPConnection *ipcon);
+
+/**
+ * \ingroup IPConnection
+ *
+ * Preallocates the storage for count queued callback packets, so the
+ * receive and callback threads don't allocate memory while the pool lasts.
+ * Call it once before ipcon_connect or ipcon_replay, the storage is freed
+ * by ipcon_destroy.
+ *
+ * Returns E_INVALID_PARAMETER if the pool was already reserved or the
+ * storage could not be allocated.
+ */
+int ipcon_reserve_packet_pool(IPConnection *ipcon, uint32_t count);
+
+/**
+ * \ingroup IPConnection
+ *
+ * Returns the number of free blocks of the packet pool and the number of
+ * blocks that had to be allocated by malloc since the pool was reserved.
+ * A queued callback packet takes two blocks.
+ */
+void ipcon_get_packet_pool_stats(IPConnection *ipcon, uint32_t *ret_available,
+                                 uint32_t *ret_misses);
+
+/**
+ * \ingroup IPConnection
+ *
+ * Copies the statistics of up to \c max_count function IDs of the given
+ * device to \c ret_stats and returns the number of copied entries.
+ */
+int device_get_stats(Device *device, FunctionStats *ret_stats, int max_count);
+
+/**
+ * \ingroup IPConnection
+ *
+ * Sets how callback packets of the given function ID of the device are
+ * queued while they wait for the callback thread, see
+ * IPCON_QUEUE_POLICY_KEEP_ALL, IPCON_QUEUE_POLICY_DROP_OLDEST and
+ * IPCON_QUEUE_POLICY_CONFLATE. Function ID 0 sets the default for every
+ * function ID without its own policy, each function ID is still queued as
+ * a stream of its own. Depth is only used by IPCON_QUEUE_POLICY_DROP_OLDEST.
+ *
+ * Returns E_INVALID_PARAMETER for an unknown policy or if the device has
+ * no free stream left.
+ */
+int device_set_queue_policy(Device *device, uint8_t function_id, uint8_t policy,
+                            uint16_t depth);
+
+/**
+ * \ingroup IPConnection
+ *
+ * Returns the number of queued callback packets of the streams with a queue
+ * policy and the number of packets they dropped or replaced so far.
+ */
+void device_get_queue_stats(Device *device, uint32_t *ret_queued,
+                            uint32_t *ret_dropped);
+
+/**
+ * \ingroup IPConnection
+ *
+ * Sets the callback lane that dispatches the callbacks of the device, see
+ * ipcon_set_callback_lane. A lane that is not enabled falls back to lane 0.
+ * Set it before the callbacks are enabled, callbacks that are already
+ * queued in the old lane may otherwise be dispatched out of order.
+ */
+void device_set_callback_lane(Device *device, uint8_t lane);
+
+/**
+ * \ingroup IPConnection
+ *
+ * Starts capturing all packets sent and received by the IP Connection to
+ * \c filename. The packets are timestamped into a lock-free ring of
+ * \c ring_size slots (rounded up to a power of two, 0 selects
+ * IPCON_CAPTURE_DEFAULT_RING_SIZE) and written to the file by a low
+ * priority thread. If the ring is full, packets are dropped instead of
+ * blocking. As long as capture was never started it costs a pointer check
+ * per packet.
+ *
+ * Must not be called concurrently with ipcon_stop_capture.
+ */
+int ipcon_start_capture(IPConnection *ipcon, const char *filename, uint32_t ring_size);
+
+/**
+ * \ingroup IPConnection
+ *
+ * Stops capturing, flushes the ring and closes the capture file.
+ */
+void ipcon_stop_capture(IPConnection *ipcon);
+
+/**
+ * \ingroup IPConnection
+ *
+ * Returns the number of captured and dropped packets since the capture was
+ * started.
+ */
+void ipcon_get_capture_stats(IPConnection *ipcon, uint64_t *ret_captured,
+                             uint64_t *ret_dropped);
+
+/**
+ * \ingroup IPConnection
+ *
+ * Replays a file written by ipcon_start_capture in place of a connection to
+ * a Brick Daemon. The recorded callbacks are fed to the devices at
+ * \c speed times the recorded pace, 0 replays as fast as possible.
+ *
+ * Requests of the devices are not sent anywhere. The replay waits at each
+ * recorded request until the same request was made again, and answers
+ * getters with the next recorded response to them, so a client that behaves
+ * as the recorded one gets the same packets in the same order regardless of
+ * the speed. A recorded request that is not made again within 500 msec is
+ * skipped, getters without any recorded response fail with E_NOT_SUPPORTED.
+ *
+ * The connected callback is triggered as for ipcon_connect, the replay is
+ * stopped by ipcon_disconnect.
+ */
+int ipcon_replay(IPConnection *ipcon, const char *filename, double speed);
+
+/**
+ * \ingroup IPConnection
+ *
+ * Returns *true* if a replay reached the end of its file.
+ */
+bool ipcon_is_replay_done(IPConnection *ipcon);
+
 #ifdef IPCON_EXPOSE_INTERNALS
 
 /**
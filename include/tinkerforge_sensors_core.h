@@ -2,11 +2,27 @@
 #define TINKERFORGE_SENSORS_CORE_H
 
 // ROS includes
-#include <list>
+#include <vector>
 #include <map>
 #include "ros/ros.h"
 #include "ros/time.h"
 #include "sensor_device.h"
+#include "sensor_registry.h"
+#include "sensor_shm_writer.h"
+#include "virtual_imu.h"
+#include "range_aggregator.h"
+#include "publish_pipeline.h"
+#include "ros_callback_lane.h"
+#include <sensor_msgs/NavSatFix.h>
+#include <sensor_msgs/Imu.h>
+#include <sensor_msgs/MagneticField.h>
+#include <sensor_msgs/Temperature.h>
+#include <sensor_msgs/Illuminance.h>
+#include <sensor_msgs/Range.h>
+#include <sensor_msgs/RelativeHumidity.h>
+#include <tinkerforge_sensors/DeviceStats.h>
+#include <tinkerforge_sensors/GetReadings.h>
+#include <tinkerforge_sensors/ImuArray.h>
 #include "ip_connection.h"
 #include "brick_imu.h"
 #include "brick_imu_v2.h"
@@ -59,15 +75,149 @@ public:
   //! Publish the Range message
   void publishRangeMessage(SensorDevice *sensor);
 
+  //! Read the device into the message fields, no header, filter or estimator, false if the read failed
+  bool readImuMessage(SensorDevice *sensor, sensor_msgs::Imu &imu_msg);
+  bool readNavSatFixMessage(SensorDevice *sensor, sensor_msgs::NavSatFix &gps_msg);
+  bool readMagneticFieldMessage(SensorDevice *sensor, sensor_msgs::MagneticField &mf_msg);
+  bool readHumidityMessage(SensorDevice *sensor, sensor_msgs::RelativeHumidity &hu_msg);
+  bool readTemperatureMessage(SensorDevice *sensor, sensor_msgs::Temperature &temp_msg);
+  bool readIlluminanceMessage(SensorDevice *sensor, sensor_msgs::Illuminance &illum_msg);
+  bool readRangeMessage(SensorDevice *sensor, sensor_msgs::Range &range_msg);
+
+  //! Values of a message in the layout of the latest value and the shared memory export, returns the count
+  static uint32_t sampleValues(const sensor_msgs::Imu &msg, double *values);
+  static uint32_t sampleValues(const sensor_msgs::NavSatFix &msg, double *values);
+  static uint32_t sampleValues(const sensor_msgs::MagneticField &msg, double *values);
+  static uint32_t sampleValues(const sensor_msgs::RelativeHumidity &msg, double *values);
+  static uint32_t sampleValues(const sensor_msgs::Temperature &msg, double *values);
+  static uint32_t sampleValues(const sensor_msgs::Illuminance &msg, double *values);
+  static uint32_t sampleValues(const sensor_msgs::Range &msg, double *values);
+
+  //! Set up a new IMU v1, called from its registry entry
+  void setupImu(SensorDevice *sensor);
+
+  //! Enable the callback lanes before connecting
+  void setupCallbackLanes();
+
+  //! Warn about the receive thread and lanes that run without their scheduling
+  void checkCallbackLanes();
+
+  //! Publish the message of a single sensor
+  void publishSensor(SensorDevice *sensor);
+
+  //! Read a sensor into its latest value without publishing, false if the read failed
+  bool readSensor(SensorDevice *sensor);
+
   //! Publish Sensors Messages
   void publishSensors();
 
+  //! Create the publishers of all sensors
+  void advertiseSensors(ros::NodeHandle &n);
+
+  //! Enable timestamp de-jittering for the given nominal sample period
+  void setStampFilter(double period, double gain);
+
+  //! Log the residual statistics of the timestamp filters
+  void logStampStats();
+
+  //! Enable request and callback statistics, call before init
+  void setStatsEnabled(bool enabled) { stats_enabled = enabled; }
+
+  //! Dispatch the callbacks of the device types in lanes with their own thread, call before init
+  void setCallbackLanes(const std::map<std::string, int> &lanes, const std::vector<int> &priority,
+    const std::vector<int> &cpu)
+  {
+    callback_lanes = lanes;
+    lane_priority = priority;
+    lane_cpu = cpu;
+  }
+
+  //! Dispatch the callbacks of lane from queue on its spinner threads, call before init
+  void setRosCallbackLane(int lane, ros::CallbackQueueInterface *queue)
+  {
+    ros_lane = lane;
+    ros_lane_queue = queue;
+  }
+
+  //! Capture the raw packets to a file, call before init
+  void setCaptureFile(const std::string &file) { capture_file = file; }
+
+  //! Replay a capture file instead of connecting to brickd, call before init
+  void setReplay(const std::string &file, double speed) { replay_file = file; replay_speed = speed; }
+
+  //! Returns true if the replay reached the end of the capture file
+  bool isReplayDone() { return !replay_file.empty() && ipcon_is_replay_done(&ipcon); }
+
+  //! Estimate the variance fields over the last window samples (0 = off), call before init
+  void setCovarianceWindow(int window) { covariance_window = window; }
+
+  //! Stream raw IMU v1 data every period ms and fuse the orientation on the host (0 = off), call before init
+  void setImuFusion(int period, double beta) { imu_fusion_period = period; imu_fusion_beta = beta; }
+
+  //! Fuse the IMUs with fuse: true in the config into one IMU on topic, call before advertiseSensors
+  void setVirtualImu(const std::string &topic, const std::string &frame, double max_skew)
+  {
+    virtual_imu_topic = topic;
+    virtual_imu.init(frame, max_skew);
+  }
+
+  //! Pack the range readings of a cycle into one cloud and/or scan in frame, call before advertiseSensors
+  void setRangeAggregate(const std::string &cloud_topic, const std::string &scan_topic,
+    const std::string &frame, double scan_resolution)
+  {
+    range_cloud_topic = cloud_topic;
+    range_scan_topic = scan_topic;
+    range_aggregator.init(frame, scan_resolution);
+  }
+
+  //! Publish the messages from a second thread with up to size pending messages (0 = from the loop)
+  void setPublishQueue(int size) { if (size > 0) publish_pipeline.start(size); }
+
+  //! Run the publish thread with SCHED_FIFO at priority (0 = default) pinned to cpu (-1 = any), call before setPublishQueue
+  void setPublishScheduling(int priority, int cpu) { publish_pipeline.setScheduling(priority, cpu); }
+
+  //! Run the receive thread with SCHED_FIFO at priority (0 = default) pinned to cpu (-1 = any), call before init
+  void setReceiveScheduling(int priority, int cpu) { receive_priority = priority; receive_cpu = cpu; }
+
+  //! Preallocate room for size queued callback packets (0 = allocate on demand), call before init
+  void setPacketPool(int size) { packet_pool_size = size; }
+
+  //! Warn about packet pool misses and heap allocations since the last warning
+  void checkAllocations();
+
+  //! Also publish the IMU samples in batches of size on <topic>_batch, call before advertiseSensors
+  void setImuBatchSize(int size) { imu_batch_size = size; }
+
+  //! Mirror the samples of the current sensors to a shared memory segment
+  bool startShmExport(const std::string &name, uint32_t ring_size);
+
+  //! Advertise the get_readings service, ttl is the default maximum age of a cached reading
+  void advertiseServices(ros::NodeHandle &n, double ttl);
+
+  //! Service callback, returns the cached or freshly read samples of the requested sensors
+  bool getReadings(tinkerforge_sensors::GetReadings::Request &req,
+    tinkerforge_sensors::GetReadings::Response &res);
+
+  //! Set the publishers for diagnostics and the compact stats topic
+  void setStatsPub(ros::Publisher diag_pub, ros::Publisher stats_pub);
+
+  //! Publish diagnostics and statistics of all devices
+  void publishStats();
+
   //! Store for sensor params
   std::map<std::string, std::map<std::string, SensorParam>> conf;
   //! Sensor list
-  std::list<SensorDevice*> sensors;
+  SensorRegistry sensors;
 
 private:
+  //! Pending IMU samples of a sensor
+  struct ImuBatch
+  {
+    ros::Publisher pub;
+    tinkerforge_sensors::ImuArray msg;
+    uint32_t seq;
+  };
+
   //! Callback function for Tinkerforge ip connected .
   static void callbackConnected(uint8_t connect_reason, void *user_data);
 
@@ -77,6 +227,33 @@ private:
     uint8_t firmware_version[3], uint16_t device_identifier,
     uint8_t enumeration_type, void *user_data);
 
+  //! Callback function for the streamed IMU v1 data, fuses the orientation
+  static void callbackImuAllData(int16_t acc_x, int16_t acc_y, int16_t acc_z,
+    int16_t mag_x, int16_t mag_y, int16_t mag_z,
+    int16_t ang_x, int16_t ang_y, int16_t ang_z,
+    int16_t temperature, void *user_data);
+
+  //! Fill a reading from the latest value, read the device if it is older than max_age
+  void getReading(SensorDevice *sensor, double max_age, tinkerforge_sensors::Reading &reading);
+
+  //! Add an IMU sample to the batch of the sensor, publish the batch when full
+  void batchImuMessage(SensorDevice *sensor, const sensor_msgs::Imu &imu_msg);
+
+  //! Add a sample to a covariance estimator of the sensor, fill cov once there is an estimate
+  void estimateCovariance(SensorDevice *sensor, unsigned int index, const double *values, double *cov);
+
+  //! Add an IMU sample to the virtual IMU, publish the fused sample when ready
+  void fuseImuMessage(SensorDevice *sensor, const sensor_msgs::Imu &imu_msg);
+
+  //! Create the publisher of a sensor and add it to the batches and aggregates
+  void advertiseSensor(SensorDevice *sensor);
+
+  //! Publish the range readings of the last cycle as cloud and scan
+  void publishRangeAggregate();
+
+  //! Hand a decoded sample to the exports
+  void exportSample(SensorDevice *sensor, const ros::Time &stamp, const double *values, uint32_t count);
+
   //! Calculate deg from rad
   float rad2deg(float x)
   {
@@ -99,6 +276,89 @@ private:
   int imu_convergence_speed;
   //! Time to correct the imu orientation
   ros::Time imu_init_time;
+  //! All data period of the IMU v1 in ms for host fusion, 0 if off
+  int imu_fusion_period;
+  //! Gain of the host orientation filter
+  double imu_fusion_beta;
+  //! Nominal sample period for the timestamp filters (0 = off)
+  double stamp_period;
+  //! Loop gain of the timestamp filters
+  double stamp_gain;
+  //! Collect request and callback statistics
+  bool stats_enabled;
+  //! Callback lane per device name of the registry, lane 0 if not listed
+  std::map<std::string, int> callback_lanes;
+  //! SCHED_FIFO priority and CPU per lane, 0 and -1 for the defaults
+  std::vector<int> lane_priority;
+  std::vector<int> lane_cpu;
+  //! SCHED_FIFO priority and CPU of the receive thread, 0 and -1 for the defaults
+  int receive_priority;
+  int receive_cpu;
+  //! Preallocated callback packets, 0 if off
+  int packet_pool_size;
+  //! Packets allocated by malloc at the last check
+  uint32_t packet_pool_misses;
+  //! Heap allocations at the last warning and its time
+  uint64_t allocations_last;
+  ros::Time allocations_time;
+  //! Lane dispatched from ros_lane_queue, 0 if off
+  int ros_lane;
+  ros::CallbackQueueInterface *ros_lane_queue;
+  RosCallbackLane ros_callback_lane;
+  //! Node handle of the sensor publishers, NULL until advertiseSensors, later sensors are advertised by the publish loop
+  boost::shared_ptr<ros::NodeHandle> advertise_node;
+  //! Publisher for diagnostic_msgs/DiagnosticArray
+  ros::Publisher diag_pub;
+  //! Publisher for the compact stats topic
+  ros::Publisher stats_pub;
+  //! Time of the last stats message
+  ros::Time stats_time;
+  //! Messages dropped by the publish pipeline at the last stats message
+  uint64_t publish_dropped_last;
+  //! Last stats per device uid, for rate calculation
+  std::map<std::string, tinkerforge_sensors::DeviceStats> stats_last;
+  //! Packet capture file, empty if off
+  std::string capture_file;
+  //! Packet capture is running
+  bool capture_started;
+  //! Capture file to replay, empty for a live connection
+  std::string replay_file;
+  //! Replay speed, 1 for real-time and 0 for max speed
+  double replay_speed;
+  //! Shared memory export of the samples
+  SensorShmWriter shm_writer;
+  //! Default window of the covariance estimators, 0 if off
+  int covariance_window;
+  //! Number of IMU samples per batch message, 0 if off
+  int imu_batch_size;
+  //! IMU batches per sensor
+  std::map<SensorDevice*, ImuBatch> imu_batches;
+  //! Topic of the virtual IMU, empty if off
+  std::string virtual_imu_topic;
+  //! Virtual IMU of the fused members
+  VirtualImu virtual_imu;
+  //! Publisher of the virtual IMU
+  ros::Publisher virtual_imu_pub;
+  //! Guards virtual_imu, its members are published under different sensor mutexes
+  std::mutex virtual_imu_mutex;
+  //! Topics of the aggregated range readings, empty if off
+  std::string range_cloud_topic;
+  std::string range_scan_topic;
+  //! Range readings of the current cycle
+  RangeAggregator range_aggregator;
+  ros::Publisher range_cloud_pub;
+  ros::Publisher range_scan_pub;
+  //! Reused messages, keep their buffers between cycles
+  sensor_msgs::PointCloud2 range_cloud_msg;
+  sensor_msgs::LaserScan range_scan_msg;
+  //! Guards range_aggregator and the messages
+  std::mutex range_mutex;
+  //! Publishes the messages of the loop from its own thread
+  PublishPipeline publish_pipeline;
+  //! Service for the latest readings
+  ros::ServiceServer readings_srv;
+  //! Default maximum age of a cached reading in sec
+  double readings_ttl;
 };
 
 #endif
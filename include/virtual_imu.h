@@ -0,0 +1,68 @@
+#ifndef VIRTUAL_IMU_H
+#define VIRTUAL_IMU_H
+
+#include <string>
+#include <vector>
+#include "ros/ros.h"
+#include <sensor_msgs/Imu.h>
+
+/*
+ * Combines the samples of several IMUs mounted on one rigid body into a
+ * single virtual IMU. Every member has a mount rotation from its sensor
+ * frame into the common frame. A fused sample is made as soon as every
+ * member has a sample and all of them lie within max_skew of each other;
+ * samples that can no longer be matched are dropped.
+ *
+ * Angular velocity and linear acceleration are rotated into the common
+ * frame and averaged, the orientations are brought to the common frame
+ * and averaged as quaternions. Covariances are rotated the same way and
+ * combined as the covariance of the mean of independent samples. A member
+ * without covariance (all zero) makes the fused covariance unknown.
+ * Lever arm effects on the acceleration are ignored.
+ */
+class VirtualImu
+{
+public:
+  //! Constructor, no members
+  VirtualImu();
+
+  //! Set frame of the fused samples and the allowed time skew in sec, removes the members
+  void init(const std::string &frame, double max_skew);
+
+  //! Add a member, roll pitch yaw rotate its sensor frame into the common frame
+  void addMember(const std::string &uid, double roll, double pitch, double yaw);
+
+  //! Returns true if uid is a member
+  bool isMember(const std::string &uid) const { return findMember(uid) >= 0; }
+
+  //! Number of members
+  size_t size() const { return members.size(); }
+
+  //! Add a sample of a member, returns true and fills fused if a fused sample is ready
+  bool add(const std::string &uid, const sensor_msgs::Imu &msg, sensor_msgs::Imu &fused);
+
+private:
+  struct Member
+  {
+    std::string uid;
+    //! rotation sensor -> common frame, row major
+    double rotation[9];
+    //! w x y z of the rotation
+    double mount[4];
+    bool valid;
+    sensor_msgs::Imu sample;
+  };
+
+  //! index of a member, -1 if not found
+  int findMember(const std::string &uid) const;
+
+  //! fuse the samples of all members
+  void fuse(sensor_msgs::Imu &fused);
+
+  std::string frame;
+  double max_skew;
+  uint32_t seq;
+  std::vector<Member> members;
+};
+
+#endif
@@ -0,0 +1,70 @@
+#ifndef WINDOW_COVARIANCE_H
+#define WINDOW_COVARIANCE_H
+
+#include <vector>
+#include <stdint.h>
+
+//! Maximum number of channels of a covariance estimator
+#define WINDOW_COVARIANCE_MAX_DIM 3
+
+/*
+ * Sample covariance of the last window samples of up to three channels.
+ * Welford's update is applied for the new sample and reversed for the one
+ * that leaves the window, so an update costs O(dim^2) independent of the
+ * window size. The running sums are recomputed from the window from time
+ * to time to drop the rounding error the removals accumulate. Angular
+ * channels are unwrapped against the previous sample, so a heading that
+ * crosses +-pi does not blow up the variance.
+ */
+class WindowCovariance
+{
+public:
+  //! Constructor, the estimator is off
+  WindowCovariance();
+
+  //! Set window size and number of channels, angular marks channels in rad
+  void init(unsigned int window, unsigned int dim, bool angular = false);
+
+  //! Forget the samples, keep the configuration
+  void reset();
+
+  //! Returns true if init was called with a window of at least 2
+  bool isEnabled() const { return window >= 2; }
+
+  //! Returns true if there are enough samples for an estimate
+  bool isReady() const { return count >= 2; }
+
+  //! Add a sample of dim values
+  void add(const double *values);
+
+  //! Add a single value sample
+  void add(double value) { add(&value); }
+
+  //! Variance of a channel
+  double getVariance(unsigned int channel = 0) const;
+
+  //! Covariance matrix, dim x dim row major
+  void getCovariance(double *cov) const;
+
+  unsigned int getDim() const { return dim; }
+
+private:
+  //! recompute mean and m2 from the window
+  void recompute();
+
+  unsigned int window;
+  unsigned int dim;
+  bool angular;
+  //! window values per channel, channel after channel
+  std::vector<double> history;
+  unsigned int head;
+  unsigned int count;
+  //! samples until the next recompute
+  unsigned int recompute_countdown;
+  double last[WINDOW_COVARIANCE_MAX_DIM];
+  double mean[WINDOW_COVARIANCE_MAX_DIM];
+  //! sum of the products of the deviations, row major
+  double m2[WINDOW_COVARIANCE_MAX_DIM * WINDOW_COVARIANCE_MAX_DIM];
+};
+
+#endif
@@ -0,0 +1,85 @@
+#include <stddef.h>
+#include <atomic>
+#include "allocation_counter.h"
+
+//! constant initialized, malloc can be called before any constructor ran
+static std::atomic<bool> counting(false);
+static std::atomic<uint64_t> allocations(0);
+
+#ifdef __GLIBC__
+
+extern "C" void *__libc_malloc(size_t size);
+extern "C" void *__libc_calloc(size_t count, size_t size);
+extern "C" void *__libc_realloc(void *ptr, size_t size);
+
+/*----------------------------------------------------------------------
+ * countAllocation()
+ * Count one allocation if the counter runs
+ *--------------------------------------------------------------------*/
+
+static inline void countAllocation()
+{
+  if (counting.load(std::memory_order_relaxed))
+    allocations.fetch_add(1, std::memory_order_relaxed);
+}
+
+/*----------------------------------------------------------------------
+ * malloc(), calloc(), realloc()
+ * Take the place of the C library functions for the whole process
+ *--------------------------------------------------------------------*/
+
+extern "C" void *malloc(size_t size)
+{
+  countAllocation();
+  return __libc_malloc(size);
+}
+
+extern "C" void *calloc(size_t count, size_t size)
+{
+  countAllocation();
+  return __libc_calloc(count, size);
+}
+
+extern "C" void *realloc(void *ptr, size_t size)
+{
+  countAllocation();
+  return __libc_realloc(ptr, size);
+}
+
+#endif
+
+/*----------------------------------------------------------------------
+ * start()
+ * Count the allocations from now on
+ *--------------------------------------------------------------------*/
+
+bool AllocationCounter::start()
+{
+#ifdef __GLIBC__
+  allocations = 0;
+  counting = true;
+  return true;
+#else
+  return false;
+#endif
+}
+
+/*----------------------------------------------------------------------
+ * isRunning()
+ * Returns true if the allocations are counted
+ *--------------------------------------------------------------------*/
+
+bool AllocationCounter::isRunning()
+{
+  return counting;
+}
+
+/*----------------------------------------------------------------------
+ * getCount()
+ * Allocations since start
+ *--------------------------------------------------------------------*/
+
+uint64_t AllocationCounter::getCount()
+{
+  return allocations.load(std::memory_order_relaxed);
+}
@@ -0,0 +1,1072 @@
+#include <cmath>
+#include <cstring>
+#include <algorithm>
+#include <errno.h>
+#include <unistd.h>
+#include <poll.h>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include "brickd_simulator.h"
+
+// function and callback IDs shared by all devices
+#define BRICKD_SIM_FUNCTION_DISCONNECT_PROBE 128
+#define BRICKD_SIM_FUNCTION_ENUMERATE 254
+#define BRICKD_SIM_CALLBACK_ENUMERATE 253
+#define BRICKD_SIM_FUNCTION_GET_IDENTITY 255
+
+// error codes of the response header
+#define BRICKD_SIM_ERROR_INVALID_PARAMETER 1
+#define BRICKD_SIM_ERROR_FUNCTION_NOT_SUPPORTED 2
+
+// device identifiers as in include/tinkerforge
+#define BRICKD_SIM_MASTER 13
+#define BRICKD_SIM_IMU 16
+#define BRICKD_SIM_IMU_V2 18
+#define BRICKD_SIM_AMBIENT_LIGHT 21
+#define BRICKD_SIM_DISTANCE_IR 25
+#define BRICKD_SIM_HUMIDITY 27
+#define BRICKD_SIM_TEMPERATURE 216
+#define BRICKD_SIM_TEMPERATURE_IR 217
+#define BRICKD_SIM_GPS 222
+#define BRICKD_SIM_INDUSTRIAL_DIGITAL_IN_4 223
+#define BRICKD_SIM_DISTANCE_US 229
+#define BRICKD_SIM_DUAL_BUTTON 230
+#define BRICKD_SIM_MOTION_DETECTOR 233
+#define BRICKD_SIM_AMBIENT_LIGHT_V2 259
+
+// first UID handed out to a simulated device
+#define BRICKD_SIM_FIRST_UID 100000
+
+static const char BASE58_ALPHABET[] =
+  "123456789abcdefghijkmnopqrstuvwxyzABCDEFGHJKLMNPQRSTUVWXYZ";
+
+struct DeviceName
+{
+  const char *name;
+  uint16_t identifier;
+};
+
+static const DeviceName DEVICE_NAMES[] = {
+  {"imu", BRICKD_SIM_IMU},
+  {"imu_v2", BRICKD_SIM_IMU_V2},
+  {"gps", BRICKD_SIM_GPS},
+  {"humidity", BRICKD_SIM_HUMIDITY},
+  {"temperature", BRICKD_SIM_TEMPERATURE},
+  {"temperature_ir", BRICKD_SIM_TEMPERATURE_IR},
+  {"ambient_light", BRICKD_SIM_AMBIENT_LIGHT},
+  {"ambient_light_v2", BRICKD_SIM_AMBIENT_LIGHT_V2},
+  {"distance_ir", BRICKD_SIM_DISTANCE_IR},
+  {"distance_us", BRICKD_SIM_DISTANCE_US},
+  {"dual_button", BRICKD_SIM_DUAL_BUTTON},
+  {"motion_detector", BRICKD_SIM_MOTION_DETECTOR},
+  {"industrial_digital_in_4", BRICKD_SIM_INDUSTRIAL_DIGITAL_IN_4},
+  {"master", BRICKD_SIM_MASTER},
+  {NULL, 0}
+};
+
+// callback period setter -> callback ID and getter of its payload,
+// the matching period getter is always setter + 1
+struct PeriodCallback
+{
+  uint16_t identifier;
+  uint8_t setter_id;
+  uint8_t callback_id;
+  uint8_t getter_id;
+};
+
+static const PeriodCallback PERIOD_CALLBACKS[] = {
+  {BRICKD_SIM_IMU, 19, 31, 1},
+  {BRICKD_SIM_IMU, 21, 32, 2},
+  {BRICKD_SIM_IMU, 23, 33, 3},
+  {BRICKD_SIM_IMU, 25, 34, 4},
+  {BRICKD_SIM_IMU, 27, 35, 5},
+  {BRICKD_SIM_IMU, 29, 36, 6},
+  {BRICKD_SIM_IMU_V2, 14, 32, 1},
+  {BRICKD_SIM_IMU_V2, 16, 33, 2},
+  {BRICKD_SIM_IMU_V2, 18, 34, 3},
+  {BRICKD_SIM_IMU_V2, 20, 35, 4},
+  {BRICKD_SIM_IMU_V2, 22, 38, 5},
+  {BRICKD_SIM_IMU_V2, 24, 36, 6},
+  {BRICKD_SIM_IMU_V2, 26, 37, 7},
+  {BRICKD_SIM_IMU_V2, 28, 39, 8},
+  {BRICKD_SIM_IMU_V2, 30, 40, 9},
+  {BRICKD_SIM_GPS, 7, 17, 1},
+  {BRICKD_SIM_GPS, 9, 18, 2},
+  {BRICKD_SIM_GPS, 11, 19, 3},
+  {BRICKD_SIM_GPS, 13, 20, 4},
+  {BRICKD_SIM_GPS, 15, 21, 5},
+  {BRICKD_SIM_HUMIDITY, 3, 13, 1},
+  {BRICKD_SIM_HUMIDITY, 5, 14, 2},
+  {BRICKD_SIM_TEMPERATURE, 2, 8, 1},
+  {BRICKD_SIM_TEMPERATURE_IR, 5, 15, 1},
+  {BRICKD_SIM_TEMPERATURE_IR, 7, 16, 2},
+  {BRICKD_SIM_AMBIENT_LIGHT, 3, 13, 1},
+  {BRICKD_SIM_AMBIENT_LIGHT, 5, 14, 2},
+  {BRICKD_SIM_AMBIENT_LIGHT_V2, 2, 10, 1},
+  {BRICKD_SIM_DISTANCE_IR, 5, 15, 1},
+  {BRICKD_SIM_DISTANCE_IR, 7, 16, 2},
+  {BRICKD_SIM_DISTANCE_US, 2, 8, 1},
+  {0, 0, 0, 0}
+};
+
+// getters per device (get_*, is_*, are_*). everything else is a setter
+// and acknowledged, getters without simulated data answer with an error
+struct DeviceGetters
+{
+  uint16_t identifier;
+  uint8_t ids[48];
+};
+
+static const DeviceGetters DEVICE_GETTERS[] = {
+  {BRICKD_SIM_IMU, {1, 2, 3, 4, 5, 6, 7, 10, 12, 14, 16, 18, 20, 22, 24, 26, 28, 30, 39, 241, 242, 255}},
+  {BRICKD_SIM_IMU_V2, {1, 2, 3, 4, 5, 6, 7, 8, 9, 12, 15, 17, 19, 21, 23, 25, 27, 29, 31, 240, 241, 242, 255}},
+  {BRICKD_SIM_GPS, {1, 2, 3, 4, 5, 8, 10, 12, 14, 16, 255}},
+  {BRICKD_SIM_HUMIDITY, {1, 2, 4, 6, 8, 10, 12, 255}},
+  {BRICKD_SIM_TEMPERATURE, {1, 3, 5, 7, 11, 255}},
+  {BRICKD_SIM_TEMPERATURE_IR, {1, 2, 4, 6, 8, 10, 12, 14, 255}},
+  {BRICKD_SIM_AMBIENT_LIGHT, {1, 2, 4, 6, 8, 10, 12, 255}},
+  {BRICKD_SIM_AMBIENT_LIGHT_V2, {1, 3, 5, 7, 9, 255}},
+  {BRICKD_SIM_DISTANCE_IR, {1, 2, 4, 6, 8, 10, 12, 14, 255}},
+  {BRICKD_SIM_DISTANCE_US, {1, 3, 5, 7, 11, 255}},
+  {BRICKD_SIM_DUAL_BUTTON, {2, 3, 255}},
+  {BRICKD_SIM_MOTION_DETECTOR, {1, 255}},
+  {BRICKD_SIM_INDUSTRIAL_DIGITAL_IN_4, {1, 3, 4, 6, 8, 10, 12, 255}},
+  {BRICKD_SIM_MASTER, {1, 2, 4, 5, 7, 9, 11, 12, 13, 15, 17, 18, 20, 22, 23, 25, 26, 28, 30,
+                       31, 34, 36, 37, 39, 40, 42, 44, 46, 48, 50, 52, 54, 56, 58, 65, 67,
+                       68, 72, 74, 76, 240, 241, 242, 255}},
+  {0, {0}}
+};
+
+/*----------------------------------------------------------------------
+ * little endian helpers
+ *--------------------------------------------------------------------*/
+
+static void putUint16(uint8_t *p, uint16_t value)
+{
+  p[0] = value & 0xff;
+  p[1] = (value >> 8) & 0xff;
+}
+
+static void putUint32(uint8_t *p, uint32_t value)
+{
+  putUint16(p, value & 0xffff);
+  putUint16(p + 2, (value >> 16) & 0xffff);
+}
+
+static void putInt16(uint8_t *p, double value)
+{
+  putUint16(p, (uint16_t)(int16_t)std::floor(value + 0.5));
+}
+
+static void putInt32(uint8_t *p, double value)
+{
+  putUint32(p, (uint32_t)(int32_t)std::floor(value + 0.5));
+}
+
+static void putFloat(uint8_t *p, float value)
+{
+  uint32_t bits;
+  memcpy(&bits, &value, sizeof(bits));
+  putUint32(p, bits);
+}
+
+static uint32_t getUint32(const uint8_t *p)
+{
+  return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static const PeriodCallback* findPeriodCallback(uint16_t identifier, uint8_t function_id)
+{
+  for (const PeriodCallback *p = PERIOD_CALLBACKS; p->identifier != 0; p++)
+  {
+    if (p->identifier == identifier && (p->setter_id == function_id || p->setter_id + 1 == function_id))
+      return p;
+  }
+  return NULL;
+}
+
+static bool isGetter(uint16_t identifier, uint8_t function_id)
+{
+  for (const DeviceGetters *g = DEVICE_GETTERS; g->identifier != 0; g++)
+  {
+    if (g->identifier != identifier)
+      continue;
+    for (size_t i = 0; i < sizeof(g->ids) && g->ids[i] != 0; i++)
+    {
+      if (g->ids[i] == function_id)
+        return true;
+    }
+    return false;
+  }
+  return false;
+}
+
+static bool isBrick(uint16_t identifier)
+{
+  return identifier == BRICKD_SIM_MASTER || identifier == BRICKD_SIM_IMU || identifier == BRICKD_SIM_IMU_V2;
+}
+
+/*----------------------------------------------------------------------
+ * BrickdSimulator()
+ * Constructor, creates the simulated devices
+ *--------------------------------------------------------------------*/
+
+BrickdSimulator::BrickdSimulator(const BrickdSimulatorConfig &config)
+  : config(config), random(config.seed)
+{
+  this->port = config.port;
+  this->listen_fd = -1;
+  this->running = false;
+
+  uint32_t next_uid = BRICKD_SIM_FIRST_UID;
+  int bricklets = 0;
+  std::string master_uid = "0";
+
+  for (std::map<uint16_t, int>::const_iterator it = config.devices.begin(); it != config.devices.end(); it++)
+  {
+    if (!isSupported(it->first))
+      continue;
+
+    for (int i = 0; i < it->second; i++)
+    {
+      Device device;
+      device.uid = next_uid++;
+      device.uid_str = encodeUid(device.uid);
+      device.identifier = it->first;
+      device.phase = 0.37 * devices.size();
+
+      if (isBrick(it->first))
+      {
+        device.connected_uid = "0";
+        device.position = '0';
+      }
+      else
+      {
+        // bricklets sit on master bricks, four ports each
+        if (bricklets % BRICKD_SIM_BRICKLETS_PER_MASTER == 0)
+        {
+          Device master;
+          master.uid = next_uid++;
+          master.uid_str = encodeUid(master.uid);
+          master.identifier = BRICKD_SIM_MASTER;
+          master.connected_uid = "0";
+          master.position = '0';
+          master.phase = 0.0;
+          device_index[master.uid] = devices.size();
+          devices.push_back(master);
+          master_uid = master.uid_str;
+        }
+        device.connected_uid = master_uid;
+        device.position = 'a' + bricklets % BRICKD_SIM_BRICKLETS_PER_MASTER;
+        bricklets++;
+      }
+
+      device_index[device.uid] = devices.size();
+      devices.push_back(device);
+    }
+  }
+}
+
+/*----------------------------------------------------------------------
+ * ~BrickdSimulator()
+ * Destructor
+ *--------------------------------------------------------------------*/
+
+BrickdSimulator::~BrickdSimulator()
+{
+  stop();
+}
+
+/*----------------------------------------------------------------------
+ * start()
+ * Bind the port and start accepting connections
+ *--------------------------------------------------------------------*/
+
+bool BrickdSimulator::start()
+{
+  if (running)
+    return true;
+
+  listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+  if (listen_fd < 0)
+    return false;
+
+  int flag = 1;
+  setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &flag, sizeof(flag));
+
+  struct sockaddr_in address;
+  memset(&address, 0, sizeof(address));
+  address.sin_family = AF_INET;
+  address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  address.sin_port = htons(config.port);
+
+  if (bind(listen_fd, (struct sockaddr *)&address, sizeof(address)) < 0 || listen(listen_fd, 16) < 0)
+  {
+    close(listen_fd);
+    listen_fd = -1;
+    return false;
+  }
+
+  socklen_t length = sizeof(address);
+  if (getsockname(listen_fd, (struct sockaddr *)&address, &length) == 0)
+    port = ntohs(address.sin_port);
+
+  start_time = Clock::now();
+  running = true;
+  acceptor = std::thread(&BrickdSimulator::acceptLoop, this);
+  return true;
+}
+
+/*----------------------------------------------------------------------
+ * stop()
+ * Close all connections and stop listening
+ *--------------------------------------------------------------------*/
+
+void BrickdSimulator::stop()
+{
+  if (!running)
+    return;
+
+  running = false;
+  if (acceptor.joinable())
+    acceptor.join();
+
+  reapClients(true);
+
+  close(listen_fd);
+  listen_fd = -1;
+}
+
+/*----------------------------------------------------------------------
+ * getUids()
+ * Base58 UIDs of the simulated devices
+ *--------------------------------------------------------------------*/
+
+std::vector<std::string> BrickdSimulator::getUids() const
+{
+  std::vector<std::string> uids;
+  for (size_t i = 0; i < devices.size(); i++)
+    uids.push_back(devices[i].uid_str);
+  return uids;
+}
+
+/*----------------------------------------------------------------------
+ * getStats()
+ * Counters since start
+ *--------------------------------------------------------------------*/
+
+BrickdSimulatorStats BrickdSimulator::getStats()
+{
+  std::lock_guard<std::mutex> lock(stats_mutex);
+  return stats;
+}
+
+/*----------------------------------------------------------------------
+ * isSupported()
+ * Returns true if the device identifier can be simulated
+ *--------------------------------------------------------------------*/
+
+bool BrickdSimulator::isSupported(uint16_t device_identifier)
+{
+  for (const DeviceName *d = DEVICE_NAMES; d->name != NULL; d++)
+  {
+    if (d->identifier == device_identifier)
+      return true;
+  }
+  return false;
+}
+
+/*----------------------------------------------------------------------
+ * parseDeviceName()
+ * Device identifier of a device name or number
+ *--------------------------------------------------------------------*/
+
+uint16_t BrickdSimulator::parseDeviceName(const std::string &name)
+{
+  for (const DeviceName *d = DEVICE_NAMES; d->name != NULL; d++)
+  {
+    if (name == d->name)
+      return d->identifier;
+  }
+
+  uint16_t identifier = (uint16_t)atoi(name.c_str());
+  return isSupported(identifier) ? identifier : 0;
+}
+
+/*----------------------------------------------------------------------
+ * encodeUid()
+ * Encode a UID to base58
+ *--------------------------------------------------------------------*/
+
+std::string BrickdSimulator::encodeUid(uint32_t uid)
+{
+  std::string str;
+  uint64_t value = uid;
+
+  do
+  {
+    str.insert(str.begin(), BASE58_ALPHABET[value % 58]);
+    value /= 58;
+  } while (value > 0);
+
+  return str;
+}
+
+/*----------------------------------------------------------------------
+ * findDevice()
+ * Index of the device with the given UID, -1 if unknown
+ *--------------------------------------------------------------------*/
+
+int BrickdSimulator::findDevice(uint32_t uid) const
+{
+  std::map<uint32_t, size_t>::const_iterator it = device_index.find(uid);
+  if (it == device_index.end())
+    return -1;
+  return (int)it->second;
+}
+
+/*----------------------------------------------------------------------
+ * acceptLoop()
+ * Accept connections until stopped
+ *--------------------------------------------------------------------*/
+
+void BrickdSimulator::acceptLoop()
+{
+  while (running)
+  {
+    struct pollfd pfd;
+    pfd.fd = listen_fd;
+    pfd.events = POLLIN;
+
+    if (poll(&pfd, 1, 100) <= 0)
+      continue;
+
+    int fd = accept(listen_fd, NULL, NULL);
+    if (fd < 0)
+      continue;
+
+    int flag = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &flag, sizeof(flag));
+
+    reapClients(false);
+
+    Client *client = new Client();
+    client->fd = fd;
+    client->running = true;
+    client->order = 0;
+    client->last_due = Clock::now();
+    client->reader = std::thread(&BrickdSimulator::readLoop, this, client);
+    client->writer = std::thread(&BrickdSimulator::writeLoop, this, client);
+
+    {
+      std::lock_guard<std::mutex> lock(clients_mutex);
+      clients.push_back(client);
+    }
+    {
+      std::lock_guard<std::mutex> lock(stats_mutex);
+      stats.connections++;
+    }
+  }
+}
+
+/*----------------------------------------------------------------------
+ * reapClients()
+ * Join and free disconnected clients, or all clients
+ *--------------------------------------------------------------------*/
+
+void BrickdSimulator::reapClients(bool all)
+{
+  std::list<Client*> finished;
+  {
+    std::lock_guard<std::mutex> lock(clients_mutex);
+    for (std::list<Client*>::iterator it = clients.begin(); it != clients.end(); )
+    {
+      bool client_running;
+      {
+        std::lock_guard<std::mutex> client_lock((*it)->mutex);
+        client_running = (*it)->running;
+        if (all)
+          (*it)->running = false;
+      }
+
+      if (all || !client_running)
+      {
+        finished.push_back(*it);
+        it = clients.erase(it);
+      }
+      else
+        it++;
+    }
+  }
+
+  for (std::list<Client*>::iterator it = finished.begin(); it != finished.end(); it++)
+  {
+    Client *client = *it;
+    shutdown(client->fd, SHUT_RDWR);
+    client->cond.notify_all();
+    client->reader.join();
+    client->writer.join();
+    close(client->fd);
+    delete client;
+  }
+}
+
+/*----------------------------------------------------------------------
+ * readLoop()
+ * Read and answer requests of a client
+ *--------------------------------------------------------------------*/
+
+void BrickdSimulator::readLoop(Client *client)
+{
+  uint8_t buffer[8192];
+  size_t used = 0;
+
+  for (;;)
+  {
+    {
+      std::lock_guard<std::mutex> lock(client->mutex);
+      if (!client->running)
+        break;
+    }
+
+    struct pollfd pfd;
+    pfd.fd = client->fd;
+    pfd.events = POLLIN;
+    if (poll(&pfd, 1, 100) <= 0)
+      continue;
+
+    ssize_t length = recv(client->fd, buffer + used, sizeof(buffer) - used, 0);
+    if (length <= 0)
+      break;
+    used += length;
+
+    size_t offset = 0;
+    while (used - offset >= BRICKD_SIM_HEADER_SIZE)
+    {
+      uint8_t packet_length = buffer[offset + 4];
+      if (packet_length < BRICKD_SIM_HEADER_SIZE || packet_length > BRICKD_SIM_PACKET_SIZE)
+      {
+        // out of sync, brickd drops the connection as well
+        offset = used;
+        length = 0;
+        break;
+      }
+      if (used - offset < packet_length)
+        break;
+
+      handleRequest(client, buffer + offset);
+      offset += packet_length;
+    }
+
+    if (length == 0)
+      break;
+
+    memmove(buffer, buffer + offset, used - offset);
+    used -= offset;
+  }
+
+  std::lock_guard<std::mutex> lock(client->mutex);
+  client->running = false;
+  client->cond.notify_all();
+}
+
+/*----------------------------------------------------------------------
+ * writeLoop()
+ * Send due packets and generate periodic callbacks
+ *--------------------------------------------------------------------*/
+
+void BrickdSimulator::writeLoop(Client *client)
+{
+  std::vector<CallbackTimer> fired;
+
+  for (;;)
+  {
+    std::vector<Packet> due;
+    fired.clear();
+
+    {
+      std::unique_lock<std::mutex> lock(client->mutex);
+      if (!client->running)
+        break;
+
+      Clock::time_point now = Clock::now();
+      Clock::time_point wakeup = now + std::chrono::milliseconds(100);
+
+      while (!client->outbox.empty() && client->outbox.top().due <= now)
+      {
+        due.push_back(client->outbox.top());
+        client->outbox.pop();
+      }
+      if (!client->outbox.empty())
+        wakeup = std::min(wakeup, client->outbox.top().due);
+
+      for (std::map<uint32_t, CallbackTimer>::iterator it = client->timers.begin(); it != client->timers.end(); it++)
+      {
+        CallbackTimer &timer = it->second;
+        if (timer.next <= now)
+        {
+          fired.push_back(timer);
+          timer.next += std::chrono::milliseconds(timer.period);
+          // a stalled writer catches up instead of bursting
+          if (timer.next < now)
+            timer.next = now + std::chrono::milliseconds(timer.period);
+        }
+        wakeup = std::min(wakeup, timer.next);
+      }
+
+      if (due.empty() && fired.empty())
+      {
+        client->cond.wait_until(lock, wakeup);
+        continue;
+      }
+    }
+
+    for (size_t i = 0; i < fired.size(); i++)
+    {
+      const Device &device = devices[fired[i].device];
+      uint8_t packet[BRICKD_SIM_PACKET_SIZE];
+      memset(packet, 0, sizeof(packet));
+
+      int size = fillGetter(device, fired[i].getter_id, packet + BRICKD_SIM_HEADER_SIZE);
+      if (size < 0)
+        continue;
+
+      putUint32(packet, device.uid);
+      packet[4] = BRICKD_SIM_HEADER_SIZE + size;
+      packet[5] = fired[i].callback_id;
+      queuePacket(client, packet, packet[4], true);
+    }
+
+    for (size_t i = 0; i < due.size(); i++)
+    {
+      size_t sent = 0;
+      while (sent < due[i].length)
+      {
+        ssize_t length = send(client->fd, due[i].data + sent, due[i].length - sent, MSG_NOSIGNAL);
+        if (length <= 0)
+        {
+          std::lock_guard<std::mutex> lock(client->mutex);
+          client->running = false;
+          return;
+        }
+        sent += length;
+      }
+    }
+  }
+}
+
+/*----------------------------------------------------------------------
+ * queuePacket()
+ * Queue a packet with simulated latency, jitter and loss
+ *--------------------------------------------------------------------*/
+
+void BrickdSimulator::queuePacket(Client *client, const uint8_t *data, uint8_t length, bool callback)
+{
+  double delay = config.latency;
+  bool lost = false;
+  {
+    std::lock_guard<std::mutex> lock(random_mutex);
+    if (config.jitter > 0.0)
+      delay += std::normal_distribution<double>(0.0, config.jitter)(random);
+    if (config.loss > 0.0)
+      lost = std::uniform_real_distribution<double>(0.0, 1.0)(random) < config.loss;
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(stats_mutex);
+    if (lost)
+      stats.dropped++;
+    else if (callback)
+      stats.callbacks++;
+    else
+      stats.responses++;
+  }
+
+  if (lost)
+    return;
+
+  if (delay < 0.0)
+    delay = 0.0;
+
+  Packet packet;
+  packet.due = Clock::now() + std::chrono::microseconds((int64_t)(delay * 1e6));
+  packet.length = length;
+  memcpy(packet.data, data, length);
+
+  std::lock_guard<std::mutex> lock(client->mutex);
+  // a TCP stream does not reorder, jitter only delays
+  if (packet.due < client->last_due)
+    packet.due = client->last_due;
+  client->last_due = packet.due;
+  packet.order = client->order++;
+  client->outbox.push(packet);
+  client->cond.notify_all();
+}
+
+/*----------------------------------------------------------------------
+ * enumerate()
+ * Send an enumerate callback for every device
+ *--------------------------------------------------------------------*/
+
+void BrickdSimulator::enumerate(Client *client)
+{
+  for (size_t i = 0; i < devices.size(); i++)
+  {
+    uint8_t packet[BRICKD_SIM_HEADER_SIZE + 26];
+    memset(packet, 0, sizeof(packet));
+
+    putUint32(packet, devices[i].uid);
+    packet[4] = sizeof(packet);
+    packet[5] = BRICKD_SIM_CALLBACK_ENUMERATE;
+    // identity layout without the enumeration type
+    fillGetter(devices[i], BRICKD_SIM_FUNCTION_GET_IDENTITY, packet + BRICKD_SIM_HEADER_SIZE);
+    packet[BRICKD_SIM_HEADER_SIZE + 25] = 0; // available
+    queuePacket(client, packet, sizeof(packet), true);
+  }
+}
+
+/*----------------------------------------------------------------------
+ * handleRequest()
+ * Answer a single request
+ *--------------------------------------------------------------------*/
+
+void BrickdSimulator::handleRequest(Client *client, const uint8_t *request)
+{
+  uint32_t uid = getUint32(request);
+  uint8_t length = request[4];
+  uint8_t function_id = request[5];
+  bool response_expected = (request[6] >> 3) & 0x01;
+
+  {
+    std::lock_guard<std::mutex> lock(stats_mutex);
+    stats.requests++;
+  }
+
+  uint8_t response[BRICKD_SIM_PACKET_SIZE];
+  memset(response, 0, sizeof(response));
+  memcpy(response, request, 4);
+  response[4] = BRICKD_SIM_HEADER_SIZE;
+  response[5] = function_id;
+  response[6] = request[6];
+
+  if (function_id == BRICKD_SIM_FUNCTION_DISCONNECT_PROBE)
+    return;
+
+  if (uid == 0 && function_id == BRICKD_SIM_FUNCTION_ENUMERATE)
+  {
+    if (response_expected)
+      queuePacket(client, response, BRICKD_SIM_HEADER_SIZE, false);
+    enumerate(client);
+    return;
+  }
+
+  // requests to unknown UIDs are not routed, the client times out
+  int index = findDevice(uid);
+  if (index < 0)
+    return;
+  const Device &device = devices[index];
+
+  const PeriodCallback *period_callback = findPeriodCallback(device.identifier, function_id);
+  if (period_callback != NULL)
+  {
+    uint32_t key = ((uint32_t)index << 8) | period_callback->setter_id;
+    std::lock_guard<std::mutex> lock(client->mutex);
+
+    if (function_id == period_callback->setter_id)
+    {
+      if (length < BRICKD_SIM_HEADER_SIZE + 4)
+      {
+        response[7] = BRICKD_SIM_ERROR_INVALID_PARAMETER << 6;
+      }
+      else
+      {
+        uint32_t period = getUint32(request + BRICKD_SIM_HEADER_SIZE);
+        if (period == 0)
+        {
+          client->timers.erase(key);
+        }
+        else
+        {
+          CallbackTimer &timer = client->timers[key];
+          timer.device = index;
+          timer.callback_id = period_callback->callback_id;
+          timer.getter_id = period_callback->getter_id;
+          timer.period = period;
+          timer.next = Clock::now() + std::chrono::milliseconds(period);
+        }
+        client->cond.notify_all();
+      }
+    }
+    else
+    {
+      std::map<uint32_t, CallbackTimer>::iterator it = client->timers.find(key);
+      putUint32(response + BRICKD_SIM_HEADER_SIZE, it == client->timers.end() ? 0 : it->second.period);
+      response[4] += 4;
+      // the period getter always answers
+      response_expected = true;
+    }
+  }
+  else if (isGetter(device.identifier, function_id))
+  {
+    int size = fillGetter(device, function_id, response + BRICKD_SIM_HEADER_SIZE);
+    if (size < 0)
+      response[7] = BRICKD_SIM_ERROR_FUNCTION_NOT_SUPPORTED << 6;
+    else
+      response[4] += size;
+    response_expected = true;
+  }
+
+  if (response[7] != 0)
+  {
+    std::lock_guard<std::mutex> lock(stats_mutex);
+    stats.errors++;
+  }
+
+  if (response_expected)
+    queuePacket(client, response, response[4], false);
+}
+
+/*----------------------------------------------------------------------
+ * fillGetter()
+ * Fill the payload of a getter with synthetic values
+ *--------------------------------------------------------------------*/
+
+int BrickdSimulator::fillGetter(const Device &device, uint8_t function_id, uint8_t *payload)
+{
+  double t = std::chrono::duration<double>(Clock::now() - start_time).count() + device.phase;
+  double s = std::sin(0.5 * t);
+  double c = std::cos(0.5 * t);
+
+  if (function_id == BRICKD_SIM_FUNCTION_GET_IDENTITY)
+  {
+    memset(payload, 0, 25);
+    strncpy((char *)payload, device.uid_str.c_str(), 8);
+    strncpy((char *)payload + 8, device.connected_uid.c_str(), 8);
+    payload[16] = device.position;
+    payload[17] = 1; // hardware version 1.0.0
+    payload[20] = 2; // firmware version 2.0.0
+    putUint16(payload + 23, device.identifier);
+    return 25;
+  }
+
+  switch (device.identifier)
+  {
+  case BRICKD_SIM_IMU:
+  {
+    // slow rotation about z at 0.5 rad/s, gravity on z
+    double yaw = 0.5 * t;
+    switch (function_id)
+    {
+    case 1: // acceleration [mG]
+      putInt16(payload, 10 * s); putInt16(payload + 2, 10 * c); putInt16(payload + 4, 1000);
+      return 6;
+    case 2: // magnetic field [mG]
+      putInt16(payload, 200 * std::cos(yaw)); putInt16(payload + 2, -200 * std::sin(yaw)); putInt16(payload + 4, -400);
+      return 6;
+    case 3: // angular velocity [14.375 LSB per deg/s]
+      putInt16(payload, 0); putInt16(payload + 2, 0); putInt16(payload + 4, 0.5 * 180.0 / M_PI * 14.375);
+      return 6;
+    case 4: // all data
+      fillGetter(device, 1, payload);
+      fillGetter(device, 2, payload + 6);
+      fillGetter(device, 3, payload + 12);
+      fillGetter(device, 7, payload + 18);
+      return 20;
+    case 5: // orientation [deg/100]
+      putInt16(payload, 0); putInt16(payload + 2, 0); putInt16(payload + 4, std::fmod(yaw * 180.0 / M_PI, 360.0) * 100);
+      return 6;
+    case 6: // quaternion x, y, z, w
+      putFloat(payload, 0.0f); putFloat(payload + 4, 0.0f);
+      putFloat(payload + 8, std::sin(0.5 * yaw)); putFloat(payload + 12, std::cos(0.5 * yaw));
+      return 16;
+    case 7: // temperature [degC/100]
+      putInt16(payload, 2500 + 50 * s);
+      return 2;
+    case 10: // are leds on
+    case 39: // is orientation calculation on
+      payload[0] = 1;
+      return 1;
+    case 16: // convergence speed
+      putUint16(payload, 30);
+      return 2;
+    }
+    break;
+  }
+  case BRICKD_SIM_IMU_V2:
+  {
+    double yaw = 0.5 * t;
+    switch (function_id)
+    {
+    case 1: // acceleration [1/100 m/s^2]
+    case 7: // gravity vector
+      putInt16(payload, 0); putInt16(payload + 2, 0); putInt16(payload + 4, 981);
+      return 6;
+    case 2: // magnetic field [1/16 uT]
+      putInt16(payload, 320 * std::cos(yaw)); putInt16(payload + 2, -320 * std::sin(yaw)); putInt16(payload + 4, -640);
+      return 6;
+    case 3: // angular velocity [1/16 deg/s]
+      putInt16(payload, 0); putInt16(payload + 2, 0); putInt16(payload + 4, 0.5 * 180.0 / M_PI * 16);
+      return 6;
+    case 4: // temperature [degC]
+      payload[0] = 25;
+      return 1;
+    case 5: // euler angles heading, roll, pitch [1/16 deg]
+      putInt16(payload, std::fmod(yaw * 180.0 / M_PI, 360.0) * 16); putInt16(payload + 2, 0); putInt16(payload + 4, 0);
+      return 6;
+    case 6: // linear acceleration
+      putInt16(payload, 0); putInt16(payload + 2, 0); putInt16(payload + 4, 0);
+      return 6;
+    case 8: // quaternion w, x, y, z [1/16383]
+      putInt16(payload, std::cos(0.5 * yaw) * 16383); putInt16(payload + 2, 0);
+      putInt16(payload + 4, 0); putInt16(payload + 6, std::sin(0.5 * yaw) * 16383);
+      return 8;
+    case 9: // all data
+      fillGetter(device, 1, payload);
+      fillGetter(device, 2, payload + 6);
+      fillGetter(device, 3, payload + 12);
+      fillGetter(device, 5, payload + 18);
+      fillGetter(device, 8, payload + 24);
+      fillGetter(device, 6, payload + 32);
+      fillGetter(device, 7, payload + 38);
+      fillGetter(device, 4, payload + 44);
+      payload[45] = 0xff; // fully calibrated
+      return 46;
+    case 12: // are leds on
+    case 240: // is status led enabled
+      payload[0] = 1;
+      return 1;
+    }
+    break;
+  }
+  case BRICKD_SIM_GPS:
+    switch (function_id)
+    {
+    case 1: // coordinates, Munich with a few meters of wander
+      putUint32(payload, 48137154 + 20 * s); payload[4] = 'N';
+      putUint32(payload + 5, 11576124 + 20 * c); payload[9] = 'E';
+      putUint16(payload + 10, 150); putUint16(payload + 12, 90);
+      putUint16(payload + 14, 120); putUint16(payload + 16, 250);
+      return 18;
+    case 2: // status: 3D fix, 9 in view, 7 used
+      payload[0] = 3; payload[1] = 9; payload[2] = 7;
+      return 3;
+    case 3: // altitude and geoidal separation [cm]
+      putInt32(payload, 51900 + 100 * s); putInt32(payload + 4, 4700);
+      return 8;
+    case 4: // course [deg/100] and speed [km/h/100]
+      putUint32(payload, 9000); putUint32(payload + 4, 150);
+      return 8;
+    case 5: // date ddmmyy and time hhmmss|sss
+      putUint32(payload, 181026); putUint32(payload + 4, 120000000);
+      return 8;
+    }
+    break;
+  case BRICKD_SIM_HUMIDITY:
+    if (function_id == 1) // humidity [%RH/10]
+    {
+      putUint16(payload, 455 + 20 * s);
+      return 2;
+    }
+    if (function_id == 2) // analog value
+    {
+      putUint16(payload, 1800 + 80 * s);
+      return 2;
+    }
+    break;
+  case BRICKD_SIM_TEMPERATURE:
+    if (function_id == 1) // temperature [degC/100]
+    {
+      putInt16(payload, 2150 + 50 * s);
+      return 2;
+    }
+    break;
+  case BRICKD_SIM_TEMPERATURE_IR:
+    if (function_id == 1) // ambient temperature [degC/10]
+    {
+      putInt16(payload, 230 + 5 * s);
+      return 2;
+    }
+    if (function_id == 2) // object temperature [degC/10]
+    {
+      putInt16(payload, 310 + 20 * s);
+      return 2;
+    }
+    if (function_id == 4) // emissivity
+    {
+      putUint16(payload, 0xffff);
+      return 2;
+    }
+    break;
+  case BRICKD_SIM_AMBIENT_LIGHT:
+    if (function_id == 1) // illuminance [lx/10]
+    {
+      putUint16(payload, 3000 + 500 * s);
+      return 2;
+    }
+    if (function_id == 2) // analog value
+    {
+      putUint16(payload, 2000 + 300 * s);
+      return 2;
+    }
+    break;
+  case BRICKD_SIM_AMBIENT_LIGHT_V2:
+    if (function_id == 1) // illuminance [lx/100]
+    {
+      putUint32(payload, 30000 + 5000 * s);
+      return 4;
+    }
+    break;
+  case BRICKD_SIM_DISTANCE_IR:
+    if (function_id == 1) // distance [mm]
+    {
+      putUint16(payload, 400 + 200 * s);
+      return 2;
+    }
+    if (function_id == 2) // analog value
+    {
+      putUint16(payload, 2000 - 1000 * s);
+      return 2;
+    }
+    break;
+  case BRICKD_SIM_DISTANCE_US:
+    if (function_id == 1) // distance value
+    {
+      putUint16(payload, 2000 + 1000 * s);
+      return 2;
+    }
+    break;
+  case BRICKD_SIM_DUAL_BUTTON:
+    if (function_id == 2 || function_id == 3) // led state, button state
+    {
+      payload[0] = 1; payload[1] = 1;
+      return 2;
+    }
+    break;
+  case BRICKD_SIM_MOTION_DETECTOR:
+    if (function_id == 1) // motion detected
+    {
+      payload[0] = s > 0.9 ? 1 : 0;
+      return 1;
+    }
+    break;
+  case BRICKD_SIM_INDUSTRIAL_DIGITAL_IN_4:
+    if (function_id == 1) // value mask
+    {
+      putUint16(payload, ((int)t) & 0x0f);
+      return 2;
+    }
+    break;
+  case BRICKD_SIM_MASTER:
+    if (function_id == 1 || function_id == 2) // stack voltage, stack current
+    {
+      putUint16(payload, function_id == 1 ? 12000 : 150);
+      return 2;
+    }
+    break;
+  }
+
+  return -1;
+}
@@ -0,0 +1,132 @@
+#include <iostream>
+#include <cstdlib>
+#include <cstring>
+#include <csignal>
+#include <errno.h>
+#include <unistd.h>
+#include "brickd_simulator.h"
+
+static volatile sig_atomic_t stop_requested = 0;
+
+/*----------------------------------------------------------------------
+ * signalHandler()
+ * Stop the simulator on SIGINT and SIGTERM
+ *--------------------------------------------------------------------*/
+
+static void signalHandler(int)
+{
+  stop_requested = 1;
+}
+
+/*----------------------------------------------------------------------
+ * usage()
+ * Print the command line options
+ *--------------------------------------------------------------------*/
+
+static void usage(const char *name)
+{
+  std::cerr << "usage: " << name << " [options]" << std::endl
+            << "  --port <port>          TCP port (default 4223, 0 = any free port)" << std::endl
+            << "  --latency <ms>         mean delay of responses and callbacks" << std::endl
+            << "  --jitter <ms>          standard deviation of the delay" << std::endl
+            << "  --loss <p>             probability that a packet is dropped (0..1)" << std::endl
+            << "  --seed <n>             seed of the random generator" << std::endl
+            << "  --device <type>[:<n>]  simulate n devices of a type, by name or" << std::endl
+            << "                         device identifier, may be repeated" << std::endl
+            << "types: imu, imu_v2, gps, humidity, temperature, temperature_ir," << std::endl
+            << "       ambient_light, ambient_light_v2, distance_ir, distance_us," << std::endl
+            << "       dual_button, motion_detector, industrial_digital_in_4, master" << std::endl
+            << "without --device one device of each sensor type is simulated" << std::endl;
+}
+
+/*----------------------------------------------------------------------
+ * main()
+ * Run a simulated brickd until interrupted
+ *--------------------------------------------------------------------*/
+
+int main(int argc, char **argv)
+{
+  BrickdSimulatorConfig config;
+
+  for (int i = 1; i < argc; i++)
+  {
+    std::string arg = argv[i];
+    if (arg == "--help" || arg == "-h")
+    {
+      usage(argv[0]);
+      return 0;
+    }
+    if (i + 1 >= argc)
+    {
+      usage(argv[0]);
+      return 1;
+    }
+
+    std::string value = argv[++i];
+    if (arg == "--port")
+      config.port = (uint16_t)atoi(value.c_str());
+    else if (arg == "--latency")
+      config.latency = atof(value.c_str()) / 1000.0;
+    else if (arg == "--jitter")
+      config.jitter = atof(value.c_str()) / 1000.0;
+    else if (arg == "--loss")
+      config.loss = atof(value.c_str());
+    else if (arg == "--seed")
+      config.seed = (unsigned int)atoi(value.c_str());
+    else if (arg == "--device")
+    {
+      int count = 1;
+      size_t colon = value.find(':');
+      if (colon != std::string::npos)
+      {
+        count = atoi(value.substr(colon + 1).c_str());
+        value = value.substr(0, colon);
+      }
+
+      uint16_t identifier = BrickdSimulator::parseDeviceName(value);
+      if (identifier == 0)
+      {
+        std::cerr << "unknown device type " << value << std::endl;
+        return 1;
+      }
+      config.devices[identifier] += count;
+    }
+    else
+    {
+      usage(argv[0]);
+      return 1;
+    }
+  }
+
+  if (config.devices.empty())
+  {
+    const char *defaults[] = {"imu", "imu_v2", "gps", "humidity", "temperature", "temperature_ir",
+                              "ambient_light", "ambient_light_v2", "distance_ir", "distance_us", NULL};
+    for (int i = 0; defaults[i] != NULL; i++)
+      config.devices[BrickdSimulator::parseDeviceName(defaults[i])] = 1;
+  }
+
+  BrickdSimulator simulator(config);
+  if (!simulator.start())
+  {
+    std::cerr << "could not listen on port " << config.port << ": " << strerror(errno) << std::endl;
+    return 1;
+  }
+
+  std::cout << "brickd simulator on port " << simulator.getPort() << " with "
+            << simulator.getDeviceCount() << " devices" << std::endl;
+
+  signal(SIGINT, signalHandler);
+  signal(SIGTERM, signalHandler);
+  while (!stop_requested)
+    usleep(100000);
+
+  simulator.stop();
+
+  BrickdSimulatorStats stats = simulator.getStats();
+  std::cout << "connections " << stats.connections << ", requests " << stats.requests
+            << ", responses " << stats.responses << ", callbacks " << stats.callbacks
+            << ", dropped " << stats.dropped << ", errors " << stats.errors << std::endl;
+
+  return 0;
+}
@@ -0,0 +1,311 @@
+#include "ros/ros.h"
+#include <sensor_msgs/NavSatFix.h>
+#include <sensor_msgs/Imu.h>
+#include <sensor_msgs/MagneticField.h>
+#include <sensor_msgs/Temperature.h>
+#include <sensor_msgs/Illuminance.h>
+#include <sensor_msgs/Range.h>
+#include <sensor_msgs/RelativeHumidity.h>
+#include "ip_connection.h"
+#include "bricklet_ambient_light.h"
+#include "bricklet_ambient_light_v2.h"
+#include "brick_imu.h"
+#include "brick_imu_v2.h"
+#include "brick_master.h"
+#include "bricklet_gps.h"
+#include "bricklet_dual_button.h"
+#include "bricklet_humidity.h"
+#include "bricklet_temperature.h"
+#include "bricklet_temperature_ir.h"
+#include "bricklet_distance_ir.h"
+#include "bricklet_distance_us.h"
+#include "bricklet_motion_detector.h"
+#include "sensor_device.h"
+#include "tinkerforge_sensors_core.h"
+#include "device_registry.h"
+
+/*
+ * DeviceTraits<identifier> describes one device type: the binding object
+ * (Device, void if the node creates none), the message it publishes
+ * (Message, void if none) and the functions to create, destroy, set up,
+ * publish and read it. DefaultTraits holds the empty defaults, a specialization only
+ * declares what its device has.
+ */
+
+typedef void (*SetupFunction)(TinkerforgeSensors *tfs, SensorDevice *sensor);
+typedef void (*PublishFunction)(TinkerforgeSensors *tfs, SensorDevice *sensor);
+typedef ros::Publisher (*AdvertiseFunction)(ros::NodeHandle &n, const std::string &topic);
+
+struct DefaultTraits
+{
+  typedef void Device;
+  typedef void Message;
+  static constexpr SetupFunction setup = nullptr;
+  static constexpr PublishFunction publish = nullptr;
+  static const uint16_t companion = 0;
+};
+
+template <uint16_t identifier> struct DeviceTraits;
+
+template <> struct DeviceTraits<AMBIENT_LIGHT_DEVICE_IDENTIFIER> : DefaultTraits
+{
+  typedef AmbientLight Device;
+  typedef sensor_msgs::Illuminance Message;
+  static const SensorClass sensor_class = SensorClass::LIGHT;
+  static void create(Device *dev, const char *uid, IPConnection *ipcon) { ambient_light_create(dev, uid, ipcon); }
+  static void destroy(Device *dev, SensorDevice *sensor) { ambient_light_destroy(dev); }
+  static void publish(TinkerforgeSensors *tfs, SensorDevice *sensor) { tfs->publishIlluminanceMessage(sensor); }
+  static bool read(TinkerforgeSensors *tfs, SensorDevice *sensor, Message &msg) { return tfs->readIlluminanceMessage(sensor, msg); }
+};
+
+template <> struct DeviceTraits<AMBIENT_LIGHT_V2_DEVICE_IDENTIFIER> : DefaultTraits
+{
+  typedef AmbientLightV2 Device;
+  typedef sensor_msgs::Illuminance Message;
+  static const SensorClass sensor_class = SensorClass::LIGHT;
+  static void create(Device *dev, const char *uid, IPConnection *ipcon) { ambient_light_v2_create(dev, uid, ipcon); }
+  static void destroy(Device *dev, SensorDevice *sensor) { ambient_light_v2_destroy(dev); }
+  static void publish(TinkerforgeSensors *tfs, SensorDevice *sensor) { tfs->publishIlluminanceMessage(sensor); }
+  static bool read(TinkerforgeSensors *tfs, SensorDevice *sensor, Message &msg) { return tfs->readIlluminanceMessage(sensor, msg); }
+};
+
+template <> struct DeviceTraits<DISTANCE_IR_DEVICE_IDENTIFIER> : DefaultTraits
+{
+  typedef DistanceIR Device;
+  typedef sensor_msgs::Range Message;
+  static const SensorClass sensor_class = SensorClass::RANGE;
+  static void create(Device *dev, const char *uid, IPConnection *ipcon) { distance_ir_create(dev, uid, ipcon); }
+  static void destroy(Device *dev, SensorDevice *sensor) { distance_ir_destroy(dev); }
+  static void publish(TinkerforgeSensors *tfs, SensorDevice *sensor) { tfs->publishRangeMessage(sensor); }
+  static bool read(TinkerforgeSensors *tfs, SensorDevice *sensor, Message &msg) { return tfs->readRangeMessage(sensor, msg); }
+};
+
+template <> struct DeviceTraits<DISTANCE_US_DEVICE_IDENTIFIER> : DefaultTraits
+{
+  typedef DistanceUS Device;
+  typedef sensor_msgs::Range Message;
+  static const SensorClass sensor_class = SensorClass::RANGE;
+  static void create(Device *dev, const char *uid, IPConnection *ipcon) { distance_us_create(dev, uid, ipcon); }
+  static void destroy(Device *dev, SensorDevice *sensor) { distance_us_destroy(dev); }
+  static void publish(TinkerforgeSensors *tfs, SensorDevice *sensor) { tfs->publishRangeMessage(sensor); }
+  static bool read(TinkerforgeSensors *tfs, SensorDevice *sensor, Message &msg) { return tfs->readRangeMessage(sensor, msg); }
+};
+
+template <> struct DeviceTraits<DUAL_BUTTON_DEVICE_IDENTIFIER> : DefaultTraits
+{
+  typedef DualButton Device;
+  static const SensorClass sensor_class = SensorClass::MISC;
+  static void create(Device *dev, const char *uid, IPConnection *ipcon) { dual_button_create(dev, uid, ipcon); }
+  static void destroy(Device *dev, SensorDevice *sensor) { dual_button_destroy(dev); }
+};
+
+template <> struct DeviceTraits<GPS_DEVICE_IDENTIFIER> : DefaultTraits
+{
+  typedef GPS Device;
+  typedef sensor_msgs::NavSatFix Message;
+  static const SensorClass sensor_class = SensorClass::GPS;
+  static void create(Device *dev, const char *uid, IPConnection *ipcon) { gps_create(dev, uid, ipcon); }
+  static void destroy(Device *dev, SensorDevice *sensor) { gps_destroy(dev); }
+  static void publish(TinkerforgeSensors *tfs, SensorDevice *sensor) { tfs->publishNavSatFixMessage(sensor); }
+  static bool read(TinkerforgeSensors *tfs, SensorDevice *sensor, Message &msg) { return tfs->readNavSatFixMessage(sensor, msg); }
+};
+
+template <> struct DeviceTraits<HUMIDITY_DEVICE_IDENTIFIER> : DefaultTraits
+{
+  typedef Humidity Device;
+  typedef sensor_msgs::RelativeHumidity Message;
+  static const SensorClass sensor_class = SensorClass::HUMIDITY;
+  static void create(Device *dev, const char *uid, IPConnection *ipcon) { humidity_create(dev, uid, ipcon); }
+  static void destroy(Device *dev, SensorDevice *sensor) { humidity_destroy(dev); }
+  static void publish(TinkerforgeSensors *tfs, SensorDevice *sensor) { tfs->publishHumidityMessage(sensor); }
+  static bool read(TinkerforgeSensors *tfs, SensorDevice *sensor, Message &msg) { return tfs->readHumidityMessage(sensor, msg); }
+};
+
+template <> struct DeviceTraits<IMU_DEVICE_IDENTIFIER> : DefaultTraits
+{
+  typedef IMU Device;
+  typedef sensor_msgs::Imu Message;
+  static const SensorClass sensor_class = SensorClass::IMU;
+  static void create(Device *dev, const char *uid, IPConnection *ipcon) { imu_create(dev, uid, ipcon); }
+  static void destroy(Device *dev, SensorDevice *sensor)
+  {
+    // hand the orientation back to the brick
+    if (sensor->getFusion().filter.isEnabled())
+    {
+      imu_set_all_data_period(dev, 0);
+      imu_orientation_calculation_on(dev);
+    }
+    imu_leds_off(dev);
+    imu_destroy(dev);
+  }
+  static void setup(TinkerforgeSensors *tfs, SensorDevice *sensor) { tfs->setupImu(sensor); }
+  static void publish(TinkerforgeSensors *tfs, SensorDevice *sensor) { tfs->publishImuMessage(sensor); }
+  static bool read(TinkerforgeSensors *tfs, SensorDevice *sensor, Message &msg) { return tfs->readImuMessage(sensor, msg); }
+};
+
+template <> struct DeviceTraits<IMU_V2_DEVICE_IDENTIFIER> : DefaultTraits
+{
+  typedef IMUV2 Device;
+  typedef sensor_msgs::Imu Message;
+  static const SensorClass sensor_class = SensorClass::IMU;
+  static const uint16_t companion = IMU_V2_MAGNETIC_DEVICE_IDENTIFIER;
+  static void create(Device *dev, const char *uid, IPConnection *ipcon) { imu_v2_create(dev, uid, ipcon); }
+  static void destroy(Device *dev, SensorDevice *sensor)
+  {
+    imu_v2_leds_off(dev);
+    imu_v2_destroy(dev);
+  }
+  static void setup(TinkerforgeSensors *tfs, SensorDevice *sensor) { imu_v2_leds_on((IMUV2*)sensor->getDev()); }
+  static void publish(TinkerforgeSensors *tfs, SensorDevice *sensor) { tfs->publishImuMessage(sensor); }
+  static bool read(TinkerforgeSensors *tfs, SensorDevice *sensor, Message &msg) { return tfs->readImuMessage(sensor, msg); }
+};
+
+// magnetometer of the IMU v2, shares the binding object of the IMU
+template <> struct DeviceTraits<IMU_V2_MAGNETIC_DEVICE_IDENTIFIER> : DefaultTraits
+{
+  typedef sensor_msgs::MagneticField Message;
+  static const SensorClass sensor_class = SensorClass::MAGNETIC;
+  static void publish(TinkerforgeSensors *tfs, SensorDevice *sensor) { tfs->publishMagneticFieldMessage(sensor); }
+  static bool read(TinkerforgeSensors *tfs, SensorDevice *sensor, Message &msg) { return tfs->readMagneticFieldMessage(sensor, msg); }
+};
+
+template <> struct DeviceTraits<MASTER_DEVICE_IDENTIFIER> : DefaultTraits
+{
+  static const SensorClass sensor_class = SensorClass::MISC;
+};
+
+template <> struct DeviceTraits<MOTION_DETECTOR_DEVICE_IDENTIFIER> : DefaultTraits
+{
+  typedef MotionDetector Device;
+  static const SensorClass sensor_class = SensorClass::MISC;
+  static void create(Device *dev, const char *uid, IPConnection *ipcon) { motion_detector_create(dev, uid, ipcon); }
+  static void destroy(Device *dev, SensorDevice *sensor) { motion_detector_destroy(dev); }
+};
+
+template <> struct DeviceTraits<TEMPERATURE_DEVICE_IDENTIFIER> : DefaultTraits
+{
+  typedef Temperature Device;
+  typedef sensor_msgs::Temperature Message;
+  static const SensorClass sensor_class = SensorClass::TEMPERATURE;
+  static void create(Device *dev, const char *uid, IPConnection *ipcon) { temperature_create(dev, uid, ipcon); }
+  static void destroy(Device *dev, SensorDevice *sensor) { temperature_destroy(dev); }
+  static void publish(TinkerforgeSensors *tfs, SensorDevice *sensor) { tfs->publishTemperatureMessage(sensor); }
+  static bool read(TinkerforgeSensors *tfs, SensorDevice *sensor, Message &msg) { return tfs->readTemperatureMessage(sensor, msg); }
+};
+
+template <> struct DeviceTraits<TEMPERATURE_IR_DEVICE_IDENTIFIER> : DefaultTraits
+{
+  typedef TemperatureIR Device;
+  typedef sensor_msgs::Temperature Message;
+  static const SensorClass sensor_class = SensorClass::TEMPERATURE;
+  static void create(Device *dev, const char *uid, IPConnection *ipcon) { temperature_ir_create(dev, uid, ipcon); }
+  static void destroy(Device *dev, SensorDevice *sensor) { temperature_ir_destroy(dev); }
+  static void publish(TinkerforgeSensors *tfs, SensorDevice *sensor) { tfs->publishTemperatureMessage(sensor); }
+  static bool read(TinkerforgeSensors *tfs, SensorDevice *sensor, Message &msg) { return tfs->readTemperatureMessage(sensor, msg); }
+};
+
+/*
+ * Entry functions generated from the traits, NULL where the traits have
+ * no binding object or no message.
+ */
+
+template <uint16_t identifier, typename Device = typename DeviceTraits<identifier>::Device>
+struct BindingHooks
+{
+  static void *create(const char *uid, IPConnection *ipcon)
+  {
+    Device *dev = new Device();
+    DeviceTraits<identifier>::create(dev, uid, ipcon);
+    return dev;
+  }
+
+  static void destroy(SensorDevice *sensor)
+  {
+    Device *dev = (Device*)sensor->getDev();
+    DeviceTraits<identifier>::destroy(dev, sensor);
+    delete dev;
+  }
+};
+
+template <uint16_t identifier>
+struct BindingHooks<identifier, void>
+{
+  static constexpr void *(*create)(const char *uid, IPConnection *ipcon) = nullptr;
+  static constexpr void (*destroy)(SensorDevice *sensor) = nullptr;
+};
+
+template <typename Message>
+struct MessageHooks
+{
+  static ros::Publisher advertise(ros::NodeHandle &n, const std::string &topic)
+  {
+    return n.advertise<Message>(topic, 50);
+  }
+};
+
+template <>
+struct MessageHooks<void>
+{
+  static constexpr AdvertiseFunction advertise = nullptr;
+};
+
+template <uint16_t identifier, typename Message = typename DeviceTraits<identifier>::Message>
+struct ReadHooks
+{
+  static bool read(TinkerforgeSensors *tfs, SensorDevice *sensor)
+  {
+    Message msg;
+    double values[SENSOR_SHM_MAX_VALUES];
+    if (!DeviceTraits<identifier>::read(tfs, sensor, msg))
+      return false;
+    uint32_t count = TinkerforgeSensors::sampleValues(msg, values);
+    sensor->getLatest().update(ros::Time::now().toNSec(), values, count);
+    return true;
+  }
+};
+
+template <uint16_t identifier>
+struct ReadHooks<identifier, void>
+{
+  static constexpr bool (*read)(TinkerforgeSensors *tfs, SensorDevice *sensor) = nullptr;
+};
+
+#define DEVICE_ENTRY(identifier, name, label) \
+  { identifier, DeviceTraits<identifier>::sensor_class, name, label, \
+    BindingHooks<identifier>::create, BindingHooks<identifier>::destroy, \
+    DeviceTraits<identifier>::setup, MessageHooks<DeviceTraits<identifier>::Message>::advertise, \
+    DeviceTraits<identifier>::publish, ReadHooks<identifier>::read, DeviceTraits<identifier>::companion }
+
+static const DeviceEntry device_table[] =
+{
+  DEVICE_ENTRY(AMBIENT_LIGHT_DEVICE_IDENTIFIER, "ambient_light", "Ambient Light"),
+  DEVICE_ENTRY(AMBIENT_LIGHT_V2_DEVICE_IDENTIFIER, "ambient_light_v2", "Ambient Light v2"),
+  DEVICE_ENTRY(DISTANCE_IR_DEVICE_IDENTIFIER, "distance_ir", "Distance IR"),
+  DEVICE_ENTRY(DISTANCE_US_DEVICE_IDENTIFIER, "distance_us", "Distance US"),
+  DEVICE_ENTRY(DUAL_BUTTON_DEVICE_IDENTIFIER, "dual_button", "DualButton"),
+  DEVICE_ENTRY(GPS_DEVICE_IDENTIFIER, "gps", "GPS"),
+  DEVICE_ENTRY(HUMIDITY_DEVICE_IDENTIFIER, "humidity", "Humidity"),
+  DEVICE_ENTRY(IMU_DEVICE_IDENTIFIER, "imu", "IMU"),
+  DEVICE_ENTRY(IMU_V2_DEVICE_IDENTIFIER, "imu_v2", "IMU_v2"),
+  DEVICE_ENTRY(IMU_V2_MAGNETIC_DEVICE_IDENTIFIER, "imu_v2_magnetic", "IMU_v2 magnetometer"),
+  DEVICE_ENTRY(MASTER_DEVICE_IDENTIFIER, "master", "Master brick"),
+  DEVICE_ENTRY(MOTION_DETECTOR_DEVICE_IDENTIFIER, "motion_detector", "Motion Detector"),
+  DEVICE_ENTRY(TEMPERATURE_DEVICE_IDENTIFIER, "temperature", "Temperature"),
+  DEVICE_ENTRY(TEMPERATURE_IR_DEVICE_IDENTIFIER, "temperature_ir", "Temperature IR")
+};
+
+/*----------------------------------------------------------------------
+ * findDeviceEntry()
+ * Entry of a device identifier
+ *--------------------------------------------------------------------*/
+
+const DeviceEntry *findDeviceEntry(uint16_t identifier)
+{
+  // only called at enumeration, the sensors keep their entry
+  for (size_t i = 0; i < sizeof(device_table) / sizeof(device_table[0]); i++)
+  {
+    if (device_table[i].identifier == identifier)
+      return &device_table[i];
+  }
+  return NULL;
+}
@@ -0,0 +1,167 @@
+#include <cmath>
+#include "madgwick_filter.h"
+
+// samples after a reset that use the start gain
+#define MADGWICK_START_SAMPLES 200
+// gain while the filter converges from the identity
+#define MADGWICK_START_BETA 2.5
+
+/*----------------------------------------------------------------------
+ * MadgwickFilter()
+ * Constructor
+ *--------------------------------------------------------------------*/
+
+MadgwickFilter::MadgwickFilter()
+{
+  beta = 0.0;
+  reset();
+}
+
+/*----------------------------------------------------------------------
+ * init()
+ * Set the gain
+ *--------------------------------------------------------------------*/
+
+void MadgwickFilter::init(double beta)
+{
+  if (beta <= 0.0)
+    beta = 0.1;
+  this->beta = beta;
+  reset();
+}
+
+/*----------------------------------------------------------------------
+ * reset()
+ * Start from the identity
+ *--------------------------------------------------------------------*/
+
+void MadgwickFilter::reset()
+{
+  q[0] = 1.0;
+  q[1] = 0.0;
+  q[2] = 0.0;
+  q[3] = 0.0;
+  start_samples = MADGWICK_START_SAMPLES;
+}
+
+/*----------------------------------------------------------------------
+ * update()
+ * Integrate the gyro and step towards the measured vectors
+ *--------------------------------------------------------------------*/
+
+void MadgwickFilter::update(const double *gyro, const double *acc, const double *mag, double dt)
+{
+  double q_dot[4];
+  double a[3], m[3];
+  double step[4];
+
+  // rate of change of the orientation from the gyro, q_dot = 0.5 * q x (0, gyro)
+  q_dot[0] = 0.5 * (-q[1] * gyro[0] - q[2] * gyro[1] - q[3] * gyro[2]);
+  q_dot[1] = 0.5 * (q[0] * gyro[0] + q[2] * gyro[2] - q[3] * gyro[1]);
+  q_dot[2] = 0.5 * (q[0] * gyro[1] - q[1] * gyro[2] + q[3] * gyro[0]);
+  q_dot[3] = 0.5 * (q[0] * gyro[2] + q[1] * gyro[1] - q[2] * gyro[0]);
+
+  // without gravity there is nothing to correct against
+  double a_norm = sqrt(acc[0] * acc[0] + acc[1] * acc[1] + acc[2] * acc[2]);
+  if (a_norm > 0.0)
+  {
+    for (int i = 0; i < 3; i++)
+      a[i] = acc[i] / a_norm;
+
+    double m_norm = (mag != NULL) ? sqrt(mag[0] * mag[0] + mag[1] * mag[1] + mag[2] * mag[2]) : 0.0;
+    if (m_norm > 0.0)
+    {
+      for (int i = 0; i < 3; i++)
+        m[i] = mag[i] / m_norm;
+      gradientMarg(a, m, step);
+    }
+    else
+    {
+      gradientImu(a, step);
+    }
+
+    double gain = beta;
+    if (start_samples > 0)
+    {
+      start_samples--;
+      gain = MADGWICK_START_BETA;
+    }
+    for (int i = 0; i < 4; i++)
+      q_dot[i] -= gain * step[i];
+  }
+
+  for (int i = 0; i < 4; i++)
+    q[i] += q_dot[i] * dt;
+
+  double q_norm = sqrt(q[0] * q[0] + q[1] * q[1] + q[2] * q[2] + q[3] * q[3]);
+  for (int i = 0; i < 4; i++)
+    q[i] /= q_norm;
+}
+
+/*----------------------------------------------------------------------
+ * gradientImu()
+ * Normalized gradient for gravity only
+ *--------------------------------------------------------------------*/
+
+void MadgwickFilter::gradientImu(const double *a, double *step) const
+{
+  double q0 = q[0], q1 = q[1], q2 = q[2], q3 = q[3];
+
+  // objective: gravity rotated into the sensor frame minus the measured one
+  double f0 = 2.0 * (q1 * q3 - q0 * q2) - a[0];
+  double f1 = 2.0 * (q0 * q1 + q2 * q3) - a[1];
+  double f2 = 2.0 * (0.5 - q1 * q1 - q2 * q2) - a[2];
+
+  // transposed jacobian times objective
+  step[0] = -2.0 * q2 * f0 + 2.0 * q1 * f1;
+  step[1] = 2.0 * q3 * f0 + 2.0 * q0 * f1 - 4.0 * q1 * f2;
+  step[2] = -2.0 * q0 * f0 + 2.0 * q3 * f1 - 4.0 * q2 * f2;
+  step[3] = 2.0 * q1 * f0 + 2.0 * q2 * f1;
+
+  double norm = sqrt(step[0] * step[0] + step[1] * step[1] + step[2] * step[2] + step[3] * step[3]);
+  if (norm > 0.0)
+    for (int i = 0; i < 4; i++)
+      step[i] /= norm;
+}
+
+/*----------------------------------------------------------------------
+ * gradientMarg()
+ * Normalized gradient for gravity and magnetic field
+ *--------------------------------------------------------------------*/
+
+void MadgwickFilter::gradientMarg(const double *a, const double *m, double *step) const
+{
+  double q0 = q[0], q1 = q[1], q2 = q[2], q3 = q[3];
+
+  // magnetic field in the earth frame, reduced to a north and a down component
+  double hx = m[0] * (q0 * q0 + q1 * q1 - q2 * q2 - q3 * q3) + 2.0 * m[1] * (q1 * q2 - q0 * q3) +
+    2.0 * m[2] * (q1 * q3 + q0 * q2);
+  double hy = 2.0 * m[0] * (q1 * q2 + q0 * q3) + m[1] * (q0 * q0 - q1 * q1 + q2 * q2 - q3 * q3) +
+    2.0 * m[2] * (q2 * q3 - q0 * q1);
+  double bx = sqrt(hx * hx + hy * hy);
+  double bz = 2.0 * m[0] * (q1 * q3 - q0 * q2) + 2.0 * m[1] * (q2 * q3 + q0 * q1) +
+    m[2] * (q0 * q0 - q1 * q1 - q2 * q2 + q3 * q3);
+
+  // objective: gravity and field rotated into the sensor frame minus the measured ones
+  double f0 = 2.0 * (q1 * q3 - q0 * q2) - a[0];
+  double f1 = 2.0 * (q0 * q1 + q2 * q3) - a[1];
+  double f2 = 2.0 * (0.5 - q1 * q1 - q2 * q2) - a[2];
+  double f3 = 2.0 * bx * (0.5 - q2 * q2 - q3 * q3) + 2.0 * bz * (q1 * q3 - q0 * q2) - m[0];
+  double f4 = 2.0 * bx * (q1 * q2 - q0 * q3) + 2.0 * bz * (q0 * q1 + q2 * q3) - m[1];
+  double f5 = 2.0 * bx * (q0 * q2 + q1 * q3) + 2.0 * bz * (0.5 - q1 * q1 - q2 * q2) - m[2];
+
+  // transposed jacobian times objective
+  step[0] = -2.0 * q2 * f0 + 2.0 * q1 * f1
+    - 2.0 * bz * q2 * f3 + 2.0 * (-bx * q3 + bz * q1) * f4 + 2.0 * bx * q2 * f5;
+  step[1] = 2.0 * q3 * f0 + 2.0 * q0 * f1 - 4.0 * q1 * f2
+    + 2.0 * bz * q3 * f3 + 2.0 * (bx * q2 + bz * q0) * f4 + 2.0 * (bx * q3 - 2.0 * bz * q1) * f5;
+  step[2] = -2.0 * q0 * f0 + 2.0 * q3 * f1 - 4.0 * q2 * f2
+    + 2.0 * (-2.0 * bx * q2 - bz * q0) * f3 + 2.0 * (bx * q1 + bz * q3) * f4 + 2.0 * (bx * q0 - 2.0 * bz * q2) * f5;
+  step[3] = 2.0 * q1 * f0 + 2.0 * q2 * f1
+    + 2.0 * (-2.0 * bx * q3 + bz * q1) * f3 + 2.0 * (-bx * q0 + bz * q2) * f4 + 2.0 * bx * q1 * f5;
+
+  double norm = sqrt(step[0] * step[0] + step[1] * step[1] + step[2] * step[2] + step[3] * step[3]);
+  if (norm > 0.0)
+    for (int i = 0; i < 4; i++)
+      step[i] /= norm;
+}
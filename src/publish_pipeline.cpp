@@ -0,0 +1,194 @@
+#include <pthread.h>
+#include <sched.h>
+#include <string.h>
+#include "publish_pipeline.h"
+
+/*----------------------------------------------------------------------
+ * PublishPipeline()
+ * Constructor
+ *--------------------------------------------------------------------*/
+
+PublishPipeline::PublishPipeline()
+{
+  running = false;
+  stopping = false;
+  capacity = 0;
+  next = 0;
+  count = 0;
+  dropped = 0;
+  sched_priority = 0;
+  sched_cpu = -1;
+}
+
+/*----------------------------------------------------------------------
+ * ~PublishPipeline()
+ * Destructor
+ *--------------------------------------------------------------------*/
+
+PublishPipeline::~PublishPipeline()
+{
+  stop();
+}
+
+/*----------------------------------------------------------------------
+ * start()
+ * Start the publisher thread
+ *--------------------------------------------------------------------*/
+
+void PublishPipeline::start(size_t capacity)
+{
+  if (running || capacity == 0)
+    return;
+
+  this->capacity = capacity;
+  stopping = false;
+  dropped = 0;
+  next = 0;
+  count = 0;
+  channels.clear();
+  running = true;
+  worker = std::thread(&PublishPipeline::run, this);
+
+  if ((sched_priority > 0 || sched_cpu >= 0) && !applyScheduling())
+    ROS_WARN_STREAM("Could not set priority " << sched_priority << " and cpu " << sched_cpu
+      << " of the publish thread, it runs with the default scheduling");
+}
+
+/*----------------------------------------------------------------------
+ * applyScheduling()
+ * Set the priority and cpu of the publisher thread
+ *--------------------------------------------------------------------*/
+
+bool PublishPipeline::applyScheduling()
+{
+  bool applied = true;
+
+  if (sched_priority > 0)
+  {
+    struct sched_param param;
+    memset(&param, 0, sizeof(param));
+    param.sched_priority = sched_priority;
+    applied = (pthread_setschedparam(worker.native_handle(), SCHED_FIFO, &param) == 0);
+  }
+
+  if (sched_cpu >= 0)
+  {
+#ifdef __linux__
+    cpu_set_t cpus;
+    CPU_ZERO(&cpus);
+    CPU_SET(sched_cpu, &cpus);
+    applied = (pthread_setaffinity_np(worker.native_handle(), sizeof(cpus), &cpus) == 0) && applied;
+#else
+    applied = false;
+#endif
+  }
+
+  return applied;
+}
+
+/*----------------------------------------------------------------------
+ * stop()
+ * Publish the pending messages and stop the thread
+ *--------------------------------------------------------------------*/
+
+void PublishPipeline::stop()
+{
+  if (!running)
+    return;
+
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    stopping = true;
+  }
+  cond.notify_one();
+  worker.join();
+  running = false;
+
+  for (size_t i = 0; i < channels.size(); i++)
+    delete channels[i];
+  channels.clear();
+
+  if (dropped > 0)
+    ROS_WARN_STREAM("Publish pipeline dropped " << dropped << " messages");
+}
+
+/*----------------------------------------------------------------------
+ * getDropped()
+ * Messages dropped because the ring of their publisher was full
+ *--------------------------------------------------------------------*/
+
+uint64_t PublishPipeline::getDropped()
+{
+  std::lock_guard<std::mutex> lock(mutex);
+  return dropped;
+}
+
+/*----------------------------------------------------------------------
+ * findChannel()
+ * Channel of a publisher, NULL if it has none yet
+ *--------------------------------------------------------------------*/
+
+PublishPipeline::Channel *PublishPipeline::findChannel(const ros::Publisher &pub)
+{
+  for (size_t i = 0; i < channels.size(); i++)
+  {
+    if (channels[i]->pub == pub)
+      return channels[i];
+  }
+  return NULL;
+}
+
+/*----------------------------------------------------------------------
+ * append()
+ * Slot for a new message of a channel, drop its oldest if it is full
+ *--------------------------------------------------------------------*/
+
+size_t PublishPipeline::append(Channel *channel)
+{
+  if (channel->count == capacity)
+  {
+    // the new message takes the slot of the oldest
+    channel->head = (channel->head + 1) % capacity;
+    channel->count--;
+    count--;
+    dropped++;
+  }
+  channel->count++;
+  count++;
+  return (channel->head + channel->count - 1) % capacity;
+}
+
+/*----------------------------------------------------------------------
+ * run()
+ * Publisher thread, takes the oldest message of the channels in turns
+ *--------------------------------------------------------------------*/
+
+void PublishPipeline::run()
+{
+  Channel *channel;
+
+  for (;;)
+  {
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      while (count == 0 && !stopping)
+        cond.wait(lock);
+      if (count == 0)
+        return;
+
+      // the channel after the last one served with a pending message
+      while (channels[next % channels.size()]->count == 0)
+        next++;
+      channel = channels[next % channels.size()];
+      next = (next + 1) % channels.size();
+
+      channel->take();
+      channel->head = (channel->head + 1) % capacity;
+      channel->count--;
+      count--;
+    }
+
+    // publish without the lock, the loop keeps filling the rings
+    channel->publishTaken();
+  }
+}
@@ -0,0 +1,244 @@
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include "range_aggregator.h"
+
+/*----------------------------------------------------------------------
+ * RangeAggregator()
+ * Constructor
+ *--------------------------------------------------------------------*/
+
+RangeAggregator::RangeAggregator()
+{
+  scan_resolution = M_PI / 180.0;
+  cloud_seq = 0;
+  scan_seq = 0;
+  fresh_count = 0;
+}
+
+/*----------------------------------------------------------------------
+ * init()
+ * Set frame and scan resolution, remove the members
+ *--------------------------------------------------------------------*/
+
+void RangeAggregator::init(const std::string &frame, double scan_resolution)
+{
+  if (scan_resolution <= 0.0 || scan_resolution > M_PI)
+    scan_resolution = M_PI / 180.0;
+
+  this->frame = frame;
+  this->scan_resolution = scan_resolution;
+  cloud_seq = 0;
+  scan_seq = 0;
+  fresh_count = 0;
+  members.clear();
+}
+
+/*----------------------------------------------------------------------
+ * addMember()
+ * Add a range sensor with its pose
+ *--------------------------------------------------------------------*/
+
+void RangeAggregator::addMember(const std::string &uid, double x, double y, double z,
+  double roll, double pitch, double yaw)
+{
+  Member member;
+  double cr = cos(roll), sr = sin(roll);
+  double cp = cos(pitch), sp = sin(pitch);
+  double cy = cos(yaw), sy = sin(yaw);
+
+  member.uid = uid;
+  member.position[0] = x;
+  member.position[1] = y;
+  member.position[2] = z;
+
+  // R = Rz(yaw) * Ry(pitch) * Rx(roll)
+  double *m = member.rotation;
+  m[0] = cy * cp;
+  m[1] = cy * sp * sr - sy * cr;
+  m[2] = cy * sp * cr + sy * sr;
+  m[3] = sy * cp;
+  m[4] = sy * sp * sr + cy * cr;
+  m[5] = sy * sp * cr - cy * sr;
+  m[6] = -sp;
+  m[7] = cp * sr;
+  m[8] = cp * cr;
+
+  member.fresh = false;
+  member.range = 0.0;
+  member.min_range = 0.0;
+  member.max_range = 0.0;
+  member.field_of_view = 0.0;
+
+  members.push_back(member);
+}
+
+/*----------------------------------------------------------------------
+ * update()
+ * Store a reading
+ *--------------------------------------------------------------------*/
+
+bool RangeAggregator::update(const std::string &uid, const sensor_msgs::Range &range)
+{
+  for (size_t i = 0; i < members.size(); i++)
+  {
+    Member &member = members[i];
+    if (member.uid != uid)
+      continue;
+
+    if (!member.fresh)
+      fresh_count++;
+    member.fresh = true;
+    member.stamp = range.header.stamp;
+    member.range = range.range;
+    member.min_range = range.min_range;
+    member.max_range = range.max_range;
+    member.field_of_view = range.field_of_view;
+    return true;
+  }
+  return false;
+}
+
+/*----------------------------------------------------------------------
+ * clearFresh()
+ * Mark all readings as used
+ *--------------------------------------------------------------------*/
+
+void RangeAggregator::clearFresh()
+{
+  for (size_t i = 0; i < members.size(); i++)
+    members[i].fresh = false;
+  fresh_count = 0;
+}
+
+/*----------------------------------------------------------------------
+ * beamPoint()
+ * Point of a beam in the base frame
+ *--------------------------------------------------------------------*/
+
+void RangeAggregator::beamPoint(const Member &member, double r, double a, double *p) const
+{
+  double s[3] = {r * cos(a), r * sin(a), 0.0};
+  const double *m = member.rotation;
+
+  for (int i = 0; i < 3; i++)
+    p[i] = member.position[i] + m[i * 3] * s[0] + m[i * 3 + 1] * s[1] + m[i * 3 + 2] * s[2];
+}
+
+/*----------------------------------------------------------------------
+ * newestStamp()
+ * Stamp of the newest fresh reading
+ *--------------------------------------------------------------------*/
+
+ros::Time RangeAggregator::newestStamp() const
+{
+  ros::Time newest;
+
+  for (size_t i = 0; i < members.size(); i++)
+  {
+    if (members[i].fresh && members[i].stamp > newest)
+      newest = members[i].stamp;
+  }
+  return newest;
+}
+
+/*----------------------------------------------------------------------
+ * fillCloud()
+ * Point cloud of the fresh readings inside their limits
+ *--------------------------------------------------------------------*/
+
+void RangeAggregator::fillCloud(sensor_msgs::PointCloud2 &cloud)
+{
+  static const char *names[] = {"x", "y", "z"};
+
+  cloud.header.seq = ++cloud_seq;
+  cloud.header.stamp = newestStamp();
+  cloud.header.frame_id = frame;
+
+  if (cloud.fields.size() != 3)
+  {
+    cloud.fields.resize(3);
+    for (int i = 0; i < 3; i++)
+    {
+      cloud.fields[i].name = names[i];
+      cloud.fields[i].offset = i * sizeof(float);
+      cloud.fields[i].datatype = sensor_msgs::PointField::FLOAT32;
+      cloud.fields[i].count = 1;
+    }
+  }
+  cloud.height = 1;
+  cloud.is_bigendian = false;
+  cloud.is_dense = true;
+  cloud.point_step = 3 * sizeof(float);
+  // resize keeps the capacity of the last cycle
+  cloud.data.resize(members.size() * cloud.point_step);
+
+  uint32_t count = 0;
+  for (size_t i = 0; i < members.size(); i++)
+  {
+    const Member &member = members[i];
+    if (!member.fresh || member.range < member.min_range || member.range > member.max_range)
+      continue;
+
+    double p[3];
+    float point[3];
+    beamPoint(member, member.range, 0.0, p);
+    for (int k = 0; k < 3; k++)
+      point[k] = p[k];
+    memcpy(&cloud.data[count * cloud.point_step], point, sizeof(point));
+    count++;
+  }
+
+  cloud.width = count;
+  cloud.row_step = count * cloud.point_step;
+  cloud.data.resize(cloud.row_step);
+}
+
+/*----------------------------------------------------------------------
+ * fillScan()
+ * Laser scan of the fresh readings inside their limits
+ *--------------------------------------------------------------------*/
+
+void RangeAggregator::fillScan(sensor_msgs::LaserScan &scan)
+{
+  int bins = (int)round(2.0 * M_PI / scan_resolution);
+  double increment = 2.0 * M_PI / bins;
+
+  scan.header.seq = ++scan_seq;
+  scan.header.stamp = newestStamp();
+  scan.header.frame_id = frame;
+  scan.angle_min = -M_PI;
+  scan.angle_max = -M_PI + (bins - 1) * increment;
+  scan.angle_increment = increment;
+  scan.time_increment = 0.0;
+  scan.scan_time = 0.0;
+  // distances are from the base origin, the sensors sit off it
+  scan.range_min = 0.0;
+  scan.range_max = 0.0;
+  scan.ranges.assign(bins, std::numeric_limits<float>::infinity());
+  scan.intensities.clear();
+
+  for (size_t i = 0; i < members.size(); i++)
+  {
+    const Member &member = members[i];
+    double reach = member.max_range + hypot(member.position[0], member.position[1]);
+    if (reach > scan.range_max)
+      scan.range_max = reach;
+    if (!member.fresh || member.range < member.min_range || member.range > member.max_range)
+      continue;
+
+    // walk the arc of the cone at half the bin width, so no bin is skipped
+    int steps = (int)ceil(2.0 * member.field_of_view / increment) + 1;
+    for (int k = 0; k < steps; k++)
+    {
+      double a = (steps > 1) ? -member.field_of_view / 2.0 + k * member.field_of_view / (steps - 1) : 0.0;
+      double p[3];
+      beamPoint(member, member.range, a, p);
+
+      float distance = hypot(p[0], p[1]);
+      int bin = (int)floor((atan2(p[1], p[0]) + M_PI) / increment + 0.5) % bins;
+      if (distance < scan.ranges[bin])
+        scan.ranges[bin] = distance;
+    }
+  }
+}
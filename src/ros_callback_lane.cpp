@@ -0,0 +1,123 @@
+#include "ros_callback_lane.h"
+
+//! callbacks dispatched per drain
+static const int DRAIN_BATCH_SIZE = 32;
+
+/*----------------------------------------------------------------------
+ * call()
+ * Drain the lane from a spinner thread
+ *--------------------------------------------------------------------*/
+
+ros::CallbackInterface::CallResult RosCallbackLane::Drain::call()
+{
+  owner->drain();
+  return Success;
+}
+
+/*----------------------------------------------------------------------
+ * RosCallbackLane()
+ * Constructor
+ *--------------------------------------------------------------------*/
+
+RosCallbackLane::RosCallbackLane()
+{
+  ipcon = NULL;
+  lane = 0;
+  queue = NULL;
+  pending = false;
+}
+
+/*----------------------------------------------------------------------
+ * ~RosCallbackLane()
+ * Destructor
+ *--------------------------------------------------------------------*/
+
+RosCallbackLane::~RosCallbackLane()
+{
+  stop();
+}
+
+/*----------------------------------------------------------------------
+ * start()
+ * Dispatch a lane of the bindings from a callback queue
+ *--------------------------------------------------------------------*/
+
+bool RosCallbackLane::start(IPConnection *ipcon, uint8_t lane, ros::CallbackQueueInterface *queue)
+{
+  if (this->queue != NULL || queue == NULL)
+    return false;
+
+  this->ipcon = ipcon;
+  this->lane = lane;
+  this->queue = queue;
+  callback.reset(new Drain(this));
+  pending = false;
+
+  if (ipcon_set_callback_lane_external(ipcon, lane, notify, this) != E_OK)
+  {
+    this->queue = NULL;
+    callback.reset();
+    return false;
+  }
+  return true;
+}
+
+/*----------------------------------------------------------------------
+ * stop()
+ * Hand the lane back to the bindings, also while connected
+ *--------------------------------------------------------------------*/
+
+void RosCallbackLane::stop()
+{
+  if (queue == NULL)
+    return;
+
+  {
+    // the bindings hand the callbacks that are left to lane 0, a drain that
+    // is running dispatches its batch before them
+    std::lock_guard<std::mutex> lock(mutex);
+    // notify is not called anymore once this returns
+    ipcon_set_callback_lane_external(ipcon, lane, NULL, NULL);
+  }
+  // waits for a drain that is running, a later one finds the lane empty
+  queue->removeByID((uint64_t)this);
+  queue = NULL;
+  callback.reset();
+}
+
+/*----------------------------------------------------------------------
+ * notify()
+ * Wake the callback queue, called from the receive thread
+ *--------------------------------------------------------------------*/
+
+void RosCallbackLane::notify(void *user_data)
+{
+  static_cast<RosCallbackLane*>(user_data)->schedule();
+}
+
+/*----------------------------------------------------------------------
+ * schedule()
+ * Queue a drain unless one is pending
+ *--------------------------------------------------------------------*/
+
+void RosCallbackLane::schedule()
+{
+  if (!pending.exchange(true))
+    queue->addCallback(callback, (uint64_t)this);
+}
+
+/*----------------------------------------------------------------------
+ * drain()
+ * Dispatch one batch of the lane
+ *--------------------------------------------------------------------*/
+
+void RosCallbackLane::drain()
+{
+  std::lock_guard<std::mutex> lock(mutex);
+
+  // packets queued from here on queue the next drain
+  pending = false;
+
+  if (ipcon_dispatch_callback_lane(ipcon, lane, DRAIN_BATCH_SIZE) == DRAIN_BATCH_SIZE)
+    schedule();
+}
@@ -0,0 +1,170 @@
+#include <cmath>
+#include <algorithm>
+#include "sample_filter.h"
+
+// scales the median absolute deviation to the standard deviation of a normal distribution
+#define SAMPLE_FILTER_MAD_SCALE 1.4826
+
+/*----------------------------------------------------------------------
+ * SampleFilter()
+ * Constructor
+ *--------------------------------------------------------------------*/
+
+SampleFilter::SampleFilter()
+{
+  type = FilterType::NONE;
+  window = 1;
+  channels = 1;
+  alpha = 1.0;
+  hampel_k = 3.0;
+  reset();
+}
+
+/*----------------------------------------------------------------------
+ * init()
+ * Set filter type and parameters, allocate the buffers
+ *--------------------------------------------------------------------*/
+
+void SampleFilter::init(FilterType type, unsigned int window, unsigned int channels,
+  double alpha, double hampel_k)
+{
+  if (window == 0)
+    window = 1;
+  if (channels == 0)
+    channels = 1;
+  if (alpha <= 0.0 || alpha > 1.0)
+    alpha = 0.2;
+  if (hampel_k <= 0.0)
+    hampel_k = 3.0;
+
+  this->type = type;
+  this->window = window;
+  this->channels = channels;
+  this->alpha = alpha;
+  this->hampel_k = hampel_k;
+
+  history.assign(window * channels, 0.0);
+  state.assign(channels, 0.0);
+  scratch.assign(window, 0.0);
+  reset();
+}
+
+/*----------------------------------------------------------------------
+ * reset()
+ * Forget the history
+ *--------------------------------------------------------------------*/
+
+void SampleFilter::reset()
+{
+  head = 0;
+  count = 0;
+  rejected = 0;
+}
+
+/*----------------------------------------------------------------------
+ * update()
+ * Filter a sample in place
+ *--------------------------------------------------------------------*/
+
+void SampleFilter::update(double *values)
+{
+  if (type == FilterType::NONE)
+    return;
+
+  if (type == FilterType::IIR)
+  {
+    // the first sample initializes the state, no step from 0
+    for (unsigned int c = 0; c < channels; c++)
+    {
+      if (count == 0)
+        state[c] = values[c];
+      else
+        state[c] += alpha * (values[c] - state[c]);
+      values[c] = state[c];
+    }
+    count = 1;
+    return;
+  }
+
+  for (unsigned int c = 0; c < channels; c++)
+    history[c * window + head] = values[c];
+  head = (head + 1) % window;
+  if (count < window)
+    count++;
+
+  for (unsigned int c = 0; c < channels; c++)
+  {
+    // the ring order does not matter for any of the window statistics
+    const double *ring = &history[c * window];
+    double *work = &scratch[0];
+
+    switch (type)
+    {
+      case FilterType::MEAN:
+      {
+        double sum = 0.0;
+        for (unsigned int i = 0; i < count; i++)
+          sum += ring[i];
+        values[c] = sum / count;
+      }
+      break;
+      case FilterType::MEDIAN:
+        std::copy(ring, ring + count, work);
+        values[c] = median(work, count);
+      break;
+      case FilterType::HAMPEL:
+      {
+        std::copy(ring, ring + count, work);
+        double center = median(work, count);
+        for (unsigned int i = 0; i < count; i++)
+          work[i] = std::fabs(ring[i] - center);
+        double mad = SAMPLE_FILTER_MAD_SCALE * median(work, count);
+        if (std::fabs(values[c] - center) > hampel_k * mad)
+        {
+          values[c] = center;
+          rejected++;
+        }
+      }
+      break;
+      default:
+      break;
+    }
+  }
+}
+
+/*----------------------------------------------------------------------
+ * median()
+ * Median of count values, average of the two middle ones if count is even
+ *--------------------------------------------------------------------*/
+
+double SampleFilter::median(double *data, unsigned int count)
+{
+  unsigned int mid = count / 2;
+
+  std::nth_element(data, data + mid, data + count);
+  if (count & 1)
+    return data[mid];
+  return (data[mid] + *std::max_element(data, data + mid)) / 2.0;
+}
+
+/*----------------------------------------------------------------------
+ * parseType()
+ * Filter type from its config name
+ *--------------------------------------------------------------------*/
+
+bool SampleFilter::parseType(const std::string &name, FilterType &type)
+{
+  if (name == "none")
+    type = FilterType::NONE;
+  else if (name == "mean")
+    type = FilterType::MEAN;
+  else if (name == "median")
+    type = FilterType::MEDIAN;
+  else if (name == "hampel")
+    type = FilterType::HAMPEL;
+  else if (name == "iir")
+    type = FilterType::IIR;
+  else
+    return false;
+  return true;
+}
@@ -0,0 +1,141 @@
+#include "ros/ros.h"
+#include "bricklet_distance_ir.h"
+#include "bricklet_distance_us.h"
+#include "sensor_config.h"
+
+/*----------------------------------------------------------------------
+ * SensorConfig()
+ * Defaults for a device type
+ *--------------------------------------------------------------------*/
+
+SensorConfig::SensorConfig(uint16_t type)
+{
+  covariance_window = -1;
+  fuse = false;
+  rate = 0.0;
+
+  pose.x = 0.0;
+  pose.y = 0.0;
+  pose.z = 0.0;
+  pose.roll = 0.0;
+  pose.pitch = 0.0;
+  pose.yaw = 0.0;
+
+  filter.type = FilterType::NONE;
+  filter.window = 5;
+  filter.alpha = 0.2;
+  filter.k = 3.0;
+
+  queue.policy = IPCON_QUEUE_POLICY_KEEP_ALL;
+  queue.depth = 1;
+
+  range.aggregate = true;
+  if (type == DISTANCE_IR_DEVICE_IDENTIFIER)
+  {
+    range.field_of_view = 0.01;
+    range.min_range = 0.03;
+    range.max_range = 0.4;
+  }
+  else
+  {
+    range.field_of_view = 0.2617;
+    range.min_range = 0.02;
+    range.max_range = 4.0;
+  }
+}
+
+/*----------------------------------------------------------------------
+ * parseQueuePolicy()
+ * Queue policy from its name in conf.yaml
+ *--------------------------------------------------------------------*/
+
+static bool parseQueuePolicy(const std::string &name, uint8_t &policy)
+{
+  if (name == "all")
+    policy = IPCON_QUEUE_POLICY_KEEP_ALL;
+  else if (name == "drop_oldest")
+    policy = IPCON_QUEUE_POLICY_DROP_OLDEST;
+  else if (name == "latest")
+    policy = IPCON_QUEUE_POLICY_CONFLATE;
+  else
+    return false;
+  return true;
+}
+
+/*----------------------------------------------------------------------
+ * compile()
+ * Typed config from the params of conf.yaml
+ *--------------------------------------------------------------------*/
+
+SensorConfig SensorConfig::compile(const std::map<std::string, SensorParam> &params, uint16_t type,
+  SensorClass sclass, const std::string &uid)
+{
+  SensorConfig config(type);
+  std::map<std::string, SensorParam>::const_iterator it;
+
+  for (it = params.begin(); it != params.end(); ++it)
+  {
+    const std::string &name = it->first;
+    const SensorParam &param = it->second;
+    bool number = (param.type == ParamType::INT || param.type == ParamType::DOUBLE);
+    bool valid = true;
+
+    if (name == "topic")
+      valid = (param.type == ParamType::STRING); // used at enumeration
+    else if (name == "frame_id" && (valid = (param.type == ParamType::STRING)))
+      config.frame_id = param.value_str;
+    else if (name == "fow" && (valid = number))
+      config.range.field_of_view = param.getNumber(0.0);
+    else if (name == "min" && (valid = number))
+      config.range.min_range = param.getNumber(0.0);
+    else if (name == "max" && (valid = number))
+      config.range.max_range = param.getNumber(0.0);
+    else if (name == "aggregate" && (valid = (param.type == ParamType::BOOL || param.type == ParamType::INT)))
+      config.range.aggregate = param.getBool(true);
+    else if (name == "filter" && (valid = (param.type == ParamType::STRING)))
+      valid = SampleFilter::parseType(param.value_str, config.filter.type);
+    else if (name == "filter_window" && (valid = (param.type == ParamType::INT && param.value_int > 0)))
+      config.filter.window = param.value_int;
+    else if (name == "filter_alpha" && (valid = number))
+      config.filter.alpha = param.getNumber(0.2);
+    else if (name == "filter_k" && (valid = number))
+      config.filter.k = param.getNumber(3.0);
+    else if (name == "covariance_window" && (valid = (param.type == ParamType::INT)))
+      config.covariance_window = param.value_int;
+    else if (name == "rate" && (valid = (number && param.getNumber(0.0) >= 0.0)))
+      config.rate = param.getNumber(0.0);
+    else if (name == "queue" && (valid = (param.type == ParamType::STRING)))
+      valid = parseQueuePolicy(param.value_str, config.queue.policy);
+    else if (name == "queue_depth" && (valid = (param.type == ParamType::INT && param.value_int > 0 &&
+      param.value_int <= 0xFFFF)))
+      config.queue.depth = param.value_int;
+    else if (name == "fuse" && (valid = (param.type == ParamType::BOOL || param.type == ParamType::INT)))
+      config.fuse = param.getBool(false);
+    else if (name == "x" && (valid = number))
+      config.pose.x = param.getNumber(0.0);
+    else if (name == "y" && (valid = number))
+      config.pose.y = param.getNumber(0.0);
+    else if (name == "z" && (valid = number))
+      config.pose.z = param.getNumber(0.0);
+    else if (name == "roll" && (valid = number))
+      config.pose.roll = param.getNumber(0.0);
+    else if (name == "pitch" && (valid = number))
+      config.pose.pitch = param.getNumber(0.0);
+    else if (name == "yaw" && (valid = number))
+      config.pose.yaw = param.getNumber(0.0);
+    else if (valid)
+      ROS_WARN_STREAM("Unknown parameter " << name << " for " << uid);
+
+    if (!valid)
+      ROS_WARN_STREAM("Invalid value of parameter " << name << " for " << uid);
+  }
+
+  if (config.filter.type != FilterType::NONE && sclass != SensorClass::RANGE && sclass != SensorClass::LIGHT &&
+      sclass != SensorClass::HUMIDITY && sclass != SensorClass::TEMPERATURE)
+  {
+    ROS_WARN_STREAM("Filter is only supported for range, light, humidity and temperature, not for " << uid);
+    config.filter.type = FilterType::NONE;
+  }
+
+  return config;
+}
@@ -0,0 +1,133 @@
+#include <thread>
+#include <chrono>
+#include "sensor_device.h"
+#include "sensor_registry.h"
+
+/*----------------------------------------------------------------------
+ * Reader()
+ * Pin the current snapshot
+ *--------------------------------------------------------------------*/
+
+SensorRegistry::Reader::Reader(SensorRegistry &registry) : registry(registry)
+{
+  // count in the current phase, retry if a writer flipped it meanwhile
+  for (;;)
+  {
+    phase = registry.epoch.load() & 1;
+    registry.readers[phase]++;
+    if ((registry.epoch.load() & 1) == phase)
+      break;
+    registry.readers[phase]--;
+  }
+  snapshot = registry.current.load();
+}
+
+/*----------------------------------------------------------------------
+ * ~Reader()
+ * Release the snapshot
+ *--------------------------------------------------------------------*/
+
+SensorRegistry::Reader::~Reader()
+{
+  registry.readers[phase]--;
+}
+
+/*----------------------------------------------------------------------
+ * SensorRegistry()
+ * Constructor
+ *--------------------------------------------------------------------*/
+
+SensorRegistry::SensorRegistry()
+{
+  current = new Snapshot();
+  epoch = 0;
+  readers[0] = 0;
+  readers[1] = 0;
+}
+
+/*----------------------------------------------------------------------
+ * ~SensorRegistry()
+ * Destructor
+ *--------------------------------------------------------------------*/
+
+SensorRegistry::~SensorRegistry()
+{
+  delete current.load();
+}
+
+/*----------------------------------------------------------------------
+ * publish()
+ * Swap in a new snapshot, free the old one after its readers left
+ *--------------------------------------------------------------------*/
+
+void SensorRegistry::publish(Snapshot *next)
+{
+  Snapshot *old = current.exchange(next);
+
+  // readers that may hold old counted themselves in this phase,
+  // new readers enter the next phase and only see next
+  unsigned int phase = epoch.fetch_add(1) & 1;
+  while (readers[phase].load() > 0)
+    std::this_thread::sleep_for(std::chrono::microseconds(100));
+
+  delete old;
+}
+
+/*----------------------------------------------------------------------
+ * add()
+ * Add a sensor after its config is set
+ *--------------------------------------------------------------------*/
+
+void SensorRegistry::add(SensorDevice *sensor)
+{
+  std::lock_guard<std::mutex> lock(write_mutex);
+  Snapshot *next = new Snapshot(*current.load());
+  Slot slot;
+
+  slot.entry = sensor->getEntry();
+  slot.sensor = sensor;
+  slot.period = (sensor->getConfig().rate > 0.0) ? 1.0 / sensor->getConfig().rate : 0.0;
+
+  next->slots.push_back(slot);
+  next->devices.push_back(sensor);
+  publish(next);
+}
+
+/*----------------------------------------------------------------------
+ * find()
+ * Sensor of a device
+ *--------------------------------------------------------------------*/
+
+SensorDevice* SensorRegistry::find(const std::string &uid, uint16_t type)
+{
+  Reader reader(*this);
+
+  for (iterator it = reader.begin(); it != reader.end(); ++it)
+  {
+    if ((*it)->getType() == type && (*it)->getUID() == uid)
+      return *it;
+  }
+  return NULL;
+}
+
+/*----------------------------------------------------------------------
+ * clear()
+ * Remove all sensors
+ *--------------------------------------------------------------------*/
+
+void SensorRegistry::clear()
+{
+  std::lock_guard<std::mutex> lock(write_mutex);
+  publish(new Snapshot());
+}
+
+/*----------------------------------------------------------------------
+ * size()
+ * Number of sensors right now
+ *--------------------------------------------------------------------*/
+
+size_t SensorRegistry::size()
+{
+  Reader reader(*this);
+  return reader.size();
+}
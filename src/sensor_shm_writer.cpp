@@ -0,0 +1,143 @@
+#include <ctime>
+#include "sensor_shm_writer.h"
+
+/*----------------------------------------------------------------------
+ * SensorShmWriter()
+ * Constructor
+ *--------------------------------------------------------------------*/
+
+SensorShmWriter::SensorShmWriter()
+{
+  base = NULL;
+  size = 0;
+}
+
+/*----------------------------------------------------------------------
+ * ~SensorShmWriter()
+ * Destructor
+ *--------------------------------------------------------------------*/
+
+SensorShmWriter::~SensorShmWriter()
+{
+  destroy();
+}
+
+/*----------------------------------------------------------------------
+ * create()
+ * Create and map the segment
+ *--------------------------------------------------------------------*/
+
+bool SensorShmWriter::create(const std::string &name, uint32_t sensor_count, uint32_t ring_size)
+{
+  destroy();
+
+  if (ring_size == 0)
+    ring_size = 1;
+
+  // readers of an old segment keep their mapping, new readers get this one
+  shm_unlink(name.c_str());
+  int fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0644);
+  if (fd < 0)
+    return false;
+
+  size_t new_size = sensorShmSize(sensor_count, ring_size);
+  if (ftruncate(fd, new_size) < 0)
+  {
+    close(fd);
+    shm_unlink(name.c_str());
+    return false;
+  }
+
+  void *addr = mmap(NULL, new_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if (addr == MAP_FAILED)
+  {
+    shm_unlink(name.c_str());
+    return false;
+  }
+
+  // ftruncate zero fills, so all slots and heads start at 0
+  this->name = name;
+  base = (uint8_t*)addr;
+  size = new_size;
+
+  SensorShmHeader *header = (SensorShmHeader*)base;
+  header->sensor_count = sensor_count;
+  header->ring_size = ring_size;
+  header->sensor_stride = sizeof(SensorShmSensor) + ring_size * sizeof(SensorShmSlot);
+  header->generation = (uint32_t)time(NULL) ^ ((uint32_t)getpid() << 16);
+  header->version = SENSOR_SHM_VERSION;
+  std::atomic_thread_fence(std::memory_order_release);
+  header->magic = SENSOR_SHM_MAGIC;
+
+  return true;
+}
+
+/*----------------------------------------------------------------------
+ * destroy()
+ * Unmap and remove the segment
+ *--------------------------------------------------------------------*/
+
+void SensorShmWriter::destroy()
+{
+  if (base == NULL)
+    return;
+
+  munmap(base, size);
+  shm_unlink(name.c_str());
+  base = NULL;
+  size = 0;
+}
+
+/*----------------------------------------------------------------------
+ * getSensor()
+ * Block of a sensor
+ *--------------------------------------------------------------------*/
+
+SensorShmSensor *SensorShmWriter::getSensor(uint32_t index)
+{
+  SensorShmHeader *header = (SensorShmHeader*)base;
+  return (SensorShmSensor*)(base + sizeof(SensorShmHeader) + index * header->sensor_stride);
+}
+
+/*----------------------------------------------------------------------
+ * setSensor()
+ * Set the description of a sensor
+ *--------------------------------------------------------------------*/
+
+void SensorShmWriter::setSensor(uint32_t index, const std::string &uid, const std::string &topic,
+  uint16_t type, uint8_t sensor_class)
+{
+  SensorShmSensor *sensor = getSensor(index);
+
+  strncpy(sensor->uid, uid.c_str(), SENSOR_SHM_UID_SIZE);
+  strncpy(sensor->topic, topic.c_str(), SENSOR_SHM_TOPIC_SIZE - 1);
+  sensor->type = type;
+  sensor->sensor_class = sensor_class;
+}
+
+/*----------------------------------------------------------------------
+ * write()
+ * Publish a sample
+ *--------------------------------------------------------------------*/
+
+void SensorShmWriter::write(uint32_t index, uint64_t stamp, const double *values, uint32_t count)
+{
+  if (base == NULL)
+    return;
+
+  SensorShmHeader *header = (SensorShmHeader*)base;
+  SensorShmSensor *sensor = getSensor(index);
+  SensorShmSlot *ring = (SensorShmSlot*)(sensor + 1);
+  uint64_t number = sensor->head + 1;
+
+  if (count > SENSOR_SHM_MAX_VALUES)
+    count = SENSOR_SHM_MAX_VALUES;
+
+  sensorShmWriteSlot(&ring[(number - 1) % header->ring_size], number, stamp, values, count);
+  sensorShmWriteSlot(&sensor->latest, number, stamp, values, count);
+
+  // readers of the ring trust every slot up to head
+  std::atomic_thread_fence(std::memory_order_release);
+  sensor->head = number;
+}
@@ -0,0 +1,152 @@
+#include <cmath>
+#include "timestamp_filter.h"
+
+// gaps larger than this many periods resync the loop
+#define TIMESTAMP_FILTER_MAX_GAP 50
+// consecutive late samples before the phase slips by whole periods
+#define TIMESTAMP_FILTER_SLIP_COUNT 3
+
+/*----------------------------------------------------------------------
+ * TimestampFilter()
+ * Constructor
+ *--------------------------------------------------------------------*/
+
+TimestampFilter::TimestampFilter()
+{
+  nominal_period = 0.0;
+  alpha = 0.0;
+  beta = 0.0;
+  reset();
+}
+
+/*----------------------------------------------------------------------
+ * init()
+ * Set nominal period and loop gain
+ *--------------------------------------------------------------------*/
+
+void TimestampFilter::init(double nominal_period, double gain)
+{
+  if (gain <= 0.0 || gain >= 1.0)
+    gain = 0.05;
+
+  this->nominal_period = nominal_period;
+  // critically damped alpha-beta loop (Benedict-Bordner)
+  this->alpha = gain;
+  this->beta = gain * gain / (2.0 - gain);
+  reset();
+}
+
+/*----------------------------------------------------------------------
+ * reset()
+ * Forget the loop state
+ *--------------------------------------------------------------------*/
+
+void TimestampFilter::reset()
+{
+  locked = false;
+  late_count = 0;
+  phase = 0.0;
+  period = nominal_period;
+  last_stamp = 0.0;
+  residual_m2 = 0.0;
+  stats = TimestampStats();
+  stats.period = nominal_period;
+}
+
+/*----------------------------------------------------------------------
+ * resync()
+ * Restart the loop at the given arrival time
+ *--------------------------------------------------------------------*/
+
+void TimestampFilter::resync(double arrival)
+{
+  // keep the drift estimate, only the phase is lost
+  phase = (arrival > last_stamp) ? arrival : last_stamp + 1e-9;
+  late_count = 0;
+  locked = true;
+}
+
+/*----------------------------------------------------------------------
+ * update()
+ * Feed an arrival time, returns the de-jittered sample time
+ *--------------------------------------------------------------------*/
+
+ros::Time TimestampFilter::update(const ros::Time &arrival)
+{
+  if (!isEnabled())
+    return arrival;
+
+  double t = arrival.toSec();
+
+  if (!locked)
+  {
+    resync(t);
+    last_stamp = phase;
+    return arrival;
+  }
+
+  double predicted = phase + period;
+  double residual = t - predicted;
+
+  if (residual > TIMESTAMP_FILTER_MAX_GAP * period || t < last_stamp - TIMESTAMP_FILTER_MAX_GAP * period)
+  {
+    stats.resyncs++;
+    resync(t);
+    last_stamp = phase;
+    return ros::Time(phase);
+  }
+
+  // a missed sample shows up as a run of residuals of about one period,
+  // a single late packet does not. slip the phase by whole periods after
+  // a run instead of pulling the loop
+  if (residual > 0.5 * period)
+  {
+    if (++late_count >= TIMESTAMP_FILTER_SLIP_COUNT)
+    {
+      double slips = std::floor(residual / period + 0.5);
+      predicted += slips * period;
+      residual -= slips * period;
+      late_count = 0;
+      stats.slips++;
+    }
+  }
+  else
+  {
+    late_count = 0;
+  }
+
+  // clip outliers, a single late packet must not pull the loop
+  double limit = 0.25 * nominal_period;
+  double correction = residual;
+  if (correction > limit)
+    correction = limit;
+  else if (correction < -limit)
+    correction = -limit;
+
+  phase = predicted + alpha * correction;
+  period += beta * correction;
+
+  // keep the period estimate in a sane range around the nominal period
+  if (period < 0.5 * nominal_period)
+    period = 0.5 * nominal_period;
+  else if (period > 1.5 * nominal_period)
+    period = 1.5 * nominal_period;
+
+  // stamps must be strictly monotonic
+  if (phase <= last_stamp)
+    phase = last_stamp + 1e-9;
+  last_stamp = phase;
+
+  // residual statistics (Welford)
+  stats.samples++;
+  double delta = residual - stats.mean;
+  stats.mean += delta / stats.samples;
+  residual_m2 += delta * (residual - stats.mean);
+  stats.stddev = (stats.samples > 1) ? std::sqrt(residual_m2 / (stats.samples - 1)) : 0.0;
+  if (std::fabs(residual) > stats.max_abs)
+    stats.max_abs = std::fabs(residual);
+  stats.period = period;
+  stats.drift_ppm = (period / nominal_period - 1.0) * 1e6;
+
+  return ros::Time(phase);
+}
@@ -404,9 +404,9 @@ typedef struct {
 
 static void imu_callback_wrapper_acceleration(DevicePrivate *device_p, Packet *packet) {
 	AccelerationCallbackFunction callback_function;
-	void *user_data = device_p->registered_callback_user_data[IMU_CALLBACK_ACCELERATION];
+	void *user_data;
 	AccelerationCallback_ *callback = (AccelerationCallback_ *)packet;
-	*(void **)(&callback_function) = device_p->registered_callbacks[IMU_CALLBACK_ACCELERATION];
+	*(void **)(&callback_function) = device_get_registered_callback(device_p, IMU_CALLBACK_ACCELERATION, &user_data);
 
 	if (callback_function == NULL) {
 		return;
@@ -421,9 +421,9 @@ static void imu_callback_wrapper_acceleration(DevicePrivate *device_p, Packet *p
 
 static void imu_callback_wrapper_magnetic_field(DevicePrivate *device_p, Packet *packet) {
 	MagneticFieldCallbackFunction callback_function;
-	void *user_data = device_p->registered_callback_user_data[IMU_CALLBACK_MAGNETIC_FIELD];
+	void *user_data;
 	MagneticFieldCallback_ *callback = (MagneticFieldCallback_ *)packet;
-	*(void **)(&callback_function) = device_p->registered_callbacks[IMU_CALLBACK_MAGNETIC_FIELD];
+	*(void **)(&callback_function) = device_get_registered_callback(device_p, IMU_CALLBACK_MAGNETIC_FIELD, &user_data);
 
 	if (callback_function == NULL) {
 		return;
@@ -438,9 +438,9 @@ static void imu_callback_wrapper_magnetic_field(DevicePrivate *device_p, Packet
 
 static void imu_callback_wrapper_angular_velocity(DevicePrivate *device_p, Packet *packet) {
 	AngularVelocityCallbackFunction callback_function;
-	void *user_data = device_p->registered_callback_user_data[IMU_CALLBACK_ANGULAR_VELOCITY];
+	void *user_data;
 	AngularVelocityCallback_ *callback = (AngularVelocityCallback_ *)packet;
-	*(void **)(&callback_function) = device_p->registered_callbacks[IMU_CALLBACK_ANGULAR_VELOCITY];
+	*(void **)(&callback_function) = device_get_registered_callback(device_p, IMU_CALLBACK_ANGULAR_VELOCITY, &user_data);
 
 	if (callback_function == NULL) {
 		return;
@@ -455,9 +455,9 @@ static void imu_callback_wrapper_angular_velocity(DevicePrivate *device_p, Packe
 
 static void imu_callback_wrapper_all_data(DevicePrivate *device_p, Packet *packet) {
 	AllDataCallbackFunction callback_function;
-	void *user_data = device_p->registered_callback_user_data[IMU_CALLBACK_ALL_DATA];
+	void *user_data;
 	AllDataCallback_ *callback = (AllDataCallback_ *)packet;
-	*(void **)(&callback_function) = device_p->registered_callbacks[IMU_CALLBACK_ALL_DATA];
+	*(void **)(&callback_function) = device_get_registered_callback(device_p, IMU_CALLBACK_ALL_DATA, &user_data);
 
 	if (callback_function == NULL) {
 		return;
@@ -479,9 +479,9 @@ static void imu_callback_wrapper_all_data(DevicePrivate *device_p, Packet *packe
 
 static void imu_callback_wrapper_orientation(DevicePrivate *device_p, Packet *packet) {
 	OrientationCallbackFunction callback_function;
-	void *user_data = device_p->registered_callback_user_data[IMU_CALLBACK_ORIENTATION];
+	void *user_data;
 	OrientationCallback_ *callback = (OrientationCallback_ *)packet;
-	*(void **)(&callback_function) = device_p->registered_callbacks[IMU_CALLBACK_ORIENTATION];
+	*(void **)(&callback_function) = device_get_registered_callback(device_p, IMU_CALLBACK_ORIENTATION, &user_data);
 
 	if (callback_function == NULL) {
 		return;
@@ -496,9 +496,9 @@ static void imu_callback_wrapper_orientation(DevicePrivate *device_p, Packet *pa
 
 static void imu_callback_wrapper_quaternion(DevicePrivate *device_p, Packet *packet) {
 	QuaternionCallbackFunction callback_function;
-	void *user_data = device_p->registered_callback_user_data[IMU_CALLBACK_QUATERNION];
+	void *user_data;
 	QuaternionCallback_ *callback = (QuaternionCallback_ *)packet;
-	*(void **)(&callback_function) = device_p->registered_callbacks[IMU_CALLBACK_QUATERNION];
+	*(void **)(&callback_function) = device_get_registered_callback(device_p, IMU_CALLBACK_QUATERNION, &user_data);
 
 	if (callback_function == NULL) {
 		return;
@@ -512,6 +512,15 @@ static void imu_callback_wrapper_quaternion(DevicePrivate *device_p, Packet *pac
 	callback_function(callback->x, callback->y, callback->z, callback->w, user_data);
 }
 
+static const DeviceCallbackWrapper imu_callback_wrappers[] = {
+	{IMU_CALLBACK_ACCELERATION, imu_callback_wrapper_acceleration},
+	{IMU_CALLBACK_MAGNETIC_FIELD, imu_callback_wrapper_magnetic_field},
+	{IMU_CALLBACK_ANGULAR_VELOCITY, imu_callback_wrapper_angular_velocity},
+	{IMU_CALLBACK_ALL_DATA, imu_callback_wrapper_all_data},
+	{IMU_CALLBACK_ORIENTATION, imu_callback_wrapper_orientation},
+	{IMU_CALLBACK_QUATERNION, imu_callback_wrapper_quaternion},
+};
+
 void imu_create(IMU *imu, const char *uid, IPConnection *ipcon) {
 	DevicePrivate *device_p;
 
@@ -563,12 +572,8 @@ void imu_create(IMU *imu, const char *uid, IPConnection *ipcon) {
 	device_p->response_expected[IMU_FUNCTION_RESET] = DEVICE_RESPONSE_EXPECTED_FALSE;
 	device_p->response_expected[IMU_FUNCTION_GET_IDENTITY] = DEVICE_RESPONSE_EXPECTED_ALWAYS_TRUE;
 
-	device_p->callback_wrappers[IMU_CALLBACK_ACCELERATION] = imu_callback_wrapper_acceleration;
-	device_p->callback_wrappers[IMU_CALLBACK_MAGNETIC_FIELD] = imu_callback_wrapper_magnetic_field;
-	device_p->callback_wrappers[IMU_CALLBACK_ANGULAR_VELOCITY] = imu_callback_wrapper_angular_velocity;
-	device_p->callback_wrappers[IMU_CALLBACK_ALL_DATA] = imu_callback_wrapper_all_data;
-	device_p->callback_wrappers[IMU_CALLBACK_ORIENTATION] = imu_callback_wrapper_orientation;
-	device_p->callback_wrappers[IMU_CALLBACK_QUATERNION] = imu_callback_wrapper_quaternion;
+	device_set_callback_wrappers(device_p, imu_callback_wrappers,
+	                             sizeof(imu_callback_wrappers) / sizeof(imu_callback_wrappers[0]));
 }
 
 void imu_destroy(IMU *imu) {
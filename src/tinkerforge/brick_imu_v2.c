@@ -442,9 +442,9 @@ typedef struct {
 
 static void imu_v2_callback_wrapper_acceleration(DevicePrivate *device_p, Packet *packet) {
 	AccelerationCallbackFunction callback_function;
-	void *user_data = device_p->registered_callback_user_data[IMU_V2_CALLBACK_ACCELERATION];
+	void *user_data;
 	AccelerationCallback_ *callback = (AccelerationCallback_ *)packet;
-	*(void **)(&callback_function) = device_p->registered_callbacks[IMU_V2_CALLBACK_ACCELERATION];
+	*(void **)(&callback_function) = device_get_registered_callback(device_p, IMU_V2_CALLBACK_ACCELERATION, &user_data);
 
 	if (callback_function == NULL) {
 		return;
@@ -459,9 +459,9 @@ static void imu_v2_callback_wrapper_acceleration(DevicePrivate *device_p, Packet
 
 static void imu_v2_callback_wrapper_magnetic_field(DevicePrivate *device_p, Packet *packet) {
 	MagneticFieldCallbackFunction callback_function;
-	void *user_data = device_p->registered_callback_user_data[IMU_V2_CALLBACK_MAGNETIC_FIELD];
+	void *user_data;
 	MagneticFieldCallback_ *callback = (MagneticFieldCallback_ *)packet;
-	*(void **)(&callback_function) = device_p->registered_callbacks[IMU_V2_CALLBACK_MAGNETIC_FIELD];
+	*(void **)(&callback_function) = device_get_registered_callback(device_p, IMU_V2_CALLBACK_MAGNETIC_FIELD, &user_data);
 
 	if (callback_function == NULL) {
 		return;
@@ -476,9 +476,9 @@ static void imu_v2_callback_wrapper_magnetic_field(DevicePrivate *device_p, Pack
 
 static void imu_v2_callback_wrapper_angular_velocity(DevicePrivate *device_p, Packet *packet) {
 	AngularVelocityCallbackFunction callback_function;
-	void *user_data = device_p->registered_callback_user_data[IMU_V2_CALLBACK_ANGULAR_VELOCITY];
+	void *user_data;
 	AngularVelocityCallback_ *callback = (AngularVelocityCallback_ *)packet;
-	*(void **)(&callback_function) = device_p->registered_callbacks[IMU_V2_CALLBACK_ANGULAR_VELOCITY];
+	*(void **)(&callback_function) = device_get_registered_callback(device_p, IMU_V2_CALLBACK_ANGULAR_VELOCITY, &user_data);
 
 	if (callback_function == NULL) {
 		return;
@@ -493,9 +493,9 @@ static void imu_v2_callback_wrapper_angular_velocity(DevicePrivate *device_p, Pa
 
 static void imu_v2_callback_wrapper_temperature(DevicePrivate *device_p, Packet *packet) {
 	TemperatureCallbackFunction callback_function;
-	void *user_data = device_p->registered_callback_user_data[IMU_V2_CALLBACK_TEMPERATURE];
+	void *user_data;
 	TemperatureCallback_ *callback = (TemperatureCallback_ *)packet;
-	*(void **)(&callback_function) = device_p->registered_callbacks[IMU_V2_CALLBACK_TEMPERATURE];
+	*(void **)(&callback_function) = device_get_registered_callback(device_p, IMU_V2_CALLBACK_TEMPERATURE, &user_data);
 
 	if (callback_function == NULL) {
 		return;
@@ -506,9 +506,9 @@ static void imu_v2_callback_wrapper_temperature(DevicePrivate *device_p, Packet
 
 static void imu_v2_callback_wrapper_linear_acceleration(DevicePrivate *device_p, Packet *packet) {
 	LinearAccelerationCallbackFunction callback_function;
-	void *user_data = device_p->registered_callback_user_data[IMU_V2_CALLBACK_LINEAR_ACCELERATION];
+	void *user_data;
 	LinearAccelerationCallback_ *callback = (LinearAccelerationCallback_ *)packet;
-	*(void **)(&callback_function) = device_p->registered_callbacks[IMU_V2_CALLBACK_LINEAR_ACCELERATION];
+	*(void **)(&callback_function) = device_get_registered_callback(device_p, IMU_V2_CALLBACK_LINEAR_ACCELERATION, &user_data);
 
 	if (callback_function == NULL) {
 		return;
@@ -523,9 +523,9 @@ static void imu_v2_callback_wrapper_linear_acceleration(DevicePrivate *device_p,
 
 static void imu_v2_callback_wrapper_gravity_vector(DevicePrivate *device_p, Packet *packet) {
 	GravityVectorCallbackFunction callback_function;
-	void *user_data = device_p->registered_callback_user_data[IMU_V2_CALLBACK_GRAVITY_VECTOR];
+	void *user_data;
 	GravityVectorCallback_ *callback = (GravityVectorCallback_ *)packet;
-	*(void **)(&callback_function) = device_p->registered_callbacks[IMU_V2_CALLBACK_GRAVITY_VECTOR];
+	*(void **)(&callback_function) = device_get_registered_callback(device_p, IMU_V2_CALLBACK_GRAVITY_VECTOR, &user_data);
 
 	if (callback_function == NULL) {
 		return;
@@ -540,9 +540,9 @@ static void imu_v2_callback_wrapper_gravity_vector(DevicePrivate *device_p, Pack
 
 static void imu_v2_callback_wrapper_orientation(DevicePrivate *device_p, Packet *packet) {
 	OrientationCallbackFunction callback_function;
-	void *user_data = device_p->registered_callback_user_data[IMU_V2_CALLBACK_ORIENTATION];
+	void *user_data;
 	OrientationCallback_ *callback = (OrientationCallback_ *)packet;
-	*(void **)(&callback_function) = device_p->registered_callbacks[IMU_V2_CALLBACK_ORIENTATION];
+	*(void **)(&callback_function) = device_get_registered_callback(device_p, IMU_V2_CALLBACK_ORIENTATION, &user_data);
 
 	if (callback_function == NULL) {
 		return;
@@ -557,9 +557,9 @@ static void imu_v2_callback_wrapper_orientation(DevicePrivate *device_p, Packet
 
 static void imu_v2_callback_wrapper_quaternion(DevicePrivate *device_p, Packet *packet) {
 	QuaternionCallbackFunction callback_function;
-	void *user_data = device_p->registered_callback_user_data[IMU_V2_CALLBACK_QUATERNION];
+	void *user_data;
 	QuaternionCallback_ *callback = (QuaternionCallback_ *)packet;
-	*(void **)(&callback_function) = device_p->registered_callbacks[IMU_V2_CALLBACK_QUATERNION];
+	*(void **)(&callback_function) = device_get_registered_callback(device_p, IMU_V2_CALLBACK_QUATERNION, &user_data);
 
 	if (callback_function == NULL) {
 		return;
@@ -575,10 +575,10 @@ static void imu_v2_callback_wrapper_quaternion(DevicePrivate *device_p, Packet *
 
 static void imu_v2_callback_wrapper_all_data(DevicePrivate *device_p, Packet *packet) {
 	AllDataCallbackFunction callback_function;
-	void *user_data = device_p->registered_callback_user_data[IMU_V2_CALLBACK_ALL_DATA];
+	void *user_data;
 	int i;
 	AllDataCallback_ *callback = (AllDataCallback_ *)packet;
-	*(void **)(&callback_function) = device_p->registered_callbacks[IMU_V2_CALLBACK_ALL_DATA];
+	*(void **)(&callback_function) = device_get_registered_callback(device_p, IMU_V2_CALLBACK_ALL_DATA, &user_data);
 
 	if (callback_function == NULL) {
 		return;
@@ -595,6 +595,18 @@ static void imu_v2_callback_wrapper_all_data(DevicePrivate *device_p, Packet *pa
 	callback_function(callback->acceleration, callback->magnetic_field, callback->angular_velocity, callback->euler_angle, callback->quaternion, callback->linear_acceleration, callback->gravity_vector, callback->temperature, callback->calibration_status, user_data);
 }
 
+static const DeviceCallbackWrapper imu_v2_callback_wrappers[] = {
+	{IMU_V2_CALLBACK_ACCELERATION, imu_v2_callback_wrapper_acceleration},
+	{IMU_V2_CALLBACK_MAGNETIC_FIELD, imu_v2_callback_wrapper_magnetic_field},
+	{IMU_V2_CALLBACK_ANGULAR_VELOCITY, imu_v2_callback_wrapper_angular_velocity},
+	{IMU_V2_CALLBACK_TEMPERATURE, imu_v2_callback_wrapper_temperature},
+	{IMU_V2_CALLBACK_LINEAR_ACCELERATION, imu_v2_callback_wrapper_linear_acceleration},
+	{IMU_V2_CALLBACK_GRAVITY_VECTOR, imu_v2_callback_wrapper_gravity_vector},
+	{IMU_V2_CALLBACK_ORIENTATION, imu_v2_callback_wrapper_orientation},
+	{IMU_V2_CALLBACK_QUATERNION, imu_v2_callback_wrapper_quaternion},
+	{IMU_V2_CALLBACK_ALL_DATA, imu_v2_callback_wrapper_all_data},
+};
+
 void imu_v2_create(IMUV2 *imu_v2, const char *uid, IPConnection *ipcon) {
 	DevicePrivate *device_p;
 
@@ -650,15 +662,8 @@ void imu_v2_create(IMUV2 *imu_v2, const char *uid, IPConnection *ipcon) {
 	device_p->response_expected[IMU_V2_FUNCTION_RESET] = DEVICE_RESPONSE_EXPECTED_FALSE;
 	device_p->response_expected[IMU_V2_FUNCTION_GET_IDENTITY] = DEVICE_RESPONSE_EXPECTED_ALWAYS_TRUE;
 
-	device_p->callback_wrappers[IMU_V2_CALLBACK_ACCELERATION] = imu_v2_callback_wrapper_acceleration;
-	device_p->callback_wrappers[IMU_V2_CALLBACK_MAGNETIC_FIELD] = imu_v2_callback_wrapper_magnetic_field;
-	device_p->callback_wrappers[IMU_V2_CALLBACK_ANGULAR_VELOCITY] = imu_v2_callback_wrapper_angular_velocity;
-	device_p->callback_wrappers[IMU_V2_CALLBACK_TEMPERATURE] = imu_v2_callback_wrapper_temperature;
-	device_p->callback_wrappers[IMU_V2_CALLBACK_LINEAR_ACCELERATION] = imu_v2_callback_wrapper_linear_acceleration;
-	device_p->callback_wrappers[IMU_V2_CALLBACK_GRAVITY_VECTOR] = imu_v2_callback_wrapper_gravity_vector;
-	device_p->callback_wrappers[IMU_V2_CALLBACK_ORIENTATION] = imu_v2_callback_wrapper_orientation;
-	device_p->callback_wrappers[IMU_V2_CALLBACK_QUATERNION] = imu_v2_callback_wrapper_quaternion;
-	device_p->callback_wrappers[IMU_V2_CALLBACK_ALL_DATA] = imu_v2_callback_wrapper_all_data;
+	device_set_callback_wrappers(device_p, imu_v2_callback_wrappers,
+	                             sizeof(imu_v2_callback_wrappers) / sizeof(imu_v2_callback_wrappers[0]));
 }
 
 void imu_v2_destroy(IMUV2 *imu_v2) {
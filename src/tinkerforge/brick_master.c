@@ -729,9 +729,9 @@ typedef struct {
 
 static void master_callback_wrapper_stack_current(DevicePrivate *device_p, Packet *packet) {
 	StackCurrentCallbackFunction callback_function;
-	void *user_data = device_p->registered_callback_user_data[MASTER_CALLBACK_STACK_CURRENT];
+	void *user_data;
 	StackCurrentCallback_ *callback = (StackCurrentCallback_ *)packet;
-	*(void **)(&callback_function) = device_p->registered_callbacks[MASTER_CALLBACK_STACK_CURRENT];
+	*(void **)(&callback_function) = device_get_registered_callback(device_p, MASTER_CALLBACK_STACK_CURRENT, &user_data);
 
 	if (callback_function == NULL) {
 		return;
@@ -744,9 +744,9 @@ static void master_callback_wrapper_stack_current(DevicePrivate *device_p, Packe
 
 static void master_callback_wrapper_stack_voltage(DevicePrivate *device_p, Packet *packet) {
 	StackVoltageCallbackFunction callback_function;
-	void *user_data = device_p->registered_callback_user_data[MASTER_CALLBACK_STACK_VOLTAGE];
+	void *user_data;
 	StackVoltageCallback_ *callback = (StackVoltageCallback_ *)packet;
-	*(void **)(&callback_function) = device_p->registered_callbacks[MASTER_CALLBACK_STACK_VOLTAGE];
+	*(void **)(&callback_function) = device_get_registered_callback(device_p, MASTER_CALLBACK_STACK_VOLTAGE, &user_data);
 
 	if (callback_function == NULL) {
 		return;
@@ -759,9 +759,9 @@ static void master_callback_wrapper_stack_voltage(DevicePrivate *device_p, Packe
 
 static void master_callback_wrapper_usb_voltage(DevicePrivate *device_p, Packet *packet) {
 	USBVoltageCallbackFunction callback_function;
-	void *user_data = device_p->registered_callback_user_data[MASTER_CALLBACK_USB_VOLTAGE];
+	void *user_data;
 	USBVoltageCallback_ *callback = (USBVoltageCallback_ *)packet;
-	*(void **)(&callback_function) = device_p->registered_callbacks[MASTER_CALLBACK_USB_VOLTAGE];
+	*(void **)(&callback_function) = device_get_registered_callback(device_p, MASTER_CALLBACK_USB_VOLTAGE, &user_data);
 
 	if (callback_function == NULL) {
 		return;
@@ -774,9 +774,9 @@ static void master_callback_wrapper_usb_voltage(DevicePrivate *device_p, Packet
 
 static void master_callback_wrapper_stack_current_reached(DevicePrivate *device_p, Packet *packet) {
 	StackCurrentReachedCallbackFunction callback_function;
-	void *user_data = device_p->registered_callback_user_data[MASTER_CALLBACK_STACK_CURRENT_REACHED];
+	void *user_data;
 	StackCurrentReachedCallback_ *callback = (StackCurrentReachedCallback_ *)packet;
-	*(void **)(&callback_function) = device_p->registered_callbacks[MASTER_CALLBACK_STACK_CURRENT_REACHED];
+	*(void **)(&callback_function) = device_get_registered_callback(device_p, MASTER_CALLBACK_STACK_CURRENT_REACHED, &user_data);
 
 	if (callback_function == NULL) {
 		return;
@@ -789,9 +789,9 @@ static void master_callback_wrapper_stack_current_reached(DevicePrivate *device_
 
 static void master_callback_wrapper_stack_voltage_reached(DevicePrivate *device_p, Packet *packet) {
 	StackVoltageReachedCallbackFunction callback_function;
-	void *user_data = device_p->registered_callback_user_data[MASTER_CALLBACK_STACK_VOLTAGE_REACHED];
+	void *user_data;
 	StackVoltageReachedCallback_ *callback = (StackVoltageReachedCallback_ *)packet;
-	*(void **)(&callback_function) = device_p->registered_callbacks[MASTER_CALLBACK_STACK_VOLTAGE_REACHED];
+	*(void **)(&callback_function) = device_get_registered_callback(device_p, MASTER_CALLBACK_STACK_VOLTAGE_REACHED, &user_data);
 
 	if (callback_function == NULL) {
 		return;
@@ -804,9 +804,9 @@ static void master_callback_wrapper_stack_voltage_reached(DevicePrivate *device_
 
 static void master_callback_wrapper_usb_voltage_reached(DevicePrivate *device_p, Packet *packet) {
 	USBVoltageReachedCallbackFunction callback_function;
-	void *user_data = device_p->registered_callback_user_data[MASTER_CALLBACK_USB_VOLTAGE_REACHED];
+	void *user_data;
 	USBVoltageReachedCallback_ *callback = (USBVoltageReachedCallback_ *)packet;
-	*(void **)(&callback_function) = device_p->registered_callbacks[MASTER_CALLBACK_USB_VOLTAGE_REACHED];
+	*(void **)(&callback_function) = device_get_registered_callback(device_p, MASTER_CALLBACK_USB_VOLTAGE_REACHED, &user_data);
 
 	if (callback_function == NULL) {
 		return;
@@ -817,6 +817,15 @@ static void master_callback_wrapper_usb_voltage_reached(DevicePrivate *device_p,
 	callback_function(callback->voltage, user_data);
 }
 
+static const DeviceCallbackWrapper master_callback_wrappers[] = {
+	{MASTER_CALLBACK_STACK_CURRENT, master_callback_wrapper_stack_current},
+	{MASTER_CALLBACK_STACK_VOLTAGE, master_callback_wrapper_stack_voltage},
+	{MASTER_CALLBACK_USB_VOLTAGE, master_callback_wrapper_usb_voltage},
+	{MASTER_CALLBACK_STACK_CURRENT_REACHED, master_callback_wrapper_stack_current_reached},
+	{MASTER_CALLBACK_STACK_VOLTAGE_REACHED, master_callback_wrapper_stack_voltage_reached},
+	{MASTER_CALLBACK_USB_VOLTAGE_REACHED, master_callback_wrapper_usb_voltage_reached},
+};
+
 void master_create(Master *master, const char *uid, IPConnection *ipcon) {
 	DevicePrivate *device_p;
 
@@ -908,12 +917,8 @@ void master_create(Master *master, const char *uid, IPConnection *ipcon) {
 	device_p->response_expected[MASTER_FUNCTION_RESET] = DEVICE_RESPONSE_EXPECTED_FALSE;
 	device_p->response_expected[MASTER_FUNCTION_GET_IDENTITY] = DEVICE_RESPONSE_EXPECTED_ALWAYS_TRUE;
 
-	device_p->callback_wrappers[MASTER_CALLBACK_STACK_CURRENT] = master_callback_wrapper_stack_current;
-	device_p->callback_wrappers[MASTER_CALLBACK_STACK_VOLTAGE] = master_callback_wrapper_stack_voltage;
-	device_p->callback_wrappers[MASTER_CALLBACK_USB_VOLTAGE] = master_callback_wrapper_usb_voltage;
-	device_p->callback_wrappers[MASTER_CALLBACK_STACK_CURRENT_REACHED] = master_callback_wrapper_stack_current_reached;
-	device_p->callback_wrappers[MASTER_CALLBACK_STACK_VOLTAGE_REACHED] = master_callback_wrapper_stack_voltage_reached;
-	device_p->callback_wrappers[MASTER_CALLBACK_USB_VOLTAGE_REACHED] = master_callback_wrapper_usb_voltage_reached;
+	device_set_callback_wrappers(device_p, master_callback_wrappers,
+	                             sizeof(master_callback_wrappers) / sizeof(master_callback_wrappers[0]));
 }
 
 void master_destroy(Master *master) {
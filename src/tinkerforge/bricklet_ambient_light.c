@@ -182,9 +182,9 @@ typedef struct {
 
 static void ambient_light_callback_wrapper_illuminance(DevicePrivate *device_p, Packet *packet) {
 	IlluminanceCallbackFunction callback_function;
-	void *user_data = device_p->registered_callback_user_data[AMBIENT_LIGHT_CALLBACK_ILLUMINANCE];
+	void *user_data;
 	IlluminanceCallback_ *callback = (IlluminanceCallback_ *)packet;
-	*(void **)(&callback_function) = device_p->registered_callbacks[AMBIENT_LIGHT_CALLBACK_ILLUMINANCE];
+	*(void **)(&callback_function) = device_get_registered_callback(device_p, AMBIENT_LIGHT_CALLBACK_ILLUMINANCE, &user_data);
 
 	if (callback_function == NULL) {
 		return;
@@ -197,9 +197,9 @@ static void ambient_light_callback_wrapper_illuminance(DevicePrivate *device_p,
 
 static void ambient_light_callback_wrapper_analog_value(DevicePrivate *device_p, Packet *packet) {
 	AnalogValueCallbackFunction callback_function;
-	void *user_data = device_p->registered_callback_user_data[AMBIENT_LIGHT_CALLBACK_ANALOG_VALUE];
+	void *user_data;
 	AnalogValueCallback_ *callback = (AnalogValueCallback_ *)packet;
-	*(void **)(&callback_function) = device_p->registered_callbacks[AMBIENT_LIGHT_CALLBACK_ANALOG_VALUE];
+	*(void **)(&callback_function) = device_get_registered_callback(device_p, AMBIENT_LIGHT_CALLBACK_ANALOG_VALUE, &user_data);
 
 	if (callback_function == NULL) {
 		return;
@@ -212,9 +212,9 @@ static void ambient_light_callback_wrapper_analog_value(DevicePrivate *device_p,
 
 static void ambient_light_callback_wrapper_illuminance_reached(DevicePrivate *device_p, Packet *packet) {
 	IlluminanceReachedCallbackFunction callback_function;
-	void *user_data = device_p->registered_callback_user_data[AMBIENT_LIGHT_CALLBACK_ILLUMINANCE_REACHED];
+	void *user_data;
 	IlluminanceReachedCallback_ *callback = (IlluminanceReachedCallback_ *)packet;
-	*(void **)(&callback_function) = device_p->registered_callbacks[AMBIENT_LIGHT_CALLBACK_ILLUMINANCE_REACHED];
+	*(void **)(&callback_function) = device_get_registered_callback(device_p, AMBIENT_LIGHT_CALLBACK_ILLUMINANCE_REACHED, &user_data);
 
 	if (callback_function == NULL) {
 		return;
@@ -227,9 +227,9 @@ static void ambient_light_callback_wrapper_illuminance_reached(DevicePrivate *de
 
 static void ambient_light_callback_wrapper_analog_value_reached(DevicePrivate *device_p, Packet *packet) {
 	AnalogValueReachedCallbackFunction callback_function;
-	void *user_data = device_p->registered_callback_user_data[AMBIENT_LIGHT_CALLBACK_ANALOG_VALUE_REACHED];
+	void *user_data;
 	AnalogValueReachedCallback_ *callback = (AnalogValueReachedCallback_ *)packet;
-	*(void **)(&callback_function) = device_p->registered_callbacks[AMBIENT_LIGHT_CALLBACK_ANALOG_VALUE_REACHED];
+	*(void **)(&callback_function) = device_get_registered_callback(device_p, AMBIENT_LIGHT_CALLBACK_ANALOG_VALUE_REACHED, &user_data);
 
 	if (callback_function == NULL) {
 		return;
@@ -240,6 +240,13 @@ static void ambient_light_callback_wrapper_analog_value_reached(DevicePrivate *d
 	callback_function(callback->value, user_data);
 }
 
+static const DeviceCallbackWrapper ambient_light_callback_wrappers[] = {
+	{AMBIENT_LIGHT_CALLBACK_ILLUMINANCE, ambient_light_callback_wrapper_illuminance},
+	{AMBIENT_LIGHT_CALLBACK_ANALOG_VALUE, ambient_light_callback_wrapper_analog_value},
+	{AMBIENT_LIGHT_CALLBACK_ILLUMINANCE_REACHED, ambient_light_callback_wrapper_illuminance_reached},
+	{AMBIENT_LIGHT_CALLBACK_ANALOG_VALUE_REACHED, ambient_light_callback_wrapper_analog_value_reached},
+};
+
 void ambient_light_create(AmbientLight *ambient_light, const char *uid, IPConnection *ipcon) {
 	DevicePrivate *device_p;
 
@@ -265,10 +272,8 @@ void ambient_light_create(AmbientLight *ambient_light, const char *uid, IPConnec
 	device_p->response_expected[AMBIENT_LIGHT_CALLBACK_ANALOG_VALUE_REACHED] = DEVICE_RESPONSE_EXPECTED_ALWAYS_FALSE;
 	device_p->response_expected[AMBIENT_LIGHT_FUNCTION_GET_IDENTITY] = DEVICE_RESPONSE_EXPECTED_ALWAYS_TRUE;
 
-	device_p->callback_wrappers[AMBIENT_LIGHT_CALLBACK_ILLUMINANCE] = ambient_light_callback_wrapper_illuminance;
-	device_p->callback_wrappers[AMBIENT_LIGHT_CALLBACK_ANALOG_VALUE] = ambient_light_callback_wrapper_analog_value;
-	device_p->callback_wrappers[AMBIENT_LIGHT_CALLBACK_ILLUMINANCE_REACHED] = ambient_light_callback_wrapper_illuminance_reached;
-	device_p->callback_wrappers[AMBIENT_LIGHT_CALLBACK_ANALOG_VALUE_REACHED] = ambient_light_callback_wrapper_analog_value_reached;
+	device_set_callback_wrappers(device_p, ambient_light_callback_wrappers,
+	                             sizeof(ambient_light_callback_wrappers) / sizeof(ambient_light_callback_wrappers[0]));
 }
 
 void ambient_light_destroy(AmbientLight *ambient_light) {
@@ -143,9 +143,9 @@ typedef struct {
 
 static void ambient_light_v2_callback_wrapper_illuminance(DevicePrivate *device_p, Packet *packet) {
 	IlluminanceCallbackFunction callback_function;
-	void *user_data = device_p->registered_callback_user_data[AMBIENT_LIGHT_V2_CALLBACK_ILLUMINANCE];
+	void *user_data;
 	IlluminanceCallback_ *callback = (IlluminanceCallback_ *)packet;
-	*(void **)(&callback_function) = device_p->registered_callbacks[AMBIENT_LIGHT_V2_CALLBACK_ILLUMINANCE];
+	*(void **)(&callback_function) = device_get_registered_callback(device_p, AMBIENT_LIGHT_V2_CALLBACK_ILLUMINANCE, &user_data);
 
 	if (callback_function == NULL) {
 		return;
@@ -158,9 +158,9 @@ static void ambient_light_v2_callback_wrapper_illuminance(DevicePrivate *device_
 
 static void ambient_light_v2_callback_wrapper_illuminance_reached(DevicePrivate *device_p, Packet *packet) {
 	IlluminanceReachedCallbackFunction callback_function;
-	void *user_data = device_p->registered_callback_user_data[AMBIENT_LIGHT_V2_CALLBACK_ILLUMINANCE_REACHED];
+	void *user_data;
 	IlluminanceReachedCallback_ *callback = (IlluminanceReachedCallback_ *)packet;
-	*(void **)(&callback_function) = device_p->registered_callbacks[AMBIENT_LIGHT_V2_CALLBACK_ILLUMINANCE_REACHED];
+	*(void **)(&callback_function) = device_get_registered_callback(device_p, AMBIENT_LIGHT_V2_CALLBACK_ILLUMINANCE_REACHED, &user_data);
 
 	if (callback_function == NULL) {
 		return;
@@ -171,6 +171,11 @@ static void ambient_light_v2_callback_wrapper_illuminance_reached(DevicePrivate
 	callback_function(callback->illuminance, user_data);
 }
 
+static const DeviceCallbackWrapper ambient_light_v2_callback_wrappers[] = {
+	{AMBIENT_LIGHT_V2_CALLBACK_ILLUMINANCE, ambient_light_v2_callback_wrapper_illuminance},
+	{AMBIENT_LIGHT_V2_CALLBACK_ILLUMINANCE_REACHED, ambient_light_v2_callback_wrapper_illuminance_reached},
+};
+
 void ambient_light_v2_create(AmbientLightV2 *ambient_light_v2, const char *uid, IPConnection *ipcon) {
 	DevicePrivate *device_p;
 
@@ -191,8 +196,8 @@ void ambient_light_v2_create(AmbientLightV2 *ambient_light_v2, const char *uid,
 	device_p->response_expected[AMBIENT_LIGHT_V2_CALLBACK_ILLUMINANCE_REACHED] = DEVICE_RESPONSE_EXPECTED_ALWAYS_FALSE;
 	device_p->response_expected[AMBIENT_LIGHT_V2_FUNCTION_GET_IDENTITY] = DEVICE_RESPONSE_EXPECTED_ALWAYS_TRUE;
 
-	device_p->callback_wrappers[AMBIENT_LIGHT_V2_CALLBACK_ILLUMINANCE] = ambient_light_v2_callback_wrapper_illuminance;
-	device_p->callback_wrappers[AMBIENT_LIGHT_V2_CALLBACK_ILLUMINANCE_REACHED] = ambient_light_v2_callback_wrapper_illuminance_reached;
+	device_set_callback_wrappers(device_p, ambient_light_v2_callback_wrappers,
+	                             sizeof(ambient_light_v2_callback_wrappers) / sizeof(ambient_light_v2_callback_wrappers[0]));
 }
 
 void ambient_light_v2_destroy(AmbientLightV2 *ambient_light_v2) {
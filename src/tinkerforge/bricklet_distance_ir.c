@@ -198,9 +198,9 @@ typedef struct {
 
 static void distance_ir_callback_wrapper_distance(DevicePrivate *device_p, Packet *packet) {
 	DistanceCallbackFunction callback_function;
-	void *user_data = device_p->registered_callback_user_data[DISTANCE_IR_CALLBACK_DISTANCE];
+	void *user_data;
 	DistanceCallback_ *callback = (DistanceCallback_ *)packet;
-	*(void **)(&callback_function) = device_p->registered_callbacks[DISTANCE_IR_CALLBACK_DISTANCE];
+	*(void **)(&callback_function) = device_get_registered_callback(device_p, DISTANCE_IR_CALLBACK_DISTANCE, &user_data);
 
 	if (callback_function == NULL) {
 		return;
@@ -213,9 +213,9 @@ static void distance_ir_callback_wrapper_distance(DevicePrivate *device_p, Packe
 
 static void distance_ir_callback_wrapper_analog_value(DevicePrivate *device_p, Packet *packet) {
 	AnalogValueCallbackFunction callback_function;
-	void *user_data = device_p->registered_callback_user_data[DISTANCE_IR_CALLBACK_ANALOG_VALUE];
+	void *user_data;
 	AnalogValueCallback_ *callback = (AnalogValueCallback_ *)packet;
-	*(void **)(&callback_function) = device_p->registered_callbacks[DISTANCE_IR_CALLBACK_ANALOG_VALUE];
+	*(void **)(&callback_function) = device_get_registered_callback(device_p, DISTANCE_IR_CALLBACK_ANALOG_VALUE, &user_data);
 
 	if (callback_function == NULL) {
 		return;
@@ -228,9 +228,9 @@ static void distance_ir_callback_wrapper_analog_value(DevicePrivate *device_p, P
 
 static void distance_ir_callback_wrapper_distance_reached(DevicePrivate *device_p, Packet *packet) {
 	DistanceReachedCallbackFunction callback_function;
-	void *user_data = device_p->registered_callback_user_data[DISTANCE_IR_CALLBACK_DISTANCE_REACHED];
+	void *user_data;
 	DistanceReachedCallback_ *callback = (DistanceReachedCallback_ *)packet;
-	*(void **)(&callback_function) = device_p->registered_callbacks[DISTANCE_IR_CALLBACK_DISTANCE_REACHED];
+	*(void **)(&callback_function) = device_get_registered_callback(device_p, DISTANCE_IR_CALLBACK_DISTANCE_REACHED, &user_data);
 
 	if (callback_function == NULL) {
 		return;
@@ -243,9 +243,9 @@ static void distance_ir_callback_wrapper_distance_reached(DevicePrivate *device_
 
 static void distance_ir_callback_wrapper_analog_value_reached(DevicePrivate *device_p, Packet *packet) {
 	AnalogValueReachedCallbackFunction callback_function;
-	void *user_data = device_p->registered_callback_user_data[DISTANCE_IR_CALLBACK_ANALOG_VALUE_REACHED];
+	void *user_data;
 	AnalogValueReachedCallback_ *callback = (AnalogValueReachedCallback_ *)packet;
-	*(void **)(&callback_function) = device_p->registered_callbacks[DISTANCE_IR_CALLBACK_ANALOG_VALUE_REACHED];
+	*(void **)(&callback_function) = device_get_registered_callback(device_p, DISTANCE_IR_CALLBACK_ANALOG_VALUE_REACHED, &user_data);
 
 	if (callback_function == NULL) {
 		return;
@@ -256,6 +256,13 @@ static void distance_ir_callback_wrapper_analog_value_reached(DevicePrivate *dev
 	callback_function(callback->value, user_data);
 }
 
+static const DeviceCallbackWrapper distance_ir_callback_wrappers[] = {
+	{DISTANCE_IR_CALLBACK_DISTANCE, distance_ir_callback_wrapper_distance},
+	{DISTANCE_IR_CALLBACK_ANALOG_VALUE, distance_ir_callback_wrapper_analog_value},
+	{DISTANCE_IR_CALLBACK_DISTANCE_REACHED, distance_ir_callback_wrapper_distance_reached},
+	{DISTANCE_IR_CALLBACK_ANALOG_VALUE_REACHED, distance_ir_callback_wrapper_analog_value_reached},
+};
+
 void distance_ir_create(DistanceIR *distance_ir, const char *uid, IPConnection *ipcon) {
 	DevicePrivate *device_p;
 
@@ -283,10 +290,8 @@ void distance_ir_create(DistanceIR *distance_ir, const char *uid, IPConnection *
 	device_p->response_expected[DISTANCE_IR_CALLBACK_ANALOG_VALUE_REACHED] = DEVICE_RESPONSE_EXPECTED_ALWAYS_FALSE;
 	device_p->response_expected[DISTANCE_IR_FUNCTION_GET_IDENTITY] = DEVICE_RESPONSE_EXPECTED_ALWAYS_TRUE;
 
-	device_p->callback_wrappers[DISTANCE_IR_CALLBACK_DISTANCE] = distance_ir_callback_wrapper_distance;
-	device_p->callback_wrappers[DISTANCE_IR_CALLBACK_ANALOG_VALUE] = distance_ir_callback_wrapper_analog_value;
-	device_p->callback_wrappers[DISTANCE_IR_CALLBACK_DISTANCE_REACHED] = distance_ir_callback_wrapper_distance_reached;
-	device_p->callback_wrappers[DISTANCE_IR_CALLBACK_ANALOG_VALUE_REACHED] = distance_ir_callback_wrapper_analog_value_reached;
+	device_set_callback_wrappers(device_p, distance_ir_callback_wrappers,
+	                             sizeof(distance_ir_callback_wrappers) / sizeof(distance_ir_callback_wrappers[0]));
 }
 
 void distance_ir_destroy(DistanceIR *distance_ir) {
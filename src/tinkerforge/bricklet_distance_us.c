@@ -141,9 +141,9 @@ typedef struct {
 
 static void distance_us_callback_wrapper_distance(DevicePrivate *device_p, Packet *packet) {
 	DistanceCallbackFunction callback_function;
-	void *user_data = device_p->registered_callback_user_data[DISTANCE_US_CALLBACK_DISTANCE];
+	void *user_data;
 	DistanceCallback_ *callback = (DistanceCallback_ *)packet;
-	*(void **)(&callback_function) = device_p->registered_callbacks[DISTANCE_US_CALLBACK_DISTANCE];
+	*(void **)(&callback_function) = device_get_registered_callback(device_p, DISTANCE_US_CALLBACK_DISTANCE, &user_data);
 
 	if (callback_function == NULL) {
 		return;
@@ -156,9 +156,9 @@ static void distance_us_callback_wrapper_distance(DevicePrivate *device_p, Packe
 
 static void distance_us_callback_wrapper_distance_reached(DevicePrivate *device_p, Packet *packet) {
 	DistanceReachedCallbackFunction callback_function;
-	void *user_data = device_p->registered_callback_user_data[DISTANCE_US_CALLBACK_DISTANCE_REACHED];
+	void *user_data;
 	DistanceReachedCallback_ *callback = (DistanceReachedCallback_ *)packet;
-	*(void **)(&callback_function) = device_p->registered_callbacks[DISTANCE_US_CALLBACK_DISTANCE_REACHED];
+	*(void **)(&callback_function) = device_get_registered_callback(device_p, DISTANCE_US_CALLBACK_DISTANCE_REACHED, &user_data);
 
 	if (callback_function == NULL) {
 		return;
@@ -169,6 +169,11 @@ static void distance_us_callback_wrapper_distance_reached(DevicePrivate *device_
 	callback_function(callback->distance, user_data);
 }
 
+static const DeviceCallbackWrapper distance_us_callback_wrappers[] = {
+	{DISTANCE_US_CALLBACK_DISTANCE, distance_us_callback_wrapper_distance},
+	{DISTANCE_US_CALLBACK_DISTANCE_REACHED, distance_us_callback_wrapper_distance_reached},
+};
+
 void distance_us_create(DistanceUS *distance_us, const char *uid, IPConnection *ipcon) {
 	DevicePrivate *device_p;
 
@@ -189,8 +194,8 @@ void distance_us_create(DistanceUS *distance_us, const char *uid, IPConnection *
 	device_p->response_expected[DISTANCE_US_FUNCTION_GET_MOVING_AVERAGE] = DEVICE_RESPONSE_EXPECTED_ALWAYS_TRUE;
 	device_p->response_expected[DISTANCE_US_FUNCTION_GET_IDENTITY] = DEVICE_RESPONSE_EXPECTED_ALWAYS_TRUE;
 
-	device_p->callback_wrappers[DISTANCE_US_CALLBACK_DISTANCE] = distance_us_callback_wrapper_distance;
-	device_p->callback_wrappers[DISTANCE_US_CALLBACK_DISTANCE_REACHED] = distance_us_callback_wrapper_distance_reached;
+	device_set_callback_wrappers(device_p, distance_us_callback_wrappers,
+	                             sizeof(distance_us_callback_wrappers) / sizeof(distance_us_callback_wrappers[0]));
 }
 
 void distance_us_destroy(DistanceUS *distance_us) {
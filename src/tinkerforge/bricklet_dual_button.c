@@ -100,9 +100,9 @@ typedef struct {
 
 static void dual_button_callback_wrapper_state_changed(DevicePrivate *device_p, Packet *packet) {
 	StateChangedCallbackFunction callback_function;
-	void *user_data = device_p->registered_callback_user_data[DUAL_BUTTON_CALLBACK_STATE_CHANGED];
+	void *user_data;
 	StateChangedCallback_ *callback = (StateChangedCallback_ *)packet;
-	*(void **)(&callback_function) = device_p->registered_callbacks[DUAL_BUTTON_CALLBACK_STATE_CHANGED];
+	*(void **)(&callback_function) = device_get_registered_callback(device_p, DUAL_BUTTON_CALLBACK_STATE_CHANGED, &user_data);
 
 	if (callback_function == NULL) {
 		return;
@@ -111,6 +111,10 @@ static void dual_button_callback_wrapper_state_changed(DevicePrivate *device_p,
 	callback_function(callback->button_l, callback->button_r, callback->led_l, callback->led_r, user_data);
 }
 
+static const DeviceCallbackWrapper dual_button_callback_wrappers[] = {
+	{DUAL_BUTTON_CALLBACK_STATE_CHANGED, dual_button_callback_wrapper_state_changed},
+};
+
 void dual_button_create(DualButton *dual_button, const char *uid, IPConnection *ipcon) {
 	DevicePrivate *device_p;
 
@@ -125,7 +129,8 @@ void dual_button_create(DualButton *dual_button, const char *uid, IPConnection *
 	device_p->response_expected[DUAL_BUTTON_FUNCTION_SET_SELECTED_LED_STATE] = DEVICE_RESPONSE_EXPECTED_FALSE;
 	device_p->response_expected[DUAL_BUTTON_FUNCTION_GET_IDENTITY] = DEVICE_RESPONSE_EXPECTED_ALWAYS_TRUE;
 
-	device_p->callback_wrappers[DUAL_BUTTON_CALLBACK_STATE_CHANGED] = dual_button_callback_wrapper_state_changed;
+	device_set_callback_wrappers(device_p, dual_button_callback_wrappers,
+	                             sizeof(dual_button_callback_wrappers) / sizeof(dual_button_callback_wrappers[0]));
 }
 
 void dual_button_destroy(DualButton *dual_button) {
@@ -237,9 +237,9 @@ typedef struct {
 
 static void gps_callback_wrapper_coordinates(DevicePrivate *device_p, Packet *packet) {
 	CoordinatesCallbackFunction callback_function;
-	void *user_data = device_p->registered_callback_user_data[GPS_CALLBACK_COORDINATES];
+	void *user_data;
 	CoordinatesCallback_ *callback = (CoordinatesCallback_ *)packet;
-	*(void **)(&callback_function) = device_p->registered_callbacks[GPS_CALLBACK_COORDINATES];
+	*(void **)(&callback_function) = device_get_registered_callback(device_p, GPS_CALLBACK_COORDINATES, &user_data);
 
 	if (callback_function == NULL) {
 		return;
@@ -257,9 +257,9 @@ static void gps_callback_wrapper_coordinates(DevicePrivate *device_p, Packet *pa
 
 static void gps_callback_wrapper_status(DevicePrivate *device_p, Packet *packet) {
 	StatusCallbackFunction callback_function;
-	void *user_data = device_p->registered_callback_user_data[GPS_CALLBACK_STATUS];
+	void *user_data;
 	StatusCallback_ *callback = (StatusCallback_ *)packet;
-	*(void **)(&callback_function) = device_p->registered_callbacks[GPS_CALLBACK_STATUS];
+	*(void **)(&callback_function) = device_get_registered_callback(device_p, GPS_CALLBACK_STATUS, &user_data);
 
 	if (callback_function == NULL) {
 		return;
@@ -270,9 +270,9 @@ static void gps_callback_wrapper_status(DevicePrivate *device_p, Packet *packet)
 
 static void gps_callback_wrapper_altitude(DevicePrivate *device_p, Packet *packet) {
 	AltitudeCallbackFunction callback_function;
-	void *user_data = device_p->registered_callback_user_data[GPS_CALLBACK_ALTITUDE];
+	void *user_data;
 	AltitudeCallback_ *callback = (AltitudeCallback_ *)packet;
-	*(void **)(&callback_function) = device_p->registered_callbacks[GPS_CALLBACK_ALTITUDE];
+	*(void **)(&callback_function) = device_get_registered_callback(device_p, GPS_CALLBACK_ALTITUDE, &user_data);
 
 	if (callback_function == NULL) {
 		return;
@@ -286,9 +286,9 @@ static void gps_callback_wrapper_altitude(DevicePrivate *device_p, Packet *packe
 
 static void gps_callback_wrapper_motion(DevicePrivate *device_p, Packet *packet) {
 	MotionCallbackFunction callback_function;
-	void *user_data = device_p->registered_callback_user_data[GPS_CALLBACK_MOTION];
+	void *user_data;
 	MotionCallback_ *callback = (MotionCallback_ *)packet;
-	*(void **)(&callback_function) = device_p->registered_callbacks[GPS_CALLBACK_MOTION];
+	*(void **)(&callback_function) = device_get_registered_callback(device_p, GPS_CALLBACK_MOTION, &user_data);
 
 	if (callback_function == NULL) {
 		return;
@@ -302,9 +302,9 @@ static void gps_callback_wrapper_motion(DevicePrivate *device_p, Packet *packet)
 
 static void gps_callback_wrapper_date_time(DevicePrivate *device_p, Packet *packet) {
 	DateTimeCallbackFunction callback_function;
-	void *user_data = device_p->registered_callback_user_data[GPS_CALLBACK_DATE_TIME];
+	void *user_data;
 	DateTimeCallback_ *callback = (DateTimeCallback_ *)packet;
-	*(void **)(&callback_function) = device_p->registered_callbacks[GPS_CALLBACK_DATE_TIME];
+	*(void **)(&callback_function) = device_get_registered_callback(device_p, GPS_CALLBACK_DATE_TIME, &user_data);
 
 	if (callback_function == NULL) {
 		return;
@@ -316,6 +316,14 @@ static void gps_callback_wrapper_date_time(DevicePrivate *device_p, Packet *pack
 	callback_function(callback->date, callback->time, user_data);
 }
 
+static const DeviceCallbackWrapper gps_callback_wrappers[] = {
+	{GPS_CALLBACK_COORDINATES, gps_callback_wrapper_coordinates},
+	{GPS_CALLBACK_STATUS, gps_callback_wrapper_status},
+	{GPS_CALLBACK_ALTITUDE, gps_callback_wrapper_altitude},
+	{GPS_CALLBACK_MOTION, gps_callback_wrapper_motion},
+	{GPS_CALLBACK_DATE_TIME, gps_callback_wrapper_date_time},
+};
+
 void gps_create(GPS *gps, const char *uid, IPConnection *ipcon) {
 	DevicePrivate *device_p;
 
@@ -346,11 +354,8 @@ void gps_create(GPS *gps, const char *uid, IPConnection *ipcon) {
 	device_p->response_expected[GPS_CALLBACK_DATE_TIME] = DEVICE_RESPONSE_EXPECTED_ALWAYS_FALSE;
 	device_p->response_expected[GPS_FUNCTION_GET_IDENTITY] = DEVICE_RESPONSE_EXPECTED_ALWAYS_TRUE;
 
-	device_p->callback_wrappers[GPS_CALLBACK_COORDINATES] = gps_callback_wrapper_coordinates;
-	device_p->callback_wrappers[GPS_CALLBACK_STATUS] = gps_callback_wrapper_status;
-	device_p->callback_wrappers[GPS_CALLBACK_ALTITUDE] = gps_callback_wrapper_altitude;
-	device_p->callback_wrappers[GPS_CALLBACK_MOTION] = gps_callback_wrapper_motion;
-	device_p->callback_wrappers[GPS_CALLBACK_DATE_TIME] = gps_callback_wrapper_date_time;
+	device_set_callback_wrappers(device_p, gps_callback_wrappers,
+	                             sizeof(gps_callback_wrappers) / sizeof(gps_callback_wrappers[0]));
 }
 
 void gps_destroy(GPS *gps) {
@@ -182,9 +182,9 @@ typedef struct {
 
 static void humidity_callback_wrapper_humidity(DevicePrivate *device_p, Packet *packet) {
 	HumidityCallbackFunction callback_function;
-	void *user_data = device_p->registered_callback_user_data[HUMIDITY_CALLBACK_HUMIDITY];
+	void *user_data;
 	HumidityCallback_ *callback = (HumidityCallback_ *)packet;
-	*(void **)(&callback_function) = device_p->registered_callbacks[HUMIDITY_CALLBACK_HUMIDITY];
+	*(void **)(&callback_function) = device_get_registered_callback(device_p, HUMIDITY_CALLBACK_HUMIDITY, &user_data);
 
 	if (callback_function == NULL) {
 		return;
@@ -197,9 +197,9 @@ static void humidity_callback_wrapper_humidity(DevicePrivate *device_p, Packet *
 
 static void humidity_callback_wrapper_analog_value(DevicePrivate *device_p, Packet *packet) {
 	AnalogValueCallbackFunction callback_function;
-	void *user_data = device_p->registered_callback_user_data[HUMIDITY_CALLBACK_ANALOG_VALUE];
+	void *user_data;
 	AnalogValueCallback_ *callback = (AnalogValueCallback_ *)packet;
-	*(void **)(&callback_function) = device_p->registered_callbacks[HUMIDITY_CALLBACK_ANALOG_VALUE];
+	*(void **)(&callback_function) = device_get_registered_callback(device_p, HUMIDITY_CALLBACK_ANALOG_VALUE, &user_data);
 
 	if (callback_function == NULL) {
 		return;
@@ -212,9 +212,9 @@ static void humidity_callback_wrapper_analog_value(DevicePrivate *device_p, Pack
 
 static void humidity_callback_wrapper_humidity_reached(DevicePrivate *device_p, Packet *packet) {
 	HumidityReachedCallbackFunction callback_function;
-	void *user_data = device_p->registered_callback_user_data[HUMIDITY_CALLBACK_HUMIDITY_REACHED];
+	void *user_data;
 	HumidityReachedCallback_ *callback = (HumidityReachedCallback_ *)packet;
-	*(void **)(&callback_function) = device_p->registered_callbacks[HUMIDITY_CALLBACK_HUMIDITY_REACHED];
+	*(void **)(&callback_function) = device_get_registered_callback(device_p, HUMIDITY_CALLBACK_HUMIDITY_REACHED, &user_data);
 
 	if (callback_function == NULL) {
 		return;
@@ -227,9 +227,9 @@ static void humidity_callback_wrapper_humidity_reached(DevicePrivate *device_p,
 
 static void humidity_callback_wrapper_analog_value_reached(DevicePrivate *device_p, Packet *packet) {
 	AnalogValueReachedCallbackFunction callback_function;
-	void *user_data = device_p->registered_callback_user_data[HUMIDITY_CALLBACK_ANALOG_VALUE_REACHED];
+	void *user_data;
 	AnalogValueReachedCallback_ *callback = (AnalogValueReachedCallback_ *)packet;
-	*(void **)(&callback_function) = device_p->registered_callbacks[HUMIDITY_CALLBACK_ANALOG_VALUE_REACHED];
+	*(void **)(&callback_function) = device_get_registered_callback(device_p, HUMIDITY_CALLBACK_ANALOG_VALUE_REACHED, &user_data);
 
 	if (callback_function == NULL) {
 		return;
@@ -240,6 +240,13 @@ static void humidity_callback_wrapper_analog_value_reached(DevicePrivate *device
 	callback_function(callback->value, user_data);
 }
 
+static const DeviceCallbackWrapper humidity_callback_wrappers[] = {
+	{HUMIDITY_CALLBACK_HUMIDITY, humidity_callback_wrapper_humidity},
+	{HUMIDITY_CALLBACK_ANALOG_VALUE, humidity_callback_wrapper_analog_value},
+	{HUMIDITY_CALLBACK_HUMIDITY_REACHED, humidity_callback_wrapper_humidity_reached},
+	{HUMIDITY_CALLBACK_ANALOG_VALUE_REACHED, humidity_callback_wrapper_analog_value_reached},
+};
+
 void humidity_create(Humidity *humidity, const char *uid, IPConnection *ipcon) {
 	DevicePrivate *device_p;
 
@@ -265,10 +272,8 @@ void humidity_create(Humidity *humidity, const char *uid, IPConnection *ipcon) {
 	device_p->response_expected[HUMIDITY_CALLBACK_ANALOG_VALUE_REACHED] = DEVICE_RESPONSE_EXPECTED_ALWAYS_FALSE;
 	device_p->response_expected[HUMIDITY_FUNCTION_GET_IDENTITY] = DEVICE_RESPONSE_EXPECTED_ALWAYS_TRUE;
 
-	device_p->callback_wrappers[HUMIDITY_CALLBACK_HUMIDITY] = humidity_callback_wrapper_humidity;
-	device_p->callback_wrappers[HUMIDITY_CALLBACK_ANALOG_VALUE] = humidity_callback_wrapper_analog_value;
-	device_p->callback_wrappers[HUMIDITY_CALLBACK_HUMIDITY_REACHED] = humidity_callback_wrapper_humidity_reached;
-	device_p->callback_wrappers[HUMIDITY_CALLBACK_ANALOG_VALUE_REACHED] = humidity_callback_wrapper_analog_value_reached;
+	device_set_callback_wrappers(device_p, humidity_callback_wrappers,
+	                             sizeof(humidity_callback_wrappers) / sizeof(humidity_callback_wrappers[0]));
 }
 
 void humidity_destroy(Humidity *humidity) {
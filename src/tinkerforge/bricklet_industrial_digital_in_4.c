@@ -155,9 +155,9 @@ typedef struct {
 
 static void industrial_digital_in_4_callback_wrapper_interrupt(DevicePrivate *device_p, Packet *packet) {
 	InterruptCallbackFunction callback_function;
-	void *user_data = device_p->registered_callback_user_data[INDUSTRIAL_DIGITAL_IN_4_CALLBACK_INTERRUPT];
+	void *user_data;
 	InterruptCallback_ *callback = (InterruptCallback_ *)packet;
-	*(void **)(&callback_function) = device_p->registered_callbacks[INDUSTRIAL_DIGITAL_IN_4_CALLBACK_INTERRUPT];
+	*(void **)(&callback_function) = device_get_registered_callback(device_p, INDUSTRIAL_DIGITAL_IN_4_CALLBACK_INTERRUPT, &user_data);
 
 	if (callback_function == NULL) {
 		return;
@@ -169,6 +169,10 @@ static void industrial_digital_in_4_callback_wrapper_interrupt(DevicePrivate *de
 	callback_function(callback->interrupt_mask, callback->value_mask, user_data);
 }
 
+static const DeviceCallbackWrapper industrial_digital_in_4_callback_wrappers[] = {
+	{INDUSTRIAL_DIGITAL_IN_4_CALLBACK_INTERRUPT, industrial_digital_in_4_callback_wrapper_interrupt},
+};
+
 void industrial_digital_in_4_create(IndustrialDigitalIn4 *industrial_digital_in_4, const char *uid, IPConnection *ipcon) {
 	DevicePrivate *device_p;
 
@@ -190,7 +194,8 @@ void industrial_digital_in_4_create(IndustrialDigitalIn4 *industrial_digital_in_
 	device_p->response_expected[INDUSTRIAL_DIGITAL_IN_4_FUNCTION_GET_EDGE_COUNT_CONFIG] = DEVICE_RESPONSE_EXPECTED_ALWAYS_TRUE;
 	device_p->response_expected[INDUSTRIAL_DIGITAL_IN_4_FUNCTION_GET_IDENTITY] = DEVICE_RESPONSE_EXPECTED_ALWAYS_TRUE;
 
-	device_p->callback_wrappers[INDUSTRIAL_DIGITAL_IN_4_CALLBACK_INTERRUPT] = industrial_digital_in_4_callback_wrapper_interrupt;
+	device_set_callback_wrappers(device_p, industrial_digital_in_4_callback_wrappers,
+	                             sizeof(industrial_digital_in_4_callback_wrappers) / sizeof(industrial_digital_in_4_callback_wrappers[0]));
 }
 
 void industrial_digital_in_4_destroy(IndustrialDigitalIn4 *industrial_digital_in_4) {
@@ -79,9 +79,9 @@ typedef struct {
 
 static void motion_detector_callback_wrapper_motion_detected(DevicePrivate *device_p, Packet *packet) {
 	MotionDetectedCallbackFunction callback_function;
-	void *user_data = device_p->registered_callback_user_data[MOTION_DETECTOR_CALLBACK_MOTION_DETECTED];
+	void *user_data;
 	(void)packet;
-	*(void **)(&callback_function) = device_p->registered_callbacks[MOTION_DETECTOR_CALLBACK_MOTION_DETECTED];
+	*(void **)(&callback_function) = device_get_registered_callback(device_p, MOTION_DETECTOR_CALLBACK_MOTION_DETECTED, &user_data);
 
 	if (callback_function == NULL) {
 		return;
@@ -92,9 +92,9 @@ static void motion_detector_callback_wrapper_motion_detected(DevicePrivate *devi
 
 static void motion_detector_callback_wrapper_detection_cycle_ended(DevicePrivate *device_p, Packet *packet) {
 	DetectionCycleEndedCallbackFunction callback_function;
-	void *user_data = device_p->registered_callback_user_data[MOTION_DETECTOR_CALLBACK_DETECTION_CYCLE_ENDED];
+	void *user_data;
 	(void)packet;
-	*(void **)(&callback_function) = device_p->registered_callbacks[MOTION_DETECTOR_CALLBACK_DETECTION_CYCLE_ENDED];
+	*(void **)(&callback_function) = device_get_registered_callback(device_p, MOTION_DETECTOR_CALLBACK_DETECTION_CYCLE_ENDED, &user_data);
 
 	if (callback_function == NULL) {
 		return;
@@ -103,6 +103,11 @@ static void motion_detector_callback_wrapper_detection_cycle_ended(DevicePrivate
 	callback_function(user_data);
 }
 
+static const DeviceCallbackWrapper motion_detector_callback_wrappers[] = {
+	{MOTION_DETECTOR_CALLBACK_MOTION_DETECTED, motion_detector_callback_wrapper_motion_detected},
+	{MOTION_DETECTOR_CALLBACK_DETECTION_CYCLE_ENDED, motion_detector_callback_wrapper_detection_cycle_ended},
+};
+
 void motion_detector_create(MotionDetector *motion_detector, const char *uid, IPConnection *ipcon) {
 	DevicePrivate *device_p;
 
@@ -115,8 +120,8 @@ void motion_detector_create(MotionDetector *motion_detector, const char *uid, IP
 	device_p->response_expected[MOTION_DETECTOR_CALLBACK_DETECTION_CYCLE_ENDED] = DEVICE_RESPONSE_EXPECTED_ALWAYS_FALSE;
 	device_p->response_expected[MOTION_DETECTOR_FUNCTION_GET_IDENTITY] = DEVICE_RESPONSE_EXPECTED_ALWAYS_TRUE;
 
-	device_p->callback_wrappers[MOTION_DETECTOR_CALLBACK_MOTION_DETECTED] = motion_detector_callback_wrapper_motion_detected;
-	device_p->callback_wrappers[MOTION_DETECTOR_CALLBACK_DETECTION_CYCLE_ENDED] = motion_detector_callback_wrapper_detection_cycle_ended;
+	device_set_callback_wrappers(device_p, motion_detector_callback_wrappers,
+	                             sizeof(motion_detector_callback_wrappers) / sizeof(motion_detector_callback_wrappers[0]));
 }
 
 void motion_detector_destroy(MotionDetector *motion_detector) {
@@ -141,9 +141,9 @@ typedef struct {
 
 static void temperature_callback_wrapper_temperature(DevicePrivate *device_p, Packet *packet) {
 	TemperatureCallbackFunction callback_function;
-	void *user_data = device_p->registered_callback_user_data[TEMPERATURE_CALLBACK_TEMPERATURE];
+	void *user_data;
 	TemperatureCallback_ *callback = (TemperatureCallback_ *)packet;
-	*(void **)(&callback_function) = device_p->registered_callbacks[TEMPERATURE_CALLBACK_TEMPERATURE];
+	*(void **)(&callback_function) = device_get_registered_callback(device_p, TEMPERATURE_CALLBACK_TEMPERATURE, &user_data);
 
 	if (callback_function == NULL) {
 		return;
@@ -156,9 +156,9 @@ static void temperature_callback_wrapper_temperature(DevicePrivate *device_p, Pa
 
 static void temperature_callback_wrapper_temperature_reached(DevicePrivate *device_p, Packet *packet) {
 	TemperatureReachedCallbackFunction callback_function;
-	void *user_data = device_p->registered_callback_user_data[TEMPERATURE_CALLBACK_TEMPERATURE_REACHED];
+	void *user_data;
 	TemperatureReachedCallback_ *callback = (TemperatureReachedCallback_ *)packet;
-	*(void **)(&callback_function) = device_p->registered_callbacks[TEMPERATURE_CALLBACK_TEMPERATURE_REACHED];
+	*(void **)(&callback_function) = device_get_registered_callback(device_p, TEMPERATURE_CALLBACK_TEMPERATURE_REACHED, &user_data);
 
 	if (callback_function == NULL) {
 		return;
@@ -169,6 +169,11 @@ static void temperature_callback_wrapper_temperature_reached(DevicePrivate *devi
 	callback_function(callback->temperature, user_data);
 }
 
+static const DeviceCallbackWrapper temperature_callback_wrappers[] = {
+	{TEMPERATURE_CALLBACK_TEMPERATURE, temperature_callback_wrapper_temperature},
+	{TEMPERATURE_CALLBACK_TEMPERATURE_REACHED, temperature_callback_wrapper_temperature_reached},
+};
+
 void temperature_create(Temperature *temperature, const char *uid, IPConnection *ipcon) {
 	DevicePrivate *device_p;
 
@@ -189,8 +194,8 @@ void temperature_create(Temperature *temperature, const char *uid, IPConnection
 	device_p->response_expected[TEMPERATURE_FUNCTION_GET_I2C_MODE] = DEVICE_RESPONSE_EXPECTED_ALWAYS_TRUE;
 	device_p->response_expected[TEMPERATURE_FUNCTION_GET_IDENTITY] = DEVICE_RESPONSE_EXPECTED_ALWAYS_TRUE;
 
-	device_p->callback_wrappers[TEMPERATURE_CALLBACK_TEMPERATURE] = temperature_callback_wrapper_temperature;
-	device_p->callback_wrappers[TEMPERATURE_CALLBACK_TEMPERATURE_REACHED] = temperature_callback_wrapper_temperature_reached;
+	device_set_callback_wrappers(device_p, temperature_callback_wrappers,
+	                             sizeof(temperature_callback_wrappers) / sizeof(temperature_callback_wrappers[0]));
 }
 
 void temperature_destroy(Temperature *temperature) {
@@ -196,9 +196,9 @@ typedef struct {
 
 static void temperature_ir_callback_wrapper_ambient_temperature(DevicePrivate *device_p, Packet *packet) {
 	AmbientTemperatureCallbackFunction callback_function;
-	void *user_data = device_p->registered_callback_user_data[TEMPERATURE_IR_CALLBACK_AMBIENT_TEMPERATURE];
+	void *user_data;
 	AmbientTemperatureCallback_ *callback = (AmbientTemperatureCallback_ *)packet;
-	*(void **)(&callback_function) = device_p->registered_callbacks[TEMPERATURE_IR_CALLBACK_AMBIENT_TEMPERATURE];
+	*(void **)(&callback_function) = device_get_registered_callback(device_p, TEMPERATURE_IR_CALLBACK_AMBIENT_TEMPERATURE, &user_data);
 
 	if (callback_function == NULL) {
 		return;
@@ -211,9 +211,9 @@ static void temperature_ir_callback_wrapper_ambient_temperature(DevicePrivate *d
 
 static void temperature_ir_callback_wrapper_object_temperature(DevicePrivate *device_p, Packet *packet) {
 	ObjectTemperatureCallbackFunction callback_function;
-	void *user_data = device_p->registered_callback_user_data[TEMPERATURE_IR_CALLBACK_OBJECT_TEMPERATURE];
+	void *user_data;
 	ObjectTemperatureCallback_ *callback = (ObjectTemperatureCallback_ *)packet;
-	*(void **)(&callback_function) = device_p->registered_callbacks[TEMPERATURE_IR_CALLBACK_OBJECT_TEMPERATURE];
+	*(void **)(&callback_function) = device_get_registered_callback(device_p, TEMPERATURE_IR_CALLBACK_OBJECT_TEMPERATURE, &user_data);
 
 	if (callback_function == NULL) {
 		return;
@@ -226,9 +226,9 @@ static void temperature_ir_callback_wrapper_object_temperature(DevicePrivate *de
 
 static void temperature_ir_callback_wrapper_ambient_temperature_reached(DevicePrivate *device_p, Packet *packet) {
 	AmbientTemperatureReachedCallbackFunction callback_function;
-	void *user_data = device_p->registered_callback_user_data[TEMPERATURE_IR_CALLBACK_AMBIENT_TEMPERATURE_REACHED];
+	void *user_data;
 	AmbientTemperatureReachedCallback_ *callback = (AmbientTemperatureReachedCallback_ *)packet;
-	*(void **)(&callback_function) = device_p->registered_callbacks[TEMPERATURE_IR_CALLBACK_AMBIENT_TEMPERATURE_REACHED];
+	*(void **)(&callback_function) = device_get_registered_callback(device_p, TEMPERATURE_IR_CALLBACK_AMBIENT_TEMPERATURE_REACHED, &user_data);
 
 	if (callback_function == NULL) {
 		return;
@@ -241,9 +241,9 @@ static void temperature_ir_callback_wrapper_ambient_temperature_reached(DevicePr
 
 static void temperature_ir_callback_wrapper_object_temperature_reached(DevicePrivate *device_p, Packet *packet) {
 	ObjectTemperatureReachedCallbackFunction callback_function;
-	void *user_data = device_p->registered_callback_user_data[TEMPERATURE_IR_CALLBACK_OBJECT_TEMPERATURE_REACHED];
+	void *user_data;
 	ObjectTemperatureReachedCallback_ *callback = (ObjectTemperatureReachedCallback_ *)packet;
-	*(void **)(&callback_function) = device_p->registered_callbacks[TEMPERATURE_IR_CALLBACK_OBJECT_TEMPERATURE_REACHED];
+	*(void **)(&callback_function) = device_get_registered_callback(device_p, TEMPERATURE_IR_CALLBACK_OBJECT_TEMPERATURE_REACHED, &user_data);
 
 	if (callback_function == NULL) {
 		return;
@@ -254,6 +254,13 @@ static void temperature_ir_callback_wrapper_object_temperature_reached(DevicePri
 	callback_function(callback->temperature, user_data);
 }
 
+static const DeviceCallbackWrapper temperature_ir_callback_wrappers[] = {
+	{TEMPERATURE_IR_CALLBACK_AMBIENT_TEMPERATURE, temperature_ir_callback_wrapper_ambient_temperature},
+	{TEMPERATURE_IR_CALLBACK_OBJECT_TEMPERATURE, temperature_ir_callback_wrapper_object_temperature},
+	{TEMPERATURE_IR_CALLBACK_AMBIENT_TEMPERATURE_REACHED, temperature_ir_callback_wrapper_ambient_temperature_reached},
+	{TEMPERATURE_IR_CALLBACK_OBJECT_TEMPERATURE_REACHED, temperature_ir_callback_wrapper_object_temperature_reached},
+};
+
 void temperature_ir_create(TemperatureIR *temperature_ir, const char *uid, IPConnection *ipcon) {
 	DevicePrivate *device_p;
 
@@ -281,10 +288,8 @@ void temperature_ir_create(TemperatureIR *temperature_ir, const char *uid, IPCon
 	device_p->response_expected[TEMPERATURE_IR_CALLBACK_OBJECT_TEMPERATURE_REACHED] = DEVICE_RESPONSE_EXPECTED_ALWAYS_FALSE;
 	device_p->response_expected[TEMPERATURE_IR_FUNCTION_GET_IDENTITY] = DEVICE_RESPONSE_EXPECTED_ALWAYS_TRUE;
 
-	device_p->callback_wrappers[TEMPERATURE_IR_CALLBACK_AMBIENT_TEMPERATURE] = temperature_ir_callback_wrapper_ambient_temperature;
-	device_p->callback_wrappers[TEMPERATURE_IR_CALLBACK_OBJECT_TEMPERATURE] = temperature_ir_callback_wrapper_object_temperature;
-	device_p->callback_wrappers[TEMPERATURE_IR_CALLBACK_AMBIENT_TEMPERATURE_REACHED] = temperature_ir_callback_wrapper_ambient_temperature_reached;
-	device_p->callback_wrappers[TEMPERATURE_IR_CALLBACK_OBJECT_TEMPERATURE_REACHED] = temperature_ir_callback_wrapper_object_temperature_reached;
+	device_set_callback_wrappers(device_p, temperature_ir_callback_wrappers,
+	                             sizeof(temperature_ir_callback_wrappers) / sizeof(temperature_ir_callback_wrappers[0]));
 }
 
 void temperature_ir_destroy(TemperatureIR *temperature_ir) {
@@ -37,6 +37,11 @@
 	#include <netinet/tcp.h> // TCP_NO_DELAY
 	#include <netdb.h> // gethostbyname
 	#include <netinet/in.h> // struct sockaddr_in
+	#include <sys/resource.h> // setpriority
+	#include <sched.h> // SCHED_FIFO, cpu_set_t
+	#ifdef __linux__
+		#include <sys/syscall.h> // SYS_gettid
+	#endif
 #endif
 
 #ifdef _MSC_VER
@@ -344,6 +349,25 @@ static int gettimeofday(struct timeval *tv, struct timezone *tz) {
 
 #endif
 
+// monotonic clock for latency measurements
+static uint64_t microseconds(void) {
+#ifdef _WIN32
+	LARGE_INTEGER frequency;
+	LARGE_INTEGER counter;
+
+	QueryPerformanceFrequency(&frequency);
+	QueryPerformanceCounter(&counter);
+
+	return (uint64_t)(counter.QuadPart / (frequency.QuadPart / 1000000));
+#else
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+#endif
+}
+
 #ifndef _WIN32
 
 static int read_uint32_non_blocking(const char *filename, uint32_t *value) {
@@ -819,6 +843,10 @@ static int semaphore_acquire(Semaphore *semaphore) {
 	return WaitForSingleObject(semaphore->handle, INFINITE) != WAIT_OBJECT_0 ? -1 : 0;
 }
 
+static int semaphore_try_acquire(Semaphore *semaphore) {
+	return WaitForSingleObject(semaphore->handle, 0) != WAIT_OBJECT_0 ? -1 : 0;
+}
+
 static void semaphore_release(Semaphore *semaphore) {
 	ReleaseSemaphore(semaphore->handle, 1, NULL);
 }
@@ -857,6 +885,10 @@ static int semaphore_acquire(Semaphore *semaphore) {
 	return sem_wait(semaphore->pointer) < 0 ? -1 : 0;
 }
 
+static int semaphore_try_acquire(Semaphore *semaphore) {
+	return sem_trywait(semaphore->pointer) < 0 ? -1 : 0;
+}
+
 static void semaphore_release(Semaphore *semaphore) {
 	sem_post(semaphore->pointer);
 }
@@ -904,6 +936,21 @@ static void thread_sleep(int msec) {
 	Sleep(msec);
 }
 
+// returns -1 if the priority or the CPU could not be set
+static int thread_set_scheduling(Thread *thread, int priority, int cpu) {
+	int ret = 0;
+
+	if (priority > 0 && !SetThreadPriority(thread->handle, THREAD_PRIORITY_TIME_CRITICAL)) {
+		ret = -1;
+	}
+
+	if (cpu >= 0 && SetThreadAffinityMask(thread->handle, (DWORD_PTR)1 << cpu) == 0) {
+		ret = -1;
+	}
+
+	return ret;
+}
+
 #else
 
 static void *thread_wrapper(void *opaque) {
@@ -937,6 +984,39 @@ static void thread_sleep(int msec) {
 	usleep(msec * 1000);
 }
 
+// returns -1 if the priority or the CPU could not be set, e.g. because
+// SCHED_FIFO needs CAP_SYS_NICE or an rtprio limit
+static int thread_set_scheduling(Thread *thread, int priority, int cpu) {
+	struct sched_param param;
+	int ret = 0;
+
+	if (priority > 0) {
+		memset(&param, 0, sizeof(param));
+		param.sched_priority = priority;
+
+		if (pthread_setschedparam(thread->handle, SCHED_FIFO, &param) != 0) {
+			ret = -1;
+		}
+	}
+
+	if (cpu >= 0) {
+#ifdef __linux__
+		cpu_set_t cpus;
+
+		CPU_ZERO(&cpus);
+		CPU_SET(cpu, &cpus);
+
+		if (pthread_setaffinity_np(thread->handle, sizeof(cpus), &cpus) != 0) {
+			ret = -1;
+		}
+#else
+		ret = -1;
+#endif
+	}
+
+	return ret;
+}
+
 #endif
 
 /*****************************************************************************
@@ -1051,14 +1131,153 @@ typedef struct {
 	uint64_t socket_id;
 } Meta;
 
-static void queue_create(Queue *queue) {
+typedef struct _PoolBlock {
+	PacketPool *pool; // NULL if allocated by malloc
+	struct _PoolBlock *next; // in the free list
+	union {
+		QueueItem item;
+		Packet packet;
+	} data;
+} PoolBlock;
+
+static void pool_create(PacketPool *pool) {
+	pool->free_blocks = NULL;
+	pool->storage = NULL;
+	pool->size = 0;
+	pool->available = 0;
+	pool->misses = 0;
+
+	mutex_create(&pool->mutex);
+}
+
+// NOTE: assumes that no block is in use
+static void pool_destroy(PacketPool *pool) {
+	free(pool->storage);
+
+	mutex_destroy(&pool->mutex);
+}
+
+static int pool_reserve(PacketPool *pool, uint32_t size) {
+	PoolBlock *blocks;
+	uint32_t i;
+
+	if (pool->storage != NULL || size == 0) {
+		return -1;
+	}
+
+	blocks = (PoolBlock *)malloc(size * sizeof(PoolBlock));
+
+	if (blocks == NULL) {
+		return -1;
+	}
+
+	// touch every page now, not on first use
+	memset(blocks, 0, size * sizeof(PoolBlock));
+
+	for (i = 0; i < size; ++i) {
+		blocks[i].pool = pool;
+		blocks[i].next = i + 1 < size ? &blocks[i + 1] : NULL;
+	}
+
+	mutex_lock(&pool->mutex);
+
+	pool->free_blocks = blocks;
+	pool->storage = blocks;
+	pool->size = size;
+	pool->available = size;
+	pool->misses = 0;
+
+	mutex_unlock(&pool->mutex);
+
+	return 0;
+}
+
+// returns storage for a QueueItem or a Packet
+static void *pool_alloc(PacketPool *pool) {
+	PoolBlock *block = NULL;
+
+	if (pool != NULL) {
+		mutex_lock(&pool->mutex);
+
+		block = pool->free_blocks;
+
+		if (block != NULL) {
+			pool->free_blocks = block->next;
+			--pool->available;
+		} else if (pool->size > 0) {
+			++pool->misses;
+		}
+
+		mutex_unlock(&pool->mutex);
+	}
+
+	if (block == NULL) {
+		block = (PoolBlock *)malloc(sizeof(PoolBlock));
+		block->pool = NULL;
+	}
+
+	return &block->data;
+}
+
+static void pool_free(void *data) {
+	PoolBlock *block;
+	PacketPool *pool;
+
+	if (data == NULL) {
+		return;
+	}
+
+	block = (PoolBlock *)((uint8_t *)data - offsetof(PoolBlock, data));
+	pool = block->pool;
+
+	if (pool == NULL) {
+		free(block);
+
+		return;
+	}
+
+	mutex_lock(&pool->mutex);
+
+	block->next = pool->free_blocks;
+	pool->free_blocks = block;
+	++pool->available;
+
+	mutex_unlock(&pool->mutex);
+}
+
+// packets come from the pool, meta data from malloc
+static void queue_free_data(int kind, void *data) {
+	if (kind == QUEUE_KIND_PACKET) {
+		pool_free(data);
+	} else {
+		free(data);
+	}
+}
+
+static void queue_create(Queue *queue, PacketPool *pool) {
 	queue->head = NULL;
 	queue->tail = NULL;
+	queue->length = 0;
+	queue->pool = pool;
 
 	mutex_create(&queue->mutex);
 	semaphore_create(&queue->semaphore);
 }
 
+// removes the head of its stream from the stream. NOTE: assumes that the
+// queue_mutex of the device is locked
+static void queue_stream_pop(QueueItem *item) {
+	DeviceQueueStream *stream = item->stream;
+
+	stream->head = item->stream_next;
+
+	if (stream->tail == item) {
+		stream->tail = NULL;
+	}
+
+	--stream->queued;
+}
+
 static void queue_destroy(Queue *queue) {
 	QueueItem *item = queue->head;
 	QueueItem *next;
@@ -1066,8 +1285,17 @@ static void queue_destroy(Queue *queue) {
 	while (item != NULL) {
 		next = item->next;
 
-		free(item->data);
-		free(item);
+		if (item->device != NULL) {
+			// the stream keeps its policy for the next connection
+			mutex_lock(&item->device->queue_mutex);
+			queue_stream_pop(item);
+			mutex_unlock(&item->device->queue_mutex);
+
+			device_release(item->device);
+		}
+
+		queue_free_data(item->kind, item->data);
+		pool_free(item);
 
 		item = next;
 	}
@@ -1076,12 +1304,17 @@ static void queue_destroy(Queue *queue) {
 	semaphore_destroy(&queue->semaphore);
 }
 
-static void queue_put(Queue *queue, int kind, void *data) {
-	QueueItem *item = (QueueItem *)malloc(sizeof(QueueItem));
+static void queue_put_timestamped(Queue *queue, int kind, void *data, uint64_t timestamp) {
+	QueueItem *item = (QueueItem *)pool_alloc(queue->pool);
 
 	item->next = NULL;
+	item->prev = NULL;
 	item->kind = kind;
 	item->data = data;
+	item->timestamp = timestamp;
+	item->device = NULL;
+	item->stream = NULL;
+	item->stream_next = NULL;
 
 	mutex_lock(&queue->mutex);
 
@@ -1089,1209 +1322,2870 @@ static void queue_put(Queue *queue, int kind, void *data) {
 		queue->head = item;
 		queue->tail = item;
 	} else {
+		item->prev = queue->tail;
 		queue->tail->next = item;
 		queue->tail = item;
 	}
 
+	++queue->length;
+
 	mutex_unlock(&queue->mutex);
 	semaphore_release(&queue->semaphore);
 }
 
-static int queue_get(Queue *queue, int *kind, void **data) {
-	QueueItem *item;
-
-	if (semaphore_acquire(&queue->semaphore) < 0) {
-		return -1;
-	}
-
-	mutex_lock(&queue->mutex);
+// NOTE: assumes that device_p->queue_mutex is locked
+static DeviceQueueStream *device_find_queue_stream(DevicePrivate *device_p, uint8_t function_id) {
+	DeviceQueueStream *stream;
+	int i;
 
-	if (queue->head == NULL) {
-		mutex_unlock(&queue->mutex);
+	for (i = 0; i < DEVICE_NUM_QUEUE_STREAMS; ++i) {
+		stream = &device_p->queue_streams[i];
 
-		return -1;
+		if (stream->used && stream->function_id == function_id) {
+			return stream;
+		}
 	}
 
-	item = queue->head;
-	queue->head = item->next;
-	item->next = NULL;
+	return NULL;
+}
 
-	if (queue->tail == item) {
-		queue->head = NULL;
-		queue->tail = NULL;
-	}
+// NOTE: assumes that device_p->queue_mutex is locked
+static DeviceQueueStream *device_add_queue_stream(DevicePrivate *device_p, uint8_t function_id) {
+	DeviceQueueStream *stream;
+	int i;
 
-	mutex_unlock(&queue->mutex);
+	for (i = 0; i < DEVICE_NUM_QUEUE_STREAMS; ++i) {
+		stream = &device_p->queue_streams[i];
 
-	*kind = item->kind;
-	*data = item->data;
+		if (!stream->used) {
+			memset(stream, 0, sizeof(DeviceQueueStream));
 
-	free(item);
+			stream->used = true;
+			stream->function_id = function_id;
+			stream->policy = IPCON_QUEUE_POLICY_KEEP_ALL;
+			stream->depth = 1;
 
-	return 0;
-}
+			return stream;
+		}
+	}
 
-/*****************************************************************************
- *
- *                                 Device
- *
- *****************************************************************************/
+	return NULL;
+}
 
-enum {
-	IPCON_FUNCTION_ENUMERATE = 254
-};
+// unlinks an item of a stream from the queue, it has to be the head of its
+// stream. NOTE: assumes that queue->mutex and the queue_mutex of the device
+// are locked
+static void queue_unlink_stream_head(Queue *queue, QueueItem *item) {
+	if (item->prev != NULL) {
+		item->prev->next = item->next;
+	} else {
+		queue->head = item->next;
+	}
 
-static int ipcon_send_request(IPConnectionPrivate *ipcon_p, Packet *request);
+	if (item->next != NULL) {
+		item->next->prev = item->prev;
+	} else {
+		queue->tail = item->prev;
+	}
 
-// NOTE: assumes device_p->ref_count == 0
-static void device_destroy(DevicePrivate *device_p) {
-	table_remove(&device_p->ipcon_p->devices, device_p->uid);
+	--queue->length;
 
-	event_destroy(&device_p->response_event);
+	queue_stream_pop(item);
+}
 
-	mutex_destroy(&device_p->response_mutex);
+// puts a callback packet into the queue according to the queue policy of its
+// stream. a packet with a policy takes over the reference to device_p that
+// the caller holds, returns false if the caller still has to release it
+static bool queue_put_packet(Queue *queue, DevicePrivate *device_p, Packet *packet,
+                             uint64_t timestamp) {
+	DeviceQueueStream *stream = NULL;
+	DeviceQueueStream *fallback;
+	QueueItem *item;
+	QueueItem *dropped = NULL;
+	bool taken = false;
+	bool added = true;
 
-	mutex_destroy(&device_p->request_mutex);
+	item = (QueueItem *)pool_alloc(queue->pool);
 
-	free(device_p);
-}
+	item->next = NULL;
+	item->prev = NULL;
+	item->kind = QUEUE_KIND_PACKET;
+	item->data = packet;
+	item->timestamp = timestamp;
+	item->device = NULL;
+	item->stream = NULL;
+	item->stream_next = NULL;
 
-void device_create(Device *device, const char *uid_str,
-                   IPConnectionPrivate *ipcon_p, uint8_t api_version_major,
-                   uint8_t api_version_minor, uint8_t api_version_release) {
-	DevicePrivate *device_p;
-	uint64_t uid;
-	uint32_t value1;
-	uint32_t value2;
-	int i;
+	mutex_lock(&queue->mutex);
+	mutex_lock(&device_p->queue_mutex);
 
-	device_p = (DevicePrivate *)malloc(sizeof(DevicePrivate));
-	device->p = device_p;
+	if (device_p->queue_streams[0].used) {
+		stream = device_find_queue_stream(device_p, packet->header.function_id);
 
-	uid = base58_decode(uid_str);
+		if (stream == NULL) {
+			// every function ID is a stream of its own, created from the default
+			fallback = device_find_queue_stream(device_p, 0);
 
-	if (uid > 0xFFFFFFFF) {
-		// convert from 64bit to 32bit
-		value1 = uid & 0xFFFFFFFF;
-		value2 = (uid >> 32) & 0xFFFFFFFF;
+			if (fallback != NULL && fallback->policy != IPCON_QUEUE_POLICY_KEEP_ALL) {
+				stream = device_add_queue_stream(device_p, packet->header.function_id);
 
-		uid  = (value1 & 0x00000FFF);
-		uid |= (value1 & 0x0F000000) >> 12;
-		uid |= (value2 & 0x0000003F) << 16;
-		uid |= (value2 & 0x000F0000) << 6;
-		uid |= (value2 & 0x3F000000) << 2;
+				if (stream != NULL) {
+					stream->inherited = true;
+					stream->policy = fallback->policy;
+					stream->depth = fallback->depth;
+				}
+			}
+		}
 	}
 
-	device_p->ref_count = 1;
+	if (stream != NULL && stream->policy == IPCON_QUEUE_POLICY_CONFLATE &&
+	    stream->tail != NULL) {
+		// replace the queued packet in its place
+		pool_free(stream->tail->data);
 
-	device_p->uid = uid & 0xFFFFFFFF;
+		stream->tail->data = packet;
+		stream->tail->timestamp = timestamp;
+		++stream->dropped;
 
-	device_p->ipcon_p = ipcon_p;
+		pool_free(item);
 
-	device_p->api_version[0] = api_version_major;
-	device_p->api_version[1] = api_version_minor;
-	device_p->api_version[2] = api_version_release;
+		added = false;
+	} else if (stream != NULL) {
+		// after the depth was lowered the stream shrinks by one packet per put
+		if (stream->policy == IPCON_QUEUE_POLICY_DROP_OLDEST &&
+		    stream->head != NULL && stream->queued >= stream->depth) {
+			dropped = stream->head;
 
-	// request
-	mutex_create(&device_p->request_mutex);
+			queue_unlink_stream_head(queue, dropped);
+			++stream->dropped;
+		}
 
-	// response
-	device_p->expected_response_function_id = 0;
-	device_p->expected_response_sequence_number = 0;
+		item->device = device_p;
+		item->stream = stream;
+		taken = true;
 
-	mutex_create(&device_p->response_mutex);
+		if (stream->tail == NULL) {
+			stream->head = item;
+		} else {
+			stream->tail->stream_next = item;
+		}
 
-	memset(&device_p->response_packet, 0, sizeof(Packet));
+		stream->tail = item;
+		++stream->queued;
+	}
 
-	event_create(&device_p->response_event);
+	mutex_unlock(&device_p->queue_mutex);
 
-	for (i = 0; i < DEVICE_NUM_FUNCTION_IDS; i++) {
-		device_p->response_expected[i] = DEVICE_RESPONSE_EXPECTED_INVALID_FUNCTION_ID;
+	if (added) {
+		if (queue->tail == NULL) {
+			queue->head = item;
+			queue->tail = item;
+		} else {
+			item->prev = queue->tail;
+			queue->tail->next = item;
+			queue->tail = item;
+		}
+
+		++queue->length;
 	}
 
-	device_p->response_expected[IPCON_FUNCTION_ENUMERATE] = DEVICE_RESPONSE_EXPECTED_ALWAYS_FALSE;
-	device_p->response_expected[IPCON_CALLBACK_ENUMERATE] = DEVICE_RESPONSE_EXPECTED_ALWAYS_FALSE;
+	mutex_unlock(&queue->mutex);
 
-	// callbacks
-	for (i = 0; i < DEVICE_NUM_FUNCTION_IDS; i++) {
-		device_p->registered_callbacks[i] = NULL;
-		device_p->registered_callback_user_data[i] = NULL;
-		device_p->callback_wrappers[i] = NULL;
+	// a dropped packet only makes room for the new one, the number of
+	// queued items stays the same
+	if (added && dropped == NULL) {
+		semaphore_release(&queue->semaphore);
 	}
 
-	// add to IPConnection
-	table_insert(&ipcon_p->devices, device_p->uid, device_p);
-}
+	if (dropped != NULL) {
+		device_release(dropped->device);
 
-void device_release(DevicePrivate *device_p) {
-	IPConnectionPrivate *ipcon_p = device_p->ipcon_p;
+		pool_free(dropped->data);
+		pool_free(dropped);
+	}
 
-	mutex_lock(&ipcon_p->devices_ref_mutex);
+	return taken;
+}
 
-	--device_p->ref_count;
+static void queue_put(Queue *queue, int kind, void *data) {
+	queue_put_timestamped(queue, kind, data, 0);
+}
 
-	if (device_p->ref_count == 0) {
-		device_destroy(device_p);
-	}
+// NOTE: assumes that the semaphore was acquired
+static int queue_take(Queue *queue, int *kind, void **data, uint64_t *timestamp) {
+	QueueItem *item;
 
-	mutex_unlock(&ipcon_p->devices_ref_mutex);
-}
+	mutex_lock(&queue->mutex);
 
-int device_get_response_expected(DevicePrivate *device_p, uint8_t function_id,
-                                 bool *ret_response_expected) {
-	int flag = device_p->response_expected[function_id];
+	if (queue->head == NULL) {
+		mutex_unlock(&queue->mutex);
 
-	if (flag == DEVICE_RESPONSE_EXPECTED_INVALID_FUNCTION_ID) {
-		return E_INVALID_PARAMETER;
+		return -1;
 	}
 
-	if (flag == DEVICE_RESPONSE_EXPECTED_ALWAYS_TRUE ||
-	    flag == DEVICE_RESPONSE_EXPECTED_TRUE) {
-		*ret_response_expected = true;
+	item = queue->head;
+
+	if (item->stream != NULL) {
+		mutex_lock(&item->device->queue_mutex);
+		queue_unlink_stream_head(queue, item);
+		mutex_unlock(&item->device->queue_mutex);
 	} else {
-		*ret_response_expected = false;
-	}
+		queue->head = item->next;
 
-	return E_OK;
-}
+		if (queue->head != NULL) {
+			queue->head->prev = NULL;
+		}
 
-int device_set_response_expected(DevicePrivate *device_p, uint8_t function_id,
-                                 bool response_expected) {
-	int current_flag = device_p->response_expected[function_id];
+		if (queue->tail == item) {
+			queue->head = NULL;
+			queue->tail = NULL;
+		}
 
-	if (current_flag != DEVICE_RESPONSE_EXPECTED_TRUE &&
-	    current_flag != DEVICE_RESPONSE_EXPECTED_FALSE) {
-		return E_INVALID_PARAMETER;
+		--queue->length;
 	}
 
-	device_p->response_expected[function_id] =
-	    response_expected ? DEVICE_RESPONSE_EXPECTED_TRUE
-	                      : DEVICE_RESPONSE_EXPECTED_FALSE;
+	item->next = NULL;
 
-	return E_OK;
-}
+	mutex_unlock(&queue->mutex);
 
-int device_set_response_expected_all(DevicePrivate *device_p, bool response_expected) {
-	int flag = response_expected ? DEVICE_RESPONSE_EXPECTED_TRUE
-	                             : DEVICE_RESPONSE_EXPECTED_FALSE;
-	int i;
+	*kind = item->kind;
+	*data = item->data;
+	*timestamp = item->timestamp;
 
-	for (i = 0; i < DEVICE_NUM_FUNCTION_IDS; ++i) {
-		if (device_p->response_expected[i] == DEVICE_RESPONSE_EXPECTED_TRUE ||
-		    device_p->response_expected[i] == DEVICE_RESPONSE_EXPECTED_FALSE) {
-			device_p->response_expected[i] = flag;
-		}
+	if (item->device != NULL) {
+		device_release(item->device);
 	}
 
-	return E_OK;
+	pool_free(item);
+
+	return 0;
 }
 
-void device_register_callback(DevicePrivate *device_p, uint8_t id, void *callback,
-                              void *user_data) {
-	device_p->registered_callbacks[id] = callback;
-	device_p->registered_callback_user_data[id] = user_data;
+static int queue_get(Queue *queue, int *kind, void **data, uint64_t *timestamp) {
+	if (semaphore_acquire(&queue->semaphore) < 0) {
+		return -1;
+	}
+
+	return queue_take(queue, kind, data, timestamp);
 }
 
-int device_get_api_version(DevicePrivate *device_p, uint8_t ret_api_version[3]) {
-	ret_api_version[0] = device_p->api_version[0];
-	ret_api_version[1] = device_p->api_version[1];
-	ret_api_version[2] = device_p->api_version[2];
+// returns -1 without waiting if the queue is empty
+static int queue_try_get(Queue *queue, int *kind, void **data, uint64_t *timestamp) {
+	if (semaphore_try_acquire(&queue->semaphore) < 0) {
+		return -1;
+	}
 
-	return E_OK;
+	return queue_take(queue, kind, data, timestamp);
 }
 
-int device_send_request(DevicePrivate *device_p, Packet *request, Packet *response) {
-	int ret = E_OK;
-	uint8_t sequence_number = packet_header_get_sequence_number(&request->header);
-	uint8_t response_expected = packet_header_get_response_expected(&request->header);
-	uint8_t error_code;
+static int queue_get_length(Queue *queue) {
+	int length;
 
-	if (response_expected) {
-		mutex_lock(&device_p->request_mutex);
+	mutex_lock(&queue->mutex);
+	length = queue->length;
+	mutex_unlock(&queue->mutex);
 
-		event_reset(&device_p->response_event);
+	return length;
+}
 
-		device_p->expected_response_function_id = request->header.function_id;
-		device_p->expected_response_sequence_number = sequence_number;
+/*****************************************************************************
+ *
+ *                                 Statistics
+ *
+ *****************************************************************************/
+
+#ifdef _MSC_VER
+	#define atomic_add_uint32(ptr, value) \
+		InterlockedExchangeAdd((LONG volatile *)(ptr), (LONG)(value))
+	#define atomic_add_uint64(ptr, value) \
+		InterlockedExchangeAdd64((LONGLONG volatile *)(ptr), (LONGLONG)(value))
+	#define atomic_cas_uint32(ptr, expected, desired) \
+		(InterlockedCompareExchange((LONG volatile *)(ptr), (LONG)(desired), (LONG)(expected)) == (LONG)(expected))
+	#define atomic_cas_pointer(ptr, expected, desired) \
+		(InterlockedCompareExchangePointer((PVOID volatile *)(ptr), (desired), (expected)) == (expected))
+#else
+	#define atomic_add_uint32(ptr, value) __sync_fetch_and_add((ptr), (value))
+	#define atomic_add_uint64(ptr, value) __sync_fetch_and_add((ptr), (value))
+	#define atomic_cas_uint32(ptr, expected, desired) \
+		__sync_bool_compare_and_swap((ptr), (expected), (desired))
+	#define atomic_cas_pointer(ptr, expected, desired) \
+		__sync_bool_compare_and_swap((ptr), (expected), (desired))
+#endif
+
+struct _DeviceStats {
+	uint32_t keys[IPCON_STATS_MAX_FUNCTIONS]; // function ID + 1, 0 if unused
+	FunctionStats functions[IPCON_STATS_MAX_FUNCTIONS];
+};
+
+// returns NULL if stats are disabled. the last slot is shared by all
+// function IDs that don't fit into the table anymore
+static FunctionStats *device_acquire_stats(DevicePrivate *device_p, uint8_t function_id) {
+	DeviceStats *stats;
+	uint32_t key = (uint32_t)function_id + 1;
+	int i;
+
+	if (!device_p->ipcon_p->stats_enabled) {
+		return NULL;
 	}
 
-	ret = ipcon_send_request(device_p->ipcon_p, request);
+	stats = device_p->stats;
 
-	if (ret != E_OK) {
-		if (response_expected) {
-			mutex_unlock(&device_p->request_mutex);
+	if (stats == NULL) {
+		stats = (DeviceStats *)calloc(1, sizeof(DeviceStats));
+
+		if (!atomic_cas_pointer(&device_p->stats, (DeviceStats *)NULL, stats)) {
+			free(stats);
 		}
 
-		return ret;
+		stats = device_p->stats;
 	}
 
-	if (response_expected) {
-		if (event_wait(&device_p->response_event, device_p->ipcon_p->timeout) < 0) {
-			ret = E_TIMEOUT;
+	for (i = 0; i < IPCON_STATS_MAX_FUNCTIONS - 1; ++i) {
+		if (stats->keys[i] == key) {
+			return &stats->functions[i];
 		}
 
-		device_p->expected_response_function_id = 0;
-		device_p->expected_response_sequence_number = 0;
+		if (stats->keys[i] == 0 &&
+		    (atomic_cas_uint32(&stats->keys[i], (uint32_t)0, key) || stats->keys[i] == key)) {
+			return &stats->functions[i];
+		}
+	}
 
-		event_reset(&device_p->response_event);
+	return &stats->functions[IPCON_STATS_MAX_FUNCTIONS - 1];
+}
 
-		if (ret == E_OK) {
-			mutex_lock(&device_p->response_mutex);
+static void function_stats_record_latency(FunctionStats *stats, uint64_t latency) { // in usec
+	uint64_t value = latency / IPCON_STATS_BUCKET_BASE;
+	uint32_t max;
+	int bucket = 0;
 
-			error_code = packet_header_get_error_code(&device_p->response_packet.header);
+	while (value > 0 && bucket < IPCON_STATS_NUM_BUCKETS - 1) {
+		value >>= 1;
+		++bucket;
+	}
 
-			if (device_p->response_packet.header.function_id != request->header.function_id ||
-			    packet_header_get_sequence_number(&device_p->response_packet.header) != sequence_number) {
-				ret = E_TIMEOUT;
-			} else if (error_code == 0) {
-				// no error
-				if (response != NULL) {
-					memcpy(response, &device_p->response_packet,
-					       device_p->response_packet.header.length);
-				}
-			} else if (error_code == 1) {
-				ret = E_INVALID_PARAMETER;
-			} else if (error_code == 2) {
-				ret = E_NOT_SUPPORTED;
-			} else {
-				ret = E_UNKNOWN_ERROR_CODE;
-			}
+	if (latency > 0xFFFFFFFF) {
+		latency = 0xFFFFFFFF;
+	}
 
-			mutex_unlock(&device_p->response_mutex);
-		}
+	atomic_add_uint32(&stats->latency_buckets[bucket], (uint32_t)1);
+	atomic_add_uint64(&stats->latency_sum, latency);
 
-		mutex_unlock(&device_p->request_mutex);
-	}
+	max = stats->latency_max;
 
-	return ret;
+	while (latency > max &&
+	       !atomic_cas_uint32(&stats->latency_max, max, (uint32_t)latency)) {
+		max = stats->latency_max;
+	}
 }
 
 /*****************************************************************************
  *
- *                                 Brick Daemon
+ *                                 Capture
  *
  *****************************************************************************/
 
-enum {
-	BRICK_DAEMON_FUNCTION_GET_AUTHENTICATION_NONCE = 1,
-	BRICK_DAEMON_FUNCTION_AUTHENTICATE = 2
+#ifdef _MSC_VER
+	#define memory_barrier() MemoryBarrier()
+#else
+	#define memory_barrier() __sync_synchronize()
+#endif
+
+#define IPCON_CAPTURE_FLUSH_INTERVAL 10 // in msec
+
+typedef struct {
+	volatile uint32_t sequence;
+	uint64_t timestamp;
+	uint8_t direction;
+	Packet packet;
+} CaptureSlot;
+
+struct _Capture {
+	volatile bool enabled;
+	volatile uint32_t writers; // producers inside capture_put
+	CaptureSlot *slots;
+	uint32_t mask;
+	volatile uint32_t enqueue_position;
+	uint32_t dequeue_position; // only used by the flush thread
+	uint64_t captured;
+	uint64_t dropped;
+	FILE *file;
+	volatile bool flush_flag;
+	Thread flush_thread;
 };
 
-static void brickd_create(BrickDaemon *brickd, const char *uid, IPConnection *ipcon) {
-	DevicePrivate *device_p;
+// wall clock, stored in the file header to map the monotonic timestamps
+static uint64_t realtime_microseconds(void) {
+#ifdef _WIN32
+	FILETIME ft;
+	uint64_t t;
 
-	device_create(brickd, uid, ipcon->p, 2, 0, 0);
+	GetSystemTimeAsFileTime(&ft);
 
-	device_p = brickd->p;
+	t = ((uint64_t)ft.dwHighDateTime << 32) | ft.dwLowDateTime;
 
-	device_p->response_expected[BRICK_DAEMON_FUNCTION_GET_AUTHENTICATION_NONCE] = DEVICE_RESPONSE_EXPECTED_ALWAYS_TRUE;
-	device_p->response_expected[BRICK_DAEMON_FUNCTION_AUTHENTICATE] = DEVICE_RESPONSE_EXPECTED_TRUE;
+	return t / 10 - 11644473600000000ULL; // 100 nsec since 1601 to usec since 1970
+#else
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+
+	return (uint64_t)tv.tv_sec * 1000000 + tv.tv_usec;
+#endif
 }
 
-static void brickd_destroy(BrickDaemon *brickd) {
-	device_release(brickd->p);
+static void capture_reset(Capture *capture) {
+	uint32_t i;
+
+	for (i = 0; i <= capture->mask; ++i) {
+		capture->slots[i].sequence = i;
+	}
+
+	capture->enqueue_position = 0;
+	capture->dequeue_position = 0;
+	capture->captured = 0;
+	capture->dropped = 0;
 }
 
-static int brickd_get_authentication_nonce(BrickDaemon *brickd, uint8_t ret_server_nonce[4]) {
-	DevicePrivate *device_p = brickd->p;
-	GetAuthenticationNonce request;
-	GetAuthenticationNonceResponse response;
-	int ret;
+// bounded MPSC ring after Dmitry Vyukov. producers claim a position with a
+// CAS and publish the slot through its sequence number, a full ring drops
+// the packet instead of blocking the receive loop or the caller
+static void capture_put(Capture *capture, uint8_t direction, Packet *packet) {
+	CaptureSlot *slot;
+	uint32_t position;
+	int32_t diff;
 
-	ret = packet_header_create(&request.header, sizeof(request), BRICK_DAEMON_FUNCTION_GET_AUTHENTICATION_NONCE, device_p->ipcon_p, device_p);
+	atomic_add_uint32(&capture->writers, (uint32_t)1);
 
-	if (ret < 0) {
-		return ret;
+	if (!capture->enabled) {
+		atomic_add_uint32(&capture->writers, (uint32_t)-1);
+
+		return;
 	}
 
-	ret = device_send_request(device_p, (Packet *)&request, (Packet *)&response);
+	for (;;) {
+		position = capture->enqueue_position;
+		slot = &capture->slots[position & capture->mask];
+		diff = (int32_t)(slot->sequence - position);
 
-	if (ret < 0) {
-		return ret;
+		if (diff == 0) {
+			if (atomic_cas_uint32(&capture->enqueue_position, position, position + 1)) {
+				break;
+			}
+		} else if (diff < 0) {
+			atomic_add_uint64(&capture->dropped, (uint64_t)1);
+			atomic_add_uint32(&capture->writers, (uint32_t)-1);
+
+			return;
+		}
 	}
 
-	memcpy(ret_server_nonce, response.server_nonce, 4 * sizeof(uint8_t));
+	slot->timestamp = microseconds();
+	slot->direction = direction;
+	memcpy(&slot->packet, packet, packet->header.length);
 
-	return ret;
+	memory_barrier();
+
+	slot->sequence = position + 1;
+
+	atomic_add_uint64(&capture->captured, (uint64_t)1);
+	atomic_add_uint32(&capture->writers, (uint32_t)-1);
 }
 
-static int brickd_authenticate(BrickDaemon *brickd, uint8_t client_nonce[4], uint8_t digest[20]) {
-	DevicePrivate *device_p = brickd->p;
-	Authenticate request;
-	int ret;
+// returns the number of records written
+static int capture_drain(Capture *capture) {
+	CaptureSlot *slot;
+	uint64_t timestamp;
+	int count = 0;
 
-	ret = packet_header_create(&request.header, sizeof(request), BRICK_DAEMON_FUNCTION_AUTHENTICATE, device_p->ipcon_p, device_p);
+	for (;;) {
+		slot = &capture->slots[capture->dequeue_position & capture->mask];
 
-	if (ret < 0) {
-		return ret;
+		if ((int32_t)(slot->sequence - (capture->dequeue_position + 1)) < 0) {
+			break; // empty
+		}
+
+		memory_barrier();
+
+		timestamp = leconvert_uint64_to(slot->timestamp);
+
+		fwrite(&timestamp, 1, sizeof(timestamp), capture->file);
+		fwrite(&slot->direction, 1, 1, capture->file);
+		fwrite(&slot->packet, 1, slot->packet.header.length, capture->file);
+
+		memory_barrier();
+
+		slot->sequence = capture->dequeue_position + capture->mask + 1;
+		++capture->dequeue_position;
+		++count;
 	}
 
-	memcpy(request.client_nonce, client_nonce, 4 * sizeof(uint8_t));
-	memcpy(request.digest, digest, 20 * sizeof(uint8_t));
+	return count;
+}
 
-	ret = device_send_request(device_p, (Packet *)&request, NULL);
+static void capture_flush_loop(void *opaque) {
+	Capture *capture = (Capture *)opaque;
 
-	return ret;
+	// the capture must not compete with the receive loop
+#ifdef _WIN32
+	SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_LOWEST);
+#elif defined __linux__
+	setpriority(PRIO_PROCESS, (id_t)syscall(SYS_gettid), 19);
+#endif
+
+	while (capture->flush_flag) {
+		if (capture_drain(capture) == 0) {
+			fflush(capture->file);
+			thread_sleep(IPCON_CAPTURE_FLUSH_INTERVAL);
+		}
+	}
+
+	capture_drain(capture);
+	fflush(capture->file);
+}
+
+static void capture_destroy(Capture *capture) {
+	free(capture->slots);
+	free(capture);
 }
 
 /*****************************************************************************
  *
- *                                 IPConnection
+ *                                 Replay
  *
  *****************************************************************************/
 
-struct _CallbackContext {
-	IPConnectionPrivate *ipcon_p;
-	Queue queue;
-	Thread thread;
+#define IPCON_REPLAY_MAX_PENDING 64
+#define IPCON_REPLAY_SYNC_TIMEOUT 500 // in msec
+
+typedef struct {
+	uint32_t uid;
+	uint8_t function_id;
+	uint8_t sequence_number;
+	bool send_pending; // not yet matched with a recorded request
+	bool response_pending; // waiting for a recorded response
+} ReplayRequest;
+
+struct _Replay {
+	FILE *file;
+	double speed; // 0 for max speed
+	Table responses; // uid -> bitmap of function IDs with recorded responses
 	Mutex mutex;
-	bool packet_dispatch_allowed;
+	ReplayRequest requests[IPCON_REPLAY_MAX_PENDING]; // protected by mutex
+	int request_count; // protected by mutex
+	Event request_event;
+	Event stop_event;
+	volatile bool replay_flag;
+	volatile bool done;
+	uint64_t records;
+	Thread thread;
 };
 
-static int ipcon_connect_unlocked(IPConnectionPrivate *ipcon_p, bool is_auto_reconnect);
-static void ipcon_disconnect_unlocked(IPConnectionPrivate *ipcon_p);
+static void ipcon_handle_response(IPConnectionPrivate *ipcon_p, Packet *response);
 
-static DevicePrivate *ipcon_acquire_device(IPConnectionPrivate *ipcon_p, uint32_t uid) {
-	DevicePrivate *device_p;
+// returns 1 for a record, 0 at the end of the file and -1 if it is corrupt
+static int replay_read_record(FILE *file, uint64_t *timestamp, uint8_t *direction,
+                              Packet *packet) {
+	uint8_t prefix[9];
 
-	mutex_lock(&ipcon_p->devices_ref_mutex);
+	if (fread(prefix, 1, sizeof(prefix), file) != sizeof(prefix)) {
+		return 0;
+	}
 
-	device_p = (DevicePrivate *)table_get(&ipcon_p->devices, uid);
+	memcpy(timestamp, prefix, sizeof(*timestamp));
 
-	if (device_p != NULL) {
-		++device_p->ref_count;
+	*timestamp = leconvert_uint64_from(*timestamp);
+	*direction = prefix[8];
+
+	if (fread(packet, 1, sizeof(PacketHeader), file) != sizeof(PacketHeader)) {
+		return 0;
 	}
 
-	mutex_unlock(&ipcon_p->devices_ref_mutex);
+	if (packet->header.length < sizeof(PacketHeader) ||
+	    packet->header.length > sizeof(Packet)) {
+		return -1;
+	}
 
-	return device_p;
+	if (fread((uint8_t *)packet + sizeof(PacketHeader), 1,
+	          packet->header.length - sizeof(PacketHeader), file) !=
+	    packet->header.length - sizeof(PacketHeader)) {
+		return 0;
+	}
+
+	return 1;
 }
 
-static void ipcon_dispatch_meta(IPConnectionPrivate *ipcon_p, Meta *meta) {
-	ConnectedCallbackFunction connected_callback_function;
-	DisconnectedCallbackFunction disconnected_callback_function;
-	void *user_data;
-	bool retry;
+static bool replay_has_response(Replay *replay, uint32_t uid, uint8_t function_id) {
+	uint8_t *bitmap = (uint8_t *)table_get(&replay->responses, uid);
 
-	if (meta->function_id == IPCON_CALLBACK_CONNECTED) {
-		if (ipcon_p->registered_callbacks[IPCON_CALLBACK_CONNECTED] != NULL) {
-			*(void **)(&connected_callback_function) = ipcon_p->registered_callbacks[IPCON_CALLBACK_CONNECTED];
-			user_data = ipcon_p->registered_callback_user_data[IPCON_CALLBACK_CONNECTED];
+	return bitmap != NULL && (bitmap[function_id / 8] & (1 << (function_id % 8))) != 0;
+}
 
-			connected_callback_function(meta->parameter, user_data);
+// index the recorded responses, so requests without one can fail at once
+// instead of running into the timeout
+static int replay_index(Replay *replay) {
+	uint64_t timestamp;
+	uint8_t direction;
+	Packet packet;
+	uint8_t *bitmap;
+	uint32_t uid;
+	int ret;
+
+	while ((ret = replay_read_record(replay->file, &timestamp, &direction, &packet)) > 0) {
+		if (direction != IPCON_CAPTURE_DIRECTION_RECEIVE ||
+		    packet_header_get_sequence_number(&packet.header) == 0) {
+			continue;
 		}
-	} else if (meta->function_id == IPCON_CALLBACK_DISCONNECTED) {
-		// need to do this here, the receive loop is not allowed to
-		// hold the socket mutex because this could cause a deadlock
-		// with a concurrent call to the (dis-)connect function
-		if (meta->parameter != IPCON_DISCONNECT_REASON_REQUEST) {
-			mutex_lock(&ipcon_p->socket_mutex);
 
-			// don't close the socket if it got disconnected or
-			// reconnected in the meantime
-			if (ipcon_p->socket != NULL && ipcon_p->socket_id == meta->socket_id) {
-				// destroy disconnect probe thread
-				event_set(&ipcon_p->disconnect_probe_event);
-				thread_join(&ipcon_p->disconnect_probe_thread);
-				thread_destroy(&ipcon_p->disconnect_probe_thread);
+		uid = leconvert_uint32_from(packet.header.uid);
+		bitmap = (uint8_t *)table_get(&replay->responses, uid);
 
-				// destroy socket
-				socket_destroy(ipcon_p->socket);
-				free(ipcon_p->socket);
-				ipcon_p->socket = NULL;
-			}
+		if (bitmap == NULL) {
+			bitmap = (uint8_t *)calloc(DEVICE_NUM_FUNCTION_IDS / 8, 1);
 
-			mutex_unlock(&ipcon_p->socket_mutex);
+			table_insert(&replay->responses, uid, bitmap);
 		}
 
-		// FIXME: wait a moment here, otherwise the next connect
-		// attempt will succeed, even if there is no open server
-		// socket. the first receive will then fail directly
-		thread_sleep(100);
+		bitmap[packet.header.function_id / 8] |= 1 << (packet.header.function_id % 8);
+	}
 
-		if (ipcon_p->registered_callbacks[IPCON_CALLBACK_DISCONNECTED] != NULL) {
-			*(void **)(&disconnected_callback_function) = ipcon_p->registered_callbacks[IPCON_CALLBACK_DISCONNECTED];
-			user_data = ipcon_p->registered_callback_user_data[IPCON_CALLBACK_DISCONNECTED];
+	return ret;
+}
 
-			disconnected_callback_function(meta->parameter, user_data);
-		}
+// called for every request sent while replaying, see ipcon_send_request
+static void replay_request(IPConnectionPrivate *ipcon_p, Packet *request) {
+	Replay *replay = ipcon_p->replay;
+	ReplayRequest *pending;
+	PacketHeader error;
+	bool response_expected = packet_header_get_response_expected(&request->header) != 0;
+	bool recorded = replay_has_response(replay, leconvert_uint32_from(request->header.uid),
+	                                    request->header.function_id);
 
-		if (meta->parameter != IPCON_DISCONNECT_REASON_REQUEST &&
-			ipcon_p->auto_reconnect && ipcon_p->auto_reconnect_allowed) {
-			ipcon_p->auto_reconnect_pending = true;
-			retry = true;
+	mutex_lock(&replay->mutex);
 
-			// block here until reconnect. this is okay, there is no
-			// callback to deliver when there is no connection
-			while (retry) {
-				retry = false;
+	if (replay->request_count == IPCON_REPLAY_MAX_PENDING) {
+		// forget the oldest request, it was not in the recording
+		memmove(replay->requests, replay->requests + 1,
+		        sizeof(ReplayRequest) * (IPCON_REPLAY_MAX_PENDING - 1));
+		--replay->request_count;
+	}
 
-				mutex_lock(&ipcon_p->socket_mutex);
+	pending = &replay->requests[replay->request_count++];
+	pending->uid = leconvert_uint32_from(request->header.uid);
+	pending->function_id = request->header.function_id;
+	pending->sequence_number = packet_header_get_sequence_number(&request->header);
+	pending->send_pending = true;
+	pending->response_pending = response_expected && recorded;
 
-				if (ipcon_p->auto_reconnect_allowed && ipcon_p->socket == NULL) {
-					if (ipcon_connect_unlocked(ipcon_p, true) < 0) {
-						retry = true;
-					}
-				} else {
-					ipcon_p->auto_reconnect_pending = false;
-				}
+	mutex_unlock(&replay->mutex);
 
-				mutex_unlock(&ipcon_p->socket_mutex);
+	event_set(&replay->request_event);
 
-				if (retry) {
-					// wait a moment to give another thread a chance to
-					// interrupt the auto-reconnect
-					thread_sleep(100);
-				}
-			}
-		}
+	if (response_expected && !recorded) {
+		// answer as a device that does not support the function
+		memcpy(&error, &request->header, sizeof(PacketHeader));
+
+		error.length = sizeof(PacketHeader);
+		error.error_code_and_future_use = 2 << 6;
+
+		ipcon_handle_response(ipcon_p, (Packet *)&error);
 	}
 }
 
-static void ipcon_dispatch_packet(IPConnectionPrivate *ipcon_p, Packet *packet) {
-	EnumerateCallbackFunction enumerate_callback_function;
-	void *user_data;
-	EnumerateCallback *enumerate_callback;
-	DevicePrivate *device_p;
-	CallbackWrapperFunction callback_wrapper_function;
+// NOTE: assumes that replay->mutex is locked
+static void replay_remove_request(Replay *replay, int i) {
+	if (replay->requests[i].send_pending || replay->requests[i].response_pending) {
+		return;
+	}
 
-	if (packet->header.function_id == IPCON_CALLBACK_ENUMERATE) {
-		if (ipcon_p->registered_callbacks[IPCON_CALLBACK_ENUMERATE] != NULL) {
-			*(void **)(&enumerate_callback_function) = ipcon_p->registered_callbacks[IPCON_CALLBACK_ENUMERATE];
-			user_data = ipcon_p->registered_callback_user_data[IPCON_CALLBACK_ENUMERATE];
-			enumerate_callback = (EnumerateCallback *)packet;
+	memmove(replay->requests + i, replay->requests + i + 1,
+	        sizeof(ReplayRequest) * (replay->request_count - i - 1));
+	--replay->request_count;
+}
 
-			enumerate_callback_function(enumerate_callback->uid,
-			                            enumerate_callback->connected_uid,
-			                            enumerate_callback->position,
-			                            enumerate_callback->hardware_version,
-			                            enumerate_callback->firmware_version,
-			                            leconvert_uint16_from(enumerate_callback->device_identifier),
-			                            enumerate_callback->enumeration_type,
-			                            user_data);
-		}
-	} else {
-		device_p = ipcon_acquire_device(ipcon_p, packet->header.uid);
+// returns true if the live client sent the recorded request in time
+static bool replay_sync_request(Replay *replay, Packet *request) {
+	uint32_t uid = leconvert_uint32_from(request->header.uid);
+	uint64_t deadline = microseconds() + IPCON_REPLAY_SYNC_TIMEOUT * 1000;
+	uint64_t now;
+	int i;
 
-		if (device_p == NULL) {
-			return;
-		}
+	while (replay->replay_flag) {
+		event_reset(&replay->request_event);
 
-		callback_wrapper_function = device_p->callback_wrappers[packet->header.function_id];
+		mutex_lock(&replay->mutex);
 
-		if (callback_wrapper_function == NULL) {
-			device_release(device_p);
+		for (i = 0; i < replay->request_count; ++i) {
+			if (replay->requests[i].send_pending &&
+			    replay->requests[i].uid == uid &&
+			    replay->requests[i].function_id == request->header.function_id) {
+				replay->requests[i].send_pending = false;
 
-			return;
+				replay_remove_request(replay, i);
+				mutex_unlock(&replay->mutex);
+
+				return true;
+			}
 		}
 
-		callback_wrapper_function(device_p, packet);
+		mutex_unlock(&replay->mutex);
 
-		device_release(device_p);
+		now = microseconds();
+
+		if (now >= deadline) {
+			break;
+		}
+
+		event_wait(&replay->request_event, (uint32_t)((deadline - now + 999) / 1000));
 	}
+
+	return false;
 }
 
-static void ipcon_callback_loop(void *opaque) {
-	CallbackContext *callback = (CallbackContext *)opaque;
-	int kind;
-	void *data;
+// rewrites a recorded response to the sequence number of the live request
+// it answers, returns false if no live request is waiting for it
+static bool replay_match_response(Replay *replay, Packet *response) {
+	uint32_t uid = leconvert_uint32_from(response->header.uid);
+	int i;
 
-	while (true) {
-		if (queue_get(&callback->queue, &kind, &data) < 0) {
-			// FIXME: what to do here? try again? exit?
-			break;
+	mutex_lock(&replay->mutex);
+
+	for (i = 0; i < replay->request_count; ++i) {
+		if (replay->requests[i].response_pending &&
+		    replay->requests[i].uid == uid &&
+		    replay->requests[i].function_id == response->header.function_id) {
+			// packet_header_set_sequence_number only ORs the new bits in
+			response->header.sequence_number_and_options &= 0x0F;
+			packet_header_set_sequence_number(&response->header,
+			                                  replay->requests[i].sequence_number);
+
+			replay->requests[i].response_pending = false;
+
+			replay_remove_request(replay, i);
+			mutex_unlock(&replay->mutex);
+
+			return true;
 		}
+	}
 
-		// FIXME: cannot lock callback mutex here because this can
-		//        deadlock due to an ordering problem with the socket mutex
-		//mutex_lock(&callback->mutex);
+	mutex_unlock(&replay->mutex);
 
-		if (kind == QUEUE_KIND_EXIT) {
-			//mutex_unlock(&callback->mutex);
-			break;
-		} else if (kind == QUEUE_KIND_META) {
-			ipcon_dispatch_meta(callback->ipcon_p, (Meta *)data);
-		} else if (kind == QUEUE_KIND_PACKET) {
-			// don't dispatch callbacks when the receive thread isn't running
-			if (callback->packet_dispatch_allowed) {
-				ipcon_dispatch_packet(callback->ipcon_p, (Packet *)data);
+	return false;
+}
+
+// NOTE: the replay loop takes the place of the receive loop. callbacks are
+//       fed through ipcon_handle_response at the recorded pace divided by
+//       the speed, recorded requests wait for the client to send them again
+//       so the replay stays in step with the client
+static void replay_loop(void *opaque) {
+	IPConnectionPrivate *ipcon_p = (IPConnectionPrivate *)opaque;
+	Replay *replay = ipcon_p->replay;
+	uint64_t timestamp;
+	uint64_t first_timestamp = 0;
+	uint64_t start = microseconds();
+	uint64_t due;
+	uint64_t now;
+	uint8_t direction;
+	Packet packet;
+
+	while (replay->replay_flag &&
+	       replay_read_record(replay->file, &timestamp, &direction, &packet) > 0) {
+		if (replay->records++ == 0) {
+			first_timestamp = timestamp;
+		}
+
+		if (replay->speed > 0) {
+			due = start + (uint64_t)((timestamp - first_timestamp) / replay->speed);
+			now = microseconds();
+
+			if (due > now) {
+				event_wait(&replay->stop_event, (uint32_t)((due - now) / 1000));
 			}
 		}
 
-		//mutex_unlock(&callback->mutex);
+		if (direction == IPCON_CAPTURE_DIRECTION_SEND) {
+			replay_sync_request(replay, &packet);
 
-		free(data);
-	}
+			if (replay->speed > 0) {
+				// shift the schedule by the time spent waiting for the client
+				due = start + (uint64_t)((timestamp - first_timestamp) / replay->speed);
+				now = microseconds();
 
-	// cleanup
-	mutex_destroy(&callback->mutex);
-	queue_destroy(&callback->queue);
-	thread_destroy(&callback->thread);
+				if (now > due) {
+					start += now - due;
+				}
+			}
+		} else if (packet_header_get_sequence_number(&packet.header) == 0) {
+			ipcon_handle_response(ipcon_p, &packet);
+		} else if (replay_match_response(replay, &packet)) {
+			ipcon_handle_response(ipcon_p, &packet);
+		}
+	}
 
-	free(callback);
+	replay->done = true;
 }
 
-// NOTE: assumes that socket_mutex is locked if disconnect_immediately is true
-static void ipcon_handle_disconnect_by_peer(IPConnectionPrivate *ipcon_p,
-                                            uint8_t disconnect_reason,
-                                            uint64_t socket_id,
-                                            bool disconnect_immediately) {
-	Meta *meta;
-
-	ipcon_p->auto_reconnect_allowed = true;
+static void replay_destroy(Replay *replay) {
+	int i;
 
-	if (disconnect_immediately) {
-		ipcon_disconnect_unlocked(ipcon_p);
+	for (i = 0; i < replay->responses.used; ++i) {
+		free(replay->responses.values[i]);
 	}
 
-	meta = (Meta *)malloc(sizeof(Meta));
-	meta->function_id = IPCON_CALLBACK_DISCONNECTED;
-	meta->parameter = disconnect_reason;
-	meta->socket_id = socket_id;
+	table_destroy(&replay->responses);
+	mutex_destroy(&replay->mutex);
+	event_destroy(&replay->request_event);
+	event_destroy(&replay->stop_event);
 
-	queue_put(&ipcon_p->callback->queue, QUEUE_KIND_META, meta);
+	fclose(replay->file);
+
+	free(replay);
 }
 
-enum {
-	IPCON_DISCONNECT_PROBE_INTERVAL = 5000
-};
+/*****************************************************************************
+ *
+ *                                 Device
+ *
+ *****************************************************************************/
 
 enum {
-	IPCON_FUNCTION_DISCONNECT_PROBE = 128
+	IPCON_FUNCTION_ENUMERATE = 254
 };
 
-// NOTE: the disconnect probe loop is not allowed to hold the socket_mutex at any
-//       time because it is created and joined while the socket_mutex is locked
-static void ipcon_disconnect_probe_loop(void *opaque) {
-	IPConnectionPrivate *ipcon_p = (IPConnectionPrivate *)opaque;
-	PacketHeader disconnect_probe;
+static int ipcon_send_request(IPConnectionPrivate *ipcon_p, Packet *request);
 
-	packet_header_create(&disconnect_probe, sizeof(PacketHeader),
-	                     IPCON_FUNCTION_DISCONNECT_PROBE, ipcon_p, NULL);
+// NOTE: assumes device_p->ref_count == 0
+static void device_destroy(DevicePrivate *device_p) {
+	table_remove(&device_p->ipcon_p->devices, device_p->uid);
 
-	while (event_wait(&ipcon_p->disconnect_probe_event,
-	                  IPCON_DISCONNECT_PROBE_INTERVAL) < 0) {
-		if (ipcon_p->disconnect_probe_flag) {
-			// FIXME: this might block
-			if (socket_send(ipcon_p->socket, &disconnect_probe,
-			                disconnect_probe.length) < 0) {
-				ipcon_handle_disconnect_by_peer(ipcon_p, IPCON_DISCONNECT_REASON_ERROR,
-				                                ipcon_p->socket_id, false);
-				break;
-			}
-		} else {
-			ipcon_p->disconnect_probe_flag = true;
-		}
-	}
+	event_destroy(&device_p->response_event);
+
+	mutex_destroy(&device_p->response_mutex);
+
+	mutex_destroy(&device_p->request_mutex);
+
+	mutex_destroy(&device_p->queue_mutex);
+
+	free(device_p->stats);
+
+	free(device_p->registered_callbacks);
+
+	free(device_p);
 }
 
-static void ipcon_handle_response(IPConnectionPrivate *ipcon_p, Packet *response) {
+void device_create(Device *device, const char *uid_str,
+                   IPConnectionPrivate *ipcon_p, uint8_t api_version_major,
+                   uint8_t api_version_minor, uint8_t api_version_release) {
 	DevicePrivate *device_p;
-	uint8_t sequence_number = packet_header_get_sequence_number(&response->header);
-	Packet *callback;
-
-	ipcon_p->disconnect_probe_flag = false;
+	uint64_t uid;
+	uint32_t value1;
+	uint32_t value2;
+	int i;
 
-	response->header.uid = leconvert_uint32_from(response->header.uid);
+	device_p = (DevicePrivate *)malloc(sizeof(DevicePrivate));
+	device->p = device_p;
 
-	if (sequence_number == 0 &&
-	    response->header.function_id == IPCON_CALLBACK_ENUMERATE) {
-		if (ipcon_p->registered_callbacks[IPCON_CALLBACK_ENUMERATE] != NULL) {
-			callback = (Packet *)malloc(response->header.length);
+	uid = base58_decode(uid_str);
 
-			memcpy(callback, response, response->header.length);
-			queue_put(&ipcon_p->callback->queue, QUEUE_KIND_PACKET, callback);
-		}
+	if (uid > 0xFFFFFFFF) {
+		// convert from 64bit to 32bit
+		value1 = uid & 0xFFFFFFFF;
+		value2 = (uid >> 32) & 0xFFFFFFFF;
 
-		return;
+		uid  = (value1 & 0x00000FFF);
+		uid |= (value1 & 0x0F000000) >> 12;
+		uid |= (value2 & 0x0000003F) << 16;
+		uid |= (value2 & 0x000F0000) << 6;
+		uid |= (value2 & 0x3F000000) << 2;
 	}
 
-	device_p = ipcon_acquire_device(ipcon_p, response->header.uid);
+	device_p->ref_count = 1;
 
-	if (device_p == NULL) {
-		// ignoring response for an unknown device
-		return;
-	}
+	device_p->uid = uid & 0xFFFFFFFF;
 
-	if (sequence_number == 0) {
-		if (device_p->registered_callbacks[response->header.function_id] != NULL) {
-			callback = (Packet *)malloc(response->header.length);
+	device_p->ipcon_p = ipcon_p;
 
-			memcpy(callback, response, response->header.length);
-			queue_put(&ipcon_p->callback->queue, QUEUE_KIND_PACKET, callback);
-		}
+	device_p->api_version[0] = api_version_major;
+	device_p->api_version[1] = api_version_minor;
+	device_p->api_version[2] = api_version_release;
 
-		device_release(device_p);
+	// request
+	mutex_create(&device_p->request_mutex);
 
-		return;
-	}
+	// response
+	device_p->expected_response_function_id = 0;
+	device_p->expected_response_sequence_number = 0;
 
-	if (device_p->expected_response_function_id == response->header.function_id &&
-	    device_p->expected_response_sequence_number == sequence_number) {
-		mutex_lock(&device_p->response_mutex);
-		memcpy(&device_p->response_packet, response, response->header.length);
-		mutex_unlock(&device_p->response_mutex);
+	mutex_create(&device_p->response_mutex);
 
-		event_set(&device_p->response_event);
+	memset(&device_p->response_packet, 0, sizeof(Packet));
 
-		device_release(device_p);
+	event_create(&device_p->response_event);
 
-		return;
+	for (i = 0; i < DEVICE_NUM_FUNCTION_IDS; i++) {
+		device_p->response_expected[i] = DEVICE_RESPONSE_EXPECTED_INVALID_FUNCTION_ID;
 	}
 
-	device_release(device_p);
+	device_p->response_expected[IPCON_FUNCTION_ENUMERATE] = DEVICE_RESPONSE_EXPECTED_ALWAYS_FALSE;
+	device_p->response_expected[IPCON_CALLBACK_ENUMERATE] = DEVICE_RESPONSE_EXPECTED_ALWAYS_FALSE;
 
-	// response seems to be OK, but can't be handled
-}
+	// callbacks, set by the binding
+	device_p->callback_wrappers = NULL;
+	device_p->registered_callbacks = NULL;
+	device_p->callback_count = 0;
 
-// NOTE: the receive loop is now allowed to hold the socket_mutex at any time
-//       because it is created and joined while the socket_mutex is locked
-static void ipcon_receive_loop(void *opaque) {
-	IPConnectionPrivate *ipcon_p = (IPConnectionPrivate *)opaque;
-	uint64_t socket_id = ipcon_p->socket_id;
-	Packet pending_data[10];
-	int pending_length = 0;
-	int length;
-	uint8_t disconnect_reason;
+	device_p->stats = NULL;
 
-	while (ipcon_p->receive_flag) {
-		length = socket_receive(ipcon_p->socket, (uint8_t *)pending_data + pending_length,
-		                        sizeof(pending_data) - pending_length);
+	device_p->callback_lane = 0;
 
-		if (!ipcon_p->receive_flag) {
-			return;
-		}
+	// queue policies, every callback is kept by default
+	mutex_create(&device_p->queue_mutex);
 
-		if (length <= 0) {
-			if (length < 0 && errno == EINTR) {
-				continue;
-			}
+	memset(device_p->queue_streams, 0, sizeof(device_p->queue_streams));
 
-			if (length == 0) {
-				disconnect_reason = IPCON_DISCONNECT_REASON_SHUTDOWN;
+	// add to IPConnection
+	table_insert(&ipcon_p->devices, device_p->uid, device_p);
+}
+
+void device_release(DevicePrivate *device_p) {
+	IPConnectionPrivate *ipcon_p = device_p->ipcon_p;
+
+	mutex_lock(&ipcon_p->devices_ref_mutex);
+
+	--device_p->ref_count;
+
+	if (device_p->ref_count == 0) {
+		device_destroy(device_p);
+	}
+
+	mutex_unlock(&ipcon_p->devices_ref_mutex);
+}
+
+int device_get_response_expected(DevicePrivate *device_p, uint8_t function_id,
+                                 bool *ret_response_expected) {
+	int flag = device_p->response_expected[function_id];
+
+	if (flag == DEVICE_RESPONSE_EXPECTED_INVALID_FUNCTION_ID) {
+		return E_INVALID_PARAMETER;
+	}
+
+	if (flag == DEVICE_RESPONSE_EXPECTED_ALWAYS_TRUE ||
+	    flag == DEVICE_RESPONSE_EXPECTED_TRUE) {
+		*ret_response_expected = true;
+	} else {
+		*ret_response_expected = false;
+	}
+
+	return E_OK;
+}
+
+int device_set_response_expected(DevicePrivate *device_p, uint8_t function_id,
+                                 bool response_expected) {
+	int current_flag = device_p->response_expected[function_id];
+
+	if (current_flag != DEVICE_RESPONSE_EXPECTED_TRUE &&
+	    current_flag != DEVICE_RESPONSE_EXPECTED_FALSE) {
+		return E_INVALID_PARAMETER;
+	}
+
+	device_p->response_expected[function_id] =
+	    response_expected ? DEVICE_RESPONSE_EXPECTED_TRUE
+	                      : DEVICE_RESPONSE_EXPECTED_FALSE;
+
+	return E_OK;
+}
+
+int device_set_response_expected_all(DevicePrivate *device_p, bool response_expected) {
+	int flag = response_expected ? DEVICE_RESPONSE_EXPECTED_TRUE
+	                             : DEVICE_RESPONSE_EXPECTED_FALSE;
+	int i;
+
+	for (i = 0; i < DEVICE_NUM_FUNCTION_IDS; ++i) {
+		if (device_p->response_expected[i] == DEVICE_RESPONSE_EXPECTED_TRUE ||
+		    device_p->response_expected[i] == DEVICE_RESPONSE_EXPECTED_FALSE) {
+			device_p->response_expected[i] = flag;
+		}
+	}
+
+	return E_OK;
+}
+
+static int device_find_callback(DevicePrivate *device_p, uint8_t id) {
+	int i;
+
+	// bindings have less than ten callbacks
+	for (i = 0; i < device_p->callback_count; ++i) {
+		if (device_p->callback_wrappers[i].function_id == id) {
+			return i;
+		}
+	}
+
+	return -1;
+}
+
+void device_set_callback_wrappers(DevicePrivate *device_p,
+                                  const DeviceCallbackWrapper *wrappers,
+                                  int count) {
+	device_p->callback_wrappers = wrappers;
+	device_p->registered_callbacks = (DeviceCallback *)calloc(count, sizeof(DeviceCallback));
+	device_p->callback_count = count;
+}
+
+CallbackWrapperFunction device_get_callback_wrapper(DevicePrivate *device_p,
+                                                    uint8_t id) {
+	int i = device_find_callback(device_p, id);
+
+	return i < 0 ? NULL : device_p->callback_wrappers[i].wrapper;
+}
+
+void *device_get_registered_callback(DevicePrivate *device_p, uint8_t id,
+                                     void **ret_user_data) {
+	int i = device_find_callback(device_p, id);
+
+	if (i < 0) {
+		*ret_user_data = NULL;
+
+		return NULL;
+	}
+
+	*ret_user_data = device_p->registered_callbacks[i].user_data;
+
+	return device_p->registered_callbacks[i].function;
+}
+
+void device_register_callback(DevicePrivate *device_p, uint8_t id, void *callback,
+                              void *user_data) {
+	int i = device_find_callback(device_p, id);
+
+	// the device type has no such callback, it would never be called
+	if (i < 0) {
+		return;
+	}
+
+	device_p->registered_callbacks[i].function = callback;
+	device_p->registered_callbacks[i].user_data = user_data;
+}
+
+int device_get_api_version(DevicePrivate *device_p, uint8_t ret_api_version[3]) {
+	ret_api_version[0] = device_p->api_version[0];
+	ret_api_version[1] = device_p->api_version[1];
+	ret_api_version[2] = device_p->api_version[2];
+
+	return E_OK;
+}
+
+int device_send_request(DevicePrivate *device_p, Packet *request, Packet *response) {
+	int ret = E_OK;
+	uint8_t sequence_number = packet_header_get_sequence_number(&request->header);
+	uint8_t response_expected = packet_header_get_response_expected(&request->header);
+	uint8_t error_code;
+	FunctionStats *stats = device_acquire_stats(device_p, request->header.function_id);
+	uint64_t start = 0;
+
+	if (stats != NULL) {
+		atomic_add_uint32(&stats->requests, (uint32_t)1);
+		start = microseconds();
+	}
+
+	if (response_expected) {
+		mutex_lock(&device_p->request_mutex);
+
+		event_reset(&device_p->response_event);
+
+		device_p->expected_response_function_id = request->header.function_id;
+		device_p->expected_response_sequence_number = sequence_number;
+	}
+
+	ret = ipcon_send_request(device_p->ipcon_p, request);
+
+	if (ret != E_OK) {
+		if (response_expected) {
+			mutex_unlock(&device_p->request_mutex);
+		}
+
+		if (stats != NULL) {
+			atomic_add_uint32(&stats->errors, (uint32_t)1);
+		}
+
+		return ret;
+	}
+
+	if (response_expected) {
+		if (event_wait(&device_p->response_event, device_p->ipcon_p->timeout) < 0) {
+			ret = E_TIMEOUT;
+		}
+
+		device_p->expected_response_function_id = 0;
+		device_p->expected_response_sequence_number = 0;
+
+		event_reset(&device_p->response_event);
+
+		if (ret == E_OK) {
+			mutex_lock(&device_p->response_mutex);
+
+			error_code = packet_header_get_error_code(&device_p->response_packet.header);
+
+			if (device_p->response_packet.header.function_id != request->header.function_id ||
+			    packet_header_get_sequence_number(&device_p->response_packet.header) != sequence_number) {
+				ret = E_TIMEOUT;
+			} else if (error_code == 0) {
+				// no error
+				if (response != NULL) {
+					memcpy(response, &device_p->response_packet,
+					       device_p->response_packet.header.length);
+				}
+			} else if (error_code == 1) {
+				ret = E_INVALID_PARAMETER;
+			} else if (error_code == 2) {
+				ret = E_NOT_SUPPORTED;
 			} else {
-				disconnect_reason = IPCON_DISCONNECT_REASON_ERROR;
+				ret = E_UNKNOWN_ERROR_CODE;
 			}
 
-			ipcon_handle_disconnect_by_peer(ipcon_p, disconnect_reason, socket_id, false);
-			return;
+			mutex_unlock(&device_p->response_mutex);
 		}
 
-		pending_length += length;
+		mutex_unlock(&device_p->request_mutex);
+	}
 
-		while (ipcon_p->receive_flag) {
-			if (pending_length < 8) {
-				// wait for complete header
-				break;
-			}
+	if (stats != NULL) {
+		if (ret == E_TIMEOUT) {
+			atomic_add_uint32(&stats->timeouts, (uint32_t)1);
+		} else if (ret < 0) {
+			atomic_add_uint32(&stats->errors, (uint32_t)1);
+		} else if (response_expected) {
+			function_stats_record_latency(stats, microseconds() - start);
+		}
+	}
 
-			length = pending_data[0].header.length;
+	return ret;
+}
 
-			if (pending_length < length) {
-				// wait for complete packet
-				break;
-			}
+/*****************************************************************************
+ *
+ *                                 Brick Daemon
+ *
+ *****************************************************************************/
+
+enum {
+	BRICK_DAEMON_FUNCTION_GET_AUTHENTICATION_NONCE = 1,
+	BRICK_DAEMON_FUNCTION_AUTHENTICATE = 2
+};
+
+static void brickd_create(BrickDaemon *brickd, const char *uid, IPConnection *ipcon) {
+	DevicePrivate *device_p;
+
+	device_create(brickd, uid, ipcon->p, 2, 0, 0);
+
+	device_p = brickd->p;
+
+	device_p->response_expected[BRICK_DAEMON_FUNCTION_GET_AUTHENTICATION_NONCE] = DEVICE_RESPONSE_EXPECTED_ALWAYS_TRUE;
+	device_p->response_expected[BRICK_DAEMON_FUNCTION_AUTHENTICATE] = DEVICE_RESPONSE_EXPECTED_TRUE;
+}
+
+static void brickd_destroy(BrickDaemon *brickd) {
+	device_release(brickd->p);
+}
+
+static int brickd_get_authentication_nonce(BrickDaemon *brickd, uint8_t ret_server_nonce[4]) {
+	DevicePrivate *device_p = brickd->p;
+	GetAuthenticationNonce request;
+	GetAuthenticationNonceResponse response;
+	int ret;
+
+	ret = packet_header_create(&request.header, sizeof(request), BRICK_DAEMON_FUNCTION_GET_AUTHENTICATION_NONCE, device_p->ipcon_p, device_p);
+
+	if (ret < 0) {
+		return ret;
+	}
+
+	ret = device_send_request(device_p, (Packet *)&request, (Packet *)&response);
+
+	if (ret < 0) {
+		return ret;
+	}
+
+	memcpy(ret_server_nonce, response.server_nonce, 4 * sizeof(uint8_t));
+
+	return ret;
+}
+
+static int brickd_authenticate(BrickDaemon *brickd, uint8_t client_nonce[4], uint8_t digest[20]) {
+	DevicePrivate *device_p = brickd->p;
+	Authenticate request;
+	int ret;
+
+	ret = packet_header_create(&request.header, sizeof(request), BRICK_DAEMON_FUNCTION_AUTHENTICATE, device_p->ipcon_p, device_p);
+
+	if (ret < 0) {
+		return ret;
+	}
+
+	memcpy(request.client_nonce, client_nonce, 4 * sizeof(uint8_t));
+	memcpy(request.digest, digest, 20 * sizeof(uint8_t));
+
+	ret = device_send_request(device_p, (Packet *)&request, NULL);
+
+	return ret;
+}
+
+/*****************************************************************************
+ *
+ *                                 IPConnection
+ *
+ *****************************************************************************/
+
+typedef struct {
+	CallbackContext *callback;
+	bool running; // fixed while the context exists
+	Queue queue;
+	Thread thread;
+} CallbackLane;
+
+// lane 0 is the queue and thread of the context itself, the other lanes
+// only dispatch device callbacks and are stopped by the thread of lane 0
+struct _CallbackContext {
+	IPConnectionPrivate *ipcon_p;
+	Queue queue;
+	Thread thread;
+	Mutex mutex;
+	bool packet_dispatch_allowed;
+	CallbackLane lanes[IPCON_MAX_CALLBACK_LANES]; // lanes[0] is unused
+};
+
+static int ipcon_connect_unlocked(IPConnectionPrivate *ipcon_p, bool is_auto_reconnect);
+static void ipcon_disconnect_unlocked(IPConnectionPrivate *ipcon_p);
+
+static DevicePrivate *ipcon_acquire_device(IPConnectionPrivate *ipcon_p, uint32_t uid) {
+	DevicePrivate *device_p;
+
+	mutex_lock(&ipcon_p->devices_ref_mutex);
+
+	device_p = (DevicePrivate *)table_get(&ipcon_p->devices, uid);
+
+	if (device_p != NULL) {
+		++device_p->ref_count;
+	}
+
+	mutex_unlock(&ipcon_p->devices_ref_mutex);
+
+	return device_p;
+}
+
+static void ipcon_dispatch_meta(IPConnectionPrivate *ipcon_p, Meta *meta) {
+	ConnectedCallbackFunction connected_callback_function;
+	DisconnectedCallbackFunction disconnected_callback_function;
+	void *user_data;
+	bool retry;
+
+	if (meta->function_id == IPCON_CALLBACK_CONNECTED) {
+		if (ipcon_p->registered_callbacks[IPCON_CALLBACK_CONNECTED] != NULL) {
+			*(void **)(&connected_callback_function) = ipcon_p->registered_callbacks[IPCON_CALLBACK_CONNECTED];
+			user_data = ipcon_p->registered_callback_user_data[IPCON_CALLBACK_CONNECTED];
+
+			connected_callback_function(meta->parameter, user_data);
+		}
+	} else if (meta->function_id == IPCON_CALLBACK_DISCONNECTED) {
+		// need to do this here, the receive loop is not allowed to
+		// hold the socket mutex because this could cause a deadlock
+		// with a concurrent call to the (dis-)connect function
+		if (meta->parameter != IPCON_DISCONNECT_REASON_REQUEST) {
+			mutex_lock(&ipcon_p->socket_mutex);
+
+			// don't close the socket if it got disconnected or
+			// reconnected in the meantime
+			if (ipcon_p->socket != NULL && ipcon_p->socket_id == meta->socket_id) {
+				// destroy disconnect probe thread
+				event_set(&ipcon_p->disconnect_probe_event);
+				thread_join(&ipcon_p->disconnect_probe_thread);
+				thread_destroy(&ipcon_p->disconnect_probe_thread);
+
+				// destroy socket
+				socket_destroy(ipcon_p->socket);
+				free(ipcon_p->socket);
+				ipcon_p->socket = NULL;
+			}
+
+			mutex_unlock(&ipcon_p->socket_mutex);
+		}
+
+		// FIXME: wait a moment here, otherwise the next connect
+		// attempt will succeed, even if there is no open server
+		// socket. the first receive will then fail directly
+		thread_sleep(100);
+
+		if (ipcon_p->registered_callbacks[IPCON_CALLBACK_DISCONNECTED] != NULL) {
+			*(void **)(&disconnected_callback_function) = ipcon_p->registered_callbacks[IPCON_CALLBACK_DISCONNECTED];
+			user_data = ipcon_p->registered_callback_user_data[IPCON_CALLBACK_DISCONNECTED];
+
+			disconnected_callback_function(meta->parameter, user_data);
+		}
+
+		if (meta->parameter != IPCON_DISCONNECT_REASON_REQUEST &&
+			ipcon_p->auto_reconnect && ipcon_p->auto_reconnect_allowed) {
+			ipcon_p->auto_reconnect_pending = true;
+			retry = true;
+
+			// block here until reconnect. this is okay, there is no
+			// callback to deliver when there is no connection
+			while (retry) {
+				retry = false;
+
+				mutex_lock(&ipcon_p->socket_mutex);
+
+				if (ipcon_p->auto_reconnect_allowed && ipcon_p->socket == NULL) {
+					if (ipcon_connect_unlocked(ipcon_p, true) < 0) {
+						retry = true;
+					}
+				} else {
+					ipcon_p->auto_reconnect_pending = false;
+				}
+
+				mutex_unlock(&ipcon_p->socket_mutex);
+
+				if (retry) {
+					// wait a moment to give another thread a chance to
+					// interrupt the auto-reconnect
+					thread_sleep(100);
+				}
+			}
+		}
+	}
+}
+
+static void ipcon_dispatch_packet(IPConnectionPrivate *ipcon_p, Packet *packet,
+                                  uint64_t timestamp) {
+	EnumerateCallbackFunction enumerate_callback_function;
+	void *user_data;
+	EnumerateCallback *enumerate_callback;
+	DevicePrivate *device_p;
+	CallbackWrapperFunction callback_wrapper_function;
+	FunctionStats *stats;
+
+	if (packet->header.function_id == IPCON_CALLBACK_ENUMERATE) {
+		if (ipcon_p->registered_callbacks[IPCON_CALLBACK_ENUMERATE] != NULL) {
+			*(void **)(&enumerate_callback_function) = ipcon_p->registered_callbacks[IPCON_CALLBACK_ENUMERATE];
+			user_data = ipcon_p->registered_callback_user_data[IPCON_CALLBACK_ENUMERATE];
+			enumerate_callback = (EnumerateCallback *)packet;
+
+			enumerate_callback_function(enumerate_callback->uid,
+			                            enumerate_callback->connected_uid,
+			                            enumerate_callback->position,
+			                            enumerate_callback->hardware_version,
+			                            enumerate_callback->firmware_version,
+			                            leconvert_uint16_from(enumerate_callback->device_identifier),
+			                            enumerate_callback->enumeration_type,
+			                            user_data);
+		}
+	} else {
+		device_p = ipcon_acquire_device(ipcon_p, packet->header.uid);
+
+		if (device_p == NULL) {
+			return;
+		}
+
+		callback_wrapper_function = device_get_callback_wrapper(device_p, packet->header.function_id);
+
+		if (callback_wrapper_function == NULL) {
+			device_release(device_p);
+
+			return;
+		}
+
+		stats = device_acquire_stats(device_p, packet->header.function_id);
+
+		if (stats != NULL) {
+			atomic_add_uint32(&stats->callbacks, (uint32_t)1);
+
+			if (timestamp > 0) {
+				function_stats_record_latency(stats, microseconds() - timestamp);
+			}
+		}
+
+		callback_wrapper_function(device_p, packet);
+
+		device_release(device_p);
+	}
+}
+
+static void ipcon_callback_lane_loop(void *opaque) {
+	CallbackLane *lane = (CallbackLane *)opaque;
+	int kind;
+	void *data;
+	uint64_t timestamp;
+
+	while (true) {
+		if (queue_get(&lane->queue, &kind, &data, &timestamp) < 0) {
+			break;
+		}
+
+		if (kind == QUEUE_KIND_EXIT) {
+			break;
+		} else if (kind == QUEUE_KIND_PACKET) {
+			// don't dispatch callbacks when the receive thread isn't running
+			if (lane->callback->packet_dispatch_allowed) {
+				ipcon_dispatch_packet(lane->callback->ipcon_p, (Packet *)data, timestamp);
+			}
+		}
+
+		queue_free_data(kind, data);
+	}
+}
+
+static void ipcon_stop_callback_lanes(CallbackContext *callback) {
+	CallbackLaneConfig *config;
+	CallbackLane *lane;
+	int kind;
+	void *data;
+	uint64_t timestamp;
+	int i;
+
+	for (i = 1; i < IPCON_MAX_CALLBACK_LANES; ++i) {
+		config = &callback->ipcon_p->callback_lanes[i];
+		lane = &callback->lanes[i];
+
+		// drop what the external lane did not dispatch yet, it belongs to
+		// the ended connection
+		mutex_lock(&callback->ipcon_p->lane_mutex);
+
+		if (config->external) {
+			while (queue_try_get(config->external_queue, &kind, &data, &timestamp) == 0) {
+				queue_free_data(kind, data);
+			}
+		}
+
+		mutex_unlock(&callback->ipcon_p->lane_mutex);
+
+		if (!lane->running) {
+			continue;
+		}
+
+		queue_put(&lane->queue, QUEUE_KIND_EXIT, NULL);
+
+		thread_join(&lane->thread);
+		thread_destroy(&lane->thread);
+
+		queue_destroy(&lane->queue);
+
+		lane->running = false;
+	}
+}
+
+// returns true if called from the thread of any lane
+static bool ipcon_is_callback_thread(CallbackContext *callback) {
+	int i;
+
+	if (thread_is_current(&callback->thread)) {
+		return true;
+	}
+
+	for (i = 1; i < IPCON_MAX_CALLBACK_LANES; ++i) {
+		if (callback->lanes[i].running && thread_is_current(&callback->lanes[i].thread)) {
+			return true;
+		}
+	}
+
+	return false;
+}
+
+// lane 0 for devices in a lane that is not running. NOTE: assumes that
+// lane_mutex is locked
+static Queue *ipcon_get_callback_queue(CallbackContext *callback, uint8_t lane) {
+	if (lane > 0 && lane < IPCON_MAX_CALLBACK_LANES) {
+		if (callback->ipcon_p->callback_lanes[lane].external) {
+			return callback->ipcon_p->callback_lanes[lane].external_queue;
+		}
+
+		if (callback->lanes[lane].running) {
+			return &callback->lanes[lane].queue;
+		}
+	}
+
+	return &callback->queue;
+}
+
+static void ipcon_callback_loop(void *opaque) {
+	CallbackContext *callback = (CallbackContext *)opaque;
+	int kind;
+	void *data;
+	uint64_t timestamp;
+
+	while (true) {
+		if (queue_get(&callback->queue, &kind, &data, &timestamp) < 0) {
+			// FIXME: what to do here? try again? exit?
+			break;
+		}
+
+		// FIXME: cannot lock callback mutex here because this can
+		//        deadlock due to an ordering problem with the socket mutex
+		//mutex_lock(&callback->mutex);
+
+		if (kind == QUEUE_KIND_EXIT) {
+			//mutex_unlock(&callback->mutex);
+			break;
+		} else if (kind == QUEUE_KIND_META) {
+			ipcon_dispatch_meta(callback->ipcon_p, (Meta *)data);
+		} else if (kind == QUEUE_KIND_PACKET) {
+			// don't dispatch callbacks when the receive thread isn't running
+			if (callback->packet_dispatch_allowed) {
+				ipcon_dispatch_packet(callback->ipcon_p, (Packet *)data, timestamp);
+			}
+		}
+
+		//mutex_unlock(&callback->mutex);
+
+		queue_free_data(kind, data);
+	}
+
+	// the lanes can still hold device callbacks that were queued before
+	// the exit, they dispatch them before they stop
+	ipcon_stop_callback_lanes(callback);
+
+	// cleanup
+	mutex_destroy(&callback->mutex);
+	queue_destroy(&callback->queue);
+	thread_destroy(&callback->thread);
+
+	free(callback);
+}
+
+// NOTE: assumes that socket_mutex is locked if disconnect_immediately is true
+static void ipcon_handle_disconnect_by_peer(IPConnectionPrivate *ipcon_p,
+                                            uint8_t disconnect_reason,
+                                            uint64_t socket_id,
+                                            bool disconnect_immediately) {
+	Meta *meta;
+
+	ipcon_p->auto_reconnect_allowed = true;
+
+	if (disconnect_immediately) {
+		ipcon_disconnect_unlocked(ipcon_p);
+	}
+
+	meta = (Meta *)malloc(sizeof(Meta));
+	meta->function_id = IPCON_CALLBACK_DISCONNECTED;
+	meta->parameter = disconnect_reason;
+	meta->socket_id = socket_id;
+
+	queue_put(&ipcon_p->callback->queue, QUEUE_KIND_META, meta);
+}
+
+enum {
+	IPCON_DISCONNECT_PROBE_INTERVAL = 5000
+};
+
+enum {
+	IPCON_FUNCTION_DISCONNECT_PROBE = 128
+};
+
+// NOTE: the disconnect probe loop is not allowed to hold the socket_mutex at any
+//       time because it is created and joined while the socket_mutex is locked
+static void ipcon_disconnect_probe_loop(void *opaque) {
+	IPConnectionPrivate *ipcon_p = (IPConnectionPrivate *)opaque;
+	PacketHeader disconnect_probe;
+
+	packet_header_create(&disconnect_probe, sizeof(PacketHeader),
+	                     IPCON_FUNCTION_DISCONNECT_PROBE, ipcon_p, NULL);
+
+	while (event_wait(&ipcon_p->disconnect_probe_event,
+	                  IPCON_DISCONNECT_PROBE_INTERVAL) < 0) {
+		if (ipcon_p->disconnect_probe_flag) {
+			// FIXME: this might block
+			if (socket_send(ipcon_p->socket, &disconnect_probe,
+			                disconnect_probe.length) < 0) {
+				ipcon_handle_disconnect_by_peer(ipcon_p, IPCON_DISCONNECT_REASON_ERROR,
+				                                ipcon_p->socket_id, false);
+				break;
+			}
+		} else {
+			ipcon_p->disconnect_probe_flag = true;
+		}
+	}
+}
+
+static void ipcon_handle_response(IPConnectionPrivate *ipcon_p, Packet *response) {
+	DevicePrivate *device_p;
+	CallbackLaneConfig *lane;
+	uint8_t sequence_number = packet_header_get_sequence_number(&response->header);
+	Packet *callback;
+	void *user_data;
+
+	ipcon_p->disconnect_probe_flag = false;
+
+	response->header.uid = leconvert_uint32_from(response->header.uid);
+
+	if (sequence_number == 0 &&
+	    response->header.function_id == IPCON_CALLBACK_ENUMERATE) {
+		if (ipcon_p->registered_callbacks[IPCON_CALLBACK_ENUMERATE] != NULL) {
+			callback = (Packet *)pool_alloc(&ipcon_p->packet_pool);
+
+			memcpy(callback, response, response->header.length);
+			queue_put(&ipcon_p->callback->queue, QUEUE_KIND_PACKET, callback);
+		}
+
+		return;
+	}
+
+	device_p = ipcon_acquire_device(ipcon_p, response->header.uid);
+
+	if (device_p == NULL) {
+		// ignoring response for an unknown device
+		return;
+	}
+
+	if (sequence_number == 0) {
+		if (device_get_registered_callback(device_p, response->header.function_id, &user_data) != NULL) {
+			callback = (Packet *)pool_alloc(&ipcon_p->packet_pool);
+
+			memcpy(callback, response, response->header.length);
+
+			lane = &ipcon_p->callback_lanes[device_p->callback_lane];
+
+			// the notify function is called under the lane_mutex, so it
+			// can't be called anymore once the lane stopped being external
+			mutex_lock(&ipcon_p->lane_mutex);
+
+			if (queue_put_packet(ipcon_get_callback_queue(ipcon_p->callback, device_p->callback_lane),
+			                     device_p, callback,
+			                     ipcon_p->stats_enabled ? microseconds() : 0)) {
+				// the queued packet holds the reference now
+				device_p = NULL;
+			}
+
+			if (lane->external) {
+				lane->notify(lane->notify_user_data);
+			}
+
+			mutex_unlock(&ipcon_p->lane_mutex);
+		}
+
+		if (device_p != NULL) {
+			device_release(device_p);
+		}
+
+		return;
+	}
+
+	if (device_p->expected_response_function_id == response->header.function_id &&
+	    device_p->expected_response_sequence_number == sequence_number) {
+		mutex_lock(&device_p->response_mutex);
+		memcpy(&device_p->response_packet, response, response->header.length);
+		mutex_unlock(&device_p->response_mutex);
+
+		event_set(&device_p->response_event);
+
+		device_release(device_p);
+
+		return;
+	}
+
+	device_release(device_p);
+
+	// response seems to be OK, but can't be handled
+}
+
+// NOTE: the receive loop is now allowed to hold the socket_mutex at any time
+//       because it is created and joined while the socket_mutex is locked
+static void ipcon_receive_loop(void *opaque) {
+	IPConnectionPrivate *ipcon_p = (IPConnectionPrivate *)opaque;
+	uint64_t socket_id = ipcon_p->socket_id;
+	Packet pending_data[10];
+	int pending_length = 0;
+	int length;
+	uint8_t disconnect_reason;
+
+	while (ipcon_p->receive_flag) {
+		length = socket_receive(ipcon_p->socket, (uint8_t *)pending_data + pending_length,
+		                        sizeof(pending_data) - pending_length);
+
+		if (!ipcon_p->receive_flag) {
+			return;
+		}
+
+		if (length <= 0) {
+			if (length < 0 && errno == EINTR) {
+				continue;
+			}
+
+			if (length == 0) {
+				disconnect_reason = IPCON_DISCONNECT_REASON_SHUTDOWN;
+			} else {
+				disconnect_reason = IPCON_DISCONNECT_REASON_ERROR;
+			}
+
+			ipcon_handle_disconnect_by_peer(ipcon_p, disconnect_reason, socket_id, false);
+			return;
+		}
+
+		pending_length += length;
+
+		while (ipcon_p->receive_flag) {
+			if (pending_length < 8) {
+				// wait for complete header
+				break;
+			}
+
+			length = pending_data[0].header.length;
+
+			if (pending_length < length) {
+				// wait for complete packet
+				break;
+			}
+
+			if (ipcon_p->capture != NULL) {
+				capture_put(ipcon_p->capture, IPCON_CAPTURE_DIRECTION_RECEIVE, pending_data);
+			}
+
+			ipcon_handle_response(ipcon_p, pending_data);
+
+			memmove(pending_data, (uint8_t *)pending_data + length,
+			        pending_length - length);
+			pending_length -= length;
+		}
+	}
+}
+
+// NOTE: assumes that socket_mutex is locked
+static int ipcon_create_callback_unlocked(IPConnectionPrivate *ipcon_p) {
+	CallbackLaneConfig *config;
+	CallbackLane *lane;
+	int i;
+
+	if (ipcon_p->callback != NULL) {
+		return E_OK;
+	}
+
+	ipcon_p->callback = (CallbackContext *)malloc(sizeof(CallbackContext));
+
+	ipcon_p->callback->ipcon_p = ipcon_p;
+	ipcon_p->callback->packet_dispatch_allowed = false;
+
+	queue_create(&ipcon_p->callback->queue, &ipcon_p->packet_pool);
+	mutex_create(&ipcon_p->callback->mutex);
+
+	// start the other lanes first, lane 0 stops them on exit. a lane that
+	// can't be started leaves its devices to lane 0
+	for (i = 1; i < IPCON_MAX_CALLBACK_LANES; ++i) {
+		config = &ipcon_p->callback_lanes[i];
+		lane = &ipcon_p->callback->lanes[i];
+
+		lane->callback = ipcon_p->callback;
+		lane->running = false;
+		config->scheduled = false;
+
+		if (!config->enabled || config->external) {
+			continue;
+		}
+
+		queue_create(&lane->queue, &ipcon_p->packet_pool);
+
+		if (thread_create(&lane->thread, ipcon_callback_lane_loop, lane) < 0) {
+			queue_destroy(&lane->queue);
+
+			continue;
+		}
+
+		lane->running = true;
+		config->scheduled = thread_set_scheduling(&lane->thread, config->sched_priority,
+		                                          config->cpu) == 0;
+	}
+
+	if (thread_create(&ipcon_p->callback->thread, ipcon_callback_loop,
+	                  ipcon_p->callback) < 0) {
+		ipcon_stop_callback_lanes(ipcon_p->callback);
+
+		mutex_destroy(&ipcon_p->callback->mutex);
+		queue_destroy(&ipcon_p->callback->queue);
+
+		free(ipcon_p->callback);
+		ipcon_p->callback = NULL;
+
+		return E_NO_THREAD;
+	}
+
+	config = &ipcon_p->callback_lanes[0];
+	config->scheduled = thread_set_scheduling(&ipcon_p->callback->thread, config->sched_priority,
+	                                          config->cpu) == 0;
+
+	return E_OK;
+}
+
+// NOTE: assumes that socket_mutex is locked
+static int ipcon_connect_unlocked(IPConnectionPrivate *ipcon_p, bool is_auto_reconnect) {
+	struct hostent *entity;
+	struct sockaddr_in address;
+	uint8_t connect_reason;
+	Meta *meta;
+
+	// create callback queue and thread
+	if (ipcon_create_callback_unlocked(ipcon_p) < 0) {
+		return E_NO_THREAD;
+	}
+
+	// create and connect socket
+	entity = gethostbyname(ipcon_p->host);
+
+	if (entity == NULL) {
+		// destroy callback thread
+		if (!is_auto_reconnect) {
+			queue_put(&ipcon_p->callback->queue, QUEUE_KIND_EXIT, NULL);
+
+			if (!ipcon_is_callback_thread(ipcon_p->callback)) {
+				thread_join(&ipcon_p->callback->thread);
+			}
+
+			ipcon_p->callback = NULL;
+		}
+
+		return E_HOSTNAME_INVALID;
+	}
+
+	memset(&address, 0, sizeof(struct sockaddr_in));
+	memcpy(&address.sin_addr, entity->h_addr_list[0], entity->h_length);
+
+	address.sin_family = AF_INET;
+	address.sin_port = htons(ipcon_p->port);
+
+	ipcon_p->socket = (Socket *)malloc(sizeof(Socket));
+
+	if (socket_create(ipcon_p->socket, AF_INET, SOCK_STREAM, 0) < 0) {
+		// destroy callback thread
+		if (!is_auto_reconnect) {
+			queue_put(&ipcon_p->callback->queue, QUEUE_KIND_EXIT, NULL);
+
+			if (!ipcon_is_callback_thread(ipcon_p->callback)) {
+				thread_join(&ipcon_p->callback->thread);
+			}
+
+			ipcon_p->callback = NULL;
+		}
+
+		// destroy socket
+		free(ipcon_p->socket);
+		ipcon_p->socket = NULL;
+
+		return E_NO_STREAM_SOCKET;
+	}
+
+	if (socket_connect(ipcon_p->socket, &address, sizeof(address)) < 0) {
+		// destroy callback thread
+		if (!is_auto_reconnect) {
+			queue_put(&ipcon_p->callback->queue, QUEUE_KIND_EXIT, NULL);
+
+			if (!ipcon_is_callback_thread(ipcon_p->callback)) {
+				thread_join(&ipcon_p->callback->thread);
+			}
+
+			ipcon_p->callback = NULL;
+		}
+
+		// destroy socket
+		socket_destroy(ipcon_p->socket);
+		free(ipcon_p->socket);
+		ipcon_p->socket = NULL;
+
+		return E_NO_CONNECT;
+	}
+
+	++ipcon_p->socket_id;
+
+	// create disconnect probe thread
+	ipcon_p->disconnect_probe_flag = true;
+
+	event_reset(&ipcon_p->disconnect_probe_event);
+
+	if (thread_create(&ipcon_p->disconnect_probe_thread,
+	                  ipcon_disconnect_probe_loop, ipcon_p) < 0) {
+		// destroy callback thread
+		if (!is_auto_reconnect) {
+			queue_put(&ipcon_p->callback->queue, QUEUE_KIND_EXIT, NULL);
+
+			if (!ipcon_is_callback_thread(ipcon_p->callback)) {
+				thread_join(&ipcon_p->callback->thread);
+			}
+
+			ipcon_p->callback = NULL;
+		}
+
+		// destroy socket
+		socket_destroy(ipcon_p->socket);
+		free(ipcon_p->socket);
+		ipcon_p->socket = NULL;
+
+		return E_NO_THREAD;
+	}
+
+	// create receive thread
+	ipcon_p->receive_flag = true;
+	ipcon_p->callback->packet_dispatch_allowed = true;
+
+	if (thread_create(&ipcon_p->receive_thread, ipcon_receive_loop, ipcon_p) < 0) {
+		// destroy socket
+		ipcon_disconnect_unlocked(ipcon_p);
+
+		// destroy callback thread
+		if (!is_auto_reconnect) {
+			queue_put(&ipcon_p->callback->queue, QUEUE_KIND_EXIT, NULL);
+
+			if (!ipcon_is_callback_thread(ipcon_p->callback)) {
+				thread_join(&ipcon_p->callback->thread);
+			}
+
+			ipcon_p->callback = NULL;
+		}
+
+		return E_NO_THREAD;
+	}
+
+	ipcon_p->receive_scheduled = thread_set_scheduling(&ipcon_p->receive_thread,
+	                                                   ipcon_p->receive_sched_priority,
+	                                                   ipcon_p->receive_cpu) == 0;
+
+	ipcon_p->auto_reconnect_allowed = false;
+	ipcon_p->auto_reconnect_pending = false;
+
+	// trigger connected callback
+	if (is_auto_reconnect) {
+		connect_reason = IPCON_CONNECT_REASON_AUTO_RECONNECT;
+	} else {
+		connect_reason = IPCON_CONNECT_REASON_REQUEST;
+	}
+
+	meta = (Meta *)malloc(sizeof(Meta));
+	meta->function_id = IPCON_CALLBACK_CONNECTED;
+	meta->parameter = connect_reason;
+	meta->socket_id = 0;
+
+	queue_put(&ipcon_p->callback->queue, QUEUE_KIND_META, meta);
+
+	return E_OK;
+}
+
+// NOTE: assumes that socket_mutex is locked
+static void ipcon_stop_replay_unlocked(IPConnectionPrivate *ipcon_p) {
+	Replay *replay = ipcon_p->replay;
+
+	ipcon_p->callback->packet_dispatch_allowed = false;
+
+	replay->replay_flag = false;
+
+	event_set(&replay->stop_event);
+	event_set(&replay->request_event);
+
+	thread_join(&replay->thread);
+	thread_destroy(&replay->thread);
+
+	ipcon_p->replay = NULL;
+
+	replay_destroy(replay);
+}
+
+// NOTE: assumes that socket_mutex is locked
+static void ipcon_disconnect_unlocked(IPConnectionPrivate *ipcon_p) {
+	// destroy disconnect probe thread
+	event_set(&ipcon_p->disconnect_probe_event);
+	thread_join(&ipcon_p->disconnect_probe_thread);
+	thread_destroy(&ipcon_p->disconnect_probe_thread);
+
+	// stop dispatching packet callbacks before ending the receive
+	// thread to avoid timeout exceptions due to callback functions
+	// trying to call getters
+	if (!ipcon_is_callback_thread(ipcon_p->callback)) {
+		// FIXME: cannot lock callback mutex here because this can
+		//        deadlock due to an ordering problem with the socket mutex
+		//mutex_lock(&ipcon->callback->mutex);
+
+		ipcon_p->callback->packet_dispatch_allowed = false;
+
+		//mutex_unlock(&ipcon->callback->mutex);
+	} else {
+		ipcon_p->callback->packet_dispatch_allowed = false;
+	}
+
+	// destroy receive thread
+	if (ipcon_p->receive_flag) {
+		ipcon_p->receive_flag = false;
+
+		socket_shutdown(ipcon_p->socket);
+
+		thread_join(&ipcon_p->receive_thread);
+		thread_destroy(&ipcon_p->receive_thread);
+	}
+
+	// destroy socket
+	socket_destroy(ipcon_p->socket);
+	free(ipcon_p->socket);
+	ipcon_p->socket = NULL;
+}
+
+static int ipcon_send_request(IPConnectionPrivate *ipcon_p, Packet *request) {
+	int ret = E_OK;
+
+	mutex_lock(&ipcon_p->socket_mutex);
+
+	if (ipcon_p->replay != NULL) {
+		replay_request(ipcon_p, request);
+
+		mutex_unlock(&ipcon_p->socket_mutex);
+
+		return E_OK;
+	}
+
+	if (ipcon_p->socket == NULL) {
+		ret = E_NOT_CONNECTED;
+	}
+
+	if (ret == E_OK) {
+		// record before sending, so the request precedes its response in
+		// the capture
+		if (ipcon_p->capture != NULL) {
+			capture_put(ipcon_p->capture, IPCON_CAPTURE_DIRECTION_SEND, request);
+		}
+
+		if (socket_send(ipcon_p->socket, request, request->header.length) < 0) {
+			ipcon_handle_disconnect_by_peer(ipcon_p, IPCON_DISCONNECT_REASON_ERROR,
+			                                0, true);
+
+			ret = E_NOT_CONNECTED;
+		} else {
+			ipcon_p->disconnect_probe_flag = false;
+		}
+	}
+
+	mutex_unlock(&ipcon_p->socket_mutex);
+
+	return ret;
+}
+
+void ipcon_create(IPConnection *ipcon) {
+	IPConnectionPrivate *ipcon_p;
+	int i;
+
+	ipcon_p = (IPConnectionPrivate *)malloc(sizeof(IPConnectionPrivate));
+	ipcon->p = ipcon_p;
+
+#ifdef _WIN32
+	ipcon_p->wsa_startup_done = false;
+#endif
+
+	ipcon_p->host = NULL;
+	ipcon_p->port = 0;
+
+	ipcon_p->timeout = 2500;
+
+	ipcon_p->auto_reconnect = true;
+	ipcon_p->auto_reconnect_allowed = false;
+	ipcon_p->auto_reconnect_pending = false;
+
+	mutex_create(&ipcon_p->sequence_number_mutex);
+	ipcon_p->next_sequence_number = 0;
+
+	mutex_create(&ipcon_p->authentication_mutex);
+	ipcon_p->next_authentication_nonce = 0;
+
+	mutex_create(&ipcon_p->devices_ref_mutex);
+	table_create(&ipcon_p->devices);
+
+	for (i = 0; i < IPCON_NUM_CALLBACK_IDS; ++i) {
+		ipcon_p->registered_callbacks[i] = NULL;
+		ipcon_p->registered_callback_user_data[i] = NULL;
+	}
+
+	mutex_create(&ipcon_p->socket_mutex);
+	mutex_create(&ipcon_p->lane_mutex);
+	ipcon_p->socket = NULL;
+	ipcon_p->socket_id = 0;
+
+	ipcon_p->receive_flag = false;
+
+	ipcon_p->callback = NULL;
+
+	ipcon_p->disconnect_probe_flag = false;
+	event_create(&ipcon_p->disconnect_probe_event);
+
+	semaphore_create(&ipcon_p->wait);
+
+	ipcon_p->stats_enabled = false;
+
+	for (i = 0; i < IPCON_MAX_CALLBACK_LANES; ++i) {
+		ipcon_p->callback_lanes[i].enabled = i == 0;
+		ipcon_p->callback_lanes[i].sched_priority = 0;
+		ipcon_p->callback_lanes[i].cpu = -1;
+		ipcon_p->callback_lanes[i].scheduled = false;
+		ipcon_p->callback_lanes[i].external = false;
+		ipcon_p->callback_lanes[i].notify = NULL;
+		ipcon_p->callback_lanes[i].notify_user_data = NULL;
+		ipcon_p->callback_lanes[i].external_queue = NULL;
+	}
+
+	ipcon_p->receive_sched_priority = 0;
+	ipcon_p->receive_cpu = -1;
+	ipcon_p->receive_scheduled = false;
+
+	pool_create(&ipcon_p->packet_pool);
+
+	ipcon_p->capture = NULL;
+
+	ipcon_p->replay = NULL;
+
+	brickd_create(&ipcon_p->brickd, "2", ipcon);
+}
+
+void ipcon_destroy(IPConnection *ipcon) {
+	IPConnectionPrivate *ipcon_p = ipcon->p;
+	int i;
+
+	ipcon_disconnect(ipcon); // FIXME: disable disconnected callback before?
+
+	for (i = 0; i < IPCON_MAX_CALLBACK_LANES; ++i) {
+		if (ipcon_p->callback_lanes[i].external_queue != NULL) {
+			queue_destroy(ipcon_p->callback_lanes[i].external_queue);
+			free(ipcon_p->callback_lanes[i].external_queue);
+		}
+	}
+
+	if (ipcon_p->capture != NULL) {
+		ipcon_stop_capture(ipcon);
+		capture_destroy(ipcon_p->capture);
+	}
+
+	brickd_destroy(&ipcon_p->brickd);
+
+	mutex_destroy(&ipcon_p->authentication_mutex);
+
+	mutex_destroy(&ipcon_p->sequence_number_mutex);
+
+	table_destroy(&ipcon_p->devices); // FIXME: destroy all devices?
+	mutex_destroy(&ipcon_p->devices_ref_mutex);
+
+	mutex_destroy(&ipcon_p->lane_mutex);
+	mutex_destroy(&ipcon_p->socket_mutex);
+
+	event_destroy(&ipcon_p->disconnect_probe_event);
+
+	semaphore_destroy(&ipcon_p->wait);
+
+	pool_destroy(&ipcon_p->packet_pool);
+
+	free(ipcon_p->host);
+
+	free(ipcon_p);
+}
+
+int ipcon_connect(IPConnection *ipcon, const char *host, uint16_t port) {
+	IPConnectionPrivate *ipcon_p = ipcon->p;
+	int ret;
+#ifdef _WIN32
+	WSADATA wsa_data;
+#endif
+
+	mutex_lock(&ipcon_p->socket_mutex);
+
+#ifdef _WIN32
+	if (!ipcon_p->wsa_startup_done) {
+		if (WSAStartup(MAKEWORD(2, 2), &wsa_data) != 0) {
+			mutex_unlock(&ipcon_p->socket_mutex);
+
+			return E_NO_STREAM_SOCKET;
+		}
+
+		ipcon_p->wsa_startup_done = true;
+	}
+#endif
+
+	if (ipcon_p->socket != NULL || ipcon_p->replay != NULL) {
+		mutex_unlock(&ipcon_p->socket_mutex);
+
+		return E_ALREADY_CONNECTED;
+	}
+
+	free(ipcon_p->host);
+
+	ipcon_p->host = strdup(host);
+	ipcon_p->port = port;
+
+	ret = ipcon_connect_unlocked(ipcon_p, false);
+
+	mutex_unlock(&ipcon_p->socket_mutex);
+
+	return ret;
+}
+
+int ipcon_disconnect(IPConnection *ipcon) {
+	IPConnectionPrivate *ipcon_p = ipcon->p;
+	CallbackContext *callback;
+	bool is_callback_thread;
+	Meta *meta;
+
+	mutex_lock(&ipcon_p->socket_mutex);
+
+	ipcon_p->auto_reconnect_allowed = false;
+
+	if (ipcon_p->auto_reconnect_pending) {
+		// abort pending auto-reconnect
+		ipcon_p->auto_reconnect_pending = false;
+	} else {
+		if (ipcon_p->replay != NULL) {
+			ipcon_stop_replay_unlocked(ipcon_p);
+		} else if (ipcon_p->socket == NULL) {
+			mutex_unlock(&ipcon_p->socket_mutex);
+
+			return E_NOT_CONNECTED;
+		} else {
+			ipcon_disconnect_unlocked(ipcon_p);
+		}
+	}
+
+	// destroy callback thread
+	callback = ipcon_p->callback;
+	ipcon_p->callback = NULL;
+
+	mutex_unlock(&ipcon_p->socket_mutex);
+
+	// do this outside of socket_mutex to allow calling (dis-)connect from
+	// the callbacks while blocking on the join call here
+	meta = (Meta *)malloc(sizeof(Meta));
+	meta->function_id = IPCON_CALLBACK_DISCONNECTED;
+	meta->parameter = IPCON_DISCONNECT_REASON_REQUEST;
+	meta->socket_id = 0;
+
+	// check before the exit, the callback thread frees the context on exit
+	is_callback_thread = ipcon_is_callback_thread(callback);
 
-			ipcon_handle_response(ipcon_p, pending_data);
+	queue_put(&callback->queue, QUEUE_KIND_META, meta);
+	queue_put(&callback->queue, QUEUE_KIND_EXIT, NULL);
 
-			memmove(pending_data, (uint8_t *)pending_data + length,
-			        pending_length - length);
-			pending_length -= length;
-		}
+	if (!is_callback_thread) {
+		thread_join(&callback->thread);
 	}
-}
 
-// NOTE: assumes that socket_mutex is locked
-static int ipcon_connect_unlocked(IPConnectionPrivate *ipcon_p, bool is_auto_reconnect) {
-	struct hostent *entity;
-	struct sockaddr_in address;
-	uint8_t connect_reason;
-	Meta *meta;
+	// NOTE: no further cleanup of the callback queue and thread here, the
+	// callback thread is doing this on exit
 
-	// create callback queue and thread
-	if (ipcon_p->callback == NULL) {
-		ipcon_p->callback = (CallbackContext *)malloc(sizeof(CallbackContext));
+	return E_OK;
+}
 
-		ipcon_p->callback->ipcon_p = ipcon_p;
-		ipcon_p->callback->packet_dispatch_allowed = false;
+int ipcon_authenticate(IPConnection *ipcon, const char secret[64]) {
+	IPConnectionPrivate *ipcon_p = ipcon->p;
+	int ret;
+	uint32_t nonces[2]; // server, client
+	uint8_t digest[SHA1_DIGEST_LENGTH];
 
-		queue_create(&ipcon_p->callback->queue);
-		mutex_create(&ipcon_p->callback->mutex);
+	mutex_lock(&ipcon_p->authentication_mutex);
 
-		if (thread_create(&ipcon_p->callback->thread, ipcon_callback_loop,
-		                  ipcon_p->callback) < 0) {
-			mutex_destroy(&ipcon_p->callback->mutex);
-			queue_destroy(&ipcon_p->callback->queue);
+	if (ipcon_p->next_authentication_nonce == 0) {
+		ipcon_p->next_authentication_nonce = get_random_uint32();
+	}
 
-			free(ipcon_p->callback);
-			ipcon_p->callback = NULL;
+	ret = brickd_get_authentication_nonce(&ipcon_p->brickd, (uint8_t *)nonces);
 
-			return E_NO_THREAD;
-		}
+	if (ret < 0) {
+		mutex_unlock(&ipcon_p->authentication_mutex);
+
+		return ret;
 	}
 
-	// create and connect socket
-	entity = gethostbyname(ipcon_p->host);
+	nonces[1] = ipcon_p->next_authentication_nonce++;
 
-	if (entity == NULL) {
-		// destroy callback thread
-		if (!is_auto_reconnect) {
-			queue_put(&ipcon_p->callback->queue, QUEUE_KIND_EXIT, NULL);
+	hmac_sha1((uint8_t *)secret, string_length(secret, IPCON_MAX_SECRET_LENGTH),
+	          (uint8_t *)nonces, sizeof(nonces), digest);
 
-			if (!thread_is_current(&ipcon_p->callback->thread)) {
-				thread_join(&ipcon_p->callback->thread);
-			}
+	ret = brickd_authenticate(&ipcon_p->brickd, (uint8_t *)&nonces[1], digest);
 
-			ipcon_p->callback = NULL;
-		}
+	if (ret < 0) {
+		mutex_unlock(&ipcon_p->authentication_mutex);
 
-		return E_HOSTNAME_INVALID;
+		return ret;
 	}
 
-	memset(&address, 0, sizeof(struct sockaddr_in));
-	memcpy(&address.sin_addr, entity->h_addr_list[0], entity->h_length);
-
-	address.sin_family = AF_INET;
-	address.sin_port = htons(ipcon_p->port);
+	mutex_unlock(&ipcon_p->authentication_mutex);
 
-	ipcon_p->socket = (Socket *)malloc(sizeof(Socket));
+	return E_OK;
+}
 
-	if (socket_create(ipcon_p->socket, AF_INET, SOCK_STREAM, 0) < 0) {
-		// destroy callback thread
-		if (!is_auto_reconnect) {
-			queue_put(&ipcon_p->callback->queue, QUEUE_KIND_EXIT, NULL);
+int ipcon_get_connection_state(IPConnection *ipcon) {
+	IPConnectionPrivate *ipcon_p = ipcon->p;
 
-			if (!thread_is_current(&ipcon_p->callback->thread)) {
-				thread_join(&ipcon_p->callback->thread);
-			}
+	if (ipcon_p->socket != NULL || ipcon_p->replay != NULL) {
+		return IPCON_CONNECTION_STATE_CONNECTED;
+	} else if (ipcon_p->auto_reconnect_pending) {
+		return IPCON_CONNECTION_STATE_PENDING;
+	} else {
+		return IPCON_CONNECTION_STATE_DISCONNECTED;
+	}
+}
 
-			ipcon_p->callback = NULL;
-		}
+void ipcon_set_auto_reconnect(IPConnection *ipcon, bool auto_reconnect) {
+	IPConnectionPrivate *ipcon_p = ipcon->p;
 
-		// destroy socket
-		free(ipcon_p->socket);
-		ipcon_p->socket = NULL;
+	ipcon_p->auto_reconnect = auto_reconnect;
 
-		return E_NO_STREAM_SOCKET;
+	if (!ipcon_p->auto_reconnect) {
+		// abort potentially pending auto reconnect
+		ipcon_p->auto_reconnect_allowed = false;
 	}
+}
 
-	if (socket_connect(ipcon_p->socket, &address, sizeof(address)) < 0) {
-		// destroy callback thread
-		if (!is_auto_reconnect) {
-			queue_put(&ipcon_p->callback->queue, QUEUE_KIND_EXIT, NULL);
+bool ipcon_get_auto_reconnect(IPConnection *ipcon) {
+	return ipcon->p->auto_reconnect;
+}
 
-			if (!thread_is_current(&ipcon_p->callback->thread)) {
-				thread_join(&ipcon_p->callback->thread);
-			}
+void ipcon_set_timeout(IPConnection *ipcon, uint32_t timeout) { // in msec
+	ipcon->p->timeout = timeout;
+}
 
-			ipcon_p->callback = NULL;
-		}
+uint32_t ipcon_get_timeout(IPConnection *ipcon) { // in msec
+	return ipcon->p->timeout;
+}
 
-		// destroy socket
-		socket_destroy(ipcon_p->socket);
-		free(ipcon_p->socket);
-		ipcon_p->socket = NULL;
+int ipcon_enumerate(IPConnection *ipcon) {
+	IPConnectionPrivate *ipcon_p = ipcon->p;
+	Enumerate enumerate;
+	int ret;
 
-		return E_NO_CONNECT;
+	ret = packet_header_create(&enumerate.header, sizeof(Enumerate),
+	                           IPCON_FUNCTION_ENUMERATE, ipcon_p, NULL);
+
+	if (ret < 0) {
+		return ret;
 	}
 
-	++ipcon_p->socket_id;
+	return ipcon_send_request(ipcon_p, (Packet *)&enumerate);
+}
 
-	// create disconnect probe thread
-	ipcon_p->disconnect_probe_flag = true;
+void ipcon_wait(IPConnection *ipcon) {
+	semaphore_acquire(&ipcon->p->wait);
+}
 
-	event_reset(&ipcon_p->disconnect_probe_event);
+void ipcon_unwait(IPConnection *ipcon) {
+	semaphore_release(&ipcon->p->wait);
+}
 
-	if (thread_create(&ipcon_p->disconnect_probe_thread,
-	                  ipcon_disconnect_probe_loop, ipcon_p) < 0) {
-		// destroy callback thread
-		if (!is_auto_reconnect) {
-			queue_put(&ipcon_p->callback->queue, QUEUE_KIND_EXIT, NULL);
+void ipcon_register_callback(IPConnection *ipcon, uint8_t id, void *callback,
+                             void *user_data) {
+	IPConnectionPrivate *ipcon_p = ipcon->p;
 
-			if (!thread_is_current(&ipcon_p->callback->thread)) {
-				thread_join(&ipcon_p->callback->thread);
-			}
+	ipcon_p->registered_callbacks[id] = callback;
+	ipcon_p->registered_callback_user_data[id] = user_data;
+}
 
-			ipcon_p->callback = NULL;
-		}
+void ipcon_set_stats_enabled(IPConnection *ipcon, bool stats_enabled) {
+	ipcon->p->stats_enabled = stats_enabled;
+}
 
-		// destroy socket
-		socket_destroy(ipcon_p->socket);
-		free(ipcon_p->socket);
-		ipcon_p->socket = NULL;
+int ipcon_get_callback_queue_length(IPConnection *ipcon) {
+	IPConnectionPrivate *ipcon_p = ipcon->p;
+	CallbackContext *callback;
+	CallbackLaneConfig *config;
+	int length = 0;
+	int i;
 
-		return E_NO_THREAD;
-	}
+	// the context of an ended connection is freed by its callback thread,
+	// it is no longer reachable once ipcon_p->callback is NULL
+	mutex_lock(&ipcon_p->socket_mutex);
 
-	// create receive thread
-	ipcon_p->receive_flag = true;
-	ipcon_p->callback->packet_dispatch_allowed = true;
+	callback = ipcon_p->callback;
 
-	if (thread_create(&ipcon_p->receive_thread, ipcon_receive_loop, ipcon_p) < 0) {
-		// destroy socket
-		ipcon_disconnect_unlocked(ipcon_p);
+	if (callback != NULL) {
+		length = queue_get_length(&callback->queue);
 
-		// destroy callback thread
-		if (!is_auto_reconnect) {
-			queue_put(&ipcon_p->callback->queue, QUEUE_KIND_EXIT, NULL);
+		mutex_lock(&ipcon_p->lane_mutex);
 
-			if (!thread_is_current(&ipcon_p->callback->thread)) {
-				thread_join(&ipcon_p->callback->thread);
-			}
+		for (i = 1; i < IPCON_MAX_CALLBACK_LANES; ++i) {
+			config = &ipcon_p->callback_lanes[i];
 
-			ipcon_p->callback = NULL;
+			// an external lane has no thread, its callbacks wait for
+			// ipcon_dispatch_callback_lane
+			if (config->external) {
+				length += queue_get_length(config->external_queue);
+			} else if (callback->lanes[i].running) {
+				length += queue_get_length(&callback->lanes[i].queue);
+			}
 		}
 
-		return E_NO_THREAD;
+		mutex_unlock(&ipcon_p->lane_mutex);
 	}
 
-	ipcon_p->auto_reconnect_allowed = false;
-	ipcon_p->auto_reconnect_pending = false;
+	mutex_unlock(&ipcon_p->socket_mutex);
 
-	// trigger connected callback
-	if (is_auto_reconnect) {
-		connect_reason = IPCON_CONNECT_REASON_AUTO_RECONNECT;
-	} else {
-		connect_reason = IPCON_CONNECT_REASON_REQUEST;
+	return length;
+}
+
+int ipcon_set_callback_lane(IPConnection *ipcon, uint8_t lane,
+                            int sched_priority, int cpu) {
+	IPConnectionPrivate *ipcon_p = ipcon->p;
+
+	if (lane >= IPCON_MAX_CALLBACK_LANES) {
+		return E_INVALID_PARAMETER;
 	}
 
-	meta = (Meta *)malloc(sizeof(Meta));
-	meta->function_id = IPCON_CALLBACK_CONNECTED;
-	meta->parameter = connect_reason;
-	meta->socket_id = 0;
+	mutex_lock(&ipcon_p->socket_mutex);
 
-	queue_put(&ipcon_p->callback->queue, QUEUE_KIND_META, meta);
+	ipcon_p->callback_lanes[lane].enabled = true;
+	ipcon_p->callback_lanes[lane].sched_priority = sched_priority;
+	ipcon_p->callback_lanes[lane].cpu = cpu;
+
+	mutex_unlock(&ipcon_p->socket_mutex);
 
 	return E_OK;
 }
 
-// NOTE: assumes that socket_mutex is locked
-static void ipcon_disconnect_unlocked(IPConnectionPrivate *ipcon_p) {
-	// destroy disconnect probe thread
-	event_set(&ipcon_p->disconnect_probe_event);
-	thread_join(&ipcon_p->disconnect_probe_thread);
-	thread_destroy(&ipcon_p->disconnect_probe_thread);
+bool ipcon_is_callback_lane_scheduled(IPConnection *ipcon, uint8_t lane) {
+	IPConnectionPrivate *ipcon_p = ipcon->p;
+	bool scheduled;
 
-	// stop dispatching packet callbacks before ending the receive
-	// thread to avoid timeout exceptions due to callback functions
-	// trying to call getters
-	if (!thread_is_current(&ipcon_p->callback->thread)) {
-		// FIXME: cannot lock callback mutex here because this can
-		//        deadlock due to an ordering problem with the socket mutex
-		//mutex_lock(&ipcon->callback->mutex);
+	if (lane >= IPCON_MAX_CALLBACK_LANES) {
+		return false;
+	}
 
-		ipcon_p->callback->packet_dispatch_allowed = false;
+	mutex_lock(&ipcon_p->socket_mutex);
+	scheduled = ipcon_p->callback != NULL && ipcon_p->callback_lanes[lane].scheduled;
+	mutex_unlock(&ipcon_p->socket_mutex);
 
-		//mutex_unlock(&ipcon->callback->mutex);
-	} else {
-		ipcon_p->callback->packet_dispatch_allowed = false;
+	return scheduled;
+}
+
+int ipcon_set_callback_lane_external(IPConnection *ipcon, uint8_t lane,
+                                     CallbackLaneNotifyFunction notify,
+                                     void *user_data) {
+	IPConnectionPrivate *ipcon_p = ipcon->p;
+	CallbackLaneConfig *config;
+	int kind;
+	void *data;
+	uint64_t timestamp;
+
+	if (lane == 0 || lane >= IPCON_MAX_CALLBACK_LANES) {
+		return E_INVALID_PARAMETER;
 	}
 
-	// destroy receive thread
-	if (ipcon_p->receive_flag) {
-		ipcon_p->receive_flag = false;
+	mutex_lock(&ipcon_p->socket_mutex);
 
-		socket_shutdown(ipcon_p->socket);
+	config = &ipcon_p->callback_lanes[lane];
 
-		thread_join(&ipcon_p->receive_thread);
-		thread_destroy(&ipcon_p->receive_thread);
+	if (notify != NULL && config->external_queue == NULL) {
+		config->external_queue = (Queue *)malloc(sizeof(Queue));
+
+		queue_create(config->external_queue, &ipcon_p->packet_pool);
 	}
 
-	// destroy socket
-	socket_destroy(ipcon_p->socket);
-	free(ipcon_p->socket);
-	ipcon_p->socket = NULL;
-}
+	mutex_lock(&ipcon_p->lane_mutex);
 
-static int ipcon_send_request(IPConnectionPrivate *ipcon_p, Packet *request) {
-	int ret = E_OK;
+	// the callbacks that were not dispatched yet go to lane 0, an external
+	// lane has no thread of its own during the connection. moving them under
+	// the lane_mutex keeps them ahead of the callbacks received after this
+	if (config->external && notify == NULL) {
+		while (queue_try_get(config->external_queue, &kind, &data, &timestamp) == 0) {
+			if (kind == QUEUE_KIND_PACKET && ipcon_p->callback != NULL) {
+				queue_put_timestamped(&ipcon_p->callback->queue, kind, data, timestamp);
+			} else {
+				queue_free_data(kind, data);
+			}
+		}
+	}
 
-	mutex_lock(&ipcon_p->socket_mutex);
+	config->enabled = true;
+	config->external = notify != NULL;
+	config->notify = notify;
+	config->notify_user_data = user_data;
 
-	if (ipcon_p->socket == NULL) {
-		ret = E_NOT_CONNECTED;
+	mutex_unlock(&ipcon_p->lane_mutex);
+	mutex_unlock(&ipcon_p->socket_mutex);
+
+	return E_OK;
+}
+
+int ipcon_dispatch_callback_lane(IPConnection *ipcon, uint8_t lane, int max_count) {
+	IPConnectionPrivate *ipcon_p = ipcon->p;
+	Queue *queue;
+	int count = 0;
+	int kind;
+	void *data;
+	uint64_t timestamp;
+
+	if (lane == 0 || lane >= IPCON_MAX_CALLBACK_LANES) {
+		return 0;
 	}
 
-	if (ret == E_OK) {
-		if (socket_send(ipcon_p->socket, request, request->header.length) < 0) {
-			ipcon_handle_disconnect_by_peer(ipcon_p, IPCON_DISCONNECT_REASON_ERROR,
-			                                0, true);
+	queue = ipcon_p->callback_lanes[lane].external_queue;
 
-			ret = E_NOT_CONNECTED;
-		} else {
-			ipcon_p->disconnect_probe_flag = false;
-		}
+	if (queue == NULL) {
+		return 0;
 	}
 
-	mutex_unlock(&ipcon_p->socket_mutex);
+	while (count < max_count && queue_try_get(queue, &kind, &data, &timestamp) == 0) {
+		if (kind == QUEUE_KIND_PACKET) {
+			ipcon_dispatch_packet(ipcon_p, (Packet *)data, timestamp);
+		}
 
-	return ret;
-}
+		queue_free_data(kind, data);
 
-void ipcon_create(IPConnection *ipcon) {
-	IPConnectionPrivate *ipcon_p;
-	int i;
+		++count;
+	}
 
-	ipcon_p = (IPConnectionPrivate *)malloc(sizeof(IPConnectionPrivate));
-	ipcon->p = ipcon_p;
+	return count;
+}
 
-#ifdef _WIN32
-	ipcon_p->wsa_startup_done = false;
-#endif
+void ipcon_set_receive_scheduling(IPConnection *ipcon, int sched_priority, int cpu) {
+	IPConnectionPrivate *ipcon_p = ipcon->p;
 
-	ipcon_p->host = NULL;
-	ipcon_p->port = 0;
+	mutex_lock(&ipcon_p->socket_mutex);
 
-	ipcon_p->timeout = 2500;
+	ipcon_p->receive_sched_priority = sched_priority;
+	ipcon_p->receive_cpu = cpu;
 
-	ipcon_p->auto_reconnect = true;
-	ipcon_p->auto_reconnect_allowed = false;
-	ipcon_p->auto_reconnect_pending = false;
+	mutex_unlock(&ipcon_p->socket_mutex);
+}
 
-	mutex_create(&ipcon_p->sequence_number_mutex);
-	ipcon_p->next_sequence_number = 0;
+bool ipcon_is_receive_scheduled(IPConnection *ipcon) {
+	IPConnectionPrivate *ipcon_p = ipcon->p;
+	bool scheduled;
 
-	mutex_create(&ipcon_p->authentication_mutex);
-	ipcon_p->next_authentication_nonce = 0;
+	mutex_lock(&ipcon_p->socket_mutex);
+	scheduled = ipcon_p->receive_scheduled;
+	mutex_unlock(&ipcon_p->socket_mutex);
 
-	mutex_create(&ipcon_p->devices_ref_mutex);
-	table_create(&ipcon_p->devices);
+	return scheduled;
+}
 
-	for (i = 0; i < IPCON_NUM_CALLBACK_IDS; ++i) {
-		ipcon_p->registered_callbacks[i] = NULL;
-		ipcon_p->registered_callback_user_data[i] = NULL;
+int ipcon_reserve_packet_pool(IPConnection *ipcon, uint32_t count) {
+	// a queued packet needs its queue item as well
+	if (count == 0 || count > UINT32_MAX / 2 ||
+	    pool_reserve(&ipcon->p->packet_pool, count * 2) < 0) {
+		return E_INVALID_PARAMETER;
 	}
 
-	mutex_create(&ipcon_p->socket_mutex);
-	ipcon_p->socket = NULL;
-	ipcon_p->socket_id = 0;
-
-	ipcon_p->receive_flag = false;
+	return E_OK;
+}
 
-	ipcon_p->callback = NULL;
+void ipcon_get_packet_pool_stats(IPConnection *ipcon, uint32_t *ret_available,
+                                 uint32_t *ret_misses) {
+	PacketPool *pool = &ipcon->p->packet_pool;
 
-	ipcon_p->disconnect_probe_flag = false;
-	event_create(&ipcon_p->disconnect_probe_event);
+	mutex_lock(&pool->mutex);
 
-	semaphore_create(&ipcon_p->wait);
+	*ret_available = pool->available;
+	*ret_misses = pool->misses;
 
-	brickd_create(&ipcon_p->brickd, "2", ipcon);
+	mutex_unlock(&pool->mutex);
 }
 
-void ipcon_destroy(IPConnection *ipcon) {
+int ipcon_start_capture(IPConnection *ipcon, const char *filename, uint32_t ring_size) {
 	IPConnectionPrivate *ipcon_p = ipcon->p;
+	Capture *capture = ipcon_p->capture;
+	FILE *file;
+	uint32_t size = 1;
+	uint8_t header[IPCON_CAPTURE_HEADER_SIZE];
+	uint16_t version = leconvert_uint16_to(IPCON_CAPTURE_VERSION);
+	uint64_t start_monotonic = leconvert_uint64_to(microseconds());
+	uint64_t start_realtime = leconvert_uint64_to(realtime_microseconds());
+
+	if (capture != NULL && capture->enabled) {
+		return E_ALREADY_CAPTURING;
+	}
 
-	ipcon_disconnect(ipcon); // FIXME: disable disconnected callback before?
+	if (ring_size == 0) {
+		ring_size = IPCON_CAPTURE_DEFAULT_RING_SIZE;
+	}
 
-	brickd_destroy(&ipcon_p->brickd);
+	while (size < ring_size && size < 0x80000000) {
+		size <<= 1;
+	}
 
-	mutex_destroy(&ipcon_p->authentication_mutex);
+	file = fopen(filename, "wb");
 
-	mutex_destroy(&ipcon_p->sequence_number_mutex);
+	if (file == NULL) {
+		return E_NO_FILE;
+	}
 
-	table_destroy(&ipcon_p->devices); // FIXME: destroy all devices?
-	mutex_destroy(&ipcon_p->devices_ref_mutex);
+	memset(header, 0, sizeof(header));
+	memcpy(header, IPCON_CAPTURE_MAGIC, 4);
+	memcpy(header + 4, &version, sizeof(version));
+	memcpy(header + 8, &start_monotonic, sizeof(start_monotonic));
+	memcpy(header + 16, &start_realtime, sizeof(start_realtime));
 
-	mutex_destroy(&ipcon_p->socket_mutex);
+	if (fwrite(header, 1, sizeof(header), file) != sizeof(header)) {
+		fclose(file);
 
-	event_destroy(&ipcon_p->disconnect_probe_event);
+		return E_NO_FILE;
+	}
 
-	semaphore_destroy(&ipcon_p->wait);
+	if (capture == NULL) {
+		capture = (Capture *)calloc(1, sizeof(Capture));
+	}
 
-	free(ipcon_p->host);
+	// no producer is inside the ring while capture is disabled
+	if (capture->slots == NULL || capture->mask + 1 != size) {
+		free(capture->slots);
 
-	free(ipcon_p);
-}
+		capture->slots = (CaptureSlot *)malloc(size * sizeof(CaptureSlot));
+		capture->mask = size - 1;
+	}
 
-int ipcon_connect(IPConnection *ipcon, const char *host, uint16_t port) {
-	IPConnectionPrivate *ipcon_p = ipcon->p;
-	int ret;
-#ifdef _WIN32
-	WSADATA wsa_data;
-#endif
+	capture_reset(capture);
 
-	mutex_lock(&ipcon_p->socket_mutex);
+	capture->file = file;
+	capture->flush_flag = true;
 
-#ifdef _WIN32
-	if (!ipcon_p->wsa_startup_done) {
-		if (WSAStartup(MAKEWORD(2, 2), &wsa_data) != 0) {
-			mutex_unlock(&ipcon_p->socket_mutex);
+	if (thread_create(&capture->flush_thread, capture_flush_loop, capture) < 0) {
+		capture->file = NULL;
+		ipcon_p->capture = capture;
 
-			return E_NO_STREAM_SOCKET;
-		}
+		fclose(file);
 
-		ipcon_p->wsa_startup_done = true;
+		return E_NO_THREAD;
 	}
-#endif
 
-	if (ipcon_p->socket != NULL) {
-		mutex_unlock(&ipcon_p->socket_mutex);
+	memory_barrier();
 
-		return E_ALREADY_CONNECTED;
+	capture->enabled = true;
+	ipcon_p->capture = capture;
+
+	return E_OK;
+}
+
+void ipcon_stop_capture(IPConnection *ipcon) {
+	Capture *capture = ipcon->p->capture;
+
+	if (capture == NULL || !capture->enabled) {
+		return;
 	}
 
-	free(ipcon_p->host);
+	capture->enabled = false;
 
-	ipcon_p->host = strdup(host);
-	ipcon_p->port = port;
+	memory_barrier();
 
-	ret = ipcon_connect_unlocked(ipcon_p, false);
+	// wait for producers that saw the capture still enabled
+	while (capture->writers > 0) {
+		thread_sleep(1);
+	}
 
-	mutex_unlock(&ipcon_p->socket_mutex);
+	capture->flush_flag = false;
 
-	return ret;
+	thread_join(&capture->flush_thread);
+	thread_destroy(&capture->flush_thread);
+
+	fclose(capture->file);
+	capture->file = NULL;
 }
 
-int ipcon_disconnect(IPConnection *ipcon) {
+void ipcon_get_capture_stats(IPConnection *ipcon, uint64_t *ret_captured,
+                             uint64_t *ret_dropped) {
+	Capture *capture = ipcon->p->capture;
+
+	*ret_captured = capture != NULL ? capture->captured : 0;
+	*ret_dropped = capture != NULL ? capture->dropped : 0;
+}
+
+int ipcon_replay(IPConnection *ipcon, const char *filename, double speed) {
 	IPConnectionPrivate *ipcon_p = ipcon->p;
-	CallbackContext *callback;
+	Replay *replay;
+	FILE *file;
+	uint8_t header[IPCON_CAPTURE_HEADER_SIZE];
+	uint16_t version;
 	Meta *meta;
+	int ret;
 
 	mutex_lock(&ipcon_p->socket_mutex);
 
-	ipcon_p->auto_reconnect_allowed = false;
+	if (ipcon_p->socket != NULL || ipcon_p->replay != NULL) {
+		mutex_unlock(&ipcon_p->socket_mutex);
 
-	if (ipcon_p->auto_reconnect_pending) {
-		// abort pending auto-reconnect
-		ipcon_p->auto_reconnect_pending = false;
-	} else {
-		if (ipcon_p->socket == NULL) {
-			mutex_unlock(&ipcon_p->socket_mutex);
+		return E_ALREADY_CONNECTED;
+	}
 
-			return E_NOT_CONNECTED;
-		}
+	file = fopen(filename, "rb");
 
-		ipcon_disconnect_unlocked(ipcon_p);
+	if (file == NULL) {
+		mutex_unlock(&ipcon_p->socket_mutex);
+
+		return E_NO_FILE;
 	}
 
-	// destroy callback thread
-	callback = ipcon_p->callback;
-	ipcon_p->callback = NULL;
+	if (fread(header, 1, sizeof(header), file) != sizeof(header) ||
+	    memcmp(header, IPCON_CAPTURE_MAGIC, 4) != 0) {
+		fclose(file);
+		mutex_unlock(&ipcon_p->socket_mutex);
 
-	mutex_unlock(&ipcon_p->socket_mutex);
+		return E_INVALID_FILE;
+	}
 
-	// do this outside of socket_mutex to allow calling (dis-)connect from
-	// the callbacks while blocking on the join call here
-	meta = (Meta *)malloc(sizeof(Meta));
-	meta->function_id = IPCON_CALLBACK_DISCONNECTED;
-	meta->parameter = IPCON_DISCONNECT_REASON_REQUEST;
-	meta->socket_id = 0;
+	memcpy(&version, header + 4, sizeof(version));
 
-	queue_put(&callback->queue, QUEUE_KIND_META, meta);
-	queue_put(&callback->queue, QUEUE_KIND_EXIT, NULL);
+	if (leconvert_uint16_from(version) != IPCON_CAPTURE_VERSION) {
+		fclose(file);
+		mutex_unlock(&ipcon_p->socket_mutex);
 
-	if (!thread_is_current(&callback->thread)) {
-		thread_join(&callback->thread);
+		return E_INVALID_FILE;
 	}
 
-	// NOTE: no further cleanup of the callback queue and thread here, the
-	// callback thread is doing this on exit
+	replay = (Replay *)calloc(1, sizeof(Replay));
 
-	return E_OK;
-}
+	replay->file = file;
+	replay->speed = speed > 0 ? speed : 0;
 
-int ipcon_authenticate(IPConnection *ipcon, const char secret[64]) {
-	IPConnectionPrivate *ipcon_p = ipcon->p;
-	int ret;
-	uint32_t nonces[2]; // server, client
-	uint8_t digest[SHA1_DIGEST_LENGTH];
+	table_create(&replay->responses);
+	mutex_create(&replay->mutex);
+	event_create(&replay->request_event);
+	event_create(&replay->stop_event);
 
-	mutex_lock(&ipcon_p->authentication_mutex);
+	if (replay_index(replay) < 0 ||
+	    fseek(file, IPCON_CAPTURE_HEADER_SIZE, SEEK_SET) < 0) {
+		replay_destroy(replay);
+		mutex_unlock(&ipcon_p->socket_mutex);
 
-	if (ipcon_p->next_authentication_nonce == 0) {
-		ipcon_p->next_authentication_nonce = get_random_uint32();
+		return E_INVALID_FILE;
 	}
 
-	ret = brickd_get_authentication_nonce(&ipcon_p->brickd, (uint8_t *)nonces);
+	ret = ipcon_create_callback_unlocked(ipcon_p);
 
 	if (ret < 0) {
-		mutex_unlock(&ipcon_p->authentication_mutex);
+		replay_destroy(replay);
+		mutex_unlock(&ipcon_p->socket_mutex);
 
 		return ret;
 	}
 
-	nonces[1] = ipcon_p->next_authentication_nonce++;
+	replay->replay_flag = true;
+	ipcon_p->replay = replay;
+	ipcon_p->callback->packet_dispatch_allowed = true;
 
-	hmac_sha1((uint8_t *)secret, string_length(secret, IPCON_MAX_SECRET_LENGTH),
-	          (uint8_t *)nonces, sizeof(nonces), digest);
+	if (thread_create(&replay->thread, replay_loop, ipcon_p) < 0) {
+		ipcon_p->replay = NULL;
 
-	ret = brickd_authenticate(&ipcon_p->brickd, (uint8_t *)&nonces[1], digest);
+		// destroy callback thread
+		queue_put(&ipcon_p->callback->queue, QUEUE_KIND_EXIT, NULL);
+		thread_join(&ipcon_p->callback->thread);
+		ipcon_p->callback = NULL;
 
-	if (ret < 0) {
-		mutex_unlock(&ipcon_p->authentication_mutex);
+		replay_destroy(replay);
+		mutex_unlock(&ipcon_p->socket_mutex);
 
-		return ret;
+		return E_NO_THREAD;
 	}
 
-	mutex_unlock(&ipcon_p->authentication_mutex);
+	// the replay thread takes the place of the receive thread
+	ipcon_p->receive_scheduled = thread_set_scheduling(&replay->thread,
+	                                                   ipcon_p->receive_sched_priority,
+	                                                   ipcon_p->receive_cpu) == 0;
+
+	// trigger connected callback
+	meta = (Meta *)malloc(sizeof(Meta));
+	meta->function_id = IPCON_CALLBACK_CONNECTED;
+	meta->parameter = IPCON_CONNECT_REASON_REQUEST;
+	meta->socket_id = 0;
+
+	queue_put(&ipcon_p->callback->queue, QUEUE_KIND_META, meta);
+
+	mutex_unlock(&ipcon_p->socket_mutex);
 
 	return E_OK;
 }
 
-int ipcon_get_connection_state(IPConnection *ipcon) {
+bool ipcon_is_replay_done(IPConnection *ipcon) {
 	IPConnectionPrivate *ipcon_p = ipcon->p;
 
-	if (ipcon_p->socket != NULL) {
-		return IPCON_CONNECTION_STATE_CONNECTED;
-	} else if (ipcon_p->auto_reconnect_pending) {
-		return IPCON_CONNECTION_STATE_PENDING;
-	} else {
-		return IPCON_CONNECTION_STATE_DISCONNECTED;
-	}
+	return ipcon_p->replay != NULL && ipcon_p->replay->done;
 }
 
-void ipcon_set_auto_reconnect(IPConnection *ipcon, bool auto_reconnect) {
-	IPConnectionPrivate *ipcon_p = ipcon->p;
+int device_get_stats(Device *device, FunctionStats *ret_stats, int max_count) {
+	DeviceStats *stats = device->p->stats;
+	int count = 0;
+	int i;
 
-	ipcon_p->auto_reconnect = auto_reconnect;
+	if (stats == NULL) {
+		return 0;
+	}
 
-	if (!ipcon_p->auto_reconnect) {
-		// abort potentially pending auto reconnect
-		ipcon_p->auto_reconnect_allowed = false;
+	for (i = 0; i < IPCON_STATS_MAX_FUNCTIONS && count < max_count; ++i) {
+		if (i < IPCON_STATS_MAX_FUNCTIONS - 1) {
+			if (stats->keys[i] == 0) {
+				continue;
+			}
+
+			ret_stats[count] = stats->functions[i];
+			ret_stats[count].function_id = (uint8_t)(stats->keys[i] - 1);
+		} else {
+			// shared slot for overflowing function IDs, reported as ID 0
+			if (stats->functions[i].requests == 0 && stats->functions[i].callbacks == 0) {
+				continue;
+			}
+
+			ret_stats[count] = stats->functions[i];
+			ret_stats[count].function_id = 0;
+		}
+
+		++count;
 	}
-}
 
-bool ipcon_get_auto_reconnect(IPConnection *ipcon) {
-	return ipcon->p->auto_reconnect;
+	return count;
 }
 
-void ipcon_set_timeout(IPConnection *ipcon, uint32_t timeout) { // in msec
-	ipcon->p->timeout = timeout;
-}
+int device_set_queue_policy(Device *device, uint8_t function_id, uint8_t policy,
+                            uint16_t depth) {
+	DevicePrivate *device_p = device->p;
+	DeviceQueueStream *stream;
+	int i;
 
-uint32_t ipcon_get_timeout(IPConnection *ipcon) { // in msec
-	return ipcon->p->timeout;
-}
+	if (policy != IPCON_QUEUE_POLICY_KEEP_ALL &&
+	    policy != IPCON_QUEUE_POLICY_DROP_OLDEST &&
+	    policy != IPCON_QUEUE_POLICY_CONFLATE) {
+		return E_INVALID_PARAMETER;
+	}
 
-int ipcon_enumerate(IPConnection *ipcon) {
-	IPConnectionPrivate *ipcon_p = ipcon->p;
-	Enumerate enumerate;
-	int ret;
+	mutex_lock(&device_p->queue_mutex);
 
-	ret = packet_header_create(&enumerate.header, sizeof(Enumerate),
-	                           IPCON_FUNCTION_ENUMERATE, ipcon_p, NULL);
+	stream = device_find_queue_stream(device_p, function_id);
 
-	if (ret < 0) {
-		return ret;
+	if (stream == NULL) {
+		stream = device_add_queue_stream(device_p, function_id);
 	}
 
-	return ipcon_send_request(ipcon_p, (Packet *)&enumerate);
-}
+	if (stream == NULL) {
+		mutex_unlock(&device_p->queue_mutex);
 
-void ipcon_wait(IPConnection *ipcon) {
-	semaphore_acquire(&ipcon->p->wait);
-}
+		return E_INVALID_PARAMETER;
+	}
 
-void ipcon_unwait(IPConnection *ipcon) {
-	semaphore_release(&ipcon->p->wait);
+	stream->policy = policy;
+	stream->depth = depth > 0 ? depth : 1;
+
+	if (function_id == 0) {
+		// streams created from the old default follow the new one
+		for (i = 0; i < DEVICE_NUM_QUEUE_STREAMS; ++i) {
+			if (device_p->queue_streams[i].used && device_p->queue_streams[i].inherited) {
+				device_p->queue_streams[i].policy = stream->policy;
+				device_p->queue_streams[i].depth = stream->depth;
+			}
+		}
+	}
+
+	mutex_unlock(&device_p->queue_mutex);
+
+	return E_OK;
 }
 
-void ipcon_register_callback(IPConnection *ipcon, uint8_t id, void *callback,
-                             void *user_data) {
-	IPConnectionPrivate *ipcon_p = ipcon->p;
+void device_get_queue_stats(Device *device, uint32_t *ret_queued,
+                            uint32_t *ret_dropped) {
+	DevicePrivate *device_p = device->p;
+	int i;
 
-	ipcon_p->registered_callbacks[id] = callback;
-	ipcon_p->registered_callback_user_data[id] = user_data;
+	*ret_queued = 0;
+	*ret_dropped = 0;
+
+	mutex_lock(&device_p->queue_mutex);
+
+	for (i = 0; i < DEVICE_NUM_QUEUE_STREAMS; ++i) {
+		if (device_p->queue_streams[i].used) {
+			*ret_queued += (uint32_t)device_p->queue_streams[i].queued;
+			*ret_dropped += device_p->queue_streams[i].dropped;
+		}
+	}
+
+	mutex_unlock(&device_p->queue_mutex);
+}
+
+void device_set_callback_lane(Device *device, uint8_t lane) {
+	device->p->callback_lane = lane < IPCON_MAX_CALLBACK_LANES ? lane : 0;
 }
 
 int packet_header_create(PacketHeader *header, uint8_t length,
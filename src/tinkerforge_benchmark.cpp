@@ -0,0 +1,940 @@
+#include <iostream>
+#include <sstream>
+#include <fstream>
+#include <vector>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <mutex>
+#include <cstdlib>
+#include <ctime>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+#include "ros/ros.h"
+#include "brickd_simulator.h"
+#include "tinkerforge_sensors_core.h"
+#include "ip_connection.h"
+#include "brick_imu_v2.h"
+#include "bricklet_temperature.h"
+
+typedef std::chrono::steady_clock Clock;
+
+//! Command line options of the benchmark
+struct BenchmarkOptions
+{
+  double duration;
+  int devices;
+  int requests;
+  int iterations;
+  double latency;
+  double jitter;
+  double loss;
+  std::string output;
+  int scale;
+  int connections;
+  int period;
+  int sweeps;
+
+  BenchmarkOptions()
+  {
+    scale = 0;
+    connections = 1;
+    period = 10;
+    sweeps = 10;
+    duration = 5.0;
+    devices = 16;
+    requests = 2000;
+    iterations = 1000;
+    latency = 0.0;
+    jitter = 0.0;
+    loss = 0.0;
+  }
+};
+
+//! Device found by enumeration
+struct BenchmarkDevice
+{
+  std::string uid;
+  uint16_t identifier;
+};
+
+//! A single result line, written as a JSON object
+class BenchmarkResult
+{
+public:
+  BenchmarkResult(const std::string &benchmark)
+  {
+    stream.precision(12);
+    stream << "{\"benchmark\":\"" << benchmark << "\",\"time\":" << (long)time(NULL);
+  }
+
+  void add(const std::string &key, double value)
+  {
+    stream << ",\"" << key << "\":" << value;
+  }
+
+  void add(const std::string &key, const std::string &value)
+  {
+    stream << ",\"" << key << "\":\"" << value << "\"";
+  }
+
+  //! Add count, mean, percentiles and max of samples in usec
+  void addLatencies(const std::string &prefix, std::vector<double> &samples)
+  {
+    add(prefix + "_count", samples.size());
+    if (samples.empty())
+      return;
+
+    std::sort(samples.begin(), samples.end());
+    double sum = 0.0;
+    for (size_t i = 0; i < samples.size(); i++)
+      sum += samples[i];
+
+    add(prefix + "_mean_us", sum / samples.size());
+    add(prefix + "_p50_us", percentile(samples, 0.50));
+    add(prefix + "_p90_us", percentile(samples, 0.90));
+    add(prefix + "_p99_us", percentile(samples, 0.99));
+    add(prefix + "_max_us", samples.back());
+  }
+
+  std::string str() const { return stream.str() + "}"; }
+
+private:
+  static double percentile(const std::vector<double> &sorted, double p)
+  {
+    size_t index = (size_t)(p * (sorted.size() - 1) + 0.5);
+    return sorted[index];
+  }
+
+  std::stringstream stream;
+};
+
+//! Receive to dispatch latency of callbacks, merged from the device statistics
+struct CallbackLatency
+{
+  uint64_t callbacks;
+  uint64_t latency_sum;
+  uint32_t latency_max;
+  uint64_t buckets[IPCON_STATS_NUM_BUCKETS];
+
+  CallbackLatency()
+  {
+    callbacks = 0;
+    latency_sum = 0;
+    latency_max = 0;
+    for (int b = 0; b < IPCON_STATS_NUM_BUCKETS; b++)
+      buckets[b] = 0;
+  }
+
+  //! Merge the callback statistics of a device
+  void collect(Device *device)
+  {
+    FunctionStats stats[IPCON_STATS_MAX_FUNCTIONS];
+    int n = device_get_stats(device, stats, IPCON_STATS_MAX_FUNCTIONS);
+    for (int f = 0; f < n; f++)
+    {
+      // getters record their round trip time, skip them
+      if (stats[f].callbacks == 0)
+        continue;
+      callbacks += stats[f].callbacks;
+      latency_sum += stats[f].latency_sum;
+      latency_max = std::max(latency_max, stats[f].latency_max);
+      for (int b = 0; b < IPCON_STATS_NUM_BUCKETS; b++)
+        buckets[b] += stats[f].latency_buckets[b];
+    }
+  }
+
+  //! Upper bound of the histogram bucket holding the percentile in usec
+  double percentile(double p) const
+  {
+    uint64_t seen = 0;
+    for (int b = 0; b < IPCON_STATS_NUM_BUCKETS && callbacks > 0; b++)
+    {
+      seen += buckets[b];
+      if (seen >= p * callbacks)
+        return (double)((uint64_t)IPCON_STATS_BUCKET_BASE << b);
+    }
+    return 0.0;
+  }
+
+  double mean() const { return callbacks > 0 ? (double)latency_sum / callbacks : 0.0; }
+};
+
+static std::ostream *output = &std::cout;
+static std::mutex enumerate_mutex;
+static std::vector<BenchmarkDevice> enumerated;
+
+/*----------------------------------------------------------------------
+ * emit()
+ * Write a result line
+ *--------------------------------------------------------------------*/
+
+static void emit(const BenchmarkResult &result)
+{
+  *output << result.str() << std::endl;
+}
+
+/*----------------------------------------------------------------------
+ * elapsedUs()
+ * Microseconds since start
+ *--------------------------------------------------------------------*/
+
+static double elapsedUs(Clock::time_point start)
+{
+  return std::chrono::duration<double, std::micro>(Clock::now() - start).count();
+}
+
+/*----------------------------------------------------------------------
+ * forkSimulator()
+ * Run the simulator in a child process, returns its port or 0. The
+ * child keeps the simulator threads out of the measured CPU time.
+ *--------------------------------------------------------------------*/
+
+static uint16_t forkSimulator(BrickdSimulator &simulator, pid_t &pid)
+{
+  int fds[2];
+  if (pipe(fds) < 0)
+    return 0;
+
+  pid = fork();
+  if (pid < 0)
+    return 0;
+
+  if (pid == 0)
+  {
+    close(fds[0]);
+    uint16_t port = simulator.start() ? simulator.getPort() : 0;
+    if (write(fds[1], &port, sizeof(port)) != sizeof(port) || port == 0)
+      _exit(1);
+    close(fds[1]);
+    for (;;)
+      pause();
+  }
+
+  close(fds[1]);
+  uint16_t port = 0;
+  if (read(fds[0], &port, sizeof(port)) != sizeof(port))
+    port = 0;
+  close(fds[0]);
+  return port;
+}
+
+/*----------------------------------------------------------------------
+ * callbackEnumerate()
+ * Collect the enumerated devices
+ *--------------------------------------------------------------------*/
+
+static void callbackEnumerate(const char *uid, const char *connected_uid,
+                              char position, uint8_t hardware_version[3],
+                              uint8_t firmware_version[3], uint16_t device_identifier,
+                              uint8_t enumeration_type, void *user_data)
+{
+  BenchmarkDevice device;
+  device.uid = uid;
+  device.identifier = device_identifier;
+
+  std::lock_guard<std::mutex> lock(enumerate_mutex);
+  enumerated.push_back(device);
+}
+
+/*----------------------------------------------------------------------
+ * enumerateDevices()
+ * Enumerate and wait until no more devices show up
+ *--------------------------------------------------------------------*/
+
+static std::vector<BenchmarkDevice> enumerateDevices(IPConnection *ipcon, size_t expected)
+{
+  {
+    std::lock_guard<std::mutex> lock(enumerate_mutex);
+    enumerated.clear();
+  }
+
+  ipcon_register_callback(ipcon, IPCON_CALLBACK_ENUMERATE, (void*)callbackEnumerate, NULL);
+  ipcon_enumerate(ipcon);
+
+  Clock::time_point start = Clock::now();
+  while (elapsedUs(start) < 5e6)
+  {
+    {
+      std::lock_guard<std::mutex> lock(enumerate_mutex);
+      if (enumerated.size() >= expected)
+        break;
+    }
+    usleep(10000);
+  }
+
+  ipcon_register_callback(ipcon, IPCON_CALLBACK_ENUMERATE, NULL, NULL);
+
+  std::lock_guard<std::mutex> lock(enumerate_mutex);
+  return enumerated;
+}
+
+/*----------------------------------------------------------------------
+ * callbackAllData()
+ * Count IMU v2 all data callbacks
+ *--------------------------------------------------------------------*/
+
+static void callbackAllData(int16_t acceleration[3], int16_t magnetic_field[3],
+                            int16_t angular_velocity[3], int16_t euler_angle[3],
+                            int16_t quaternion[4], int16_t linear_acceleration[3],
+                            int16_t gravity_vector[3], int8_t temperature,
+                            uint8_t calibration_status, void *user_data)
+{
+  ((std::atomic<uint64_t>*)user_data)->fetch_add(1);
+}
+
+/*----------------------------------------------------------------------
+ * benchCallbacks()
+ * Callback packets/s through receive loop, response handling and
+ * callback dispatch
+ *--------------------------------------------------------------------*/
+
+static void benchCallbacks(const BenchmarkOptions &options, uint16_t port, size_t device_count)
+{
+  IPConnection ipcon;
+  ipcon_create(&ipcon);
+  ipcon_set_stats_enabled(&ipcon, true);
+
+  if (ipcon_connect(&ipcon, "localhost", port) < 0)
+  {
+    ROS_ERROR_STREAM("Could not connect to the simulator");
+    ipcon_destroy(&ipcon);
+    return;
+  }
+
+  std::vector<BenchmarkDevice> found = enumerateDevices(&ipcon, device_count);
+
+  std::atomic<uint64_t> count(0);
+  std::vector<IMUV2*> imus;
+  for (size_t i = 0; i < found.size(); i++)
+  {
+    if (found[i].identifier != IMU_V2_DEVICE_IDENTIFIER)
+      continue;
+
+    IMUV2 *imu = new IMUV2();
+    imu_v2_create(imu, found[i].uid.c_str(), &ipcon);
+    imu_v2_register_callback(imu, IMU_V2_CALLBACK_ALL_DATA, (void*)callbackAllData, &count);
+    imu_v2_set_all_data_period(imu, 1);
+    imus.push_back(imu);
+  }
+
+  // warm up, then measure
+  usleep(500000);
+  uint64_t start_count = count;
+  int queue_max = 0;
+  Clock::time_point start = Clock::now();
+  while (elapsedUs(start) < options.duration * 1e6)
+  {
+    queue_max = std::max(queue_max, ipcon_get_callback_queue_length(&ipcon));
+    usleep(1000);
+  }
+  double seconds = elapsedUs(start) / 1e6;
+  uint64_t packets = count - start_count;
+
+  // receive to dispatch latency from the callback statistics
+  CallbackLatency latency;
+  for (size_t i = 0; i < imus.size(); i++)
+    latency.collect(imus[i]);
+
+  for (size_t i = 0; i < imus.size(); i++)
+  {
+    imu_v2_set_all_data_period(imus[i], 0);
+    imu_v2_destroy(imus[i]);
+    delete imus[i];
+  }
+  ipcon_destroy(&ipcon);
+
+  BenchmarkResult result("callback_throughput");
+  result.add("devices", imus.size());
+  result.add("period_ms", 1);
+  result.add("duration_s", seconds);
+  result.add("packets", packets);
+  result.add("packets_per_s", packets / seconds);
+  result.add("offered_per_s", imus.size() * 1000.0);
+  result.add("queue_length_max", queue_max);
+  result.add("dispatch_latency_mean_us", latency.mean());
+  result.add("dispatch_latency_p99_us", latency.percentile(0.99));
+  result.add("dispatch_latency_max_us", latency.latency_max);
+  emit(result);
+}
+
+/*----------------------------------------------------------------------
+ * benchRequests()
+ * Round trip time of synchronous requests through device_send_request
+ *--------------------------------------------------------------------*/
+
+static void benchRequests(const BenchmarkOptions &options, uint16_t port, size_t device_count)
+{
+  IPConnection ipcon;
+  ipcon_create(&ipcon);
+
+  if (ipcon_connect(&ipcon, "localhost", port) < 0)
+  {
+    ROS_ERROR_STREAM("Could not connect to the simulator");
+    ipcon_destroy(&ipcon);
+    return;
+  }
+
+  std::vector<BenchmarkDevice> found = enumerateDevices(&ipcon, device_count);
+
+  std::string temperature_uid, imu_uid;
+  for (size_t i = 0; i < found.size(); i++)
+  {
+    if (found[i].identifier == TEMPERATURE_DEVICE_IDENTIFIER && temperature_uid.empty())
+      temperature_uid = found[i].uid;
+    if (found[i].identifier == IMU_V2_DEVICE_IDENTIFIER && imu_uid.empty())
+      imu_uid = found[i].uid;
+  }
+
+  // small response
+  if (!temperature_uid.empty())
+  {
+    Temperature temperature;
+    temperature_create(&temperature, temperature_uid.c_str(), &ipcon);
+
+    std::vector<double> rtt;
+    int errors = 0;
+    for (int i = 0; i < options.requests; i++)
+    {
+      int16_t value;
+      Clock::time_point start = Clock::now();
+      if (temperature_get_temperature(&temperature, &value) < 0)
+        errors++;
+      else
+        rtt.push_back(elapsedUs(start));
+    }
+    temperature_destroy(&temperature);
+
+    BenchmarkResult result("request_rtt");
+    result.add("function", "temperature_get_temperature");
+    result.add("response_bytes", 10);
+    result.add("errors", errors);
+    result.addLatencies("rtt", rtt);
+    emit(result);
+  }
+
+  // largest response of the simulated devices
+  if (!imu_uid.empty())
+  {
+    IMUV2 imu;
+    imu_v2_create(&imu, imu_uid.c_str(), &ipcon);
+
+    std::vector<double> rtt;
+    int errors = 0;
+    for (int i = 0; i < options.requests; i++)
+    {
+      int16_t acc[3], mag[3], ang[3], euler[3], quat[4], lin[3], grav[3];
+      int8_t temperature;
+      uint8_t calibration;
+      Clock::time_point start = Clock::now();
+      if (imu_v2_get_all_data(&imu, acc, mag, ang, euler, quat, lin, grav, &temperature, &calibration) < 0)
+        errors++;
+      else
+        rtt.push_back(elapsedUs(start));
+    }
+    imu_v2_destroy(&imu);
+
+    BenchmarkResult result("request_rtt");
+    result.add("function", "imu_v2_get_all_data");
+    result.add("response_bytes", 54);
+    result.add("errors", errors);
+    result.addLatencies("rtt", rtt);
+    emit(result);
+  }
+
+  ipcon_destroy(&ipcon);
+}
+
+/*----------------------------------------------------------------------
+ * sensorName()
+ * Name of a sensor type for the results
+ *--------------------------------------------------------------------*/
+
+static std::string sensorName(uint16_t type)
+{
+  const DeviceEntry *entry = findDeviceEntry(type);
+  if (entry != NULL)
+    return entry->name;
+
+  std::stringstream stream;
+  stream << type;
+  return stream.str();
+}
+
+/*----------------------------------------------------------------------
+ * benchPublish()
+ * Cost per message of the publishXxxMessage functions, request
+ * included
+ *--------------------------------------------------------------------*/
+
+static void benchPublish(const BenchmarkOptions &options, uint16_t port, const std::vector<std::string> &uids)
+{
+  // publishing on an invalid publisher asserts, a master is required
+  if (!ros::master::check())
+  {
+    BenchmarkResult result("publish");
+    result.add("skipped", "no ros master");
+    emit(result);
+    return;
+  }
+
+  ros::NodeHandle n;
+  TinkerforgeSensors tfs("localhost", port);
+
+  // keep the benchmark topics apart from a running node
+  for (size_t i = 0; i < uids.size(); i++)
+  {
+    SensorParam param;
+    param.type = ParamType::STRING;
+    param.value_str = "/tfsensors_benchmark/dev_" + uids[i];
+    tfs.conf[uids[i]]["topic"] = param;
+  }
+
+  if (!tfs.init())
+    return;
+
+  // wait until the enumeration settled
+  size_t last = 0;
+  for (int i = 0; i < 50; i++)
+  {
+    usleep(100000);
+    if (tfs.sensors.size() > 0 && tfs.sensors.size() == last)
+      break;
+    last = tfs.sensors.size();
+  }
+
+  tfs.advertiseSensors(n);
+
+  // one sensor per type
+  std::map<uint16_t, SensorDevice*> types;
+  SensorRegistry::Reader reader(tfs.sensors);
+  SensorRegistry::iterator it;
+  for (it = reader.begin(); it != reader.end(); ++it)
+  {
+    // publishSensor does not handle these classes
+    if ((*it)->getSensorClass() == SensorClass::GPS || (*it)->getSensorClass() == SensorClass::MISC)
+      continue;
+    if (types.find((*it)->getType()) == types.end())
+      types[(*it)->getType()] = *it;
+  }
+
+  std::map<uint16_t, SensorDevice*>::iterator tit;
+  for (tit = types.begin(); tit != types.end(); ++tit)
+  {
+    std::vector<double> cost;
+    for (int i = 0; i < options.iterations; i++)
+    {
+      Clock::time_point start = Clock::now();
+      tfs.publishSensor(tit->second);
+      cost.push_back(elapsedUs(start));
+    }
+
+    BenchmarkResult result("publish");
+    result.add("sensor", sensorName(tit->first));
+    result.addLatencies("cost", cost);
+    emit(result);
+  }
+}
+
+/*----------------------------------------------------------------------
+ * residentKb()
+ * Resident set size of the process in kB
+ *--------------------------------------------------------------------*/
+
+static long residentKb()
+{
+  std::ifstream statm("/proc/self/statm");
+  long size = 0, resident = 0;
+  statm >> size >> resident;
+  return resident * (sysconf(_SC_PAGESIZE) / 1024);
+}
+
+/*----------------------------------------------------------------------
+ * cpuUs()
+ * User and system CPU time of the process in usec
+ *--------------------------------------------------------------------*/
+
+static double cpuUs()
+{
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  return (usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * 1e6 + usage.ru_utime.tv_usec + usage.ru_stime.tv_usec;
+}
+
+/*----------------------------------------------------------------------
+ * callbackInt16() / callbackUint16()
+ * Count value callbacks of the bricklets
+ *--------------------------------------------------------------------*/
+
+static void callbackInt16(int16_t value, void *user_data)
+{
+  ((std::atomic<uint64_t>*)user_data)->fetch_add(1);
+}
+
+static void callbackUint16(uint16_t value, void *user_data)
+{
+  ((std::atomic<uint64_t>*)user_data)->fetch_add(1);
+}
+
+/*----------------------------------------------------------------------
+ * setCallbackPeriod()
+ * Register the value callback of a sensor and set its period
+ *--------------------------------------------------------------------*/
+
+static void setCallbackPeriod(SensorDevice *sensor, uint32_t period, std::atomic<uint64_t> *count)
+{
+  switch (sensor->getType())
+  {
+    case TEMPERATURE_DEVICE_IDENTIFIER:
+      temperature_register_callback((Temperature*)sensor->getDev(), TEMPERATURE_CALLBACK_TEMPERATURE, (void*)callbackInt16, count);
+      temperature_set_temperature_callback_period((Temperature*)sensor->getDev(), period);
+    break;
+    case HUMIDITY_DEVICE_IDENTIFIER:
+      humidity_register_callback((Humidity*)sensor->getDev(), HUMIDITY_CALLBACK_HUMIDITY, (void*)callbackUint16, count);
+      humidity_set_humidity_callback_period((Humidity*)sensor->getDev(), period);
+    break;
+    case AMBIENT_LIGHT_DEVICE_IDENTIFIER:
+      ambient_light_register_callback((AmbientLight*)sensor->getDev(), AMBIENT_LIGHT_CALLBACK_ILLUMINANCE, (void*)callbackUint16, count);
+      ambient_light_set_illuminance_callback_period((AmbientLight*)sensor->getDev(), period);
+    break;
+    case DISTANCE_IR_DEVICE_IDENTIFIER:
+      distance_ir_register_callback((DistanceIR*)sensor->getDev(), DISTANCE_IR_CALLBACK_DISTANCE, (void*)callbackUint16, count);
+      distance_ir_set_distance_callback_period((DistanceIR*)sensor->getDev(), period);
+    break;
+    case DISTANCE_US_DEVICE_IDENTIFIER:
+      distance_us_register_callback((DistanceUS*)sensor->getDev(), DISTANCE_US_CALLBACK_DISTANCE, (void*)callbackUint16, count);
+      distance_us_set_distance_callback_period((DistanceUS*)sensor->getDev(), period);
+    break;
+  }
+}
+
+/*----------------------------------------------------------------------
+ * pollSensor()
+ * Read a sensor the way the publish loop does, returns < 0 on error
+ *--------------------------------------------------------------------*/
+
+static int pollSensor(SensorDevice *sensor)
+{
+  int16_t int_value;
+  uint16_t value;
+
+  switch (sensor->getType())
+  {
+    case TEMPERATURE_DEVICE_IDENTIFIER:
+      return temperature_get_temperature((Temperature*)sensor->getDev(), &int_value);
+    case HUMIDITY_DEVICE_IDENTIFIER:
+      return humidity_get_humidity((Humidity*)sensor->getDev(), &value);
+    case AMBIENT_LIGHT_DEVICE_IDENTIFIER:
+      return ambient_light_get_illuminance((AmbientLight*)sensor->getDev(), &value);
+    case DISTANCE_IR_DEVICE_IDENTIFIER:
+      return distance_ir_get_distance((DistanceIR*)sensor->getDev(), &value);
+    case DISTANCE_US_DEVICE_IDENTIFIER:
+      return distance_us_get_distance_value((DistanceUS*)sensor->getDev(), &value);
+  }
+  return 0;
+}
+
+/*----------------------------------------------------------------------
+ * pollSweeps()
+ * Serial poll loop over all sensors of one connection
+ *--------------------------------------------------------------------*/
+
+static void pollSweeps(TinkerforgeSensors *tfs, int sweeps, std::vector<double> *cycles,
+                       std::vector<double> *rtt, int *errors)
+{
+  for (int k = 0; k < sweeps; k++)
+  {
+    Clock::time_point cycle_start = Clock::now();
+    SensorRegistry::Reader reader(tfs->sensors);
+    SensorRegistry::iterator it;
+    for (it = reader.begin(); it != reader.end(); ++it)
+    {
+      Clock::time_point start = Clock::now();
+      if (pollSensor(*it) < 0)
+        (*errors)++;
+      else
+        rtt->push_back(elapsedUs(start));
+    }
+    cycles->push_back(elapsedUs(cycle_start));
+  }
+}
+
+/*----------------------------------------------------------------------
+ * benchScaling()
+ * Enumerate many devices over several connections, measure memory per
+ * device, the serial poll loop and CPU and latency per callback sample
+ *--------------------------------------------------------------------*/
+
+static void benchScaling(const BenchmarkOptions &options, const std::vector<uint16_t> &ports)
+{
+  // enumeration and memory per device
+  long rss_start = residentKb();
+  Clock::time_point start = Clock::now();
+
+  std::vector<TinkerforgeSensors*> nodes;
+  for (size_t m = 0; m < ports.size(); m++)
+  {
+    TinkerforgeSensors *tfs = new TinkerforgeSensors("localhost", ports[m]);
+    tfs->setStatsEnabled(true);
+    if (!tfs->init())
+    {
+      delete tfs;
+      continue;
+    }
+    nodes.push_back(tfs);
+  }
+
+  size_t found = 0;
+  while (elapsedUs(start) < 60e6)
+  {
+    found = 0;
+    for (size_t m = 0; m < nodes.size(); m++)
+      found += nodes[m]->sensors.size();
+    if (found >= (size_t)options.scale)
+      break;
+    usleep(1000);
+  }
+  double enumerate_s = elapsedUs(start) / 1e6;
+  long rss_devices = residentKb();
+
+  // serial poll loop, one thread per connection like one node each
+  std::vector<std::vector<double> > cycles(nodes.size()), rtt(nodes.size());
+  std::vector<int> errors(nodes.size(), 0);
+  std::vector<std::thread> threads;
+  for (size_t m = 0; m < nodes.size(); m++)
+    threads.push_back(std::thread(pollSweeps, nodes[m], options.sweeps, &cycles[m], &rtt[m], &errors[m]));
+  for (size_t m = 0; m < threads.size(); m++)
+    threads[m].join();
+
+  std::vector<double> all_cycles, all_rtt;
+  int all_errors = 0;
+  for (size_t m = 0; m < nodes.size(); m++)
+  {
+    all_cycles.insert(all_cycles.end(), cycles[m].begin(), cycles[m].end());
+    all_rtt.insert(all_rtt.end(), rtt[m].begin(), rtt[m].end());
+    all_errors += errors[m];
+  }
+
+  // periodic callbacks of all sensors
+  std::atomic<uint64_t> count(0);
+  for (size_t m = 0; m < nodes.size(); m++)
+  {
+    SensorRegistry::Reader reader(nodes[m]->sensors);
+    SensorRegistry::iterator it;
+    for (it = reader.begin(); it != reader.end(); ++it)
+      setCallbackPeriod(*it, options.period, &count);
+  }
+
+  usleep(1000000);
+  uint64_t start_count = count;
+  double start_cpu = cpuUs();
+  start = Clock::now();
+  usleep((useconds_t)(options.duration * 1e6));
+  double seconds = elapsedUs(start) / 1e6;
+  double cpu = cpuUs() - start_cpu;
+  uint64_t samples = count - start_count;
+
+  CallbackLatency latency;
+  for (size_t m = 0; m < nodes.size(); m++)
+  {
+    SensorRegistry::Reader reader(nodes[m]->sensors);
+    SensorRegistry::iterator it;
+    for (it = reader.begin(); it != reader.end(); ++it)
+    {
+      setCallbackPeriod(*it, 0, &count);
+      latency.collect((Device*)(*it)->getDev());
+    }
+  }
+
+  BenchmarkResult result("scaling");
+  result.add("devices", found);
+  result.add("connections", nodes.size());
+  result.add("period_ms", options.period);
+  result.add("enumerate_s", enumerate_s);
+  result.add("rss_per_device_kb", found > 0 ? (double)(rss_devices - rss_start) / found : 0.0);
+  result.add("poll_errors", all_errors);
+  result.addLatencies("poll_cycle", all_cycles);
+  result.addLatencies("poll_rtt", all_rtt);
+  result.add("duration_s", seconds);
+  result.add("samples_per_s", samples / seconds);
+  result.add("offered_per_s", found * 1000.0 / options.period);
+  result.add("cpu_load", cpu / (seconds * 1e6));
+  result.add("cpu_per_sample_us", samples > 0 ? cpu / samples : 0.0);
+  result.add("dispatch_latency_mean_us", latency.mean());
+  result.add("dispatch_latency_p50_us", latency.percentile(0.50));
+  result.add("dispatch_latency_p90_us", latency.percentile(0.90));
+  result.add("dispatch_latency_p99_us", latency.percentile(0.99));
+  result.add("dispatch_latency_max_us", latency.latency_max);
+  emit(result);
+
+  for (size_t m = 0; m < nodes.size(); m++)
+    delete nodes[m];
+}
+
+/*----------------------------------------------------------------------
+ * usage()
+ * Print the command line options
+ *--------------------------------------------------------------------*/
+
+static void usage(const char *name)
+{
+  std::cerr << "usage: " << name << " [options]" << std::endl
+            << "  --duration <s>      length of the throughput run (default 5)" << std::endl
+            << "  --devices <n>       IMU v2 sending callbacks every 1 ms (default 16)" << std::endl
+            << "  --requests <n>      requests per RTT run (default 2000)" << std::endl
+            << "  --iterations <n>    messages per publish run (default 1000)" << std::endl
+            << "  --latency <ms>      simulated brickd latency (default 0)" << std::endl
+            << "  --jitter <ms>       simulated brickd jitter (default 0)" << std::endl
+            << "  --loss <p>          simulated packet loss (default 0)" << std::endl
+            << "  --output <file>     append the results to a file instead of stdout" << std::endl
+            << "scaling mode:" << std::endl
+            << "  --scale <n>         enumerate n bricklets and run the scaling test only" << std::endl
+            << "  --connections <m>   spread them over m simulated brickds (default 1)" << std::endl
+            << "  --period <ms>       callback period of each bricklet (default 10)" << std::endl
+            << "  --sweeps <n>        serial poll sweeps over all bricklets (default 10)" << std::endl;
+}
+
+/*----------------------------------------------------------------------
+ * main()
+ * Run the benchmarks against a simulated brickd, one JSON object per
+ * line and benchmark
+ *--------------------------------------------------------------------*/
+
+int main(int argc, char **argv)
+{
+  BenchmarkOptions options;
+
+  for (int i = 1; i < argc; i++)
+  {
+    std::string arg = argv[i];
+    if (arg == "--help" || arg == "-h")
+    {
+      usage(argv[0]);
+      return 0;
+    }
+    // leave ros remappings to ros::init
+    if (arg.find(":=") != std::string::npos)
+      continue;
+    if (i + 1 >= argc)
+    {
+      usage(argv[0]);
+      return 1;
+    }
+
+    std::string value = argv[++i];
+    if (arg == "--duration")
+      options.duration = atof(value.c_str());
+    else if (arg == "--devices")
+      options.devices = atoi(value.c_str());
+    else if (arg == "--requests")
+      options.requests = atoi(value.c_str());
+    else if (arg == "--iterations")
+      options.iterations = atoi(value.c_str());
+    else if (arg == "--latency")
+      options.latency = atof(value.c_str()) / 1000.0;
+    else if (arg == "--jitter")
+      options.jitter = atof(value.c_str()) / 1000.0;
+    else if (arg == "--loss")
+      options.loss = atof(value.c_str());
+    else if (arg == "--output")
+      options.output = value;
+    else if (arg == "--scale")
+      options.scale = atoi(value.c_str());
+    else if (arg == "--connections")
+      options.connections = std::max(atoi(value.c_str()), 1);
+    else if (arg == "--period")
+      options.period = std::max(atoi(value.c_str()), 1);
+    else if (arg == "--sweeps")
+      options.sweeps = atoi(value.c_str());
+    else
+    {
+      usage(argv[0]);
+      return 1;
+    }
+  }
+
+  BrickdSimulatorConfig config;
+  config.port = 0;
+  config.latency = options.latency;
+  config.jitter = options.jitter;
+  config.loss = options.loss;
+
+  std::vector<BrickdSimulatorConfig> configs;
+  if (options.scale > 0)
+  {
+    // bricklets of the value types spread over the connections
+    const char *types[] = {"temperature", "humidity", "ambient_light", "distance_ir", "distance_us"};
+    configs.resize(options.connections, config);
+    for (int i = 0; i < options.scale; i++)
+    {
+      BrickdSimulatorConfig &c = configs[i % options.connections];
+      c.devices[BrickdSimulator::parseDeviceName(types[(i / options.connections) % 5])]++;
+      c.seed = config.seed + i % options.connections;
+    }
+  }
+  else
+  {
+    // one device of each sensor type, and the IMUs for the throughput run
+    const char *types[] = {"imu", "gps", "humidity", "temperature", "temperature_ir", "ambient_light",
+                           "ambient_light_v2", "distance_ir", "distance_us", NULL};
+    for (int i = 0; types[i] != NULL; i++)
+      config.devices[BrickdSimulator::parseDeviceName(types[i])] = 1;
+    config.devices[BrickdSimulator::parseDeviceName("imu_v2")] = std::max(options.devices, 1);
+    configs.push_back(config);
+  }
+
+  std::vector<BrickdSimulator*> simulators;
+  std::vector<pid_t> pids;
+  std::vector<uint16_t> ports;
+  for (size_t i = 0; i < configs.size(); i++)
+  {
+    BrickdSimulator *simulator = new BrickdSimulator(configs[i]);
+    pid_t pid;
+    uint16_t port = forkSimulator(*simulator, pid);
+    if (port == 0)
+    {
+      std::cerr << "could not start the brickd simulator" << std::endl;
+      for (size_t k = 0; k < pids.size(); k++)
+        kill(pids[k], SIGTERM);
+      return 1;
+    }
+    simulators.push_back(simulator);
+    pids.push_back(pid);
+    ports.push_back(port);
+  }
+
+  std::ofstream file;
+  if (!options.output.empty())
+  {
+    file.open(options.output.c_str(), std::ios::app);
+    output = &file;
+  }
+
+  ros::init(argc, argv, "tinkerforge_benchmark", ros::init_options::AnonymousName | ros::init_options::NoSigintHandler);
+
+  if (options.scale > 0)
+  {
+    // one log line per enumerated device would swamp the results
+    if (ros::console::set_logger_level(ROSCONSOLE_DEFAULT_NAME, ros::console::levels::Warn))
+      ros::console::notifyLoggerLevelsChanged();
+    benchScaling(options, ports);
+  }
+  else
+  {
+    benchCallbacks(options, ports[0], simulators[0]->getDeviceCount());
+    benchRequests(options, ports[0], simulators[0]->getDeviceCount());
+    benchPublish(options, ports[0], simulators[0]->getUids());
+  }
+
+  for (size_t i = 0; i < pids.size(); i++)
+  {
+    kill(pids[i], SIGTERM);
+    waitpid(pids[i], NULL, 0);
+    delete simulators[i];
+  }
+
+  return 0;
+}
@@ -2,7 +2,11 @@
 #include <sstream>
 #include <fstream>
 #include <cmath>
+#include <set>
+#include <algorithm>
 #include <stdio.h>
+#include <string.h>
+#include <errno.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <fcntl.h>
@@ -10,6 +14,7 @@
 #include "ros/ros.h"
 #include "sensor_device.h"
 #include "tinkerforge_sensors_core.h"
+#include "allocation_counter.h"
 #include <sensor_msgs/NavSatFix.h>
 #include <sensor_msgs/Imu.h>
 #include <sensor_msgs/MagneticField.h>
@@ -17,6 +22,8 @@
 #include <sensor_msgs/Illuminance.h>
 #include <sensor_msgs/Range.h>
 #include <sensor_msgs/RelativeHumidity.h>
+#include <diagnostic_msgs/DiagnosticArray.h>
+#include <tinkerforge_sensors/DeviceStatsArray.h>
 #include "ip_connection.h"
 #include "bricklet_ambient_light.h"
 #include "bricklet_ambient_light_v2.h"
@@ -42,6 +49,24 @@
 TinkerforgeSensors::TinkerforgeSensors()
 {
   imu_convergence_speed = 0;
+  imu_fusion_period = 0;
+  imu_fusion_beta = 0.1;
+  stamp_period = 0.0;
+  stamp_gain = 0.0;
+  stats_enabled = false;
+  capture_started = false;
+  replay_speed = 1.0;
+  readings_ttl = 1.0;
+  ros_lane = 0;
+  ros_lane_queue = NULL;
+  publish_dropped_last = 0;
+  receive_priority = 0;
+  receive_cpu = -1;
+  packet_pool_size = 0;
+  packet_pool_misses = 0;
+  allocations_last = 0;
+  imu_batch_size = 0;
+  covariance_window = 0;
 }
 
 TinkerforgeSensors::TinkerforgeSensors(std::string host, int port)
@@ -54,6 +79,25 @@ TinkerforgeSensors::TinkerforgeSensors(std::string host, int port)
     this->port = 4223;
   else
     this->port = port;
+  imu_convergence_speed = 0;
+  imu_fusion_period = 0;
+  imu_fusion_beta = 0.1;
+  stamp_period = 0.0;
+  stamp_gain = 0.0;
+  stats_enabled = false;
+  capture_started = false;
+  replay_speed = 1.0;
+  readings_ttl = 1.0;
+  ros_lane = 0;
+  ros_lane_queue = NULL;
+  publish_dropped_last = 0;
+  receive_priority = 0;
+  receive_cpu = -1;
+  packet_pool_size = 0;
+  packet_pool_misses = 0;
+  allocations_last = 0;
+  imu_batch_size = 0;
+  covariance_window = 0;
 }
 
 /*----------------------------------------------------------------------
@@ -64,52 +108,45 @@ TinkerforgeSensors::TinkerforgeSensors(std::string host, int port)
 TinkerforgeSensors::~TinkerforgeSensors()
 {
   bool is_ipcon = false;
-  // clean up tf devices
-  while(!sensors.empty())
+
+  // the pending messages still hold the publishers
+  publish_pipeline.stop();
+
+  // the callbacks of the lane go to lane 0 from here on, the connection
+  // stays up for the destroy hooks
+  ros_callback_lane.stop();
+
+  if (capture_started)
+  {
+    uint64_t captured, dropped;
+    ipcon_stop_capture(&ipcon);
+    ipcon_get_capture_stats(&ipcon, &captured, &dropped);
+    ROS_INFO_STREAM("Captured " << captured << " packets to " << capture_file << ", dropped " << dropped);
+  }
+
+  // clean up tf devices, the destroy hooks still talk to the devices
+  {
+    SensorRegistry::Reader reader(sensors);
+    for (size_t i = 0; i < reader.size(); i++)
+    {
+      SensorDevice *dev = reader[i];
+      if (dev->getEntry()->destroy != NULL)
+        dev->getEntry()->destroy(dev);
+    }
+  }
+
+  // joins the callback threads, a running callback can still use its sensor
+  ipcon_disconnect(&ipcon);
+
   {
-    SensorDevice *dev = sensors.front();
-    switch (dev->getType())
+    SensorRegistry::Reader reader(sensors);
+    for (size_t i = 0; i < reader.size(); i++)
     {
-      case AMBIENT_LIGHT_DEVICE_IDENTIFIER:
-        ambient_light_destroy((AmbientLight*)dev->getDev());
-      break;
-      case AMBIENT_LIGHT_V2_DEVICE_IDENTIFIER:
-        ambient_light_v2_destroy((AmbientLightV2*)dev->getDev());
-      break;
-      case DISTANCE_IR_DEVICE_IDENTIFIER:
-        distance_ir_destroy((DistanceIR*)dev->getDev());
-      break;
-      case DISTANCE_US_DEVICE_IDENTIFIER:
-        distance_us_destroy((DistanceUS*)dev->getDev());
-      break;
-      case DUAL_BUTTON_DEVICE_IDENTIFIER:
-        dual_button_destroy((DualButton*)dev->getDev());
-      break;
-      case GPS_DEVICE_IDENTIFIER:
-        gps_destroy((GPS*)dev->getDev());
-      break;
-      case HUMIDITY_DEVICE_IDENTIFIER:
-        humidity_destroy((Humidity*)dev->getDev());
-      break;
-      case IMU_DEVICE_IDENTIFIER:
-        imu_leds_off((IMU*)dev->getDev());
-        imu_destroy((IMU*)dev->getDev());
-      break;
-      case IMU_V2_DEVICE_IDENTIFIER:
-        imu_v2_leds_off((IMUV2*)dev->getDev());
-        imu_v2_destroy((IMUV2*)dev->getDev());
-      break;
-      case TEMPERATURE_DEVICE_IDENTIFIER:
-        temperature_destroy((Temperature*)dev->getDev());
-      break;
-      case TEMPERATURE_IR_DEVICE_IDENTIFIER:
-        temperature_ir_destroy((TemperatureIR*)dev->getDev());
-      break;
-    }
-    delete dev;
-    sensors.pop_front();
-    is_ipcon = true;
+      delete reader[i];
+      is_ipcon = true;
+    }
   }
+  sensors.clear();
   if (is_ipcon)
   {
     ipcon_destroy(&ipcon);
@@ -125,14 +162,28 @@ bool TinkerforgeSensors::init()
 {
   // create IP connection
   ipcon_create(&ipcon);
+  ipcon_set_stats_enabled(&ipcon, stats_enabled);
+  setupCallbackLanes();
 
-  // connect to brickd
-  if(ipcon_connect(&ipcon, this->host.c_str(), this->port) < 0) {
-    ROS_FATAL_STREAM("Could not connect to brickd!");
-    return false;
+  // no malloc on the callback path while the pool lasts
+  if (packet_pool_size > 0 && ipcon_reserve_packet_pool(&ipcon, packet_pool_size) != E_OK)
+    ROS_WARN_STREAM("Could not reserve the packet pool of " << packet_pool_size << " packets");
+  if (receive_priority > 0 || receive_cpu >= 0)
+    ipcon_set_receive_scheduling(&ipcon, receive_priority, receive_cpu);
+
+  // capture the wire traffic from the first packet on
+  if (!capture_file.empty())
+  {
+    int ret = ipcon_start_capture(&ipcon, capture_file.c_str(), 0);
+    if (ret < 0)
+      ROS_ERROR_STREAM("Could not start packet capture to " << capture_file << ", error " << ret);
+    else
+      ROS_INFO_STREAM("Capturing packets to " << capture_file);
+    capture_started = (ret == E_OK);
   }
 
-  // register connected callback to "cb_connected"
+  // register connected callback to "cb_connected", before connecting
+  // so the enumeration on connect can not be missed
   ipcon_register_callback(&ipcon,
     IPCON_CALLBACK_CONNECTED,
     (void*)callbackConnected,
@@ -144,91 +195,269 @@ bool TinkerforgeSensors::init()
     (void*)callbackEnumerate,
     this);
 
+  // replay a capture in place of brickd
+  if (!replay_file.empty())
+  {
+    int ret = ipcon_replay(&ipcon, replay_file.c_str(), replay_speed);
+    if (ret < 0)
+    {
+      ROS_FATAL_STREAM("Could not replay " << replay_file << ", error " << ret);
+      return false;
+    }
+    ROS_INFO_STREAM("Replaying " << replay_file << " at speed " << replay_speed);
+    checkCallbackLanes();
+    return true;
+  }
+
+  // connect to brickd
+  if(ipcon_connect(&ipcon, this->host.c_str(), this->port) < 0) {
+    ROS_FATAL_STREAM("Could not connect to brickd!");
+    return false;
+  }
+
+  checkCallbackLanes();
   return true;
 }
 
 /*----------------------------------------------------------------------
- * publishImuMessage()
- * Publish the Imu message.
+ * setupCallbackLanes()
+ * Enable the lanes of the device types and their scheduling
  *--------------------------------------------------------------------*/
 
-void TinkerforgeSensors::publishImuMessage(SensorDevice *sensor)
+void TinkerforgeSensors::setupCallbackLanes()
 {
-  int16_t acc_x, acc_y, acc_z;
-  int16_t mag_x, mag_y, mag_z;
-  int16_t ang_x, ang_y, ang_z;
-  double acc_f_x, acc_f_y, acc_f_z;
-  double ang_f_x, ang_f_y, ang_f_z;
-  int16_t temp;
-  float x = 0.0, y = 0.0, z = 0.0, w = 0.0;
-  int16_t ix = 0, iy = 0, iz = 0, iw = 0;
-  ros::Time current_time = ros::Time::now();
-  tf::TransformBroadcaster tf_broadcaster;
-  if (sensor != NULL)
+  std::set<int> used;
+  std::map<std::string, int>::iterator it = callback_lanes.begin();
+  while (it != callback_lanes.end())
   {
-    sensor_msgs::Imu imu_msg;
+    if (it->second < 0 || it->second >= IPCON_MAX_CALLBACK_LANES)
+    {
+      ROS_WARN_STREAM("Invalid callback lane " << it->second << " for " << it->first
+        << ", lanes are 0 to " << IPCON_MAX_CALLBACK_LANES - 1);
+      callback_lanes.erase(it++);
+      continue;
+    }
+    used.insert(it->second);
+    ++it;
+  }
+
+  for (int lane = 0; lane < IPCON_MAX_CALLBACK_LANES; lane++)
+  {
+    int priority = (lane < (int)lane_priority.size()) ? lane_priority[lane] : 0;
+    int cpu = (lane < (int)lane_cpu.size()) ? lane_cpu[lane] : -1;
+    if (used.count(lane) > 0 || priority > 0 || cpu >= 0)
+      ipcon_set_callback_lane(&ipcon, lane, priority, cpu);
+  }
 
-    // for the conversions look at rep 103 http://www.ros.org/reps/rep-0103.html
-    // for IMU v1 http://www.tinkerforge.com/de/doc/Software/Bricks/IMU_Brick_C.html#imu-brick-c-api
-    // for IMU v2 http://www.tinkerforge.com/de/doc/Software/Bricks/IMUV2_Brick_C.html#imu-v2-brick-c-api
-    if (sensor->getType() == IMU_DEVICE_IDENTIFIER)
+  // the spinner threads of the queue dispatch this lane instead of a lane thread
+  if (ros_lane != 0 && ros_lane_queue != NULL)
+  {
+    if (ros_lane < 0 || ros_lane >= IPCON_MAX_CALLBACK_LANES ||
+        !ros_callback_lane.start(&ipcon, ros_lane, ros_lane_queue))
+      ROS_WARN_STREAM("Could not dispatch callback lane " << ros_lane << " from the ROS callback queue");
+    else
+      ROS_INFO_STREAM("Dispatching callback lane " << ros_lane << " from the ROS callback queue");
+  }
+}
+
+/*----------------------------------------------------------------------
+ * checkAllocations()
+ * Warn about pool misses and heap allocations since the last warning
+ *--------------------------------------------------------------------*/
+
+void TinkerforgeSensors::checkAllocations()
+{
+  uint32_t available, misses;
+
+  if (packet_pool_size > 0)
+  {
+    ipcon_get_packet_pool_stats(&ipcon, &available, &misses);
+    if (misses != packet_pool_misses)
+    {
+      ROS_WARN_STREAM("Packet pool exhausted, " << misses - packet_pool_misses
+        << " pool misses on the callback path (" << misses << " since startup)");
+      packet_pool_misses = misses;
+    }
+  }
+
+  // counted for the whole process, at most one warning per 10 s
+  if (AllocationCounter::isRunning())
+  {
+    uint64_t allocations = AllocationCounter::getCount();
+    ros::Time now = ros::Time::now();
+    if (allocations != allocations_last && (now - allocations_time).toSec() >= 10.0)
     {
-      // check if imu is initialized
-      //if (ros::Time::now().sec - imu_init_time.sec < 3)
-      //  return;
-      //else
-      //  imu_set_convergence_speed(&imu, imu_convergence_speed);
-      //
-      imu_get_quaternion((IMU*)sensor->getDev(), &x, &y, &z, &w);
+      ROS_WARN_STREAM(allocations - allocations_last << " heap allocations since the last warning ("
+        << allocations << " since startup)");
+      allocations_last = allocations;
+      allocations_time = now;
+    }
+  }
+}
+
+/*----------------------------------------------------------------------
+ * checkCallbackLanes()
+ * Warn about the receive thread and lanes that run without their scheduling
+ *--------------------------------------------------------------------*/
+
+void TinkerforgeSensors::checkCallbackLanes()
+{
+  if ((receive_priority > 0 || receive_cpu >= 0) && !ipcon_is_receive_scheduled(&ipcon))
+    ROS_WARN_STREAM("Could not set priority " << receive_priority << " and cpu " << receive_cpu
+      << " of the receive thread, it runs with the default scheduling");
+
+  for (int lane = 0; lane < IPCON_MAX_CALLBACK_LANES; lane++)
+  {
+    int priority = (lane < (int)lane_priority.size()) ? lane_priority[lane] : 0;
+    int cpu = (lane < (int)lane_cpu.size()) ? lane_cpu[lane] : -1;
+    if ((priority > 0 || cpu >= 0) && !ipcon_is_callback_lane_scheduled(&ipcon, lane))
+      ROS_WARN_STREAM("Could not set priority " << priority << " and cpu " << cpu << " of callback lane "
+        << lane << ", it runs with the default scheduling");
+  }
+}
+
+/*----------------------------------------------------------------------
+ * setImuV1Motion()
+ * Fill the angular velocity and acceleration of an IMU v1 sample
+ *--------------------------------------------------------------------*/
+
+static void setImuV1Motion(sensor_msgs::Imu &imu_msg, const int16_t acc[3], const int16_t ang[3])
+{
+  // velocity from °/14.375 to rad/s
+  imu_msg.angular_velocity.x = ang[0] / 14.375 * M_PI / 180.0;
+  imu_msg.angular_velocity.y = ang[1] / 14.375 * M_PI / 180.0;
+  imu_msg.angular_velocity.z = ang[2] / 14.375 * M_PI / 180.0;
+
+  // acceleration from mG to m/s²
+  imu_msg.linear_acceleration.x = (acc[0]/1000.0)*9.80605;
+  imu_msg.linear_acceleration.y = (acc[1]/1000.0)*9.80605;
+  imu_msg.linear_acceleration.z = (acc[2]/1000.0)*9.80605;
+}
+
+/*----------------------------------------------------------------------
+ * setFusedOrientation()
+ * Fill the orientation from the host filter
+ *--------------------------------------------------------------------*/
+
+static void setFusedOrientation(sensor_msgs::Imu &imu_msg, const double q[4])
+{
+  // the filter works in north-west-up, turn by 90 deg about z to east-north-up
+  const double c = sqrt(0.5);
+  imu_msg.orientation.w = c * (q[0] - q[3]);
+  imu_msg.orientation.x = c * (q[1] - q[2]);
+  imu_msg.orientation.y = c * (q[2] + q[1]);
+  imu_msg.orientation.z = c * (q[3] + q[0]);
+}
 
-      imu_get_all_data((IMU*)sensor->getDev(), &acc_x, &acc_y, &acc_z, &mag_x, &mag_y,
-        &mag_z, &ang_x, &ang_y, &ang_z, &temp);
+/*----------------------------------------------------------------------
+ * readImuMessage()
+ * Read the orientation and motion of an IMU
+ *--------------------------------------------------------------------*/
 
-      ang_f_x = ang_x / 14.375;
-      ang_f_y = ang_y / 14.375;
-      ang_f_z = ang_z / 14.375;
+bool TinkerforgeSensors::readImuMessage(SensorDevice *sensor, sensor_msgs::Imu &imu_msg)
+{
+  int16_t acc[3], mag[3], ang[3];
+  int16_t temp;
+  float x = 0.0, y = 0.0, z = 0.0, w = 0.0;
+  int16_t ix = 0, iy = 0, iz = 0, iw = 0;
 
-      acc_f_x = (acc_x/1000.0)*9.80605;
-      acc_f_y = (acc_y/1000.0)*9.80605;
-      acc_f_z = (acc_z/1000.0)*9.80605;
+  // for the conversions look at rep 103 http://www.ros.org/reps/rep-0103.html
+  // for IMU v1 http://www.tinkerforge.com/de/doc/Software/Bricks/IMU_Brick_C.html#imu-brick-c-api
+  // for IMU v2 http://www.tinkerforge.com/de/doc/Software/Bricks/IMUV2_Brick_C.html#imu-v2-brick-c-api
+  if (sensor->getType() == IMU_DEVICE_IDENTIFIER)
+  {
+    // the brick does not calculate the orientation while the host fuses it
+    bool fused = sensor->getFusion().filter.isEnabled();
+    if ((!fused && imu_get_quaternion((IMU*)sensor->getDev(), &x, &y, &z, &w) < 0) ||
+        imu_get_all_data((IMU*)sensor->getDev(), &acc[0], &acc[1], &acc[2], &mag[0], &mag[1],
+          &mag[2], &ang[0], &ang[1], &ang[2], &temp) < 0)
+    {
+      ROS_ERROR_STREAM("Could not get imu data from " << sensor->getUID() << ", probably timeout");
+      return false;
+    }
 
+    setImuV1Motion(imu_msg, acc, ang);
+    if (fused)
+    {
+      setFusedOrientation(imu_msg, sensor->getFusion().orientation);
+    }
+    else
+    {
       imu_msg.orientation.x = w;
       imu_msg.orientation.y = z*-1;
       imu_msg.orientation.z = y;
       imu_msg.orientation.w = x*-1;
     }
-    else if (sensor->getType() == IMU_V2_DEVICE_IDENTIFIER)
+  }
+  else if (sensor->getType() == IMU_V2_DEVICE_IDENTIFIER)
+  {
+    if (imu_v2_get_quaternion((IMUV2*)sensor->getDev(), &ix, &iy, &iz, &iw) < 0 ||
+        imu_v2_get_acceleration((IMUV2*)sensor->getDev(), &acc[0], &acc[1], &acc[2]) < 0 ||
+        imu_v2_get_angular_velocity((IMUV2*)sensor->getDev(), &ang[0], &ang[1], &ang[2]) < 0)
     {
-      imu_v2_get_quaternion((IMUV2*)sensor->getDev(), &ix, &iy, &iz, &iw);
-      x = ix / 16383.0;
-      y = iy / 16383.0;
-      z = iz / 16383.0;
-      w = iw / 16383.0;
+      ROS_ERROR_STREAM("Could not get imu data from " << sensor->getUID() << ", probably timeout");
+      return false;
+    }
+    x = ix / 16383.0;
+    y = iy / 16383.0;
+    z = iz / 16383.0;
+    w = iw / 16383.0;
+
+    imu_msg.orientation.x = z*-1;
+    imu_msg.orientation.y = y;
+    imu_msg.orientation.z = x;
+    imu_msg.orientation.w = w*-1;
+
+    // velocity from °/16 to rad/s
+    imu_msg.angular_velocity.x = deg2rad(ang[0] / 16.0);
+    imu_msg.angular_velocity.y = deg2rad(ang[1] / 16.0);
+    imu_msg.angular_velocity.z = deg2rad(ang[2] / 16.0);
+
+    // acceleration from 1/100 m/s² to m/s²
+    imu_msg.linear_acceleration.x = acc[0] / 100.0;
+    imu_msg.linear_acceleration.y = acc[1] / 100.0;
+    imu_msg.linear_acceleration.z = acc[2] / 100.0;
+  }
+  else
+  {
+    return false;
+  }
+  return true;
+}
 
-      imu_v2_get_acceleration((IMUV2*)sensor->getDev(), &acc_x, &acc_y, &acc_z);
-      imu_v2_get_angular_velocity((IMUV2*)sensor->getDev(), &ang_x, &ang_y, &ang_z);
+/*----------------------------------------------------------------------
+ * publishImuMessage()
+ * Publish the Imu message.
+ *--------------------------------------------------------------------*/
 
-      ang_f_x = ang_x / 16.0;
-      ang_f_y = ang_y / 16.0;
-      ang_f_z = ang_z / 16.0;
+void TinkerforgeSensors::publishImuMessage(SensorDevice *sensor)
+{
+  ros::Time current_time = ros::Time::now();
+  tf::TransformBroadcaster tf_broadcaster;
+  if (sensor != NULL)
+  {
+    sensor_msgs::Imu imu_msg;
 
-      acc_f_x = acc_x / 100.0;
-      acc_f_y = acc_y / 100.0;
-      acc_f_z = acc_z / 100.0;
+    if (sensor->getType() == IMU_DEVICE_IDENTIFIER && sensor->getFusion().filter.isEnabled())
+    {
+      // streamed sample with host fused orientation, no request to the brick
+      ImuFusionState &fusion = sensor->getFusion();
+      if (!fusion.fresh)
+        return;
+      fusion.fresh = false;
+      current_time = fusion.arrival;
 
-      imu_msg.orientation.x = z*-1;
-      imu_msg.orientation.y = y;
-      imu_msg.orientation.z = x;
-      imu_msg.orientation.w = w*-1;
+      setImuV1Motion(imu_msg, fusion.acc, fusion.ang);
+      setFusedOrientation(imu_msg, fusion.orientation);
     }
-    else
+    else if (!readImuMessage(sensor, imu_msg))
     {
       return;
     }
 
     // message header
     imu_msg.header.seq = sensor->getSeq();
-    imu_msg.header.stamp = current_time;
+    imu_msg.header.stamp = sensor->getStamp(current_time);
     imu_msg.header.frame_id = sensor->getFrame();
 
     // orientation_covariance
@@ -239,11 +468,6 @@ void TinkerforgeSensors::publishImuMessage(SensorDevice *sensor)
 
     imu_msg.orientation_covariance = oc;
 
-    // velocity from °/14.375 to rad/s
-    imu_msg.angular_velocity.x = deg2rad(ang_f_x);
-    imu_msg.angular_velocity.y = deg2rad(ang_f_y);
-    imu_msg.angular_velocity.z = deg2rad(ang_f_z);
-
     // velocity_covariance
     boost::array<const double, 9> vc =
       { 0.0, 0.0, 0.0,
@@ -251,11 +475,6 @@ void TinkerforgeSensors::publishImuMessage(SensorDevice *sensor)
         0.0, 0.0, 0.0};
     imu_msg.angular_velocity_covariance = vc;
 
-    // acceleration from mG to m/s²
-    imu_msg.linear_acceleration.x = acc_f_x;
-    imu_msg.linear_acceleration.y = acc_f_y;
-    imu_msg.linear_acceleration.z = acc_f_z;
-
     // linear_acceleration_covariance
     boost::array<const double, 9> lac =
       { 0.0, 0.0, 0.0,
@@ -263,55 +482,136 @@ void TinkerforgeSensors::publishImuMessage(SensorDevice *sensor)
         0.0, 0.0, 0.0};
     imu_msg.linear_acceleration_covariance = lac;
 
-    sensor->getPub().publish(imu_msg);
+    if (sensor->getCovariance().isEnabled())
+    {
+      const geometry_msgs::Quaternion &q = imu_msg.orientation;
+      double rpy[] = {
+        atan2(2.0 * (q.w * q.x + q.y * q.z), 1.0 - 2.0 * (q.x * q.x + q.y * q.y)),
+        asin(std::max(-1.0, std::min(1.0, 2.0 * (q.w * q.y - q.z * q.x)))),
+        atan2(2.0 * (q.w * q.z + q.x * q.y), 1.0 - 2.0 * (q.y * q.y + q.z * q.z))};
+      double av[] = {imu_msg.angular_velocity.x, imu_msg.angular_velocity.y, imu_msg.angular_velocity.z};
+      double la[] = {imu_msg.linear_acceleration.x, imu_msg.linear_acceleration.y,
+        imu_msg.linear_acceleration.z};
+      estimateCovariance(sensor, 0, rpy, &imu_msg.orientation_covariance[0]);
+      estimateCovariance(sensor, 1, av, &imu_msg.angular_velocity_covariance[0]);
+      estimateCovariance(sensor, 2, la, &imu_msg.linear_acceleration_covariance[0]);
+    }
+
+    double values[SENSOR_SHM_MAX_VALUES];
+    uint32_t count = sampleValues(imu_msg, values);
+    exportSample(sensor, imu_msg.header.stamp, values, count);
+
+    publish_pipeline.publish(sensor->getPub(), imu_msg);
+
+    if (imu_batch_size > 0)
+      batchImuMessage(sensor, imu_msg);
+
+    if (virtual_imu.size() > 0)
+      fuseImuMessage(sensor, imu_msg);
   }
 }
 
 /*----------------------------------------------------------------------
- * publishMagneticFieldMessage()
- * Publish the MagneticField message.
+ * batchImuMessage()
+ * Add an IMU sample to the batch, publish the batch when full
  *--------------------------------------------------------------------*/
 
-void TinkerforgeSensors::publishMagneticFieldMessage(SensorDevice *sensor)
+void TinkerforgeSensors::batchImuMessage(SensorDevice *sensor, const sensor_msgs::Imu &imu_msg)
 {
+  std::map<SensorDevice*, ImuBatch>::iterator it = imu_batches.find(sensor);
+  if (it == imu_batches.end())
+    return;
 
-  if (sensor != NULL)
+  ImuBatch &batch = it->second;
+  if (batch.msg.samples.empty())
+  {
+    batch.msg.header.stamp = imu_msg.header.stamp;
+    batch.msg.header.frame_id = imu_msg.header.frame_id;
+  }
+  batch.msg.samples.push_back(imu_msg);
+
+  if ((int)batch.msg.samples.size() >= imu_batch_size)
+  {
+    batch.msg.header.seq = ++batch.seq;
+    publish_pipeline.publish(batch.pub, batch.msg);
+    // clear keeps the capacity, the next batch does not allocate
+    batch.msg.samples.clear();
+  }
+}
+
+/*----------------------------------------------------------------------
+ * fuseImuMessage()
+ * Add an IMU sample to the virtual IMU, publish the fused sample
+ *--------------------------------------------------------------------*/
+
+void TinkerforgeSensors::fuseImuMessage(SensorDevice *sensor, const sensor_msgs::Imu &imu_msg)
+{
+  sensor_msgs::Imu fused_msg;
   {
-    if (sensor->getType() != IMU_V2_DEVICE_IDENTIFIER)
+    std::lock_guard<std::mutex> lock(virtual_imu_mutex);
+    if (!virtual_imu.add(sensor->getUID(), imu_msg, fused_msg))
       return;
+  }
+  publish_pipeline.publish(virtual_imu_pub, fused_msg);
+}
+
+/*----------------------------------------------------------------------
+ * readMagneticFieldMessage()
+ * Read the magnetic field of an IMU
+ *--------------------------------------------------------------------*/
 
-    int16_t x = 0, y = 0, z = 0;
+bool TinkerforgeSensors::readMagneticFieldMessage(SensorDevice *sensor, sensor_msgs::MagneticField &mf_msg)
+{
+  int16_t mag_x = 0, mag_y = 0, mag_z = 0;
 
-    // for the conversions look at rep 103 http://www.ros.org/reps/rep-0103.html
-    // for IMU v1 http://www.tinkerforge.com/de/doc/Software/Bricks/IMU_Brick_C.html#imu-brick-c-api
-    // for IMU v2 http://www.tinkerforge.com/de/doc/Software/Bricks/IMUV2_Brick_C.html#imu-v2-brick-c-api
-    if (sensor->getType() == IMU_DEVICE_IDENTIFIER)
-    {
-      imu_get_magnetic_field((IMU*)sensor->getDev(), &x, &y, &z); // nT -> T
-      x = x / 10000000.0;
-      y = y / 10000000.0;
-      z = z / 10000000.0;
+  // for the conversions look at rep 103 http://www.ros.org/reps/rep-0103.html
+  // for IMU v1 http://www.tinkerforge.com/de/doc/Software/Bricks/IMU_Brick_C.html#imu-brick-c-api
+  // for IMU v2 http://www.tinkerforge.com/de/doc/Software/Bricks/IMUV2_Brick_C.html#imu-v2-brick-c-api
+  if (sensor->getType() == IMU_DEVICE_IDENTIFIER)
+  {
+    if (imu_get_magnetic_field((IMU*)sensor->getDev(), &mag_x, &mag_y, &mag_z) < 0) {
+      ROS_ERROR_STREAM("Could not get magnetic field from " << sensor->getUID() << ", probably timeout");
+      return false;
     }
-    else
-    {
-      imu_v2_get_magnetic_field((IMUV2*)sensor->getDev(), &x, &y, &z); // µT -> T
-      x = x / 1000000.0;
-      y = y / 1000000.0;
-      z = z / 1000000.0;
+    // nT -> T
+    mf_msg.magnetic_field.x = mag_x / 10000000.0;
+    mf_msg.magnetic_field.y = mag_y / 10000000.0;
+    mf_msg.magnetic_field.z = mag_z / 10000000.0;
+  }
+  else
+  {
+    if (imu_v2_get_magnetic_field((IMUV2*)sensor->getDev(), &mag_x, &mag_y, &mag_z) < 0) {
+      ROS_ERROR_STREAM("Could not get magnetic field from " << sensor->getUID() << ", probably timeout");
+      return false;
     }
+    // µT -> T
+    mf_msg.magnetic_field.x = mag_x / 1000000.0;
+    mf_msg.magnetic_field.y = mag_y / 1000000.0;
+    mf_msg.magnetic_field.z = mag_z / 1000000.0;
+  }
+  return true;
+}
+
+/*----------------------------------------------------------------------
+ * publishMagneticFieldMessage()
+ * Publish the MagneticField message.
+ *--------------------------------------------------------------------*/
+
+void TinkerforgeSensors::publishMagneticFieldMessage(SensorDevice *sensor)
+{
 
+  if (sensor != NULL)
+  {
     sensor_msgs::MagneticField mf_msg;
 
+    if (!readMagneticFieldMessage(sensor, mf_msg))
+      return;
+
     // message header
     mf_msg.header.seq =  sensor->getSeq();
-    mf_msg.header.stamp = ros::Time::now();
+    mf_msg.header.stamp = sensor->getStamp(ros::Time::now());
     mf_msg.header.frame_id = sensor->getFrame();
 
-    // magnetic field from mG to T
-    mf_msg.magnetic_field.x = x;
-    mf_msg.magnetic_field.y = y;
-    mf_msg.magnetic_field.z = z;
-
     boost::array<const double, 9> mfc =
       { 0.01, 0.01, 0.01,
         0.01, 0.01, 0.01,
@@ -319,57 +619,112 @@ void TinkerforgeSensors::publishMagneticFieldMessage(SensorDevice *sensor)
 
     mf_msg.magnetic_field_covariance = mfc;
 
-    sensor->getPub().publish(mf_msg);
+    double values[SENSOR_SHM_MAX_VALUES];
+    uint32_t count = sampleValues(mf_msg, values);
+    estimateCovariance(sensor, 0, values, &mf_msg.magnetic_field_covariance[0]);
+    exportSample(sensor, mf_msg.header.stamp, values, count);
+
+    publish_pipeline.publish(sensor->getPub(), mf_msg);
   }
   return;
 }
 
 /*----------------------------------------------------------------------
- * publishNavSatFixMessage()
- * Publish the NavSatFix message.
+ * readNavSatFixMessage()
+ * Read the position of a GPS, false without a 3D fix
  *--------------------------------------------------------------------*/
 
-void TinkerforgeSensors::publishNavSatFixMessage(SensorDevice *sensor)
+bool TinkerforgeSensors::readNavSatFixMessage(SensorDevice *sensor, sensor_msgs::NavSatFix &gps_msg)
 {
   uint8_t fix, satellites_view, satellites_used;
   uint16_t pdop, hdop, vdop, epe;
   uint32_t latitude, longitude;
   uint32_t altitude, geoidal_separation;
-  uint32_t course, speed;
   char ns, ew;
-  if (sensor != NULL)
-  {
-    // get gps sensor status
-    gps_get_status((GPS*)sensor->getDev(), &fix, &satellites_view, &satellites_used);
 
-    if (fix != GPS_FIX_3D_FIX)
-      return; // No valid data
+  // get gps sensor status
+  if (gps_get_status((GPS*)sensor->getDev(), &fix, &satellites_view, &satellites_used) < 0) {
+    ROS_ERROR_STREAM("Could not get gps status from " << sensor->getUID() << ", probably timeout");
+    return false;
+  }
+
+  if (fix != GPS_FIX_3D_FIX)
+    return false; // No valid data
+
+  if (gps_get_coordinates((GPS*)sensor->getDev(), &latitude, &ns, &longitude, &ew, &pdop,
+        &hdop, &vdop, &epe) < 0 ||
+      gps_get_altitude((GPS*)sensor->getDev(), &altitude, &geoidal_separation) < 0) {
+    ROS_ERROR_STREAM("Could not get gps position from " << sensor->getUID() << ", probably timeout");
+    return false;
+  }
+
+  // gps status
+  gps_msg.status.status = gps_msg.status.STATUS_SBAS_FIX;
+  gps_msg.status.service = gps_msg.status.SERVICE_GPS;
+
+  gps_msg.latitude = latitude/1000000.0;
+  gps_msg.longitude = longitude/1000000.0;
+  gps_msg.altitude = altitude/100.0;
+  gps_msg.position_covariance_type = gps_msg.COVARIANCE_TYPE_UNKNOWN;
+  return true;
+}
 
-    gps_get_coordinates((GPS*)sensor->getDev(), &latitude, &ns, &longitude, &ew, &pdop,
-      &hdop, &vdop, &epe);
-    gps_get_altitude((GPS*)sensor->getDev(), &altitude, &geoidal_separation);
-    // course in deg, speed in 1/100 km/h
-    gps_get_motion((GPS*)sensor->getDev(), &course, &speed);
+/*----------------------------------------------------------------------
+ * publishNavSatFixMessage()
+ * Publish the NavSatFix message.
+ *--------------------------------------------------------------------*/
 
+void TinkerforgeSensors::publishNavSatFixMessage(SensorDevice *sensor)
+{
+  if (sensor != NULL)
+  {
     // generate NavSatFix message from gps sensor data
     sensor_msgs::NavSatFix gps_msg;
 
+    if (!readNavSatFixMessage(sensor, gps_msg))
+      return;
+
     // message header
     gps_msg.header.seq =  sensor->getSeq();
-    gps_msg.header.stamp = ros::Time::now();
+    gps_msg.header.stamp = sensor->getStamp(ros::Time::now());
     gps_msg.header.frame_id = sensor->getFrame();
-    // gps status
-    gps_msg.status.status = gps_msg.status.STATUS_SBAS_FIX;
-    gps_msg.status.service = gps_msg.status.SERVICE_GPS;
 
-    gps_msg.latitude = latitude/1000000.0;
-    gps_msg.longitude = longitude/1000000.0;
-    gps_msg.altitude = altitude/100.0;
-    gps_msg.position_covariance_type = gps_msg.COVARIANCE_TYPE_UNKNOWN;
+    if (sensor->getCovariance().isEnabled())
+    {
+      // position_covariance is east, north, up in m^2
+      double enu[] = {gps_msg.longitude * 111319.49 * cos(deg2rad(gps_msg.latitude)),
+        gps_msg.latitude * 111319.49, gps_msg.altitude};
+      estimateCovariance(sensor, 0, enu, &gps_msg.position_covariance[0]);
+      if (sensor->getCovariance().isReady())
+        gps_msg.position_covariance_type = gps_msg.COVARIANCE_TYPE_APPROXIMATED;
+    }
+
+    double values[SENSOR_SHM_MAX_VALUES];
+    uint32_t count = sampleValues(gps_msg, values);
+    exportSample(sensor, gps_msg.header.stamp, values, count);
 
     // publish gps msg to ros
-    sensor->getPub().publish(gps_msg);
+    publish_pipeline.publish(sensor->getPub(), gps_msg);
+  }
+}
+
+/*----------------------------------------------------------------------
+ * readHumidityMessage()
+ * Read the unfiltered humidity
+ *--------------------------------------------------------------------*/
+
+bool TinkerforgeSensors::readHumidityMessage(SensorDevice *sensor, sensor_msgs::RelativeHumidity &hu_msg)
+{
+  uint16_t humidity = 0.0;
+
+  if(humidity_get_humidity((Humidity*)sensor->getDev(), &humidity) < 0) {
+    ROS_ERROR_STREAM("Could not get humidity from " << sensor->getUID() << ", probably timeout");
+    return false;
   }
+
+  hu_msg.relative_humidity = humidity / 1000.0;
+  hu_msg.variance = 0; // 0 is interpreted as variance unknown
+  return true;
 }
 
 /*----------------------------------------------------------------------
@@ -381,414 +736,1013 @@ void TinkerforgeSensors::publishHumidityMessage(SensorDevice *sensor)
 {
   if (sensor != NULL)
   {
-	uint16_t humidity = 0.0;
-
-    if(humidity_get_humidity((Humidity*)sensor->getDev(), &humidity) < 0) {
-      ROS_ERROR_STREAM("Could not get humidity from " << sensor->getUID() << ", probably timeout");
-      return;
-    }
-
     // generate Humidity message from humidity sensor
     sensor_msgs::RelativeHumidity hu_msg;
 
+    if (!readHumidityMessage(sensor, hu_msg))
+      return;
+
     // message header
     hu_msg.header.seq =  sensor->getSeq();
-    hu_msg.header.stamp = ros::Time::now();
+    hu_msg.header.stamp = sensor->getStamp(ros::Time::now());
     hu_msg.header.frame_id = sensor->getFrame();
 
-    hu_msg.relative_humidity = humidity / 1000.0;
-    hu_msg.variance = 0; // 0 is interpreted as variance unknown
+    hu_msg.relative_humidity = sensor->getFilter().update(hu_msg.relative_humidity);
+
+    double value = hu_msg.relative_humidity;
+    estimateCovariance(sensor, 0, &value, &hu_msg.variance);
+    exportSample(sensor, hu_msg.header.stamp, &value, 1);
 
     // publish Humidity msg to ros
-    sensor->getPub().publish(hu_msg);
+    publish_pipeline.publish(sensor->getPub(), hu_msg);
   }
 }
 
 /*----------------------------------------------------------------------
- * publishTemperatureMessage()
- * Publish the Temperature message.
+ * readTemperatureMessage()
+ * Read the unfiltered temperature
  *--------------------------------------------------------------------*/
 
-void TinkerforgeSensors::publishTemperatureMessage(SensorDevice *sensor)
+bool TinkerforgeSensors::readTemperatureMessage(SensorDevice *sensor, sensor_msgs::Temperature &temp_msg)
 {
-  if (sensor != NULL)
-  {
-    float temperature = 0.0;
+  float temperature = 0.0;
 
-    if (sensor->getType() == TEMPERATURE_DEVICE_IDENTIFIER)
-    {
-      int16_t ambient_temperature;
-      if(temperature_get_temperature((Temperature*)sensor->getDev(), &ambient_temperature) < 0) {
-        ROS_ERROR_STREAM("Could not get temperature from " << sensor->getUID() << ", probably timeout");
-        return;
-      }
-      temperature = temperature / 100.0;
+  if (sensor->getType() == TEMPERATURE_DEVICE_IDENTIFIER)
+  {
+    int16_t ambient_temperature;
+    if(temperature_get_temperature((Temperature*)sensor->getDev(), &ambient_temperature) < 0) {
+      ROS_ERROR_STREAM("Could not get temperature from " << sensor->getUID() << ", probably timeout");
+      return false;
     }
-    else if (sensor->getType() == TEMPERATURE_IR_DEVICE_IDENTIFIER) {
-      int16_t object_temperature;
+    temperature = temperature / 100.0;
+  }
+  else if (sensor->getType() == TEMPERATURE_IR_DEVICE_IDENTIFIER) {
+    int16_t object_temperature;
 
-      if(temperature_ir_get_object_temperature((TemperatureIR*)sensor->getDev(), &object_temperature) < 0) {
-        ROS_ERROR_STREAM("Could not get object temperature from" << sensor->getUID() << ", probably timeout");
-        return;
-      }
-      temperature = object_temperature / 10.0;
+    if(temperature_ir_get_object_temperature((TemperatureIR*)sensor->getDev(), &object_temperature) < 0) {
+      ROS_ERROR_STREAM("Could not get object temperature from" << sensor->getUID() << ", probably timeout");
+      return false;
     }
+    temperature = object_temperature / 10.0;
+  }
+
+  temp_msg.temperature = temperature;
+  temp_msg.variance = 0;
+  return true;
+}
+
+/*----------------------------------------------------------------------
+ * publishTemperatureMessage()
+ * Publish the Temperature message.
+ *--------------------------------------------------------------------*/
 
+void TinkerforgeSensors::publishTemperatureMessage(SensorDevice *sensor)
+{
+  if (sensor != NULL)
+  {
     // generate Temperature message from temperature sensor
     sensor_msgs::Temperature temp_msg;
 
+    if (!readTemperatureMessage(sensor, temp_msg))
+      return;
+
     // message header
     temp_msg.header.seq =  sensor->getSeq();
-    temp_msg.header.stamp = ros::Time::now();
+    temp_msg.header.stamp = sensor->getStamp(ros::Time::now());
     temp_msg.header.frame_id = sensor->getFrame();
 
-    temp_msg.temperature = temperature;
-    temp_msg.variance = 0;
+    temp_msg.temperature = sensor->getFilter().update(temp_msg.temperature);
+
+    double value = temp_msg.temperature;
+    estimateCovariance(sensor, 0, &value, &temp_msg.variance);
+    exportSample(sensor, temp_msg.header.stamp, &value, 1);
 
     // publish Temperature msg to ros
-    sensor->getPub().publish(temp_msg);
+    publish_pipeline.publish(sensor->getPub(), temp_msg);
   }
 }
 
 /*----------------------------------------------------------------------
- * publishRangeMessage()
- * Publish the Range message.
+ * readRangeMessage()
+ * Read the unfiltered range and the limits of the config
  *--------------------------------------------------------------------*/
-void TinkerforgeSensors::publishRangeMessage(SensorDevice *sensor)
+
+bool TinkerforgeSensors::readRangeMessage(SensorDevice *sensor, sensor_msgs::Range &range_msg)
+{
+  const RangeConfig &config = sensor->getConfig().range;
+  uint16_t distance;
+
+  if (sensor->getType() == DISTANCE_US_DEVICE_IDENTIFIER)
+  {
+    if(distance_us_get_distance_value((DistanceUS*)sensor->getDev(), &distance) < 0) {
+      ROS_ERROR_STREAM("Could not get range us from " << sensor->getUID() << ", probably timeout");
+      return false;
+    }
+    range_msg.radiation_type = sensor_msgs::Range::ULTRASOUND;
+    range_msg.range = distance / 1000.0;
+  }
+  else if (sensor->getType() == DISTANCE_IR_DEVICE_IDENTIFIER)
+  {
+    if(distance_ir_get_distance((DistanceIR*)sensor->getDev(), &distance) < 0) {
+      ROS_ERROR_STREAM("Could not get range ir from " << sensor->getUID() << ", probably timeout");
+      return false;
+    }
+    range_msg.radiation_type = sensor_msgs::Range::INFRARED;
+    range_msg.range = distance / 1000.0;
+  }
+  else
+  {
+    return false;
+  }
+
+  // limits from the config, the defaults depend on the sensor type
+  range_msg.field_of_view = config.field_of_view;
+  range_msg.min_range = config.min_range;
+  range_msg.max_range = config.max_range;
+  return true;
+}
+
+/*----------------------------------------------------------------------
+ * publishRangeMessage()
+ * Publish the Range message.
+ *--------------------------------------------------------------------*/
+void TinkerforgeSensors::publishRangeMessage(SensorDevice *sensor)
 {
   if (sensor != NULL)
   {
-    SensorParam param;
     // generate Range message from distance sensor
     sensor_msgs::Range range_msg;
-    uint16_t distance;
-    if (sensor->getType() == DISTANCE_US_DEVICE_IDENTIFIER)
-    {
-      if(distance_us_get_distance_value((DistanceUS*)sensor->getDev(), &distance) < 0) {
-        ROS_ERROR_STREAM("Could not get range us from " << sensor->getUID() << ", probably timeout");
-        return;
-      }
-      range_msg.radiation_type = sensor_msgs::Range::ULTRASOUND;
-      range_msg.range = distance / 1000.0;
-      param = sensor->getParam("fow");
-      range_msg.field_of_view = (param.type != ParamType::NONE)? param.value_double : 0.2617;
-      param = sensor->getParam("min");
-      range_msg.min_range = (param.type != ParamType::NONE)? param.value_double : 0.02;
-      param = sensor->getParam("max");
-      range_msg.max_range = (param.type != ParamType::NONE)? param.value_double : 4.0;
-    }
-    else if (sensor->getType() == DISTANCE_IR_DEVICE_IDENTIFIER)
-    {
-      if(distance_ir_get_distance((DistanceIR*)sensor->getDev(), &distance) < 0) {
-        ROS_ERROR_STREAM("Could not get range ir from " << sensor->getUID() << ", probably timeout");
-        return;
-      }
-      range_msg.radiation_type = sensor_msgs::Range::INFRARED;
-      range_msg.range = distance / 1000.0;
-      param = sensor->getParam("fow");
-      range_msg.field_of_view = (param.type != ParamType::NONE)? param.value_double : 0.01;
-      param = sensor->getParam("min");
-      range_msg.min_range = (param.type != ParamType::NONE)? param.value_double : 0.03;
-      param = sensor->getParam("max");
-      range_msg.max_range = (param.type != ParamType::NONE)? param.value_double : 0.4;
-    }
-    else
-    {
+
+    if (!readRangeMessage(sensor, range_msg))
       return;
-    }
 
     // message header
     range_msg.header.seq =  sensor->getSeq();
-    range_msg.header.stamp = ros::Time::now();
+    range_msg.header.stamp = sensor->getStamp(ros::Time::now());
     range_msg.header.frame_id = sensor->getFrame();
 
+    range_msg.range = sensor->getFilter().update(range_msg.range);
+
+    double value = range_msg.range;
+    exportSample(sensor, range_msg.header.stamp, &value, 1);
+
     // publish Range msg to ros
-    sensor->getPub().publish(range_msg);
+    publish_pipeline.publish(sensor->getPub(), range_msg);
+
+    if (range_aggregator.size() > 0)
+    {
+      std::lock_guard<std::mutex> lock(range_mutex);
+      range_aggregator.update(sensor->getUID(), range_msg);
+    }
   }
 }
 
 /*----------------------------------------------------------------------
- * publishIlluminanceMessage()
- * Publish the Illuminance message.
+ * readIlluminanceMessage()
+ * Read the unfiltered illuminance
  *--------------------------------------------------------------------*/
-void TinkerforgeSensors::publishIlluminanceMessage(SensorDevice *sensor)
+
+bool TinkerforgeSensors::readIlluminanceMessage(SensorDevice *sensor, sensor_msgs::Illuminance &illum_msg)
 {
-  if (sensor != NULL)
-  {
-    uint32_t illuminance = 0;
+  uint32_t illuminance = 0;
 
-    // for the conversions look at rep 103 http://www.ros.org/reps/rep-0103.html
-    // for Ambient Light v1 http://www.tinkerforge.com/de/doc/Software/Bricklets/AmbientLight_Bricklet_C.html
-    // for Ambient Light v2 http://www.tinkerforge.com/de/doc/Software/Bricklets/AmbientLightV2_Bricklet_C.html
+  // for the conversions look at rep 103 http://www.ros.org/reps/rep-0103.html
+  // for Ambient Light v1 http://www.tinkerforge.com/de/doc/Software/Bricklets/AmbientLight_Bricklet_C.html
+  // for Ambient Light v2 http://www.tinkerforge.com/de/doc/Software/Bricklets/AmbientLightV2_Bricklet_C.html
 
-    if (sensor->getType() == AMBIENT_LIGHT_DEVICE_IDENTIFIER)
-    {
-      uint16_t ill = 0;
-      // get current illuminance (unit is Lux/10)
-      if(ambient_light_get_illuminance((AmbientLight*)sensor->getDev(), &ill) < 0) {
-        ROS_ERROR_STREAM("Could not get illuminance from " << sensor->getUID() << ", probably timeout");
-        return;
-      }
-      illuminance = (uint32_t)ill / 10.0;
-    }
-    else if (sensor->getType() == AMBIENT_LIGHT_V2_DEVICE_IDENTIFIER)
-    {
-      // get current illuminance (unit is Lux/100)
-      if (ambient_light_v2_get_illuminance((AmbientLightV2*)sensor->getDev(), &illuminance) < 0) {
-        ROS_ERROR_STREAM("Could not get illuminance from " << sensor->getUID() << ", probably timeout");
-        return;
-      }
-      illuminance = illuminance / 100.0;
+  if (sensor->getType() == AMBIENT_LIGHT_DEVICE_IDENTIFIER)
+  {
+    uint16_t ill = 0;
+    // get current illuminance (unit is Lux/10)
+    if(ambient_light_get_illuminance((AmbientLight*)sensor->getDev(), &ill) < 0) {
+      ROS_ERROR_STREAM("Could not get illuminance from " << sensor->getUID() << ", probably timeout");
+      return false;
     }
-    else
-    {
-      return;
+    illuminance = (uint32_t)ill / 10.0;
+  }
+  else if (sensor->getType() == AMBIENT_LIGHT_V2_DEVICE_IDENTIFIER)
+  {
+    // get current illuminance (unit is Lux/100)
+    if (ambient_light_v2_get_illuminance((AmbientLightV2*)sensor->getDev(), &illuminance) < 0) {
+      ROS_ERROR_STREAM("Could not get illuminance from " << sensor->getUID() << ", probably timeout");
+      return false;
     }
+    illuminance = illuminance / 100.0;
+  }
+  else
+  {
+    return false;
+  }
 
+  illum_msg.illuminance = illuminance;
+  illum_msg.variance = 0;
+  return true;
+}
+
+/*----------------------------------------------------------------------
+ * publishIlluminanceMessage()
+ * Publish the Illuminance message.
+ *--------------------------------------------------------------------*/
+void TinkerforgeSensors::publishIlluminanceMessage(SensorDevice *sensor)
+{
+  if (sensor != NULL)
+  {
     // generate Illuminance message from Ambient Light sensor
     sensor_msgs::Illuminance illum_msg;
 
+    if (!readIlluminanceMessage(sensor, illum_msg))
+      return;
+
     // message header
     illum_msg.header.seq =  sensor->getSeq();
-    illum_msg.header.stamp = ros::Time::now();
+    illum_msg.header.stamp = sensor->getStamp(ros::Time::now());
     illum_msg.header.frame_id = sensor->getFrame();
 
-    illum_msg.illuminance = illuminance;
-    illum_msg.variance = 0;
+    illum_msg.illuminance = sensor->getFilter().update(illum_msg.illuminance);
+
+    double value = illum_msg.illuminance;
+    estimateCovariance(sensor, 0, &value, &illum_msg.variance);
+    exportSample(sensor, illum_msg.header.stamp, &value, 1);
 
     // publish Temperature msg to ros
-    sensor->getPub().publish(illum_msg);
+    publish_pipeline.publish(sensor->getPub(), illum_msg);
   }
 }
 
 /*----------------------------------------------------------------------
-* publishSensors()
-* Publish the Sensors messages.
-*--------------------------------------------------------------------*/
+ * sampleValues()
+ * Values of a message in the layout of the latest value and the export
+ *--------------------------------------------------------------------*/
+
+uint32_t TinkerforgeSensors::sampleValues(const sensor_msgs::Imu &msg, double *values)
+{
+  values[0] = msg.orientation.x;
+  values[1] = msg.orientation.y;
+  values[2] = msg.orientation.z;
+  values[3] = msg.orientation.w;
+  values[4] = msg.angular_velocity.x;
+  values[5] = msg.angular_velocity.y;
+  values[6] = msg.angular_velocity.z;
+  values[7] = msg.linear_acceleration.x;
+  values[8] = msg.linear_acceleration.y;
+  values[9] = msg.linear_acceleration.z;
+  return 10;
+}
+
+uint32_t TinkerforgeSensors::sampleValues(const sensor_msgs::MagneticField &msg, double *values)
+{
+  values[0] = msg.magnetic_field.x;
+  values[1] = msg.magnetic_field.y;
+  values[2] = msg.magnetic_field.z;
+  return 3;
+}
+
+uint32_t TinkerforgeSensors::sampleValues(const sensor_msgs::NavSatFix &msg, double *values)
+{
+  values[0] = msg.latitude;
+  values[1] = msg.longitude;
+  values[2] = msg.altitude;
+  return 3;
+}
+
+uint32_t TinkerforgeSensors::sampleValues(const sensor_msgs::RelativeHumidity &msg, double *values)
+{
+  values[0] = msg.relative_humidity;
+  return 1;
+}
+
+uint32_t TinkerforgeSensors::sampleValues(const sensor_msgs::Temperature &msg, double *values)
+{
+  values[0] = msg.temperature;
+  return 1;
+}
+
+uint32_t TinkerforgeSensors::sampleValues(const sensor_msgs::Range &msg, double *values)
+{
+  values[0] = msg.range;
+  return 1;
+}
+
+uint32_t TinkerforgeSensors::sampleValues(const sensor_msgs::Illuminance &msg, double *values)
+{
+  values[0] = msg.illuminance;
+  return 1;
+}
+
+/*----------------------------------------------------------------------
+ * publishSensor()
+ * Publish the message of a single sensor
+ *--------------------------------------------------------------------*/
+
+void TinkerforgeSensors::publishSensor(SensorDevice *sensor)
+{
+  // the publish loop and on-demand reads may meet on a sensor
+  std::lock_guard<std::mutex> lock(sensor->getMutex());
+
+  const DeviceEntry *entry = sensor->getEntry();
+  if (entry->publish != NULL)
+    entry->publish(this, sensor);
+}
+
+/*----------------------------------------------------------------------
+ * readSensor()
+ * Read a sensor into its latest value without publishing
+ *--------------------------------------------------------------------*/
+
+bool TinkerforgeSensors::readSensor(SensorDevice *sensor)
+{
+  // the publish loop and on-demand reads may meet on a sensor
+  std::lock_guard<std::mutex> lock(sensor->getMutex());
+
+  const DeviceEntry *entry = sensor->getEntry();
+  return entry->read != NULL && entry->read(this, sensor);
+}
+
+/*----------------------------------------------------------------------
+ * publishSensors()
+ * Publish the messages of all sensors
+ *--------------------------------------------------------------------*/
+
 void TinkerforgeSensors::publishSensors()
 {
-  std::list<SensorDevice*>::iterator lIter;
-  for (lIter = sensors.begin(); lIter != sensors.end(); ++lIter)
+  double now = ros::Time::now().toSec();
+  // enumeration may add sensors meanwhile, they are published next cycle
+  SensorRegistry::Reader reader(sensors);
+
+  for (size_t i = 0; i < reader.size(); i++)
   {
-    switch((*lIter)->getSensorClass())
+    SensorRegistry::Slot &slot = reader.slot(i);
+    if (slot.entry->publish == NULL)
+      continue;
+
+    // enumerated after advertiseSensors, wire it up before its first message
+    if (!slot.sensor->getPub())
     {
-      case SensorClass::HUMIDITY:
-        publishHumidityMessage(*lIter);
-      break;
-      case SensorClass::LIGHT:
-        publishIlluminanceMessage(*lIter);
-      break;
-      case SensorClass::IMU:
-        publishImuMessage(*lIter);
-      break;
-      case SensorClass::MAGNETIC:
-        publishMagneticFieldMessage(*lIter);
-      break;
-      case SensorClass::RANGE:
-        publishRangeMessage(*lIter);
-      break;
-      case SensorClass::TEMPERATURE:
-        publishTemperatureMessage(*lIter);
-      break;
+      if (!advertise_node)
+        continue;
+      advertiseSensor(slot.sensor);
     }
+
+    if (!SensorRegistry::isDue(slot, now))
+      continue;
+
+    // the publish loop and on-demand reads may meet on a sensor
+    std::lock_guard<std::mutex> lock(slot.sensor->getMutex());
+    slot.entry->publish(this, slot.sensor);
   }
+
+  if (range_aggregator.size() > 0)
+    publishRangeAggregate();
   return;
 }
 
 /*----------------------------------------------------------------------
- * callbackConnected()
- * Callback function for Tinkerforge ip connected
+ * publishRangeAggregate()
+ * Publish the range readings of the cycle as one cloud and scan
  *--------------------------------------------------------------------*/
 
-void TinkerforgeSensors::callbackConnected(uint8_t connect_reason, void *user_data)
+void TinkerforgeSensors::publishRangeAggregate()
 {
-  TinkerforgeSensors *tfs = (TinkerforgeSensors*) user_data;
-  //if (tfs->is_imu_connected == false)
-    ipcon_enumerate(&(tfs->ipcon));
-  return;
+  std::lock_guard<std::mutex> lock(range_mutex);
+
+  if (!range_aggregator.hasFresh())
+    return;
+
+  if (!range_cloud_topic.empty())
+  {
+    range_aggregator.fillCloud(range_cloud_msg);
+    publish_pipeline.publish(range_cloud_pub, range_cloud_msg);
+  }
+  if (!range_scan_topic.empty())
+  {
+    range_aggregator.fillScan(range_scan_msg);
+    publish_pipeline.publish(range_scan_pub, range_scan_msg);
+  }
+  range_aggregator.clearFresh();
 }
 
 /*----------------------------------------------------------------------
- * callbackEnumerate()
- * Callback function for Tinkerforge enumerate
+ * advertiseSensor()
+ * Create the publisher of a sensor and add it to the batches and aggregates
  *--------------------------------------------------------------------*/
 
-void TinkerforgeSensors::callbackEnumerate(const char *uid, const char *connected_uid,
-                  char position, uint8_t hardware_version[3],
-                  uint8_t firmware_version[3], uint16_t device_identifier,
-                  uint8_t enumeration_type, void *user_data)
+void TinkerforgeSensors::advertiseSensor(SensorDevice *sensor)
 {
-  TinkerforgeSensors *tfs = (TinkerforgeSensors*) user_data;
-  std::map<std::string, std::map<std::string, SensorParam>>::iterator it;
-  std::map<std::string, SensorParam>::iterator it_sp;
-  std::string topic("");
+  ROS_DEBUG_STREAM("node" << "::" << sensor->getUID() << "::" << sensor->getTopic());
 
-  if(enumeration_type == IPCON_ENUMERATION_TYPE_DISCONNECTED)
+  const DeviceEntry *entry = sensor->getEntry();
+  if (entry->advertise != NULL)
+    sensor->setPub(entry->advertise(*advertise_node, sensor->getTopic()));
+
+  // batched IMU samples next to the per sample topic
+  if (imu_batch_size > 0 && sensor->getSensorClass() == SensorClass::IMU)
   {
-    return;
+    ImuBatch &batch = imu_batches[sensor];
+    batch.pub = advertise_node->advertise<tinkerforge_sensors::ImuArray>(sensor->getTopic() + "_batch", 10);
+    batch.msg.samples.reserve(imu_batch_size);
+    batch.seq = 0;
   }
 
-  // check if uid is in conf
-  it = tfs->conf.find((std::string)uid);
-  if (it != tfs->conf.end())
+  // members of the virtual IMU
+  const SensorConfig &config = sensor->getConfig();
+  if (!virtual_imu_topic.empty() && sensor->getSensorClass() == SensorClass::IMU && config.fuse)
   {
-    // check if topic is set
-    it_sp = it->second.find("topic");
-    if (it_sp != it->second.end())
-      topic = (std::string)it_sp->second.value_str;
+    std::lock_guard<std::mutex> lock(virtual_imu_mutex);
+    virtual_imu.addMember(sensor->getUID(), config.pose.roll, config.pose.pitch, config.pose.yaw);
+    ROS_INFO_STREAM("Fusing IMU " << sensor->getUID() << " into " << virtual_imu_topic);
   }
 
-  // get sensor count for later check, to add params to sensor
-  int sensor_count = tfs->sensors.size();
-
-  // check if device is an imu
-  if(device_identifier == IMU_DEVICE_IDENTIFIER)
+  // range sensors of the aggregated cloud and scan
+  if ((!range_cloud_topic.empty() || !range_scan_topic.empty()) &&
+      sensor->getSensorClass() == SensorClass::RANGE && config.range.aggregate)
   {
-    ROS_INFO_STREAM("found IMU with UID:" << uid);
-    // Create IMU device object
-    IMU *imu = new IMU();
-    imu_create(imu, uid, &(tfs->ipcon));
-    imu_set_convergence_speed(imu,tfs->imu_convergence_speed);
-    imu_leds_on(imu);
-    tfs->imu_init_time = ros::Time::now();
-
-    SensorDevice *imu_dev = new SensorDevice(imu, uid, topic, IMU_DEVICE_IDENTIFIER, SensorClass::IMU, 10);
-    tfs->sensors.push_back(imu_dev);
+    std::lock_guard<std::mutex> lock(range_mutex);
+    range_aggregator.addMember(sensor->getUID(), config.pose.x, config.pose.y, config.pose.z,
+      config.pose.roll, config.pose.pitch, config.pose.yaw);
   }
-  else if (device_identifier == IMU_V2_DEVICE_IDENTIFIER)
-  {
-    ROS_INFO_STREAM("found IMU_v2 with UID:" << uid);
-    // Create IMU_v2 device object
-    IMUV2 *imu_v2 = new IMUV2();
-    imu_v2_create(imu_v2, uid, &(tfs->ipcon));
-    imu_v2_leds_on(imu_v2);
+}
 
-    SensorDevice *imu_dev = new SensorDevice(imu_v2, uid, topic, IMU_V2_DEVICE_IDENTIFIER, SensorClass::IMU, 10);
-    tfs->sensors.push_back(imu_dev);
+/*----------------------------------------------------------------------
+ * advertiseSensors()
+ * Create the publishers of all sensors
+ *--------------------------------------------------------------------*/
 
-    imu_dev = new SensorDevice(imu_v2, uid, std::string(""), IMU_V2_MAGNETIC_DEVICE_IDENTIFIER, SensorClass::MAGNETIC, 10);
-    tfs->sensors.push_back(imu_dev);
-  }
-  else if (device_identifier == GPS_DEVICE_IDENTIFIER)
+void TinkerforgeSensors::advertiseSensors(ros::NodeHandle &n)
+{
+  advertise_node.reset(new ros::NodeHandle(n));
+
+  SensorRegistry::Reader reader(sensors);
+  SensorRegistry::iterator Iter;
+  for (Iter = reader.begin(); Iter != reader.end(); ++Iter)
+    advertiseSensor(*Iter);
+
+  if (!range_cloud_topic.empty())
+    range_cloud_pub = n.advertise<sensor_msgs::PointCloud2>(range_cloud_topic, 10);
+  if (!range_scan_topic.empty())
+    range_scan_pub = n.advertise<sensor_msgs::LaserScan>(range_scan_topic, 10);
+
+  if (!virtual_imu_topic.empty())
   {
-    ROS_INFO_STREAM("found GPS with UID:" << uid);
-    // Create GPS device object
-    GPS *gps = new GPS();
-    gps_create(gps, uid, &(tfs->ipcon));
+    if (virtual_imu.size() < 2)
+      ROS_WARN_STREAM("Virtual IMU " << virtual_imu_topic << " has " << virtual_imu.size() << " members");
+    virtual_imu_pub = n.advertise<sensor_msgs::Imu>(virtual_imu_topic, 50);
+  }
+}
+
+/*----------------------------------------------------------------------
+ * startShmExport()
+ * Mirror the samples of the current sensors to a shared memory segment
+ *--------------------------------------------------------------------*/
 
-    SensorDevice *gps_dev = new SensorDevice(gps, uid, topic, GPS_DEVICE_IDENTIFIER, SensorClass::GPS, 10);
-    tfs->sensors.push_back(gps_dev);
+bool TinkerforgeSensors::startShmExport(const std::string &name, uint32_t ring_size)
+{
+  SensorRegistry::Reader reader(sensors);
+  if (!shm_writer.create(name, reader.size(), ring_size))
+  {
+    ROS_ERROR_STREAM("Could not create shared memory " << name << ": " << strerror(errno));
+    return false;
   }
-  else if (device_identifier == DUAL_BUTTON_DEVICE_IDENTIFIER)
+
+  // sensors enumerated later are not exported
+  int index = 0;
+  SensorRegistry::iterator lIter;
+  for (lIter = reader.begin(); lIter != reader.end(); ++lIter, ++index)
   {
-    ROS_INFO_STREAM("found DualButton with UID:" << uid);
+    shm_writer.setSensor(index, (*lIter)->getUID(), (*lIter)->getTopic(), (*lIter)->getType(),
+      (uint8_t)(*lIter)->getSensorClass());
+    (*lIter)->setShmIndex(index);
+  }
 
-    DualButton *db = new DualButton();
-    dual_button_create(db, uid, &(tfs->ipcon));
+  ROS_INFO_STREAM("Exporting " << reader.size() << " sensors to shared memory " << name);
+  return true;
+}
+
+/*----------------------------------------------------------------------
+ * setupImu()
+ * Set up a new IMU v1, streams the raw data for host fusion if enabled
+ *--------------------------------------------------------------------*/
 
-    SensorDevice *db_dev = new SensorDevice(db, uid, topic, DUAL_BUTTON_DEVICE_IDENTIFIER, SensorClass::MISC, 10);
-    tfs->sensors.push_back(db_dev);
+void TinkerforgeSensors::setupImu(SensorDevice *sensor)
+{
+  IMU *imu = (IMU*)sensor->getDev();
+
+  imu_set_convergence_speed(imu, imu_convergence_speed);
+  imu_leds_on(imu);
+  imu_init_time = ros::Time::now();
+
+  // stream the raw data and fuse the orientation on the host
+  if (imu_fusion_period > 0)
+  {
+    sensor->getFusion().filter.init(imu_fusion_beta);
+    sensor->getFusion().period = imu_fusion_period / 1000.0;
+    imu_orientation_calculation_off(imu);
+    imu_register_callback(imu, IMU_CALLBACK_ALL_DATA, (void*)callbackImuAllData, sensor);
+    imu_set_all_data_period(imu, imu_fusion_period);
   }
-  else if (device_identifier == HUMIDITY_DEVICE_IDENTIFIER)
+}
+
+/*----------------------------------------------------------------------
+ * callbackImuAllData()
+ * Fuse a streamed IMU v1 sample and keep it for the next publish
+ *--------------------------------------------------------------------*/
+
+void TinkerforgeSensors::callbackImuAllData(int16_t acc_x, int16_t acc_y, int16_t acc_z,
+  int16_t mag_x, int16_t mag_y, int16_t mag_z,
+  int16_t ang_x, int16_t ang_y, int16_t ang_z,
+  int16_t temperature, void *user_data)
+{
+  SensorDevice *sensor = (SensorDevice*)user_data;
+  ros::Time arrival = ros::Time::now();
+  std::lock_guard<std::mutex> lock(sensor->getMutex());
+  ImuFusionState &fusion = sensor->getFusion();
+
+  // the measured interval, unless the stream just started or stalled
+  double dt = fusion.period;
+  if (!fusion.arrival.isZero())
   {
-    ROS_INFO_STREAM("found Humidity with UID:" << uid);
-    Humidity *hu = new Humidity();
-    // Create Humidity device object
-    humidity_create(hu, uid, &(tfs->ipcon));
+    double measured = (arrival - fusion.arrival).toSec();
+    if (measured > 0.0 && measured < 5.0 * fusion.period)
+      dt = measured;
+  }
 
-    SensorDevice *hu_dev = new SensorDevice(hu, uid, topic, HUMIDITY_DEVICE_IDENTIFIER, SensorClass::HUMIDITY, 10);
-    tfs->sensors.push_back(hu_dev);
+  // angular velocity from deg/14.375 s to rad/s
+  double gyro[] = {ang_x / 14.375 * M_PI / 180.0, ang_y / 14.375 * M_PI / 180.0, ang_z / 14.375 * M_PI / 180.0};
+  double acc[] = {(double)acc_x, (double)acc_y, (double)acc_z};
+  double mag[] = {(double)mag_x, (double)mag_y, (double)mag_z};
+  fusion.filter.update(gyro, acc, mag, dt);
+  fusion.filter.getQuaternion(fusion.orientation[0], fusion.orientation[1],
+    fusion.orientation[2], fusion.orientation[3]);
+
+  fusion.acc[0] = acc_x;
+  fusion.acc[1] = acc_y;
+  fusion.acc[2] = acc_z;
+  fusion.ang[0] = ang_x;
+  fusion.ang[1] = ang_y;
+  fusion.ang[2] = ang_z;
+  fusion.arrival = arrival;
+  fusion.fresh = true;
+}
 
+/*----------------------------------------------------------------------
+ * estimateCovariance()
+ * Update a covariance estimator and fill the message field
+ *--------------------------------------------------------------------*/
+
+void TinkerforgeSensors::estimateCovariance(SensorDevice *sensor, unsigned int index,
+  const double *values, double *cov)
+{
+  WindowCovariance &estimator = sensor->getCovariance(index);
+
+  if (!estimator.isEnabled())
+    return;
+
+  estimator.add(values);
+  // keep the default of the message until the window has some samples
+  if (estimator.isReady())
+    estimator.getCovariance(cov);
+}
+
+/*----------------------------------------------------------------------
+ * exportSample()
+ * Hand a decoded sample to the exports
+ *--------------------------------------------------------------------*/
+
+void TinkerforgeSensors::exportSample(SensorDevice *sensor, const ros::Time &stamp,
+  const double *values, uint32_t count)
+{
+  sensor->getLatest().update(stamp.toNSec(), values, count);
+  if (sensor->getShmIndex() >= 0)
+    shm_writer.write(sensor->getShmIndex(), stamp.toNSec(), values, count);
+}
+
+/*----------------------------------------------------------------------
+ * advertiseServices()
+ * Advertise the get_readings service
+ *--------------------------------------------------------------------*/
+
+void TinkerforgeSensors::advertiseServices(ros::NodeHandle &n, double ttl)
+{
+  readings_ttl = ttl;
+  readings_srv = n.advertiseService("/tfsensors/get_readings", &TinkerforgeSensors::getReadings, this);
+}
+
+/*----------------------------------------------------------------------
+ * getReading()
+ * Fill a reading from the latest value, read the device if it is too old
+ *--------------------------------------------------------------------*/
+
+void TinkerforgeSensors::getReading(SensorDevice *sensor, double max_age,
+  tinkerforge_sensors::Reading &reading)
+{
+  SensorShmSample sample;
+  bool valid = sensor->getLatest().get(&sample);
+  uint64_t number = sample.number;
+
+  if (!valid || (ros::Time::now() - ros::Time().fromNSec(sample.stamp)).toSec() > max_age)
+  {
+    // one caller reads the device, concurrent callers share its result
+    if (sensor->getLatest().beginRead())
+    {
+      readSensor(sensor);
+      sensor->getLatest().endRead();
+    }
+    valid = sensor->getLatest().get(&sample);
   }
-  else if (device_identifier == TEMPERATURE_DEVICE_IDENTIFIER)
+
+  reading.uid = sensor->getUID();
+  reading.topic = sensor->getTopic();
+  reading.device_identifier = sensor->getType();
+  reading.valid = valid;
+  reading.fresh = (sample.number != number);
+  if (valid)
   {
-    ROS_INFO_STREAM("found Temperature with UID:" << uid);
-    Temperature *temp = new Temperature();
-    // Create Temperature device object
-    temperature_create(temp, uid, &(tfs->ipcon));
+    reading.stamp.fromNSec(sample.stamp);
+    reading.values.assign(sample.values, sample.values + sample.count);
+  }
+}
+
+/*----------------------------------------------------------------------
+ * getReadings()
+ * Service callback for the latest readings
+ *--------------------------------------------------------------------*/
+
+bool TinkerforgeSensors::getReadings(tinkerforge_sensors::GetReadings::Request &req,
+  tinkerforge_sensors::GetReadings::Response &res)
+{
+  double max_age = (req.max_age > 0.0) ? req.max_age : readings_ttl;
+  std::set<std::string> uids(req.uids.begin(), req.uids.end());
+  std::set<std::string> found;
 
-    SensorDevice *temp_dev = new SensorDevice(temp, uid, topic, TEMPERATURE_DEVICE_IDENTIFIER, SensorClass::TEMPERATURE, 10);
-    tfs->sensors.push_back(temp_dev);
+  SensorRegistry::Reader reader(sensors);
 
-  }
-  else if (device_identifier == TEMPERATURE_IR_DEVICE_IDENTIFIER)
+  SensorRegistry::iterator lIter;
+  for (lIter = reader.begin(); lIter != reader.end(); ++lIter)
   {
-    ROS_INFO_STREAM("found Temperature IR with UID:" << uid);
-    TemperatureIR *tir = new TemperatureIR();
-    // Create Temperature IR device object
-    temperature_ir_create(tir, uid, &(tfs->ipcon));
+    if (!uids.empty() && uids.count((*lIter)->getUID()) == 0)
+      continue;
 
-    SensorDevice *tir_dev = new SensorDevice(tir, uid, topic, TEMPERATURE_IR_DEVICE_IDENTIFIER, SensorClass::TEMPERATURE, 10);
-    tfs->sensors.push_back(tir_dev);
+    tinkerforge_sensors::Reading reading;
+    getReading(*lIter, max_age, reading);
+    res.readings.push_back(reading);
+    found.insert((*lIter)->getUID());
+  }
 
+  // unknown uids are answered with an invalid reading
+  for (size_t i = 0; i < req.uids.size(); i++)
+  {
+    if (found.count(req.uids[i]) != 0)
+      continue;
+    tinkerforge_sensors::Reading reading;
+    reading.uid = req.uids[i];
+    reading.device_identifier = 0;
+    reading.valid = false;
+    reading.fresh = false;
+    res.readings.push_back(reading);
   }
-  else if (device_identifier == AMBIENT_LIGHT_DEVICE_IDENTIFIER)
+  return true;
+}
+
+/*----------------------------------------------------------------------
+ * setStampFilter()
+ * Enable timestamp de-jittering for the given nominal sample period
+ *--------------------------------------------------------------------*/
+
+void TinkerforgeSensors::setStampFilter(double period, double gain)
+{
+  stamp_period = period;
+  stamp_gain = gain;
+
+  SensorRegistry::Reader reader(sensors);
+
+  SensorRegistry::iterator lIter;
+  for (lIter = reader.begin(); lIter != reader.end(); ++lIter)
   {
-    ROS_INFO_STREAM("found Ambient Light with UID:" << uid);
-    // Create Ambient Light device object
-    AmbientLight *ambient_light = new AmbientLight();
-    ambient_light_create(ambient_light, uid, &(tfs->ipcon));
-    SensorDevice *ambient_light_dev = new SensorDevice(ambient_light, uid, topic, AMBIENT_LIGHT_DEVICE_IDENTIFIER, SensorClass::LIGHT, 10);
-    tfs->sensors.push_back(ambient_light_dev);
+    (*lIter)->initStampFilter(stamp_period, stamp_gain);
   }
-  else if (device_identifier == AMBIENT_LIGHT_V2_DEVICE_IDENTIFIER)
+}
+
+/*----------------------------------------------------------------------
+ * logStampStats()
+ * Log the residual statistics of the timestamp filters
+ *--------------------------------------------------------------------*/
+
+void TinkerforgeSensors::logStampStats()
+{
+  SensorRegistry::Reader reader(sensors);
+  SensorRegistry::iterator lIter;
+  for (lIter = reader.begin(); lIter != reader.end(); ++lIter)
   {
-    ROS_INFO_STREAM("found Ambient Light v2 with UID:" << uid);
-    // Create Ambient Light device object
-    AmbientLightV2 *ambient_v2_light = new AmbientLightV2();
-    ambient_light_create(ambient_v2_light, uid, &(tfs->ipcon));
-    SensorDevice *ambient_light_v2_dev = new SensorDevice(ambient_v2_light, uid, topic, AMBIENT_LIGHT_V2_DEVICE_IDENTIFIER, SensorClass::LIGHT, 10);
-    tfs->sensors.push_back(ambient_light_v2_dev);
+    if (!(*lIter)->getStampFilter().isEnabled())
+      continue;
+
+    const TimestampStats &stats = (*lIter)->getStampFilter().getStats();
+    ROS_INFO_STREAM((*lIter)->getTopic() << " stamp residual mean:" << stats.mean * 1000.0
+      << "ms stddev:" << stats.stddev * 1000.0 << "ms max:" << stats.max_abs * 1000.0
+      << "ms drift:" << stats.drift_ppm << "ppm resyncs:" << stats.resyncs);
   }
-  else if (device_identifier == DISTANCE_IR_DEVICE_IDENTIFIER)
+}
+
+/*----------------------------------------------------------------------
+ * setStatsPub()
+ * Set the publishers for diagnostics and the compact stats topic
+ *--------------------------------------------------------------------*/
+
+void TinkerforgeSensors::setStatsPub(ros::Publisher diag_pub, ros::Publisher stats_pub)
+{
+  this->diag_pub = diag_pub;
+  this->stats_pub = stats_pub;
+}
+
+static diagnostic_msgs::KeyValue makeKeyValue(const std::string &key, double value)
+{
+  diagnostic_msgs::KeyValue kv;
+  std::stringstream stream;
+
+  stream << value;
+  kv.key = key;
+  kv.value = stream.str();
+  return kv;
+}
+
+/*----------------------------------------------------------------------
+ * publishStats()
+ * Publish diagnostics and statistics of all devices
+ *--------------------------------------------------------------------*/
+
+void TinkerforgeSensors::publishStats()
+{
+  diagnostic_msgs::DiagnosticArray diag_msg;
+  tinkerforge_sensors::DeviceStatsArray stats_msg;
+  FunctionStats fstats[IPCON_STATS_MAX_FUNCTIONS];
+  ros::Time now = ros::Time::now();
+  double elapsed = stats_time.isZero() ? 0.0 : (now - stats_time).toSec();
+  std::set<void*> devices;
+
+  diag_msg.header.stamp = now;
+  stats_msg.header.stamp = now;
+  stats_msg.callback_queue_length = ipcon_get_callback_queue_length(&ipcon);
+  ipcon_get_packet_pool_stats(&ipcon, &stats_msg.packet_pool_available, &stats_msg.packet_pool_misses);
+  stats_msg.allocations = AllocationCounter::getCount();
+  stats_msg.publish_dropped = publish_pipeline.getDropped();
+
+  SensorRegistry::Reader reader(sensors);
+
+  SensorRegistry::iterator lIter;
+  for (lIter = reader.begin(); lIter != reader.end(); ++lIter)
   {
-    ROS_INFO_STREAM("found Distance IR with UID:" << uid);
-    // Create Distance IR device object
-    DistanceIR *distance_ir = new DistanceIR();
-    distance_ir_create(distance_ir, uid, &(tfs->ipcon));
-    SensorDevice *distance_ir_dev = new SensorDevice(distance_ir, uid, topic, DISTANCE_IR_DEVICE_IDENTIFIER, SensorClass::RANGE, 10);
-    tfs->sensors.push_back(distance_ir_dev);
+    SensorDevice *sensor = *lIter;
+
+    // the imu v2 shares its device with the magnetic field sensor
+    if (!devices.insert(sensor->getDev()).second)
+      continue;
+
+    tinkerforge_sensors::DeviceStats dev_stats;
+    diagnostic_msgs::DiagnosticStatus status;
+    uint64_t latency_sum = 0;
+    uint64_t latency_count = 0;
+    uint32_t latency_max = 0;
+
+    dev_stats.uid = sensor->getUID();
+    dev_stats.topic = sensor->getTopic();
+    dev_stats.requests = 0;
+    dev_stats.timeouts = 0;
+    dev_stats.errors = 0;
+    dev_stats.callbacks = 0;
+    device_get_queue_stats((Device*)sensor->getDev(), &dev_stats.callbacks_queued, &dev_stats.callbacks_dropped);
+    dev_stats.latency_histogram.assign(IPCON_STATS_NUM_BUCKETS, 0);
+
+    status.name = std::string("tinkerforge_sensors: ") + sensor->getTopic();
+    status.hardware_id = sensor->getUID();
+
+    int count = device_get_stats((Device*)sensor->getDev(), fstats, IPCON_STATS_MAX_FUNCTIONS);
+    for (int i = 0; i < count; i++)
+    {
+      uint64_t function_count = 0;
+      for (int b = 0; b < IPCON_STATS_NUM_BUCKETS; b++)
+      {
+        dev_stats.latency_histogram[b] += fstats[i].latency_buckets[b];
+        function_count += fstats[i].latency_buckets[b];
+      }
+      dev_stats.requests += fstats[i].requests;
+      dev_stats.timeouts += fstats[i].timeouts;
+      dev_stats.errors += fstats[i].errors;
+      dev_stats.callbacks += fstats[i].callbacks;
+      latency_sum += fstats[i].latency_sum;
+      latency_count += function_count;
+      if (fstats[i].latency_max > latency_max)
+        latency_max = fstats[i].latency_max;
+
+      std::stringstream stream;
+      stream << "requests:" << fstats[i].requests << " timeouts:" << fstats[i].timeouts
+        << " errors:" << fstats[i].errors << " callbacks:" << fstats[i].callbacks
+        << " latency_mean:" << (function_count > 0 ? fstats[i].latency_sum / function_count : 0) << "us"
+        << " latency_max:" << fstats[i].latency_max << "us";
+      std::stringstream key;
+      key << "function " << (int)fstats[i].function_id;
+      diagnostic_msgs::KeyValue kv;
+      kv.key = key.str();
+      kv.value = stream.str();
+      status.values.push_back(kv);
+    }
+
+    dev_stats.latency_mean = (latency_count > 0) ? (latency_sum / (double)latency_count) / 1e6 : 0.0;
+    dev_stats.latency_max = latency_max / 1e6;
+
+    // upper bound of the bucket holding the 99th percentile
+    dev_stats.latency_p99 = 0.0;
+    uint64_t cumulated = 0;
+    for (int b = 0; b < IPCON_STATS_NUM_BUCKETS && latency_count > 0; b++)
+    {
+      cumulated += dev_stats.latency_histogram[b];
+      if (cumulated * 100 >= latency_count * 99)
+      {
+        dev_stats.latency_p99 = ((uint64_t)IPCON_STATS_BUCKET_BASE << b) / 1e6;
+        break;
+      }
+    }
+
+    // rates and new timeouts since the last stats period
+    uint32_t new_timeouts = dev_stats.timeouts;
+    dev_stats.request_rate = 0.0;
+    dev_stats.callback_rate = 0.0;
+    std::map<std::string, tinkerforge_sensors::DeviceStats>::iterator it = stats_last.find(dev_stats.uid);
+    if (it != stats_last.end())
+    {
+      new_timeouts = dev_stats.timeouts - it->second.timeouts;
+      if (elapsed > 0.0)
+      {
+        dev_stats.request_rate = (dev_stats.requests - it->second.requests) / elapsed;
+        dev_stats.callback_rate = (dev_stats.callbacks - it->second.callbacks) / elapsed;
+      }
+    }
+    stats_last[dev_stats.uid] = dev_stats;
+
+    if (new_timeouts > 0)
+    {
+      status.level = diagnostic_msgs::DiagnosticStatus::WARN;
+      status.message = "timeouts";
+    }
+    else
+    {
+      status.level = diagnostic_msgs::DiagnosticStatus::OK;
+      status.message = "ok";
+    }
+
+    status.values.push_back(makeKeyValue("request_rate", dev_stats.request_rate));
+    status.values.push_back(makeKeyValue("callback_rate", dev_stats.callback_rate));
+    status.values.push_back(makeKeyValue("latency_mean", dev_stats.latency_mean));
+    status.values.push_back(makeKeyValue("latency_max", dev_stats.latency_max));
+    status.values.push_back(makeKeyValue("latency_p99", dev_stats.latency_p99));
+    status.values.push_back(makeKeyValue("callbacks_queued", dev_stats.callbacks_queued));
+    status.values.push_back(makeKeyValue("callbacks_dropped", dev_stats.callbacks_dropped));
+
+    if (sensor->getStampFilter().isEnabled())
+    {
+      const TimestampStats &stamp = sensor->getStampFilter().getStats();
+      status.values.push_back(makeKeyValue("stamp_residual_mean", stamp.mean));
+      status.values.push_back(makeKeyValue("stamp_residual_stddev", stamp.stddev));
+      status.values.push_back(makeKeyValue("stamp_residual_max", stamp.max_abs));
+      status.values.push_back(makeKeyValue("stamp_drift_ppm", stamp.drift_ppm));
+    }
+
+    diag_msg.status.push_back(status);
+    stats_msg.devices.push_back(dev_stats);
   }
-  else if (device_identifier == DISTANCE_US_DEVICE_IDENTIFIER)
+
+  // overload of the publish pipeline, the loop outran the subscribers
+  if (publish_pipeline.isRunning())
   {
-    ROS_INFO_STREAM("found Distance US with UID:" << uid);
-    // Create Distance US  device object
-    DistanceUS *distance_us = new DistanceUS();
-    distance_us_create(distance_us, uid, &(tfs->ipcon));
-    SensorDevice *distance_us_dev = new SensorDevice(distance_us, uid, topic, DISTANCE_US_DEVICE_IDENTIFIER, SensorClass::RANGE, 10);
-    tfs->sensors.push_back(distance_us_dev);
+    diagnostic_msgs::DiagnosticStatus status;
+    status.name = "tinkerforge_sensors: publish pipeline";
+    if (stats_msg.publish_dropped != publish_dropped_last)
+    {
+      status.level = diagnostic_msgs::DiagnosticStatus::WARN;
+      status.message = "dropped messages";
+    }
+    else
+    {
+      status.level = diagnostic_msgs::DiagnosticStatus::OK;
+      status.message = "ok";
+    }
+    status.values.push_back(makeKeyValue("dropped", stats_msg.publish_dropped));
+    diag_msg.status.push_back(status);
   }
-  else if (device_identifier == MOTION_DETECTOR_DEVICE_IDENTIFIER)
+  publish_dropped_last = stats_msg.publish_dropped;
+
+  stats_time = now;
+  diag_pub.publish(diag_msg);
+  stats_pub.publish(stats_msg);
+}
+
+/*----------------------------------------------------------------------
+ * callbackConnected()
+ * Callback function for Tinkerforge ip connected
+ *--------------------------------------------------------------------*/
+
+void TinkerforgeSensors::callbackConnected(uint8_t connect_reason, void *user_data)
+{
+  TinkerforgeSensors *tfs = (TinkerforgeSensors*) user_data;
+  //if (tfs->is_imu_connected == false)
+    ipcon_enumerate(&(tfs->ipcon));
+  return;
+}
+
+/*----------------------------------------------------------------------
+ * callbackEnumerate()
+ * Callback function for Tinkerforge enumerate
+ *--------------------------------------------------------------------*/
+
+void TinkerforgeSensors::callbackEnumerate(const char *uid, const char *connected_uid,
+                  char position, uint8_t hardware_version[3],
+                  uint8_t firmware_version[3], uint16_t device_identifier,
+                  uint8_t enumeration_type, void *user_data)
+{
+  TinkerforgeSensors *tfs = (TinkerforgeSensors*) user_data;
+  std::map<std::string, std::map<std::string, SensorParam>>::iterator it;
+  std::map<std::string, SensorParam>::iterator it_sp;
+  std::string topic("");
+
+  if(enumeration_type == IPCON_ENUMERATION_TYPE_DISCONNECTED)
   {
-    ROS_INFO_STREAM("found Motion Detector with UID:" << uid);
-    // Create Motion Detector  device object
-    MotionDetector * md = new MotionDetector();
-    motion_detector_create(md, uid, &(tfs->ipcon));
-    SensorDevice *md_dev = new SensorDevice(md, uid, topic, MOTION_DETECTOR_DEVICE_IDENTIFIER, SensorClass::MISC, 10);
-    tfs->sensors.push_back(md_dev);
+    return;
   }
-  else if (device_identifier == MASTER_DEVICE_IDENTIFIER)
+
+  // check if uid is in conf
+  it = tfs->conf.find((std::string)uid);
+  if (it != tfs->conf.end())
   {
-    ROS_INFO_STREAM("found Master brick with UID:" << uid);
+    // check if topic is set
+    it_sp = it->second.find("topic");
+    if (it_sp != it->second.end())
+      topic = (std::string)it_sp->second.value_str;
   }
-  else
+
+  const DeviceEntry *entry = findDeviceEntry(device_identifier);
+  if (entry == NULL)
   {
     ROS_WARN_STREAM("unkown sensor with UID:" << uid);
+    return;
   }
 
-  //if new sensor add params
-  if (sensor_count < tfs->sensors.size())
+  // enumerated again after a reconnect, a restarted device lost its setup
+  SensorDevice *known = tfs->sensors.find(uid, entry->identifier);
+  if (known != NULL)
   {
-    //ROS_INFO_STREAM("Add Params");
-    if (it != tfs->conf.end())
+    if (enumeration_type == IPCON_ENUMERATION_TYPE_CONNECTED && entry->setup != NULL)
     {
-      auto sit = tfs->sensors.rbegin();
-      for(unsigned int i = sensor_count; i < tfs->sensors.size(); i++)
-      {
-        (*sit)->setParams(it->second);
-        sit++;
-      }
-	  //tfs->sensors.back()->setParams(it->second);
+      ROS_INFO_STREAM("set up " << entry->label << " with UID:" << uid << " again");
+      std::lock_guard<std::mutex> lock(known->getMutex());
+      entry->setup(tfs, known);
     }
+    return;
+  }
+
+  ROS_INFO_STREAM("found " << entry->label << " with UID:" << uid);
+  if (entry->create == NULL)
+    return;
+
+  std::vector<SensorDevice*> added;
+
+  // Create the device object
+  void *dev = entry->create(uid, &(tfs->ipcon));
+  SensorDevice *sensor = new SensorDevice(dev, uid, topic, entry->identifier, entry->sensor_class);
+  sensor->setEntry(entry);
+
+  added.push_back(sensor);
+
+  // second sensor on the same device object
+  const DeviceEntry *companion = findDeviceEntry(entry->companion);
+  if (companion != NULL)
+  {
+    sensor = new SensorDevice(dev, uid, std::string(""), companion->identifier, companion->sensor_class);
+    sensor->setEntry(companion);
+    added.push_back(sensor);
   }
+
+  // add params before the setup, it configures the device from them
+  for (size_t i = 0; i < added.size(); i++)
+  {
+    if (it != tfs->conf.end())
+      added[i]->setParams(it->second);
+    added[i]->initStampFilter(tfs->stamp_period, tfs->stamp_gain);
+    added[i]->initCovariance(tfs->covariance_window);
+  }
+
+  // dispatch its callbacks in the lane of its device type
+  std::map<std::string, int>::const_iterator lane = tfs->callback_lanes.find(entry->name);
+  if (lane != tfs->callback_lanes.end())
+    device_set_callback_lane((Device*)dev, lane->second);
+
+  // the policy stays with the device object across reconnects
+  const QueueConfig &queue = added[0]->getConfig().queue;
+  if (queue.policy != IPCON_QUEUE_POLICY_KEEP_ALL &&
+      device_set_queue_policy((Device*)dev, 0, queue.policy, queue.depth) != E_OK)
+    ROS_WARN_STREAM("Could not set the queue policy for " << uid);
+
+  if (entry->setup != NULL)
+    entry->setup(tfs, added[0]);
+
+  // the registry takes the publish rate from the config
+  for (size_t i = 0; i < added.size(); i++)
+    tfs->sensors.add(added[i]);
 }
@@ -1,8 +1,13 @@
 #include <iostream>
 #include <vector>
+#include <algorithm>
 #include <signal.h>
+#include <errno.h>
+#include <string.h>
+#include <sys/mman.h>
 #include "sensor_device.h"
 #include <ros/ros.h>
+#include <ros/callback_queue.h>
 #include <sensor_msgs/NavSatFix.h>
 #include <sensor_msgs/MagneticField.h>
 #include <sensor_msgs/Imu.h>
@@ -11,7 +16,10 @@
 #include <sensor_msgs/Illuminance.h>
 #include <sensor_msgs/Range.h>
 #include <sensor_msgs/RelativeHumidity.h>
+#include <diagnostic_msgs/DiagnosticArray.h>
+#include <tinkerforge_sensors/DeviceStatsArray.h>
 #include "tinkerforge_sensors_core.h"
+#include "allocation_counter.h"
 
 using std::string;
 
@@ -30,6 +38,35 @@ int main (int argc, char **argv)
   int imu_convergence_speed;
   int port;
   string host;
+  bool dejitter;
+  double dejitter_gain;
+  double stats_period;
+  string capture_file;
+  string replay_file;
+  double replay_speed;
+  string shm_name;
+  int shm_ring_size;
+  double readings_ttl;
+  int imu_batch_size;
+  std::string virtual_imu_topic;
+  std::string virtual_imu_frame;
+  double virtual_imu_skew;
+  std::string range_cloud_topic;
+  std::string range_scan_topic;
+  std::string range_frame;
+  double range_scan_resolution;
+  int imu_fusion_period;
+  int publish_queue;
+  double imu_fusion_beta;
+  int covariance_window;
+  int ros_callback_lane;
+  int ros_callback_threads;
+  bool realtime;
+  int realtime_pool_size;
+  int receive_priority;
+  int receive_cpu;
+  int publish_priority;
+  int publish_cpu;
 
   signal(SIGINT, sigintHandler);
 
@@ -38,6 +75,44 @@ int main (int argc, char **argv)
   private_node_handle_.param("rate", rate, int(10));
   private_node_handle_.param("host", host, string("localhost"));
   private_node_handle_.param("port", port, int(4223));
+  private_node_handle_.param("dejitter", dejitter, false);
+  private_node_handle_.param("dejitter_gain", dejitter_gain, double(0.05));
+  private_node_handle_.param("stats_period", stats_period, double(0.0));
+  private_node_handle_.param("capture_file", capture_file, string(""));
+  private_node_handle_.param("replay_file", replay_file, string(""));
+  private_node_handle_.param("replay_speed", replay_speed, double(1.0));
+  private_node_handle_.param("shm_name", shm_name, string(""));
+  private_node_handle_.param("shm_ring_size", shm_ring_size, int(256));
+  private_node_handle_.param("readings_ttl", readings_ttl, double(1.0));
+  private_node_handle_.param("imu_batch_size", imu_batch_size, int(0));
+  private_node_handle_.param("virtual_imu_topic", virtual_imu_topic, string(""));
+  private_node_handle_.param("virtual_imu_frame", virtual_imu_frame, string("base_link"));
+  private_node_handle_.param("virtual_imu_skew", virtual_imu_skew, double(0.02));
+  private_node_handle_.param("range_cloud_topic", range_cloud_topic, string(""));
+  private_node_handle_.param("range_scan_topic", range_scan_topic, string(""));
+  private_node_handle_.param("range_frame", range_frame, string("base_link"));
+  private_node_handle_.param("range_scan_resolution", range_scan_resolution, double(M_PI / 180.0));
+  private_node_handle_.param("imu_fusion_period", imu_fusion_period, int(0));
+  private_node_handle_.param("imu_fusion_beta", imu_fusion_beta, double(0.1));
+  private_node_handle_.param("covariance_window", covariance_window, int(0));
+  private_node_handle_.param("publish_queue", publish_queue, int(0));
+  private_node_handle_.param("ros_callback_lane", ros_callback_lane, int(0));
+  private_node_handle_.param("ros_callback_threads", ros_callback_threads, int(1));
+  private_node_handle_.param("realtime", realtime, false);
+  private_node_handle_.param("realtime_pool_size", realtime_pool_size, int(1024));
+  private_node_handle_.param("receive_priority", receive_priority, int(0));
+  private_node_handle_.param("receive_cpu", receive_cpu, int(-1));
+  private_node_handle_.param("publish_priority", publish_priority, int(0));
+  private_node_handle_.param("publish_cpu", publish_cpu, int(-1));
+
+  // keep all pages of the process in memory, so the sample path never waits for a page fault
+  if (realtime)
+  {
+    if (mlockall(MCL_CURRENT | MCL_FUTURE) != 0)
+      ROS_WARN_STREAM("Could not lock the memory of the node: " << strerror(errno));
+    else
+      ROS_INFO_STREAM("Real-time mode, memory locked");
+  }
 
   // create a new LaserTransformer object.
   TinkerforgeSensors *node_tfs = new TinkerforgeSensors(host, port);
@@ -70,6 +145,11 @@ int main (int argc, char **argv)
             param.type = ParamType::INT;
             param.value_int = static_cast<int>(l2[it2->first]);
             node_tfs->conf[(std::string)(it->first)][(std::string)it2->first] = param;
+          }
+		  else if (it2->second.getType() == XmlRpc::XmlRpcValue::TypeBoolean) {
+            param.type = ParamType::BOOL;
+            param.value_int = static_cast<bool>(l2[it2->first]) ? 1 : 0;
+            node_tfs->conf[(std::string)(it->first)][(std::string)it2->first] = param;
           }
 		  else if (it2->second.getType() == XmlRpc::XmlRpcValue::TypeDouble) {
             //ROS_DEBUG_STREAM("  Value:"  << (std::string)it2->first << "::" << static_cast<double>(l2[it2->first]) << "::" << it2->second.getType() );
@@ -85,6 +165,67 @@ int main (int argc, char **argv)
     }
   }
 
+  // dispatch the callbacks of the device types in their own lanes
+  XmlRpc::XmlRpcValue lanes_param;
+  std::map<std::string, int> callback_lanes;
+  std::vector<int> lane_priority;
+  std::vector<int> lane_cpu;
+  if (private_node_handle_.getParam("callback_lanes", lanes_param) &&
+      lanes_param.getType() == XmlRpc::XmlRpcValue::TypeStruct)
+  {
+    for (XmlRpc::XmlRpcValue::ValueStruct::const_iterator it = lanes_param.begin(); it != lanes_param.end(); ++it)
+    {
+      if (it->second.getType() == XmlRpc::XmlRpcValue::TypeInt)
+        callback_lanes[it->first] = static_cast<int>(lanes_param[it->first]);
+      else
+        ROS_WARN_STREAM("Could not read callback lane of " << it->first);
+    }
+  }
+  private_node_handle_.param("callback_lane_priority", lane_priority, std::vector<int>());
+  private_node_handle_.param("callback_lane_cpu", lane_cpu, std::vector<int>());
+  node_tfs->setCallbackLanes(callback_lanes, lane_priority, lane_cpu);
+
+  // run the callbacks of one lane on ROS spinner threads instead of a lane thread
+  ros::CallbackQueue sensor_callback_queue;
+  ros::AsyncSpinner sensor_spinner(ros_callback_threads > 0 ? ros_callback_threads : 1, &sensor_callback_queue);
+  if (ros_callback_lane > 0)
+  {
+    node_tfs->setRosCallbackLane(ros_callback_lane, &sensor_callback_queue);
+    sensor_spinner.start();
+  }
+
+  // preallocate the callback packets and pin the threads of the sample path
+  if (realtime)
+    node_tfs->setPacketPool(realtime_pool_size);
+  node_tfs->setReceiveScheduling(receive_priority, receive_cpu);
+  node_tfs->setPublishScheduling(publish_priority, publish_cpu);
+
+  // smooth the header stamps of the periodic samples
+  if (dejitter)
+    node_tfs->setStampFilter(1.0 / rate, dejitter_gain);
+
+  // estimate the variance fields from the recent samples
+  node_tfs->setCovarianceWindow(covariance_window);
+
+  // fuse the IMU v1 orientation on the host
+  node_tfs->setImuFusion(imu_fusion_period, imu_fusion_beta);
+
+  // collect request and callback statistics
+  if (stats_period > 0.0)
+  {
+    node_tfs->setStatsEnabled(true);
+    node_tfs->setStatsPub(n.advertise<diagnostic_msgs::DiagnosticArray>("/diagnostics", 10),
+      n.advertise<tinkerforge_sensors::DeviceStatsArray>("/tfsensors/stats", 10));
+  }
+
+  // capture the raw packets for offline analysis
+  if (!capture_file.empty())
+    node_tfs->setCaptureFile(capture_file);
+
+  // replay a capture instead of the hardware
+  if (!replay_file.empty())
+    node_tfs->setReplay(replay_file, replay_speed);
+
   // init tinkerforge connection
   if (!node_tfs->init())
   {
@@ -97,58 +238,66 @@ int main (int argc, char **argv)
   // sleep a second for init sensors
   ros::Duration(1.0).sleep();
 
+  // publish from a second thread, so slow subscribers do not delay the reads
+  node_tfs->setPublishQueue(publish_queue);
+
   // create publishers
-  std::list<SensorDevice*>::iterator Iter;
-  for (Iter = node_tfs->sensors.begin(); Iter != node_tfs->sensors.end(); ++Iter)
-  {
-    ROS_DEBUG_STREAM("node" << "::" << (*Iter)->getUID() << "::" << (*Iter)->getTopic());
-    //std::cout << "node::" << "::" << (*Iter)->getUID() << "::" << (*Iter)->getTopic() << std::endl;
+  node_tfs->setImuBatchSize(imu_batch_size);
+  if (!virtual_imu_topic.empty())
+    node_tfs->setVirtualImu(virtual_imu_topic, virtual_imu_frame, virtual_imu_skew);
+  if (!range_cloud_topic.empty() || !range_scan_topic.empty())
+    node_tfs->setRangeAggregate(range_cloud_topic, range_scan_topic, range_frame, range_scan_resolution);
+  node_tfs->advertiseSensors(n);
 
-    switch((*Iter)->getType())
-    {
-      case AMBIENT_LIGHT_DEVICE_IDENTIFIER:
-        (*Iter)->setPub(n.advertise<sensor_msgs::Illuminance>((*Iter)->getTopic().c_str(), 50));
-      break;
-      case AMBIENT_LIGHT_V2_DEVICE_IDENTIFIER:
-        (*Iter)->setPub(n.advertise<sensor_msgs::Illuminance>((*Iter)->getTopic().c_str(), 50));
-      case DISTANCE_IR_DEVICE_IDENTIFIER:
-        (*Iter)->setPub(n.advertise<sensor_msgs::Range>((*Iter)->getTopic().c_str(), 50));
-      break;
-      case DISTANCE_US_DEVICE_IDENTIFIER:
-        (*Iter)->setPub(n.advertise<sensor_msgs::Range>((*Iter)->getTopic().c_str(), 50));
-      break;
-      case GPS_DEVICE_IDENTIFIER:
-        (*Iter)->setPub(n.advertise<sensor_msgs::NavSatFix>((*Iter)->getTopic().c_str(), 50));
-      break;
-      case HUMIDITY_DEVICE_IDENTIFIER:
-        (*Iter)->setPub(n.advertise<sensor_msgs::RelativeHumidity>((*Iter)->getTopic().c_str(), 50));
-      break;
-      case IMU_DEVICE_IDENTIFIER:
-        (*Iter)->setPub(n.advertise<sensor_msgs::Imu>((*Iter)->getTopic().c_str(), 50));
-      break;
-      case IMU_V2_DEVICE_IDENTIFIER:
-        (*Iter)->setPub(n.advertise<sensor_msgs::Imu>((*Iter)->getTopic().c_str(), 50));
-      break;
-      case TEMPERATURE_DEVICE_IDENTIFIER:
-        (*Iter)->setPub(n.advertise<sensor_msgs::Temperature>((*Iter)->getTopic().c_str(), 50));
-      break;
-      case TEMPERATURE_IR_DEVICE_IDENTIFIER:
-        (*Iter)->setPub(n.advertise<sensor_msgs::Temperature>((*Iter)->getTopic().c_str(), 50));
-      break;
-      case IMU_V2_MAGNETIC_DEVICE_IDENTIFIER:
-        (*Iter)->setPub(n.advertise<sensor_msgs::MagneticField>((*Iter)->getTopic().c_str(), 50));
-      break;
-    }
-  }
+  // mirror the samples to shared memory for consumers outside ROS
+  if (!shm_name.empty())
+    node_tfs->startShmExport(shm_name, shm_ring_size);
+
+  // serve the readings service from its own threads, so a request does
+  // not wait for the publish loop
+  ros::CallbackQueue service_queue;
+  ros::NodeHandle service_node;
+  service_node.setCallbackQueue(&service_queue);
+  node_tfs->advertiseServices(service_node, readings_ttl);
+  ros::AsyncSpinner service_spinner(2, &service_queue);
+  service_spinner.start();
 
+  ros::Time stamp_stats_time = ros::Time::now();
+  ros::Time stats_time = ros::Time::now();
+  int allocation_cycles = realtime ? std::max(publish_queue, 0) + 1 : -1;
   while (n.ok())
   {
     node_tfs->publishSensors();
+    // every slot of the publish rings was filled once by now, the sample
+    // path should not allocate from here on
+    if (allocation_cycles >= 0 && allocation_cycles-- == 0)
+    {
+      if (!AllocationCounter::start())
+        ROS_WARN_STREAM("Could not count the heap allocations, needs glibc");
+    }
+    node_tfs->checkAllocations();
+    if (dejitter && (ros::Time::now() - stamp_stats_time).toSec() >= 30.0)
+    {
+      node_tfs->logStampStats();
+      stamp_stats_time = ros::Time::now();
+    }
+    if (stats_period > 0.0 && (ros::Time::now() - stats_time).toSec() >= stats_period)
+    {
+      node_tfs->publishStats();
+      stats_time = ros::Time::now();
+    }
+    if (node_tfs->isReplayDone())
+    {
+      ROS_INFO_STREAM("Replay finished");
+      break;
+    }
     ros::spinOnce();
     r.sleep();
   }
 
   ROS_INFO_STREAM("Shutdown node ...!");
+  service_spinner.stop();
+  sensor_spinner.stop();
 
   // clean up
   if (node_tfs != NULL)
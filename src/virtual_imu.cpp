@@ -0,0 +1,246 @@
+#include <cmath>
+#include "virtual_imu.h"
+
+/*----------------------------------------------------------------------
+ * multiply()
+ * Hamilton product of two quaternions given as w x y z
+ *--------------------------------------------------------------------*/
+
+static void multiply(const double *a, const double *b, double *r)
+{
+  r[0] = a[0] * b[0] - a[1] * b[1] - a[2] * b[2] - a[3] * b[3];
+  r[1] = a[0] * b[1] + a[1] * b[0] + a[2] * b[3] - a[3] * b[2];
+  r[2] = a[0] * b[2] - a[1] * b[3] + a[2] * b[0] + a[3] * b[1];
+  r[3] = a[0] * b[3] + a[1] * b[2] - a[2] * b[1] + a[3] * b[0];
+}
+
+/*----------------------------------------------------------------------
+ * rotateVector()
+ * r = m * v for a row major 3x3 matrix
+ *--------------------------------------------------------------------*/
+
+static void rotateVector(const double *m, const geometry_msgs::Vector3 &v, double *r)
+{
+  for (int i = 0; i < 3; i++)
+    r[i] = m[i * 3] * v.x + m[i * 3 + 1] * v.y + m[i * 3 + 2] * v.z;
+}
+
+/*----------------------------------------------------------------------
+ * rotateCovariance()
+ * Add m * c * m^T to sum, returns false if c is unknown (all zero)
+ *--------------------------------------------------------------------*/
+
+static bool rotateCovariance(const double *m, const boost::array<double, 9> &c, double *sum)
+{
+  double mc[9];
+  bool known = false;
+
+  for (int i = 0; i < 9; i++)
+    known = known || (c[i] != 0.0);
+  if (!known)
+    return false;
+
+  for (int i = 0; i < 3; i++)
+    for (int j = 0; j < 3; j++)
+      mc[i * 3 + j] = m[i * 3] * c[j] + m[i * 3 + 1] * c[3 + j] + m[i * 3 + 2] * c[6 + j];
+  for (int i = 0; i < 3; i++)
+    for (int j = 0; j < 3; j++)
+      sum[i * 3 + j] += mc[i * 3] * m[j * 3] + mc[i * 3 + 1] * m[j * 3 + 1] + mc[i * 3 + 2] * m[j * 3 + 2];
+  return true;
+}
+
+/*----------------------------------------------------------------------
+ * VirtualImu()
+ * Constructor
+ *--------------------------------------------------------------------*/
+
+VirtualImu::VirtualImu()
+{
+  max_skew = 0.0;
+  seq = 0;
+}
+
+/*----------------------------------------------------------------------
+ * init()
+ * Set frame and skew, remove the members
+ *--------------------------------------------------------------------*/
+
+void VirtualImu::init(const std::string &frame, double max_skew)
+{
+  this->frame = frame;
+  this->max_skew = max_skew;
+  seq = 0;
+  members.clear();
+}
+
+/*----------------------------------------------------------------------
+ * addMember()
+ * Add an IMU with its mount rotation
+ *--------------------------------------------------------------------*/
+
+void VirtualImu::addMember(const std::string &uid, double roll, double pitch, double yaw)
+{
+  Member member;
+  double cr = cos(roll / 2.0), sr = sin(roll / 2.0);
+  double cp = cos(pitch / 2.0), sp = sin(pitch / 2.0);
+  double cy = cos(yaw / 2.0), sy = sin(yaw / 2.0);
+
+  member.uid = uid;
+  member.valid = false;
+
+  // yaw, then pitch, then roll about the moving axes
+  double *q = member.mount;
+  q[0] = cr * cp * cy + sr * sp * sy;
+  q[1] = sr * cp * cy - cr * sp * sy;
+  q[2] = cr * sp * cy + sr * cp * sy;
+  q[3] = cr * cp * sy - sr * sp * cy;
+
+  double *m = member.rotation;
+  m[0] = 1.0 - 2.0 * (q[2] * q[2] + q[3] * q[3]);
+  m[1] = 2.0 * (q[1] * q[2] - q[0] * q[3]);
+  m[2] = 2.0 * (q[1] * q[3] + q[0] * q[2]);
+  m[3] = 2.0 * (q[1] * q[2] + q[0] * q[3]);
+  m[4] = 1.0 - 2.0 * (q[1] * q[1] + q[3] * q[3]);
+  m[5] = 2.0 * (q[2] * q[3] - q[0] * q[1]);
+  m[6] = 2.0 * (q[1] * q[3] - q[0] * q[2]);
+  m[7] = 2.0 * (q[2] * q[3] + q[0] * q[1]);
+  m[8] = 1.0 - 2.0 * (q[1] * q[1] + q[2] * q[2]);
+
+  members.push_back(member);
+}
+
+/*----------------------------------------------------------------------
+ * findMember()
+ * Index of a member by uid
+ *--------------------------------------------------------------------*/
+
+int VirtualImu::findMember(const std::string &uid) const
+{
+  for (size_t i = 0; i < members.size(); i++)
+  {
+    if (members[i].uid == uid)
+      return (int)i;
+  }
+  return -1;
+}
+
+/*----------------------------------------------------------------------
+ * add()
+ * Store a member sample, fuse when all members are aligned
+ *--------------------------------------------------------------------*/
+
+bool VirtualImu::add(const std::string &uid, const sensor_msgs::Imu &msg, sensor_msgs::Imu &fused)
+{
+  int index = findMember(uid);
+  if (index < 0)
+    return false;
+
+  members[index].sample = msg;
+  members[index].valid = true;
+
+  ros::Time newest = msg.header.stamp;
+  for (size_t i = 0; i < members.size(); i++)
+  {
+    if (members[i].valid && members[i].sample.header.stamp > newest)
+      newest = members[i].sample.header.stamp;
+  }
+
+  // a sample too far behind the newest one will never be matched
+  bool complete = true;
+  for (size_t i = 0; i < members.size(); i++)
+  {
+    if (members[i].valid && (newest - members[i].sample.header.stamp).toSec() > max_skew)
+      members[i].valid = false;
+    complete = complete && members[i].valid;
+  }
+  if (!complete)
+    return false;
+
+  fuse(fused);
+  for (size_t i = 0; i < members.size(); i++)
+    members[i].valid = false;
+  return true;
+}
+
+/*----------------------------------------------------------------------
+ * fuse()
+ * Average the member samples in the common frame
+ *--------------------------------------------------------------------*/
+
+void VirtualImu::fuse(sensor_msgs::Imu &fused)
+{
+  double n = members.size();
+  double angular[3] = {0.0, 0.0, 0.0};
+  double linear[3] = {0.0, 0.0, 0.0};
+  double orientation[4] = {0.0, 0.0, 0.0, 0.0};
+  double orientation_cov[9] = {0.0};
+  double angular_cov[9] = {0.0};
+  double linear_cov[9] = {0.0};
+  bool orientation_known = true, angular_known = true, linear_known = true;
+  double offset = 0.0;
+  const ros::Time first = members[0].sample.header.stamp;
+
+  for (size_t i = 0; i < members.size(); i++)
+  {
+    const Member &member = members[i];
+    const sensor_msgs::Imu &sample = member.sample;
+    double v[3];
+
+    offset += (sample.header.stamp - first).toSec();
+
+    rotateVector(member.rotation, sample.angular_velocity, v);
+    for (int k = 0; k < 3; k++)
+      angular[k] += v[k];
+    rotateVector(member.rotation, sample.linear_acceleration, v);
+    for (int k = 0; k < 3; k++)
+      linear[k] += v[k];
+
+    // orientation of the common frame, q_sensor * mount^-1
+    double q_sensor[4] = {sample.orientation.w, sample.orientation.x, sample.orientation.y, sample.orientation.z};
+    double mount_inv[4] = {member.mount[0], -member.mount[1], -member.mount[2], -member.mount[3]};
+    double q[4];
+    multiply(q_sensor, mount_inv, q);
+    // q and -q are the same orientation, average on one hemisphere
+    double dot = q[0] * orientation[0] + q[1] * orientation[1] + q[2] * orientation[2] + q[3] * orientation[3];
+    double sign = (dot < 0.0) ? -1.0 : 1.0;
+    for (int k = 0; k < 4; k++)
+      orientation[k] += sign * q[k];
+
+    // the orientation covariance is about the fixed axes and needs no rotation
+    bool known = false;
+    for (int k = 0; k < 9; k++)
+    {
+      orientation_cov[k] += sample.orientation_covariance[k];
+      known = known || (sample.orientation_covariance[k] != 0.0);
+    }
+    orientation_known = orientation_known && known;
+    angular_known = rotateCovariance(member.rotation, sample.angular_velocity_covariance, angular_cov) && angular_known;
+    linear_known = rotateCovariance(member.rotation, sample.linear_acceleration_covariance, linear_cov) && linear_known;
+  }
+
+  fused.header.seq = ++seq;
+  fused.header.stamp = first + ros::Duration(offset / n);
+  fused.header.frame_id = frame;
+
+  double norm = sqrt(orientation[0] * orientation[0] + orientation[1] * orientation[1] +
+    orientation[2] * orientation[2] + orientation[3] * orientation[3]);
+  fused.orientation.w = orientation[0] / norm;
+  fused.orientation.x = orientation[1] / norm;
+  fused.orientation.y = orientation[2] / norm;
+  fused.orientation.z = orientation[3] / norm;
+
+  fused.angular_velocity.x = angular[0] / n;
+  fused.angular_velocity.y = angular[1] / n;
+  fused.angular_velocity.z = angular[2] / n;
+  fused.linear_acceleration.x = linear[0] / n;
+  fused.linear_acceleration.y = linear[1] / n;
+  fused.linear_acceleration.z = linear[2] / n;
+
+  // covariance of the mean of n independent samples
+  for (int k = 0; k < 9; k++)
+  {
+    fused.orientation_covariance[k] = orientation_known ? orientation_cov[k] / (n * n) : 0.0;
+    fused.angular_velocity_covariance[k] = angular_known ? angular_cov[k] / (n * n) : 0.0;
+    fused.linear_acceleration_covariance[k] = linear_known ? linear_cov[k] / (n * n) : 0.0;
+  }
+}
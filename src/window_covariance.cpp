@@ -0,0 +1,175 @@
+#include <cmath>
+#include <cstring>
+#include "window_covariance.h"
+
+// full windows between two exact recomputes of the running sums
+#define WINDOW_COVARIANCE_RECOMPUTE 256
+
+/*----------------------------------------------------------------------
+ * WindowCovariance()
+ * Constructor
+ *--------------------------------------------------------------------*/
+
+WindowCovariance::WindowCovariance()
+{
+  window = 0;
+  dim = 1;
+  angular = false;
+  reset();
+}
+
+/*----------------------------------------------------------------------
+ * init()
+ * Set window and channels, allocate the window
+ *--------------------------------------------------------------------*/
+
+void WindowCovariance::init(unsigned int window, unsigned int dim, bool angular)
+{
+  if (dim == 0)
+    dim = 1;
+  if (dim > WINDOW_COVARIANCE_MAX_DIM)
+    dim = WINDOW_COVARIANCE_MAX_DIM;
+
+  this->window = window;
+  this->dim = dim;
+  this->angular = angular;
+  history.assign(window * dim, 0.0);
+  reset();
+}
+
+/*----------------------------------------------------------------------
+ * reset()
+ * Forget the samples
+ *--------------------------------------------------------------------*/
+
+void WindowCovariance::reset()
+{
+  head = 0;
+  count = 0;
+  recompute_countdown = window * WINDOW_COVARIANCE_RECOMPUTE;
+  memset(last, 0, sizeof(last));
+  memset(mean, 0, sizeof(mean));
+  memset(m2, 0, sizeof(m2));
+}
+
+/*----------------------------------------------------------------------
+ * add()
+ * Add a sample, remove the oldest if the window is full
+ *--------------------------------------------------------------------*/
+
+void WindowCovariance::add(const double *values)
+{
+  double x[WINDOW_COVARIANCE_MAX_DIM];
+  double delta[WINDOW_COVARIANCE_MAX_DIM];
+
+  if (!isEnabled())
+    return;
+
+  for (unsigned int i = 0; i < dim; i++)
+  {
+    x[i] = values[i];
+    // continue on the branch of the previous sample
+    if (angular && count > 0)
+      x[i] += 2.0 * M_PI * std::floor((last[i] - x[i]) / (2.0 * M_PI) + 0.5);
+    last[i] = x[i];
+  }
+
+  // reverse the update of the sample that leaves the window
+  if (count == window)
+  {
+    double old[WINDOW_COVARIANCE_MAX_DIM];
+    for (unsigned int i = 0; i < dim; i++)
+    {
+      old[i] = history[i * window + head];
+      delta[i] = old[i] - mean[i];
+      mean[i] -= delta[i] / (count - 1);
+    }
+    for (unsigned int i = 0; i < dim; i++)
+      for (unsigned int j = 0; j < dim; j++)
+        m2[i * dim + j] -= delta[i] * (old[j] - mean[j]);
+    count--;
+  }
+
+  for (unsigned int i = 0; i < dim; i++)
+    history[i * window + head] = x[i];
+  head = (head + 1) % window;
+
+  // Welford update for the new sample
+  count++;
+  for (unsigned int i = 0; i < dim; i++)
+  {
+    delta[i] = x[i] - mean[i];
+    mean[i] += delta[i] / count;
+  }
+  for (unsigned int i = 0; i < dim; i++)
+    for (unsigned int j = 0; j < dim; j++)
+      m2[i * dim + j] += delta[i] * (x[j] - mean[j]);
+
+  if (count == window && --recompute_countdown == 0)
+  {
+    recompute();
+    recompute_countdown = window * WINDOW_COVARIANCE_RECOMPUTE;
+  }
+}
+
+/*----------------------------------------------------------------------
+ * recompute()
+ * Exact mean and m2 of the window
+ *--------------------------------------------------------------------*/
+
+void WindowCovariance::recompute()
+{
+  for (unsigned int i = 0; i < dim; i++)
+  {
+    const double *ring = &history[i * window];
+    double sum = 0.0;
+    for (unsigned int k = 0; k < count; k++)
+      sum += ring[k];
+    mean[i] = sum / count;
+  }
+  for (unsigned int i = 0; i < dim; i++)
+  {
+    for (unsigned int j = 0; j < dim; j++)
+    {
+      const double *ring_i = &history[i * window];
+      const double *ring_j = &history[j * window];
+      double sum = 0.0;
+      for (unsigned int k = 0; k < count; k++)
+        sum += (ring_i[k] - mean[i]) * (ring_j[k] - mean[j]);
+      m2[i * dim + j] = sum;
+    }
+  }
+}
+
+/*----------------------------------------------------------------------
+ * getVariance()
+ * Sample variance of a channel
+ *--------------------------------------------------------------------*/
+
+double WindowCovariance::getVariance(unsigned int channel) const
+{
+  if (count < 2 || channel >= dim)
+    return 0.0;
+  double variance = m2[channel * dim + channel] / (count - 1);
+  // the removals may leave a tiny negative rest
+  return (variance > 0.0) ? variance : 0.0;
+}
+
+/*----------------------------------------------------------------------
+ * getCovariance()
+ * Sample covariance matrix
+ *--------------------------------------------------------------------*/
+
+void WindowCovariance::getCovariance(double *cov) const
+{
+  for (unsigned int i = 0; i < dim; i++)
+  {
+    for (unsigned int j = 0; j < dim; j++)
+    {
+      if (i == j)
+        cov[i * dim + j] = getVariance(i);
+      else
+        cov[i * dim + j] = (count < 2) ? 0.0 : m2[i * dim + j] / (count - 1);
+    }
+  }
+}
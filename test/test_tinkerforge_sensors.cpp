@@ -0,0 +1,80 @@
+#include <gtest/gtest.h>
+#include <map>
+#include <string>
+#include "sensor_device.h"
+
+//! Temperature sensor with the given per-UID publish rate, 0 for none
+static SensorDevice *createSensor(double rate)
+{
+  std::map<std::string, SensorParam> params;
+  SensorDevice *sensor = new SensorDevice(NULL, "abc", "/tfsensors/temperature_test",
+    TEMPERATURE_DEVICE_IDENTIFIER, SensorClass::TEMPERATURE);
+
+  if (rate > 0.0)
+  {
+    params["rate"].type = ParamType::DOUBLE;
+    params["rate"].value_double = rate;
+  }
+  sensor->setParams(params);
+  return sensor;
+}
+
+//! Feed count samples every period sec with a few ms of jitter
+static void feedSamples(SensorDevice *sensor, double period, int count)
+{
+  for (int i = 0; i < count; i++)
+  {
+    double jitter = ((i * 7) % 11 - 5) * 0.001;
+    sensor->getStamp(ros::Time(1000.0 + i * period + jitter));
+  }
+}
+
+TEST(StampFilter, usesNodePeriodWithoutRate)
+{
+  SensorDevice *sensor = createSensor(0.0);
+  sensor->initStampFilter(0.1, 0.05);
+
+  EXPECT_DOUBLE_EQ(0.1, sensor->getStampFilter().getStats().period);
+  delete sensor;
+}
+
+TEST(StampFilter, usesSlowerSensorRate)
+{
+  // node publishes at 10 Hz, the sensor at 2 Hz
+  SensorDevice *sensor = createSensor(2.0);
+  sensor->initStampFilter(0.1, 0.05);
+  EXPECT_DOUBLE_EQ(0.5, sensor->getStampFilter().getStats().period);
+
+  feedSamples(sensor, 0.5, 200);
+  const TimestampStats &stats = sensor->getStampFilter().getStats();
+  EXPECT_EQ(0u, stats.resyncs);
+  EXPECT_EQ(0u, stats.slips);
+  EXPECT_LT(stats.max_abs, 0.01);
+  EXPECT_NEAR(0.5, stats.period, 0.001);
+  delete sensor;
+}
+
+TEST(StampFilter, keepsNodePeriodForFasterSensorRate)
+{
+  // a sensor is never published faster than the node loop
+  SensorDevice *sensor = createSensor(50.0);
+  sensor->initStampFilter(0.1, 0.05);
+
+  EXPECT_DOUBLE_EQ(0.1, sensor->getStampFilter().getStats().period);
+  delete sensor;
+}
+
+TEST(StampFilter, staysOffWithSensorRate)
+{
+  SensorDevice *sensor = createSensor(2.0);
+  sensor->initStampFilter(0.0, 0.05);
+
+  EXPECT_FALSE(sensor->getStampFilter().isEnabled());
+  delete sensor;
+}
+
+int main(int argc, char **argv)
+{
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}